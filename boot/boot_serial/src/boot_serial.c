@@ -35,27 +35,24 @@
 #include <zephyr/drivers/flash.h>
 #include <zephyr/kernel.h>
 #include <zephyr/sys/crc.h>
-#include <zephyr/sys/base64.h>
 #include <hal/hal_flash.h>
 #elif __ESPRESSIF__
 #include <bootloader_utility.h>
 #include <esp_rom_sys.h>
 #include <esp_crc.h>
 #include <endian.h>
-#include <mbedtls/base64.h>
 #else
 #include <bsp/bsp.h>
 #include <hal/hal_system.h>
 #include <hal/hal_flash.h>
 #include <os/endian.h>
 #include <os/os_cputime.h>
-#include <crc/crc16.h>
-#include <base64/base64.h>
 #endif /* __ZEPHYR__ */
 
 #include <zcbor_decode.h>
 #include <zcbor_encode.h>
 #include "zcbor_bulk.h"
+#include "boot_serial_codec.h"
 
 #include <flash_map_backend/flash_map_backend.h>
 #include <os/os.h>
@@ -102,6 +99,10 @@ BOOT_LOG_MODULE_DECLARE(mcuboot);
 #define MCUBOOT_SERIAL_MAX_RECEIVE_SIZE 512
 #endif
 
+#if defined(MCUBOOT_SERIAL_WRITE_BEHIND_SIZE) && MCUBOOT_SERIAL_WRITE_BEHIND_SIZE > 0
+#define BOOT_SERIAL_WRITE_BEHIND
+#endif
+
 #ifdef MCUBOOT_SERIAL_IMG_GRP_IMAGE_STATE
 #define BOOT_SERIAL_IMAGE_STATE_SIZE_MAX 48
 #else
@@ -130,25 +131,33 @@ BOOT_LOG_MODULE_DECLARE(mcuboot);
 
 #define BOOT_SERIAL_FRAME_MTU   124 /* 127 - pkt start (2 bytes) and stop (1 byte) */
 
+#ifdef MCUBOOT_SERIAL_BINARY_FRAMING
+#ifdef MCUBOOT_SERIAL_RAW_PROTOCOL
+#error "MCUBOOT_SERIAL_BINARY_FRAMING is not supported with MCUBOOT_SERIAL_RAW_PROTOCOL"
+#endif
+
+#ifndef MCUBOOT_SERIAL_BIN_WINDOW
+#define MCUBOOT_SERIAL_BIN_WINDOW 1
+#endif
+
+/*
+ * Largest SMP packet in a binary frame: once its CRC32 is appended and it is
+ * COBS encoded (one code byte per 254 bytes, plus one), it must fit in in_buf
+ * with the start markers, the newline and the terminating NUL.
+ */
+#define BOOT_SERIAL_BIN_PKT_MAX (MCUBOOT_SERIAL_MAX_RECEIVE_SIZE - 8 - \
+                                 MCUBOOT_SERIAL_MAX_RECEIVE_SIZE / 254)
+#define BOOT_SERIAL_BIN_DELIM   '\n'
+#define BOOT_SERIAL_BIN_CRC_SZ  4
+#endif
+
 /* Number of estimated CBOR elements for responses */
 #define CBOR_ENTRIES_SLOT_INFO_IMAGE_MAP 4
 #define CBOR_ENTRIES_SLOT_INFO_SLOTS_MAP 3
 
 #ifdef __ZEPHYR__
-/* base64 lib encodes data to null-terminated string */
-#define BASE64_ENCODE_SIZE(in_size) ((((((in_size) - 1) / 3) * 4) + 4) + 1)
-
-#define CRC16_INITIAL_CRC       0       /* what to seed crc16 with */
-#define CRC_CITT_POLYMINAL 0x1021
-
 #define ntohs(x) sys_be16_to_cpu(x)
 #define htons(x) sys_cpu_to_be16(x)
-#elif __ESPRESSIF__
-#define BASE64_ENCODE_SIZE(in_size) ((((((in_size) - 1) / 3) * 4) + 4) + 1)
-#define CRC16_INITIAL_CRC       0       /* what to seed crc16 with */
-
-#define base64_decode mbedtls_base64_decode
-#define base64_encode mbedtls_base64_encode
 #endif
 
 #if (BOOT_IMAGE_NUMBER > 1)
@@ -160,15 +169,39 @@ BOOT_LOG_MODULE_DECLARE(mcuboot);
 #define SWAP_USING_OFFSET_SECTOR_UPDATE_BEGIN 1
 #define BOOT_DIRECT_UPLOAD_SECONDARY_SLOT_ID_REMAINDER 0
 
-static char in_buf[MCUBOOT_SERIAL_MAX_RECEIVE_SIZE + 1];
 #ifndef MCUBOOT_SERIAL_RAW_PROTOCOL
-static char dec_buf[MCUBOOT_SERIAL_MAX_RECEIVE_SIZE + 1];
+/*
+ * Console packets are decoded in place in in_buf, in front of the line being
+ * read, which has room for a whole packet plus a line.
+ */
+#define BOOT_SERIAL_IN_LINE_MAX (BOOT_SERIAL_FRAME_MTU + 4)
+#else
+#define BOOT_SERIAL_IN_LINE_MAX 0
 #endif
+
+static char in_buf[MCUBOOT_SERIAL_MAX_RECEIVE_SIZE + 1 + BOOT_SERIAL_IN_LINE_MAX];
 const struct boot_uart_funcs *boot_uf;
 static struct nmgr_hdr *bs_hdr;
 static bool bs_entry;
 
+#ifndef MCUBOOT_SERIAL_RAW_PROTOCOL
+/*
+ * Console frames are assembled around the response, which is encoded at
+ * bs_obuf: the length and the SMP header go in front of it and the CRC after
+ * it, and the whole frame is then base64 encoded over itself.
+ */
+#define BOOT_SERIAL_FRAME_HDR_SZ (sizeof(uint16_t) + sizeof(struct nmgr_hdr))
+#define BOOT_SERIAL_FRAME_MAX    (BOOT_SERIAL_FRAME_HDR_SZ + BOOT_SERIAL_OUT_MAX + \
+                                  sizeof(uint16_t))
+static char bs_frame[BOOT_SERIAL_BASE64_SIZE(BOOT_SERIAL_FRAME_MAX)];
+#define bs_obuf (&bs_frame[BOOT_SERIAL_FRAME_HDR_SZ])
+#else
 static char bs_obuf[BOOT_SERIAL_OUT_MAX];
+#endif
+#ifdef MCUBOOT_SERIAL_BINARY_FRAMING
+/* Whether the request being served came in a binary frame */
+static bool bs_bin_frame;
+#endif
 
 static void boot_serial_output(void);
 
@@ -194,7 +227,7 @@ static zcbor_state_t cbor_state[2 + CBOR_EXTRA_STATES];
 void reset_cbor_state(void)
 {
     zcbor_new_encode_state(cbor_state, ARRAY_SIZE(cbor_state), (uint8_t *)bs_obuf,
-                           sizeof(bs_obuf), 0);
+                           BOOT_SERIAL_OUT_MAX, 0);
 }
 
 /**
@@ -843,6 +876,62 @@ finish:
 }
 #endif
 
+/*
+ * State of an image upload in progress, held for the duration of the upload.
+ * There is one per image, so that several images can be uploaded at once.
+ */
+struct bs_upload_ctx {
+    size_t img_size;                /* Total image size */
+    uint32_t curr_off;              /* Expected current offset */
+    uint32_t img_num;
+    bool used;
+    uint32_t seq;                   /* Order in which the uploads were started */
+#ifdef MCUBOOT_ERASE_PROGRESSIVELY
+    off_t not_yet_erased;           /* Offset of next byte to erase; writes to flash
+                                     * are done in consecutive manner and erases are done
+                                     * to allow currently received chunk to be written;
+                                     * this state variable holds information where last
+                                     * erase has stopped to let us know whether erase
+                                     * is needed to be able to write current chunk.
+                                     */
+#ifdef BOOT_IMAGE_HAS_STATUS_FIELDS
+    struct flash_sector status_sector;
+#endif
+#ifdef MCUBOOT_SECTOR_INDEX
+    struct boot_sector_index sector_index;  /* Sector layout of the slot, built when
+                                             * the upload starts.
+                                             */
+#endif
+#endif /* MCUBOOT_ERASE_PROGRESSIVELY */
+#ifdef MCUBOOT_SWAP_USING_OFFSET
+    uint32_t start_off;
+#endif
+#ifdef BOOT_SERIAL_WRITE_BEHIND
+    bool wb;                        /* Whether the image data goes through its ring */
+    uint32_t written_off;           /* Offset up to which the image was programmed; the
+                                     * data from there to curr_off is in the ring.
+                                     */
+    int wb_rc;                      /* Error of programming the buffered data, reported
+                                     * to the next upload request.
+                                     */
+#endif
+#ifdef MCUBOOT_SERIAL_UPLOAD_RESUME
+    bool jrnl;                      /* Whether the progress is kept in the journal */
+    struct flash_sector jrnl_sector;
+    uint32_t jrnl_idx;              /* Index of the next progress record */
+    uint32_t jrnl_last;             /* Offset in the last progress record */
+    uint32_t jrnl_next;             /* Programmed offset from which to add a record */
+    uint32_t jrnl_step;
+#endif
+};
+
+#define BS_UPLOAD_CTX_NUM BOOT_IMAGE_NUMBER
+
+static struct bs_upload_ctx bs_upload_ctx[BS_UPLOAD_CTX_NUM];
+/* Upload which the chunks that do not give the image number belong to */
+static struct bs_upload_ctx *bs_upload_last = &bs_upload_ctx[0];
+static uint32_t bs_upload_seq;
+
 #ifdef MCUBOOT_ERASE_PROGRESSIVELY
 /** Erases range of flash, aligned to sector size
  *
@@ -853,15 +942,16 @@ finish:
  * The function is intended to be called iteratively with previously returned
  * offset as @p start.
  *
+ * @param   ctx upload the range is erased for;
  * @param   start starting offset, aligned to sector offset;
  * @param   end ending offset, maybe anywhere within sector;
  *
  * @retval On success: offset of the first byte past last erased sector;
  *         On failure: -EINVAL.
  */
-static off_t erase_range(const struct flash_area *fap, off_t start, off_t end)
+static off_t erase_range(struct bs_upload_ctx *ctx, const struct flash_area *fap,
+                         off_t start, off_t end)
 {
-    struct flash_sector sect;
     size_t size;
     int rc;
 
@@ -873,15 +963,32 @@ static off_t erase_range(const struct flash_area *fap, off_t start, off_t end)
         return start;
     }
 
-    if (flash_area_get_sector(fap, end, &sect)) {
-        return -EINVAL;
+#ifdef MCUBOOT_SECTOR_INDEX
+    uint32_t sect_off;
+    uint32_t sect_size;
+
+    if (boot_sector_index_find(&ctx->sector_index, end, &sect_off, &sect_size) == 0) {
+        size = sect_off + sect_size - start;
+    } else
+#endif
+    {
+        struct flash_sector sect;
+
+        if (flash_area_get_sector(fap, end, &sect)) {
+            return -EINVAL;
+        }
+
+        size = flash_sector_get_off(&sect) + flash_sector_get_size(&sect) - start;
     }
 
-    size = flash_sector_get_off(&sect) + flash_sector_get_size(&sect) - start;
     BOOT_LOG_DBG("Erasing range 0x%jx:0x%jx", (intmax_t)start,
 		 (intmax_t)(start + size - 1));
 
+#ifdef MCUBOOT_SECTOR_INDEX
+    rc = boot_erase_region_indexed(fap, &ctx->sector_index, start, size, false);
+#else
     rc = boot_erase_region(fap, start, size, false);
+#endif
     if (rc != 0) {
         BOOT_LOG_ERR("Error %d while erasing range", rc);
         return -EINVAL;
@@ -891,42 +998,561 @@ static off_t erase_range(const struct flash_area *fap, off_t start, off_t end)
 }
 #endif
 
+static int
+bs_upload_area_id(uint32_t img_num)
+{
+#if !defined(MCUBOOT_SERIAL_DIRECT_IMAGE_UPLOAD)
+    return flash_area_id_from_multi_image_slot(img_num, 0);
+#else
+    return flash_area_id_from_direct_image(img_num);
+#endif
+}
+
+/*
+ * Returns the upload in progress to an image, or NULL if there is none.
+ */
+static struct bs_upload_ctx *
+bs_upload_ctx_find(uint32_t img_num)
+{
+    int i;
+
+    for (i = 0; i < BS_UPLOAD_CTX_NUM; i++) {
+        if (bs_upload_ctx[i].used && bs_upload_ctx[i].img_num == img_num) {
+            return &bs_upload_ctx[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Returns the context for a new upload to an image: that of the previous
+ * upload to the image, else a free one, else that of a completed upload, else
+ * that of the upload started first.
+ */
+static struct bs_upload_ctx *
+bs_upload_ctx_start(uint32_t img_num)
+{
+    struct bs_upload_ctx *ctx = bs_upload_ctx_find(img_num);
+    int i;
+
+    for (i = 0; ctx == NULL && i < BS_UPLOAD_CTX_NUM; i++) {
+        if (!bs_upload_ctx[i].used) {
+            ctx = &bs_upload_ctx[i];
+        }
+    }
+    for (i = 0; ctx == NULL && i < BS_UPLOAD_CTX_NUM; i++) {
+        if (bs_upload_ctx[i].curr_off == bs_upload_ctx[i].img_size) {
+            ctx = &bs_upload_ctx[i];
+        }
+    }
+    if (ctx == NULL) {
+        ctx = &bs_upload_ctx[0];
+        for (i = 1; i < BS_UPLOAD_CTX_NUM; i++) {
+            if ((int32_t)(bs_upload_ctx[i].seq - ctx->seq) < 0) {
+                ctx = &bs_upload_ctx[i];
+            }
+        }
+    }
+
+    ctx->used = true;
+    ctx->img_num = img_num;
+    ctx->seq = bs_upload_seq++;
+    bs_upload_last = ctx;
+
+    return ctx;
+}
+
+#ifdef MCUBOOT_SERIAL_UPLOAD_RESUME
+/*
+ * Journal of the upload progress, kept in the last sector of the slot below
+ * the image trailer while the image ends before that sector. It starts with a
+ * header identifying the upload by the image number, size and the SHA sent by
+ * the client, followed by records of the offsets below which all the sectors
+ * of the image have been programmed, each record in a separate write.
+ */
+#define BS_JRNL_MAGIC   0x4a504c55  /* "ULPJ" */
+#define BS_JRNL_SHA_MAX 32
+
+struct bs_jrnl_hdr {
+    uint32_t magic;
+    uint32_t img_num;
+    uint32_t img_size;
+    uint32_t sha_len;
+    uint8_t sha[BS_JRNL_SHA_MAX];
+};
+
+struct bs_jrnl_rec {
+    uint32_t off;
+    uint32_t off_inv;               /* ~off, to tell torn records */
+};
+
+#define BS_JRNL_HDR_SZ(fap) ALIGN_UP(sizeof(struct bs_jrnl_hdr), flash_area_align(fap))
+#define BS_JRNL_REC_SZ(fap) ALIGN_UP(sizeof(struct bs_jrnl_rec), flash_area_align(fap))
+
+/*
+ * Looks the journal sector up, and sets cnt to the number of progress records
+ * it holds, 0 if there is no room for the journal after the image.
+ *
+ * @return 0 on success; nonzero if the slot has no such sector.
+ */
+static int
+bs_upload_jrnl_sector(struct bs_upload_ctx *ctx, const struct flash_area *fap, uint32_t *cnt)
+{
+    uint32_t limit = boot_status_off(fap);
+    uint32_t start_off = 0;
+    uint32_t off;
+    uint32_t size;
+
+#ifdef MCUBOOT_VALIDATED_HASH_CACHE
+    if (boot_hash_cache_off(fap) < limit) {
+        limit = boot_hash_cache_off(fap);
+    }
+#endif
+#ifdef MCUBOOT_SWAP_USING_OFFSET
+    start_off = ctx->start_off;
+#endif
+
+    *cnt = 0;
+    if (limit == 0 || flash_area_get_sector(fap, limit - 1, &ctx->jrnl_sector) != 0) {
+        return -1;
+    }
+
+    off = flash_sector_get_off(&ctx->jrnl_sector);
+    if (off + flash_sector_get_size(&ctx->jrnl_sector) > limit) {
+        /* The trailer starts within that sector, use the previous one */
+        if (off == 0 || flash_area_get_sector(fap, off - 1, &ctx->jrnl_sector) != 0) {
+            return -1;
+        }
+        off = flash_sector_get_off(&ctx->jrnl_sector);
+    }
+
+    size = flash_sector_get_size(&ctx->jrnl_sector);
+    if (ctx->img_size + start_off <= off && size > BS_JRNL_HDR_SZ(fap)) {
+        *cnt = (size - BS_JRNL_HDR_SZ(fap)) / BS_JRNL_REC_SZ(fap);
+    }
+
+    return 0;
+}
+
+/*
+ * Starts the journal of a new upload, once the slot has been erased or is to
+ * be erased progressively. A journal left by another upload is erased, so
+ * that it cannot be taken for this one; a new journal is only started if the
+ * client identified the image by its SHA.
+ *
+ * @return 0 on success; nonzero if a previous journal could not be erased.
+ */
+static int
+bs_upload_jrnl_start(struct bs_upload_ctx *ctx, const struct flash_area *fap,
+                     const struct zcbor_string *sha)
+{
+    uint8_t buf[ALIGN_UP(sizeof(struct bs_jrnl_hdr), BOOT_MAX_ALIGN)];
+    struct bs_jrnl_hdr hdr;
+    uint32_t cnt;
+
+    ctx->jrnl = false;
+    if (bs_upload_jrnl_sector(ctx, fap, &cnt) != 0 || cnt == 0) {
+        /* An image reaching the sector overwrites any journal in it */
+        return 0;
+    }
+
+#ifdef MCUBOOT_ERASE_PROGRESSIVELY
+    /* The sector is past the image, so it would not be erased otherwise */
+    if (boot_erase_region(fap, flash_sector_get_off(&ctx->jrnl_sector),
+                          flash_sector_get_size(&ctx->jrnl_sector), false) != 0) {
+        BOOT_LOG_ERR("Unable to erase the upload journal");
+        return -1;
+    }
+#endif
+
+    if (sha->len == 0 || sha->len > BS_JRNL_SHA_MAX) {
+        return 0;
+    }
+
+    hdr.magic = BS_JRNL_MAGIC;
+    hdr.img_num = ctx->img_num;
+    hdr.img_size = ctx->img_size;
+    hdr.sha_len = sha->len;
+    memset(hdr.sha, 0, sizeof(hdr.sha));
+    memcpy(hdr.sha, sha->value, sha->len);
+
+    memset(buf, flash_area_erased_val(fap), sizeof(buf));
+    memcpy(buf, &hdr, sizeof(hdr));
+    if (flash_area_write(fap, flash_sector_get_off(&ctx->jrnl_sector), buf,
+                         BS_JRNL_HDR_SZ(fap)) != 0) {
+        /* The upload goes on without it */
+        BOOT_LOG_WRN("Unable to start the upload journal");
+        return 0;
+    }
+
+    ctx->jrnl = true;
+    ctx->jrnl_idx = 0;
+    ctx->jrnl_last = 0;
+    ctx->jrnl_step = ctx->img_size / cnt + 1;
+    ctx->jrnl_next = ctx->jrnl_step;
+
+    return 0;
+}
+
+/*
+ * Records that the image has been programmed up to off, every jrnl_step bytes.
+ * Only the sectors below the one holding off are known to be complete, so the
+ * record is of the start of that sector.
+ */
+static void
+bs_upload_jrnl_mark(struct bs_upload_ctx *ctx, const struct flash_area *fap, uint32_t off)
+{
+    uint8_t buf[ALIGN_UP(sizeof(struct bs_jrnl_rec), BOOT_MAX_ALIGN)];
+    struct flash_sector sector;
+    struct bs_jrnl_rec rec;
+    uint32_t start_off = 0;
+    uint32_t cnt;
+
+    if (!ctx->jrnl || off < ctx->jrnl_next) {
+        return;
+    }
+
+#ifdef MCUBOOT_SWAP_USING_OFFSET
+    start_off = ctx->start_off;
+#endif
+
+    ctx->jrnl_next = off + ctx->jrnl_step;
+    if (flash_area_get_sector(fap, off + start_off, &sector) != 0 ||
+        bs_upload_jrnl_sector(ctx, fap, &cnt) != 0 || ctx->jrnl_idx >= cnt) {
+        ctx->jrnl = false;
+        return;
+    }
+
+    rec.off = flash_sector_get_off(&sector) - start_off;
+    if (rec.off <= ctx->jrnl_last) {
+        return;
+    }
+    rec.off_inv = ~rec.off;
+
+    memset(buf, flash_area_erased_val(fap), sizeof(buf));
+    memcpy(buf, &rec, sizeof(rec));
+    if (flash_area_write(fap, flash_sector_get_off(&ctx->jrnl_sector) + BS_JRNL_HDR_SZ(fap) +
+                         ctx->jrnl_idx * BS_JRNL_REC_SZ(fap), buf, BS_JRNL_REC_SZ(fap)) != 0) {
+        /* The records written so far remain valid */
+        BOOT_LOG_WRN("Unable to write to the upload journal");
+        ctx->jrnl = false;
+        return;
+    }
+
+    ctx->jrnl_idx++;
+    ctx->jrnl_last = rec.off;
+}
+
+/*
+ * Resumes the upload interrupted by a reset, if the journal in the slot is of
+ * the same image, identified by its number, size and SHA, and the beginning
+ * of the slot still matches the first chunk. Data programmed after the last
+ * record may be incomplete, so it is erased and the upload resumes there.
+ *
+ * @return true if the upload was resumed.
+ */
+static bool
+bs_upload_resume(struct bs_upload_ctx *ctx, const struct flash_area *fap,
+                 const struct zcbor_string *sha, const uint8_t *chunk, size_t chunk_len)
+{
+    struct bs_jrnl_hdr hdr;
+    struct bs_jrnl_rec rec;
+    uint8_t tmp[32];
+    uint32_t start_off = 0;
+    uint32_t jrnl_off;
+    uint32_t off = 0;
+    uint32_t cnt;
+    uint32_t pos;
+    uint32_t n;
+    uint32_t i;
+
+#ifdef MCUBOOT_SWAP_USING_OFFSET
+    start_off = ctx->start_off;
+#endif
+
+    if (sha->len == 0 || sha->len > BS_JRNL_SHA_MAX ||
+        bs_upload_jrnl_sector(ctx, fap, &cnt) != 0 || cnt == 0) {
+        return false;
+    }
+
+    jrnl_off = flash_sector_get_off(&ctx->jrnl_sector);
+    if (flash_area_read(fap, jrnl_off, &hdr, sizeof(hdr)) != 0 ||
+        hdr.magic != BS_JRNL_MAGIC || hdr.img_num != ctx->img_num ||
+        hdr.img_size != ctx->img_size || hdr.sha_len != sha->len ||
+        memcmp(hdr.sha, sha->value, sha->len) != 0) {
+        return false;
+    }
+
+    for (i = 0; i < cnt; i++) {
+        if (flash_area_read(fap, jrnl_off + BS_JRNL_HDR_SZ(fap) + i * BS_JRNL_REC_SZ(fap),
+                            &rec, sizeof(rec)) != 0) {
+            return false;
+        }
+        if (bootutil_buffer_is_erased(fap, &rec, sizeof(rec))) {
+            break;
+        }
+        if (rec.off_inv != ~rec.off || rec.off > ctx->img_size) {
+            /* Torn by a reset, the record is lost but its place is used; the
+             * records after it were added once the upload was resumed.
+             */
+            continue;
+        }
+        off = rec.off;
+    }
+
+    if (off == 0) {
+        return false;
+    }
+
+    for (pos = 0; pos < chunk_len && pos < off; pos += n) {
+        n = MIN(sizeof(tmp), MIN(chunk_len, off) - pos);
+        if (flash_area_read(fap, pos + start_off, tmp, n) != 0 ||
+            memcmp(tmp, chunk + pos, n) != 0) {
+            return false;
+        }
+    }
+
+#ifdef MCUBOOT_ERASE_PROGRESSIVELY
+    ctx->not_yet_erased = off + start_off;
+#else
+    if (boot_erase_region(fap, off + start_off, jrnl_off - off - start_off, false) != 0) {
+        return false;
+    }
+#endif
+
+    ctx->curr_off = off;
+#ifdef BOOT_SERIAL_WRITE_BEHIND
+    ctx->written_off = off;
+#endif
+    ctx->jrnl = true;
+    ctx->jrnl_idx = i;
+    ctx->jrnl_last = off;
+    ctx->jrnl_step = ctx->img_size / cnt + 1;
+    ctx->jrnl_next = off + ctx->jrnl_step;
+
+    BOOT_LOG_INF("Resuming upload of image %d at 0x%x", (int)ctx->img_num, (unsigned)off);
+
+    return true;
+}
+#endif /* MCUBOOT_SERIAL_UPLOAD_RESUME */
+
+/*
+ * Runs the final steps of an upload, once the whole image is in flash.
+ */
+static int
+bs_upload_done(struct bs_upload_ctx *ctx, const struct flash_area *fap)
+{
+    int rc;
+
+#if defined(MCUBOOT_ERASE_PROGRESSIVELY) && defined(BOOT_IMAGE_HAS_STATUS_FIELDS)
+    /* Assure that sector for image trailer was erased. */
+    /* Check whether it was erased during previous upload. */
+    off_t start = flash_sector_get_off(&ctx->status_sector);
+
+    if (erase_range(ctx, fap, start, start) < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+#endif
+#ifdef MCUBOOT_SERIAL_UPLOAD_RESUME
+    /* The slot content may change from now on, e.g. by a swap */
+    if (ctx->jrnl) {
+        ctx->jrnl = false;
+        if (boot_erase_region(fap, flash_sector_get_off(&ctx->jrnl_sector),
+                              flash_sector_get_size(&ctx->jrnl_sector), false) != 0) {
+            return MGMT_ERR_EUNKNOWN;
+        }
+    }
+#endif
+    rc = BOOT_HOOK_CALL(boot_serial_uploaded_hook, 0, ctx->img_num, fap,
+                        ctx->img_size);
+    if (rc) {
+        BOOT_LOG_ERR("Error %d post upload hook", rc);
+    }
+
+    return rc;
+}
+
+#ifdef BOOT_SERIAL_WRITE_BEHIND
+/*
+ * Image data accepted but not programmed yet, in a ring per upload. Writes to
+ * the slot are sequential, so the ring holds the image data from written_off
+ * to curr_off, at the position of its offset modulo the size of the ring; when
+ * the size of the ring is a multiple of the write alignment, every write from
+ * the ring is aligned.
+ */
+static uint32_t bs_wb_ring[BS_UPLOAD_CTX_NUM][MCUBOOT_SERIAL_WRITE_BEHIND_SIZE / sizeof(uint32_t)];
+
+#define BS_WB_RING(ctx) ((uint8_t *)bs_wb_ring[(ctx) - bs_upload_ctx])
+#define BS_WB_RING_SIZE ((uint32_t)sizeof(bs_wb_ring[0]))
+
+/*
+ * Programs the buffered data that can be written: the aligned part of it, or
+ * all of it once the whole image has been received. Only one contiguous part
+ * of the ring is programmed unless "all" is set. On failure, the error is kept
+ * to be reported to the next upload request.
+ *
+ * @return true if some data was programmed.
+ */
+static bool
+bs_upload_wb_program(struct bs_upload_ctx *ctx, const struct flash_area *fap, bool all)
+{
+    const uint32_t align = flash_area_align(fap);
+    bool programmed = false;
+    uint32_t start_off = 0;
+    uint32_t pos;
+    uint32_t len;
+    uint32_t rem_bytes;
+    int rc = 0;
+
+#ifdef MCUBOOT_SWAP_USING_OFFSET
+    start_off = ctx->start_off;
+#endif
+
+    while (ctx->wb_rc == 0 && ctx->written_off < ctx->curr_off) {
+        pos = ctx->written_off % BS_WB_RING_SIZE;
+        len = MIN(ctx->curr_off - ctx->written_off, BS_WB_RING_SIZE - pos);
+        rem_bytes = len % align;
+        if (ctx->written_off + len < ctx->img_size) {
+            /* The unaligned end is written with the data following it */
+            len -= rem_bytes;
+            rem_bytes = 0;
+        }
+        if (len == 0) {
+            break;
+        }
+
+#ifdef MCUBOOT_ERASE_PROGRESSIVELY
+        ctx->not_yet_erased = erase_range(ctx, fap, ctx->not_yet_erased,
+                                          ctx->written_off + len - 1 + start_off);
+        if (ctx->not_yet_erased < 0) {
+            rc = -1;
+            break;
+        }
+#endif
+
+        BOOT_LOG_DBG("Writing at 0x%x until 0x%x", ctx->written_off,
+                     ctx->written_off + len);
+        if (len > rem_bytes) {
+            rc = flash_area_write(fap, ctx->written_off + start_off, &BS_WB_RING(ctx)[pos],
+                                  len - rem_bytes);
+        }
+        if (rc == 0 && rem_bytes) {
+            uint8_t wbs_aligned[BOOT_MAX_ALIGN];
+
+            memset(wbs_aligned, flash_area_erased_val(fap), sizeof(wbs_aligned));
+            memcpy(wbs_aligned, &BS_WB_RING(ctx)[pos + len - rem_bytes], rem_bytes);
+            rc = flash_area_write(fap, ctx->written_off + len - rem_bytes + start_off,
+                                  wbs_aligned, align);
+        }
+        if (rc != 0) {
+            break;
+        }
+
+        ctx->written_off += len;
+        programmed = true;
+#ifdef MCUBOOT_SERIAL_UPLOAD_RESUME
+        bs_upload_jrnl_mark(ctx, fap, ctx->written_off);
+#endif
+        if (!all) {
+            break;
+        }
+    }
+
+    if (rc != 0) {
+        BOOT_LOG_ERR("Error %d while writing buffered data", rc);
+        ctx->wb_rc = MGMT_ERR_EUNKNOWN;
+    }
+
+    return programmed;
+}
+
+/*
+ * Programs part of the buffered image data of an upload.
+ *
+ * @return true if there may be more data to program.
+ */
+static bool
+bs_upload_wb_ctx_step(struct bs_upload_ctx *ctx)
+{
+    const struct flash_area *fap;
+    bool programmed;
+
+    if (!ctx->wb || ctx->wb_rc != 0 || ctx->written_off == ctx->curr_off) {
+        return false;
+    }
+
+    if (flash_area_open(bs_upload_area_id(ctx->img_num), &fap)) {
+        ctx->wb_rc = MGMT_ERR_EUNKNOWN;
+        return false;
+    }
+
+    programmed = bs_upload_wb_program(ctx, fap, false);
+    flash_area_close(fap);
+
+    return programmed;
+}
+
+/*
+ * Programs part of the buffered image data, called while no request is being
+ * received so that programming overlaps with the transfer of the next chunks.
+ * The uploads with buffered data are served in turns.
+ *
+ * @return true if there may be more data to program.
+ */
+static bool
+bs_upload_wb_step(void)
+{
+    static int next;
+    struct bs_upload_ctx *ctx;
+    int i;
+
+    for (i = 0; i < BS_UPLOAD_CTX_NUM; i++) {
+        ctx = &bs_upload_ctx[next];
+        next = (next + 1) % BS_UPLOAD_CTX_NUM;
+        if (bs_upload_wb_ctx_step(ctx)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Programs all of the buffered image data, before serving a request which may
+ * access the slot.
+ */
+static void
+bs_upload_wb_flush(void)
+{
+    while (bs_upload_wb_step()) {
+    }
+}
+#endif /* BOOT_SERIAL_WRITE_BEHIND */
+
 /*
  * Image upload request.
  */
 static void
 bs_upload(char *buf, int len)
 {
-    static size_t img_size;             /* Total image size, held for duration of upload */
-    static uint32_t curr_off;           /* Expected current offset */
+    struct bs_upload_ctx *ctx = NULL;
     const uint8_t *img_chunk = NULL;    /* Pointer to buffer with received image chunk */
     size_t img_chunk_len = 0;           /* Length of received image chunk */
     size_t img_chunk_off = SIZE_MAX;    /* Offset of image chunk within image  */
     size_t rem_bytes;                   /* Reminder bytes after aligning chunk write to
                                          * to flash alignment */
     uint32_t img_num_tmp = UINT_MAX;    /* Temp variable for image number */
-    static uint32_t img_num = 0;
+    uint32_t img_num;
     size_t img_size_tmp = SIZE_MAX;     /* Temp variable for image size */
     const struct flash_area *fap = NULL;
     int rc;
     struct zcbor_string img_chunk_data = { 0 };
+#ifdef MCUBOOT_SERIAL_UPLOAD_RESUME
+    struct zcbor_string img_sha = { 0 };
+#endif
     size_t decoded = 0;
     bool ok;
-#ifdef MCUBOOT_ERASE_PROGRESSIVELY
-    static off_t not_yet_erased = 0;    /* Offset of next byte to erase; writes to flash
-                                         * are done in consecutive manner and erases are done
-                                         * to allow currently received chunk to be written;
-                                         * this state variable holds information where last
-                                         * erase has stopped to let us know whether erase
-                                         * is needed to be able to write current chunk.
-                                         */
-#ifdef BOOT_IMAGE_HAS_STATUS_FIELDS
-    static struct flash_sector status_sector;
-#endif
-#endif /* MCUBOOT_ERASE_PROGRESSIVELY */
-#ifdef MCUBOOT_SWAP_USING_OFFSET
-    static uint32_t start_off = 0;
-#endif
 
     zcbor_state_t zsd[4 + CBOR_EXTRA_STATES];
     zcbor_new_decode_state(zsd, ARRAY_SIZE(zsd), (uint8_t *)buf, len, 1, NULL, 0);
@@ -936,6 +1562,9 @@ bs_upload(char *buf, int len)
         ZCBOR_MAP_DECODE_KEY_DECODER("data", zcbor_bstr_decode, &img_chunk_data),
         ZCBOR_MAP_DECODE_KEY_DECODER("len", zcbor_size_decode, &img_size_tmp),
         ZCBOR_MAP_DECODE_KEY_DECODER("off", zcbor_size_decode, &img_chunk_off),
+#ifdef MCUBOOT_SERIAL_UPLOAD_RESUME
+        ZCBOR_MAP_DECODE_KEY_DECODER("sha", zcbor_bstr_decode, &img_sha),
+#endif
     };
 
     ok = zcbor_map_decode_bulk(zsd, image_upload_decode, ARRAY_SIZE(image_upload_decode),
@@ -951,10 +1580,12 @@ bs_upload(char *buf, int len)
     /*
      * Expected data format.
      * {
-     *   "image":<image number in a multi-image set (OPTIONAL)>
+     *   "image":<image number in a multi-image set (OPTIONAL); in chunks
+     *            after the first one, selects the upload they belong to>
      *   "data":<image data>
      *   "len":<image len>
      *   "off":<current offset of image data>
+     *   "sha":<SHA of the whole image, with the first chunk (OPTIONAL)>
      * }
      */
 
@@ -965,20 +1596,26 @@ bs_upload(char *buf, int len)
         goto out_invalid_data;
     }
 
-    /* Use image number only from packet with offset == 0. */
     if (img_chunk_off == 0) {
-        if (img_num_tmp != UINT_MAX) {
-            img_num = img_num_tmp;
-        } else {
-            img_num = 0;
+        /* A new upload, to image 0 unless told otherwise */
+        img_num = (img_num_tmp != UINT_MAX) ? img_num_tmp : 0;
+    } else if (img_num_tmp != UINT_MAX) {
+        /* Chunks giving the image number may be interleaved with those of
+         * uploads to other images.
+         */
+        ctx = bs_upload_ctx_find(img_num_tmp);
+        if (ctx == NULL) {
+            /* No upload to that image, respond with offset 0 to restart it */
+            rc = 0;
+            goto out;
         }
+        img_num = ctx->img_num;
+    } else {
+        ctx = bs_upload_last;
+        img_num = ctx->img_num;
     }
 
-#if !defined(MCUBOOT_SERIAL_DIRECT_IMAGE_UPLOAD)
-    rc = flash_area_open(flash_area_id_from_multi_image_slot(img_num, 0), &fap);
-#else
-    rc = flash_area_open(flash_area_id_from_direct_image(img_num), &fap);
-#endif
+    rc = flash_area_open(bs_upload_area_id(img_num), &fap);
     if (rc) {
         rc = MGMT_ERR_EINVAL;
         goto out;
@@ -995,14 +1632,20 @@ bs_upload(char *buf, int len)
         struct flash_sector sector_data;
 #endif
 
-        curr_off = 0;
+        ctx = bs_upload_ctx_start(img_num);
+        ctx->curr_off = 0;
+#ifdef BOOT_SERIAL_WRITE_BEHIND
+        ctx->wb = (BS_WB_RING_SIZE % flash_area_align(fap) == 0);
+        ctx->written_off = 0;
+        ctx->wb_rc = 0;
+#endif
 #if defined(MCUBOOT_ERASE_PROGRESSIVELY) && defined(BOOT_IMAGE_HAS_STATUS_FIELDS)
         /* Get trailer sector information; this is done early because inability to get
          * that sector information means that upload will not work anyway.
          * TODO: This is single occurrence issue, it should get detected during tests
          * and fixed otherwise you are deploying broken mcuboot.
          */
-        if (flash_area_get_sector(fap, boot_status_off(fap), &status_sector)) {
+        if (flash_area_get_sector(fap, boot_status_off(fap), &ctx->status_sector)) {
             rc = MGMT_ERR_EUNKNOWN;
             BOOT_LOG_ERR("Unable to determine flash sector of the image trailer");
             goto out;
@@ -1016,6 +1659,11 @@ bs_upload(char *buf, int len)
         if (img_size_tmp > (area_size - BOOT_MAGIC_SZ)) {
             goto out_invalid_data;
         }
+#elif defined(MCUBOOT_VALIDATED_HASH_CACHE)
+        /* Same for the validated image hash record, which is kept in the trailer. */
+        if (img_size_tmp > boot_hash_cache_off(fap)) {
+            goto out_invalid_data;
+        }
 #else
         if (img_size_tmp > area_size) {
             goto out_invalid_data;
@@ -1023,23 +1671,18 @@ bs_upload(char *buf, int len)
 
 #endif
 
-#ifndef MCUBOOT_ERASE_PROGRESSIVELY
-        /* Non-progressive erase erases entire image slot when first chunk of
-         * an image is received.
-         */
-        rc = boot_erase_region(fap, 0, area_size, false);
+#ifdef MCUBOOT_VALIDATED_HASH_CACHE
+        rc = boot_invalidate_hash_cache(fap);
         if (rc) {
             goto out_invalid_data;
         }
-#else
-        not_yet_erased = 0;
 #endif
 
-        img_size = img_size_tmp;
+        ctx->img_size = img_size_tmp;
 
 #if defined(MCUBOOT_SWAP_USING_OFFSET) && defined(MCUBOOT_SERIAL_DIRECT_IMAGE_UPLOAD)
-        if (img_num > 0 &&
-            (img_num % BOOT_NUM_SLOTS) == BOOT_DIRECT_UPLOAD_SECONDARY_SLOT_ID_REMAINDER) {
+        if (ctx->img_num > 0 &&
+            (ctx->img_num % BOOT_NUM_SLOTS) == BOOT_DIRECT_UPLOAD_SECONDARY_SLOT_ID_REMAINDER) {
             rc = flash_area_get_sectors(fap->fa_id, &num_sectors, &sector_data);
 
             if ((rc != 0 && rc != -ENOMEM) ||
@@ -1048,36 +1691,121 @@ bs_upload(char *buf, int len)
                 goto out;
             }
 
-            start_off = sector_data.fs_size;
+            ctx->start_off = sector_data.fs_size;
         } else {
-            start_off = 0;
+            ctx->start_off = 0;
+        }
+#endif
+
+#if defined(MCUBOOT_ERASE_PROGRESSIVELY) && defined(MCUBOOT_SECTOR_INDEX)
+        /* On failure the index is left empty and sectors are looked up one
+         * by one instead.
+         */
+        (void)boot_sector_index_build(&ctx->sector_index, fap);
+#endif
+
+#ifdef MCUBOOT_SERIAL_UPLOAD_RESUME
+        if (bs_upload_resume(ctx, fap, &img_sha, img_chunk, img_chunk_len)) {
+            /* The client goes on from the offset in the response */
+            rc = 0;
+            if (ctx->curr_off == ctx->img_size) {
+                rc = bs_upload_done(ctx, fap);
+            }
+            goto out;
+        }
+#endif
+
+#ifndef MCUBOOT_ERASE_PROGRESSIVELY
+        /* Non-progressive erase erases entire image slot when first chunk of
+         * an image is received.
+         */
+        rc = boot_erase_region(fap, 0, area_size, false);
+        if (rc) {
+            goto out_invalid_data;
         }
+#else
+        ctx->not_yet_erased = 0;
+#endif
+
+#ifdef MCUBOOT_SERIAL_UPLOAD_RESUME
+        if (bs_upload_jrnl_start(ctx, fap, &img_sha) != 0) {
+            rc = MGMT_ERR_EUNKNOWN;
+            goto out;
+        }
+#endif
+#ifdef BOOT_SERIAL_WRITE_BEHIND
+    } else if (ctx->wb_rc != 0) {
+        goto out_wb_failed;
 #endif
-    } else if (img_chunk_off != curr_off) {
+    } else if (img_chunk_off != ctx->curr_off) {
         /* If received chunk offset does not match expected one jump, pretend
          * success and jump to out; out will respond to client with success
          * and request the expected offset, held by curr_off.
          */
         rc = 0;
         goto out;
-    } else if (curr_off + img_chunk_len > img_size) {
+    } else if (ctx->curr_off + img_chunk_len > ctx->img_size) {
         rc = MGMT_ERR_EINVAL;
         goto out;
     }
 
+#ifdef BOOT_SERIAL_WRITE_BEHIND
+    if (ctx->wb) {
+        /* Accept as much of the chunk as there is room for in the ring, after
+         * programming the buffered data if needed; the response requests the
+         * rest. Except for the last chunk, the data is programmed later.
+         */
+        uint32_t room = BS_WB_RING_SIZE - (ctx->curr_off - ctx->written_off);
+        uint32_t pos;
+        uint32_t n;
+
+        if (room < img_chunk_len) {
+            (void)bs_upload_wb_program(ctx, fap, true);
+            if (ctx->wb_rc != 0) {
+                goto out_wb_failed;
+            }
+            room = BS_WB_RING_SIZE - (ctx->curr_off - ctx->written_off);
+        }
+        img_chunk_len = MIN(img_chunk_len, room);
+
+        pos = ctx->curr_off % BS_WB_RING_SIZE;
+        n = MIN(img_chunk_len, BS_WB_RING_SIZE - pos);
+        memcpy(&BS_WB_RING(ctx)[pos], img_chunk, n);
+        memcpy(BS_WB_RING(ctx), img_chunk + n, img_chunk_len - n);
+        ctx->curr_off += img_chunk_len;
+
+        rc = 0;
+        if (ctx->curr_off == ctx->img_size) {
+            (void)bs_upload_wb_program(ctx, fap, true);
+            if (ctx->wb_rc != 0) {
+                goto out_wb_failed;
+            }
+            rc = bs_upload_done(ctx, fap);
+        }
+        goto out;
+
+out_wb_failed:
+        /* Programming the buffered data failed, the upload has to restart */
+        rc = ctx->wb_rc;
+        ctx->wb_rc = 0;
+        ctx->curr_off = ctx->written_off;
+        goto out;
+    }
+#endif
+
 #ifdef MCUBOOT_ERASE_PROGRESSIVELY
     /* Progressive erase will erase enough flash, aligned to sector size,
      * as needed for the current chunk to be written.
      */
 #ifdef MCUBOOT_SWAP_USING_OFFSET
-    not_yet_erased = erase_range(fap, not_yet_erased,
-                                 curr_off + img_chunk_len - 1 + start_off);
+    ctx->not_yet_erased = erase_range(ctx, fap, ctx->not_yet_erased,
+                                      ctx->curr_off + img_chunk_len - 1 + ctx->start_off);
 #else
-    not_yet_erased = erase_range(fap, not_yet_erased,
-                                 curr_off + img_chunk_len - 1);
+    ctx->not_yet_erased = erase_range(ctx, fap, ctx->not_yet_erased,
+                                      ctx->curr_off + img_chunk_len - 1);
 #endif
 
-    if (not_yet_erased < 0) {
+    if (ctx->not_yet_erased < 0) {
         rc = MGMT_ERR_EINVAL;
         goto out;
     }
@@ -1091,11 +1819,12 @@ bs_upload(char *buf, int len)
     rem_bytes = img_chunk_len % flash_area_align(fap);
     img_chunk_len -= rem_bytes;
 
-    if (curr_off + img_chunk_len + rem_bytes < img_size) {
+    if (ctx->curr_off + img_chunk_len + rem_bytes < ctx->img_size) {
         rem_bytes = 0;
     }
 
-    BOOT_LOG_DBG("Writing at 0x%x until 0x%x", curr_off, curr_off + (uint32_t)img_chunk_len);
+    BOOT_LOG_DBG("Writing at 0x%x until 0x%x", ctx->curr_off,
+                 ctx->curr_off + (uint32_t)img_chunk_len);
     /* Write flash aligned chunk, note that img_chunk_len now holds aligned length */
 #if defined(MCUBOOT_SERIAL_UNALIGNED_BUFFER_SIZE) && MCUBOOT_SERIAL_UNALIGNED_BUFFER_SIZE > 0
     if (flash_area_align(fap) > 1 &&
@@ -1113,31 +1842,31 @@ bs_upload(char *buf, int len)
             memcpy(wbs_aligned, img_chunk, write_size);
 
 #ifdef MCUBOOT_SWAP_USING_OFFSET
-            rc = flash_area_write(fap, curr_off + start_off, wbs_aligned, write_size);
+            rc = flash_area_write(fap, ctx->curr_off + ctx->start_off, wbs_aligned, write_size);
 #else
-            rc = flash_area_write(fap, curr_off, wbs_aligned, write_size);
+            rc = flash_area_write(fap, ctx->curr_off, wbs_aligned, write_size);
 #endif
 
             if (rc != 0) {
                 goto out;
             }
 
-            curr_off += write_size;
+            ctx->curr_off += write_size;
             img_chunk += write_size;
             img_chunk_len -= write_size;
         }
     } else {
 #ifdef MCUBOOT_SWAP_USING_OFFSET
-        rc = flash_area_write(fap, curr_off + start_off, img_chunk, img_chunk_len);
+        rc = flash_area_write(fap, ctx->curr_off + ctx->start_off, img_chunk, img_chunk_len);
 #else
-        rc = flash_area_write(fap, curr_off, img_chunk, img_chunk_len);
+        rc = flash_area_write(fap, ctx->curr_off, img_chunk, img_chunk_len);
 #endif
     }
 #else
 #ifdef MCUBOOT_SWAP_USING_OFFSET
-    rc = flash_area_write(fap, curr_off + start_off, img_chunk, img_chunk_len);
+    rc = flash_area_write(fap, ctx->curr_off + ctx->start_off, img_chunk, img_chunk_len);
 #else
-    rc = flash_area_write(fap, curr_off, img_chunk, img_chunk_len);
+    rc = flash_area_write(fap, ctx->curr_off, img_chunk, img_chunk_len);
 #endif
 #endif
 
@@ -1152,33 +1881,21 @@ bs_upload(char *buf, int len)
         memcpy(wbs_aligned, img_chunk + img_chunk_len, rem_bytes);
 
 #ifdef MCUBOOT_SWAP_USING_OFFSET
-        rc = flash_area_write(fap, curr_off + img_chunk_len + start_off, wbs_aligned,
+        rc = flash_area_write(fap, ctx->curr_off + img_chunk_len + ctx->start_off, wbs_aligned,
                               flash_area_align(fap));
 #else
-        rc = flash_area_write(fap, curr_off + img_chunk_len, wbs_aligned,
+        rc = flash_area_write(fap, ctx->curr_off + img_chunk_len, wbs_aligned,
                               flash_area_align(fap));
 #endif
     }
 
     if (rc == 0) {
-        curr_off += img_chunk_len + rem_bytes;
-        if (curr_off == img_size) {
-#if defined(MCUBOOT_ERASE_PROGRESSIVELY) && defined(BOOT_IMAGE_HAS_STATUS_FIELDS)
-            /* Assure that sector for image trailer was erased. */
-            /* Check whether it was erased during previous upload. */
-            off_t start = flash_sector_get_off(&status_sector);
-
-            if (erase_range(fap, start, start) < 0) {
-                rc = MGMT_ERR_EUNKNOWN;
-                goto out;
-            }
+        ctx->curr_off += img_chunk_len + rem_bytes;
+#ifdef MCUBOOT_SERIAL_UPLOAD_RESUME
+        bs_upload_jrnl_mark(ctx, fap, ctx->curr_off);
 #endif
-            rc = BOOT_HOOK_CALL(boot_serial_uploaded_hook, 0, img_num, fap,
-                                img_size);
-            if (rc) {
-                BOOT_LOG_ERR("Error %d post upload hook", rc);
-                goto out;
-            }
+        if (ctx->curr_off == ctx->img_size) {
+            rc = bs_upload_done(ctx, fap);
         }
     } else {
 out_invalid_data:
@@ -1192,7 +1909,7 @@ out:
     zcbor_int32_put(cbor_state, rc);
     if (rc == 0) {
         zcbor_tstr_put_lit_cast(cbor_state, "off");
-        zcbor_uint32_put(cbor_state, curr_off);
+        zcbor_uint32_put(cbor_state, (ctx != NULL) ? ctx->curr_off : 0);
     }
     zcbor_map_end_encode(cbor_state, 10);
 
@@ -1200,13 +1917,8 @@ out:
 
 #ifdef MCUBOOT_ENC_IMAGES
     /* Check if this upload was for the primary slot */
-#if !defined(MCUBOOT_SERIAL_DIRECT_IMAGE_UPLOAD)
-    if (flash_area_id_from_multi_image_slot(img_num, 0) == FLASH_AREA_IMAGE_PRIMARY(0))
-#else
-    if (flash_area_id_from_direct_image(img_num) == FLASH_AREA_IMAGE_PRIMARY(0))
-#endif
-    {
-        if (curr_off == img_size) {
+    if (ctx != NULL && bs_upload_area_id(ctx->img_num) == FLASH_AREA_IMAGE_PRIMARY(0)) {
+        if (ctx->curr_off == ctx->img_size) {
             /* Last sector received, now start a decryption on the image if it is encrypted */
             rc = boot_handle_enc_fw(fap);
         }
@@ -1272,16 +1984,29 @@ out:
  * reassembles one command at a time into a single buffer, hence a buffer
  * count of 1. The line length is not reported; enabling this command requires
  * BOOT_MAX_LINE_INPUT_LEN to remain at the standard 128-byte fragment size.
+ * With binary framing, the largest SMP packet of a binary frame and the
+ * number of upload requests the client may send ahead of the responses are
+ * reported too.
  */
 static void
 bs_mcumgr_params(char *buf, int len)
 {
+#ifdef MCUBOOT_SERIAL_BINARY_FRAMING
+    static const uint_fast32_t max_num = 4;
+#else
     static const uint_fast32_t max_num = 2;
+#endif
     bool ok = zcbor_map_start_encode(cbor_state, max_num) &&
               zcbor_tstr_put_lit_cast(cbor_state, "buf_size") &&
               zcbor_uint32_put(cbor_state, MCUBOOT_SERIAL_MAX_RECEIVE_SIZE) &&
               zcbor_tstr_put_lit_cast(cbor_state, "buf_count") &&
               zcbor_uint32_put(cbor_state, 1) &&
+#ifdef MCUBOOT_SERIAL_BINARY_FRAMING
+              zcbor_tstr_put_lit_cast(cbor_state, "bin_size") &&
+              zcbor_uint32_put(cbor_state, BOOT_SERIAL_BIN_PKT_MAX) &&
+              zcbor_tstr_put_lit_cast(cbor_state, "bin_window") &&
+              zcbor_uint32_put(cbor_state, MCUBOOT_SERIAL_BIN_WINDOW) &&
+#endif
               zcbor_map_end_encode(cbor_state, max_num);
 
     if (ok) {
@@ -1353,6 +2078,13 @@ boot_serial_input(char *buf, int len)
 
     reset_cbor_state();
 
+#ifdef BOOT_SERIAL_WRITE_BEHIND
+    if (hdr->nh_group != MGMT_GROUP_ID_IMAGE || hdr->nh_id != IMGMGR_NMGR_ID_UPLOAD) {
+        /* Other commands see the uploaded data in the slot */
+        bs_upload_wb_flush();
+    }
+#endif
+
     /*
      * Limited support for commands.
      */
@@ -1407,22 +2139,111 @@ boot_serial_input(char *buf, int len)
 #endif
 }
 
+#ifdef MCUBOOT_SERIAL_BINARY_FRAMING
+/*
+ * CRC32 (IEEE 802.3) of a binary frame, continuing from crc; start with 0.
+ */
+static uint32_t
+boot_serial_crc32(uint32_t crc, const void *data, size_t len)
+{
+#ifdef __ZEPHYR__
+    return crc32_ieee_update(crc, data, len);
+#elif __ESPRESSIF__
+    return esp_crc32_le(crc, data, len);
+#else
+    const uint8_t *p = data;
+    int i;
+
+    crc = ~crc;
+    while (len--) {
+        crc ^= *p++;
+        for (i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+
+    return ~crc;
+#endif
+}
+
+/*
+ * COBS encoder writing a binary frame to the serial port one group at a
+ * time, each group being at most 254 bytes of data after its code byte.
+ */
+struct boot_serial_cobs {
+    uint8_t grp[255];
+    uint8_t len;
+};
+
+static void
+boot_serial_cobs_flush(struct boot_serial_cobs *c)
+{
+    int i;
+
+    c->grp[0] = c->len + 1;
+    for (i = 0; i <= c->len; i++) {
+        c->grp[i] ^= BOOT_SERIAL_BIN_DELIM;
+    }
+    boot_uf->write((const char *)c->grp, c->len + 1);
+    c->len = 0;
+}
+
+static void
+boot_serial_cobs_put(struct boot_serial_cobs *c, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    while (len--) {
+        if (*p == 0) {
+            boot_serial_cobs_flush(c);
+        } else {
+            c->grp[++c->len] = *p;
+            if (c->len == sizeof(c->grp) - 1) {
+                boot_serial_cobs_flush(c);
+            }
+        }
+        p++;
+    }
+}
+
+static void
+boot_serial_output_bin(const char *data, int len)
+{
+    const char pkt_start[2] = { BOOT_SERIAL_BIN_START1, BOOT_SERIAL_BIN_START2 };
+    struct boot_serial_cobs cobs;
+    uint8_t crc_be[BOOT_SERIAL_BIN_CRC_SZ];
+    uint32_t crc;
+
+    crc = boot_serial_crc32(0, bs_hdr, sizeof(*bs_hdr));
+    crc = boot_serial_crc32(crc, data, len);
+    crc_be[0] = (uint8_t)(crc >> 24);
+    crc_be[1] = (uint8_t)(crc >> 16);
+    crc_be[2] = (uint8_t)(crc >> 8);
+    crc_be[3] = (uint8_t)crc;
+
+    boot_uf->write(pkt_start, sizeof(pkt_start));
+    cobs.len = 0;
+    boot_serial_cobs_put(&cobs, bs_hdr, sizeof(*bs_hdr));
+    boot_serial_cobs_put(&cobs, data, len);
+    boot_serial_cobs_put(&cobs, crc_be, sizeof(crc_be));
+    boot_serial_cobs_flush(&cobs);
+    boot_uf->write("\n", 1);
+}
+#endif /* MCUBOOT_SERIAL_BINARY_FRAMING */
+
 static void
 boot_serial_output(void)
 {
-    char *data;
     int len;
 #ifndef MCUBOOT_SERIAL_RAW_PROTOCOL
+    uint8_t *frame = (uint8_t *)bs_frame;
     int out;
+    int totlen;
     uint16_t crc;
-    uint16_t totlen;
     char pkt_cont[2] = { SHELL_NLIP_DATA_START1, SHELL_NLIP_DATA_START2 };
     char pkt_start[2] = { SHELL_NLIP_PKT_START1, SHELL_NLIP_PKT_START2 };
-    char buf[BOOT_SERIAL_OUT_MAX + sizeof(*bs_hdr) + sizeof(crc) + sizeof(totlen)];
-    char encoded_buf[BASE64_ENCODE_SIZE(sizeof(buf))];
 #endif
 
-    data = bs_obuf;
     len = (uintptr_t)cbor_state->payload_mut - (uintptr_t)bs_obuf;
 
     bs_hdr->nh_op++;
@@ -1432,43 +2253,26 @@ boot_serial_output(void)
 
 #ifdef MCUBOOT_SERIAL_RAW_PROTOCOL
     boot_uf->write((const char *)bs_hdr, sizeof(*bs_hdr));
-    boot_uf->write(data, len);
-#else
-#ifdef __ZEPHYR__
-    crc =  crc16_itu_t(CRC16_INITIAL_CRC, (uint8_t *)bs_hdr, sizeof(*bs_hdr));
-    crc =  crc16_itu_t(crc, data, len);
-#elif __ESPRESSIF__
-    /* For ESP32 it was used the CRC API in rom/crc.h */
-    crc =  ~esp_crc16_be(~CRC16_INITIAL_CRC, (uint8_t *)bs_hdr, sizeof(*bs_hdr));
-    crc =  ~esp_crc16_be(~crc, (uint8_t *)data, len);
+    boot_uf->write(bs_obuf, len);
 #else
-    crc = crc16_ccitt(CRC16_INITIAL_CRC, bs_hdr, sizeof(*bs_hdr));
-    crc = crc16_ccitt(crc, data, len);
-#endif
-    crc = htons(crc);
-
-    totlen = len + sizeof(*bs_hdr) + sizeof(crc);
-    totlen = htons(totlen);
-
-    memcpy(buf, &totlen, sizeof(totlen));
-    totlen = sizeof(totlen);
-    memcpy(&buf[totlen], bs_hdr, sizeof(*bs_hdr));
-    totlen += sizeof(*bs_hdr);
-    memcpy(&buf[totlen], data, len);
-    totlen += len;
-    memcpy(&buf[totlen], &crc, sizeof(crc));
-    totlen += sizeof(crc);
-#ifdef __ZEPHYR__
-    size_t enc_len;
-    base64_encode(encoded_buf, sizeof(encoded_buf), &enc_len, buf, totlen);
-    totlen = enc_len;
-#elif __ESPRESSIF__
-    size_t enc_len;
-    base64_encode((unsigned char *)encoded_buf, sizeof(encoded_buf), &enc_len, (unsigned char *)buf, totlen);
-    totlen = enc_len;
-#else
-    totlen = base64_encode(buf, totlen, encoded_buf, 1);
+#ifdef MCUBOOT_SERIAL_BINARY_FRAMING
+    if (bs_bin_frame) {
+        boot_serial_output_bin(bs_obuf, len);
+        BOOT_LOG_DBG("TX");
+        return;
+    }
 #endif
+    /* The response is already in place, between the header and the CRC */
+    totlen = sizeof(*bs_hdr) + len + sizeof(crc);
+    frame[0] = (uint8_t)(totlen >> 8);
+    frame[1] = (uint8_t)totlen;
+    memcpy(&frame[sizeof(uint16_t)], bs_hdr, sizeof(*bs_hdr));
+    crc = boot_serial_crc16(0, &frame[sizeof(uint16_t)], sizeof(*bs_hdr) + len);
+    frame[BOOT_SERIAL_FRAME_HDR_SZ + len] = (uint8_t)(crc >> 8);
+    frame[BOOT_SERIAL_FRAME_HDR_SZ + len + 1] = (uint8_t)crc;
+
+    totlen = (int)boot_serial_base64_encode(bs_frame, frame,
+                                            BOOT_SERIAL_FRAME_HDR_SZ + len + sizeof(crc));
 
     out = 0;
     while (out < totlen) {
@@ -1479,7 +2283,7 @@ boot_serial_output(void)
         }
 
         len = MIN(BOOT_SERIAL_FRAME_MTU, totlen - out);
-        boot_uf->write(&encoded_buf[out], len);
+        boot_uf->write(&bs_frame[out], len);
 
         out += len;
 
@@ -1492,6 +2296,8 @@ boot_serial_output(void)
 
 #ifndef MCUBOOT_SERIAL_RAW_PROTOCOL
 /*
+ * Decodes a line of a console packet, appending it at out + *out_off, which
+ * may be in front of "in" in the same buffer.
  * Returns 1 if full packet has been received.
  */
 static int
@@ -1501,33 +2307,16 @@ boot_serial_in_dec(char *in, int inlen, char *out, int *out_off, int maxout)
     uint16_t crc;
     uint16_t len;
 
-#ifdef __ZEPHYR__
-    size_t rc;
-    int err;
-    err = base64_decode( &out[*out_off], maxout - *out_off, &rc, in, inlen - 2);
-    if (err) {
-        return -1;
+    /* Drop the newline ending the line, and the NUL added by some ports */
+    while (inlen > 0 && (in[inlen - 1] == '\n' || in[inlen - 1] == '\r' ||
+                         in[inlen - 1] == '\0')) {
+        inlen--;
     }
-    decoded_len = (int)rc;
-#elif __ESPRESSIF__
-    size_t rc;
-    int err;
-    err = base64_decode((unsigned char *)&out[*out_off], maxout - *out_off, &rc, (unsigned char *)in, inlen);
-    if (err) {
+    /* Decoding never writes past the encoded data, check the length after */
+    decoded_len = boot_serial_base64_decode((uint8_t *)&out[*out_off], in, inlen);
+    if (decoded_len < 0 || *out_off + decoded_len > maxout) {
         return -1;
     }
-    decoded_len = (int)rc;
-#else
-    int rc;
-    if (*out_off + base64_decode_len(in) >= maxout) {
-        return -1;
-    }
-    rc = base64_decode(in, &out[*out_off]);
-    if (rc < 0) {
-        return -1;
-    }
-    decoded_len = rc;
-#endif
 
     *out_off += decoded_len;
     if (*out_off <= sizeof(uint16_t)) {
@@ -1540,13 +2329,7 @@ boot_serial_in_dec(char *in, int inlen, char *out, int *out_off, int maxout)
     }
 
     out += sizeof(uint16_t);
-#ifdef __ZEPHYR__
-    crc = crc16_itu_t(CRC16_INITIAL_CRC, out, len);
-#elif __ESPRESSIF__
-    crc = ~esp_crc16_be(~CRC16_INITIAL_CRC, (uint8_t *)out, len);
-#else
-    crc = crc16_ccitt(CRC16_INITIAL_CRC, out, len);
-#endif
+    crc = boot_serial_crc16(0, out, len);
     if (crc || len <= sizeof(crc)) {
         return 0;
     }
@@ -1557,6 +2340,62 @@ boot_serial_in_dec(char *in, int inlen, char *out, int *out_off, int maxout)
 }
 #endif /* !MCUBOOT_SERIAL_RAW_PROTOCOL */
 
+#ifdef MCUBOOT_SERIAL_BINARY_FRAMING
+/*
+ * Decodes a binary frame in place, "in" pointing past the start markers.
+ * Returns the length of the SMP packet at the start of "in", or -1 if the
+ * frame is malformed or its CRC does not match.
+ */
+static int
+boot_serial_in_bin(char *in, int inlen)
+{
+    uint8_t *buf = (uint8_t *)in;
+    int rd = 0;
+    int wr = 0;
+    int code;
+    int i;
+    uint32_t crc;
+
+    /* Drop the NUL added by the port and the newline ending the frame */
+    if (inlen > 0 && buf[inlen - 1] == '\0') {
+        inlen--;
+    }
+    if (inlen <= 0 || buf[inlen - 1] != BOOT_SERIAL_BIN_DELIM) {
+        return -1;
+    }
+    inlen--;
+
+    /* The decoded data is never longer than the encoded data, so it is
+     * written over the groups already read.
+     */
+    while (rd < inlen) {
+        code = buf[rd++] ^ BOOT_SERIAL_BIN_DELIM;
+        if (code == 0 || rd + code - 1 > inlen) {
+            return -1;
+        }
+        for (i = 1; i < code; i++) {
+            buf[wr++] = buf[rd++] ^ BOOT_SERIAL_BIN_DELIM;
+        }
+        if (code != 0xFF && rd < inlen) {
+            buf[wr++] = 0;
+        }
+    }
+
+    if (wr < (int)sizeof(struct nmgr_hdr) + BOOT_SERIAL_BIN_CRC_SZ) {
+        return -1;
+    }
+    wr -= BOOT_SERIAL_BIN_CRC_SZ;
+
+    crc = ((uint32_t)buf[wr] << 24) | ((uint32_t)buf[wr + 1] << 16) |
+          ((uint32_t)buf[wr + 2] << 8) | buf[wr + 3];
+    if (boot_serial_crc32(0, buf, wr) != crc) {
+        return -1;
+    }
+
+    return wr;
+}
+#endif /* MCUBOOT_SERIAL_BINARY_FRAMING */
+
 #ifdef MCUBOOT_SERIAL_RAW_PROTOCOL
 /* Dispatch every complete raw SMP packet at the front of "buf" (length from the
  * SMP header, capacity "max_input") via boot_serial_input(), keeping any
@@ -1610,6 +2449,7 @@ boot_serial_read_console(const struct boot_uart_funcs *f,int timeout_in_ms)
     int off;
 #ifndef MCUBOOT_SERIAL_RAW_PROTOCOL
     int dec_off = 0;
+    char *line;
 #endif
     int full_line;
     int max_input;
@@ -1652,6 +2492,12 @@ boot_serial_read_console(const struct boot_uart_funcs *f,int timeout_in_ms)
 #endif
         rc = f->read(in_buf + off, sizeof(in_buf) - off, &full_line);
         if (rc <= 0 && !full_line) {
+#ifdef BOOT_SERIAL_WRITE_BEHIND
+            /* Program the uploaded data while the next chunk is received */
+            if (bs_upload_wb_step()) {
+                goto check_timeout;
+            }
+#endif
 #ifndef MCUBOOT_SERIAL_WAIT_FOR_DFU
             allow_idle = true;
 #endif
@@ -1680,23 +2526,54 @@ boot_serial_read_console(const struct boot_uart_funcs *f,int timeout_in_ms)
                  * Full line, no newline yet. Reset the input buffer.
                  */
                 off = 0;
+                dec_off = 0;
             }
             goto check_timeout;
         }
-        if (in_buf[0] == SHELL_NLIP_PKT_START1 &&
-          in_buf[1] == SHELL_NLIP_PKT_START2) {
+
+        /*
+         * Lines are read after the part of the packet decoded so far, in
+         * in_buf[0..dec_off), and decoded in place to extend it.
+         */
+        line = &in_buf[dec_off];
+        off -= dec_off;
+        if (off < 2) {
+            /* Too short for the two start bytes of any framing */
+            rc = 0;
+        } else if (line[0] == SHELL_NLIP_PKT_START1 &&
+          line[1] == SHELL_NLIP_PKT_START2) {
             dec_off = 0;
-            rc = boot_serial_in_dec(&in_buf[2], off - 2, dec_buf, &dec_off, max_input);
-        } else if (in_buf[0] == SHELL_NLIP_DATA_START1 &&
-          in_buf[1] == SHELL_NLIP_DATA_START2) {
-            rc = boot_serial_in_dec(&in_buf[2], off - 2, dec_buf, &dec_off, max_input);
+            rc = boot_serial_in_dec(&line[2], off - 2, in_buf, &dec_off,
+                                    MCUBOOT_SERIAL_MAX_RECEIVE_SIZE + 1);
+        } else if (line[0] == SHELL_NLIP_DATA_START1 &&
+          line[1] == SHELL_NLIP_DATA_START2) {
+            rc = boot_serial_in_dec(&line[2], off - 2, in_buf, &dec_off,
+                                    MCUBOOT_SERIAL_MAX_RECEIVE_SIZE + 1);
+#ifdef MCUBOOT_SERIAL_BINARY_FRAMING
+        } else if (line[0] == BOOT_SERIAL_BIN_START1 &&
+          line[1] == BOOT_SERIAL_BIN_START2) {
+            /* A binary frame holds a whole packet, answered the same way */
+            dec_off = 0;
+            rc = boot_serial_in_bin(&line[2], off - 2);
+            if (rc > 0) {
+                bs_bin_frame = true;
+                boot_serial_input(&line[2], rc);
+            }
+            rc = 0;
+#endif
+        } else {
+            rc = 0;
         }
 
         /* serve errors: out of decode memory, or bad encoding */
         if (rc == 1) {
-            boot_serial_input(&dec_buf[2], dec_off - 2);
+#ifdef MCUBOOT_SERIAL_BINARY_FRAMING
+            bs_bin_frame = false;
+#endif
+            boot_serial_input(&in_buf[2], dec_off - 2);
+            dec_off = 0;
         }
-        off = 0;
+        off = dec_off;
 #endif /* MCUBOOT_SERIAL_RAW_PROTOCOL */
 check_timeout:
 #ifdef MCUBOOT_SERIAL_RAW_PROTOCOL_INPUT_TIMEOUT
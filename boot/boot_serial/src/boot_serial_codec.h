@@ -0,0 +1,73 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef H_BOOT_SERIAL_CODEC_
+#define H_BOOT_SERIAL_CODEC_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Length of the base64 encoding of in_size bytes, padding included */
+#define BOOT_SERIAL_BASE64_SIZE(in_size) ((((in_size) + 2) / 3) * 4)
+
+/**
+ * CRC16-CCITT (polynomial 0x1021, not reflected, no final XOR), as used by
+ * the console framing: continues from crc, start with 0.
+ *
+ * @param crc   CRC of the preceding data.
+ * @param data  Data to add.
+ * @param len   Length of the data.
+ *
+ * @return      The updated CRC.
+ */
+uint16_t boot_serial_crc16(uint16_t crc, const void *data, size_t len);
+
+/**
+ * Encodes data in base64, with padding and without a terminating NUL.
+ *
+ * The output may overwrite the input, i.e. dst may be equal to src, in
+ * which case the buffer must hold BOOT_SERIAL_BASE64_SIZE(len) bytes.
+ *
+ * @param dst   Buffer of BOOT_SERIAL_BASE64_SIZE(len) bytes for the encoding.
+ * @param src   Data to encode.
+ * @param len   Length of the data.
+ *
+ * @return      The length of the encoding.
+ */
+size_t boot_serial_base64_encode(char *dst, const uint8_t *src, size_t len);
+
+/**
+ * Decodes base64 data whose length is a multiple of 4.
+ *
+ * The output may overwrite the input, i.e. dst may be equal to, or come
+ * before, src.
+ *
+ * @param dst   Buffer for the decoded data.
+ * @param src   Encoded data.
+ * @param len   Length of the encoded data.
+ *
+ * @return      The length of the decoded data; -1 if the encoding is invalid.
+ */
+int boot_serial_base64_decode(uint8_t *dst, const char *src, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* H_BOOT_SERIAL_CODEC_ */
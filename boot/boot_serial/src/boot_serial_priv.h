@@ -33,6 +33,13 @@ extern "C" {
 #define SHELL_NLIP_DATA_START1  4
 #define SHELL_NLIP_DATA_START2  20
 
+/*
+ * Start of a binary frame: the SMP packet followed by its CRC32, COBS
+ * encoded and XORed with the newline ending the frame.
+ */
+#define BOOT_SERIAL_BIN_START1  5
+#define BOOT_SERIAL_BIN_START2  11
+
 /*
  * From newtmgr.h
  */
@@ -33,16 +33,30 @@
 
 #include "boot_serial/boot_serial.h"
 #include "boot_serial_priv.h"
+#include "zcbor_decode.h"
+#include "zcbor_bulk.h"
+#include "boot_test.h"
 
 TEST_CASE_DECL(boot_serial_setup)
 TEST_CASE_DECL(boot_serial_empty_msg)
 TEST_CASE_DECL(boot_serial_empty_img_msg)
 TEST_CASE_DECL(boot_serial_img_msg)
 TEST_CASE_DECL(boot_serial_upload_bigger_image)
+TEST_CASE_DECL(boot_serial_codec)
+TEST_CASE_DECL(boot_serial_bin_frame)
+TEST_CASE_DECL(boot_serial_upload_write_behind)
+TEST_CASE_DECL(boot_serial_upload_resume)
 
-static void
+char rx_buf[1024];
+int rx_len;
+
+void
 test_uart_write(const char *str, int len)
 {
+    if (rx_len + len <= sizeof(rx_buf)) {
+        memcpy(&rx_buf[rx_len], str, len);
+        rx_len += len;
+    }
 }
 
 static const struct boot_uart_funcs test_uart = {
@@ -55,6 +69,151 @@ tx_msg(void *src, int len)
     boot_serial_input(src, len);
 }
 
+void
+rx_clear(void)
+{
+    rx_len = 0;
+}
+
+int
+rx_rsp_decode(const uint8_t *pkt, int len, int32_t *rc, uint32_t *off)
+{
+    const struct nmgr_hdr *hdr = (const struct nmgr_hdr *)pkt;
+    zcbor_state_t zsd[4];
+    size_t decoded = 0;
+
+    struct zcbor_map_decode_key_val rsp_decode[] = {
+        ZCBOR_MAP_DECODE_KEY_DECODER("rc", zcbor_int32_decode, rc),
+        ZCBOR_MAP_DECODE_KEY_DECODER("off", zcbor_uint32_decode, off),
+    };
+
+    if (len < sizeof(*hdr) || ntohs(hdr->nh_len) != len - sizeof(*hdr)) {
+        return -1;
+    }
+
+    *rc = -1;
+    *off = UINT32_MAX;
+    zcbor_new_decode_state(zsd, sizeof(zsd) / sizeof(zsd[0]), pkt + sizeof(*hdr),
+                           len - sizeof(*hdr), 1, NULL, 0);
+
+    return zcbor_map_decode_bulk(zsd, rsp_decode, sizeof(rsp_decode) / sizeof(rsp_decode[0]),
+                                 &decoded);
+}
+
+/*
+ * Decodes the response in the console frame written since the last
+ * rx_clear().
+ */
+static int
+rx_console_rsp(int32_t *rc, uint32_t *off)
+{
+    static char enc[sizeof(rx_buf) + 1];
+    static uint8_t frame[sizeof(rx_buf)];
+    int len;
+
+    if (rx_len < 3 || rx_buf[0] != SHELL_NLIP_PKT_START1 ||
+        rx_buf[1] != SHELL_NLIP_PKT_START2 || rx_buf[rx_len - 1] != '\n') {
+        return -1;
+    }
+    memcpy(enc, &rx_buf[2], rx_len - 3);
+    enc[rx_len - 3] = '\0';
+
+    /* Length, SMP packet, CRC16 */
+    len = base64_decode(enc, frame);
+    if (len < 4 || ((frame[0] << 8) | frame[1]) != len - 2) {
+        return -1;
+    }
+
+    return rx_rsp_decode(&frame[2], len - 4, rc, off);
+}
+
+static int
+cbor_head(uint8_t *p, uint8_t major, uint32_t val)
+{
+    if (val < 24) {
+        p[0] = (major << 5) | val;
+        return 1;
+    } else if (val <= 0xff) {
+        p[0] = (major << 5) | 24;
+        p[1] = val;
+        return 2;
+    } else if (val <= 0xffff) {
+        p[0] = (major << 5) | 25;
+        p[1] = val >> 8;
+        p[2] = val;
+        return 3;
+    }
+    p[0] = (major << 5) | 26;
+    p[1] = val >> 24;
+    p[2] = val >> 16;
+    p[3] = val >> 8;
+    p[4] = val;
+    return 5;
+}
+
+static int
+cbor_key(uint8_t *p, const char *key)
+{
+    int len = cbor_head(p, 3, strlen(key));
+
+    memcpy(&p[len], key, strlen(key));
+    return len + strlen(key);
+}
+
+int32_t
+tx_upload(const uint8_t *data, int len, uint32_t off, uint32_t img_len,
+          const uint8_t *sha, int sha_len, uint32_t *rsp_off)
+{
+    static uint8_t buf[512];
+    struct nmgr_hdr *hdr = (struct nmgr_hdr *)buf;
+    int pos = sizeof(*hdr);
+    int32_t rc;
+
+    assert(pos + 32 + len + sha_len <= sizeof(buf));
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->nh_op = NMGR_OP_WRITE;
+    hdr->nh_group = htons(MGMT_GROUP_ID_IMAGE);
+    hdr->nh_id = IMGMGR_NMGR_ID_UPLOAD;
+
+    pos += cbor_head(&buf[pos], 5, off ? 2 : (sha_len ? 4 : 3));
+    pos += cbor_key(&buf[pos], "data");
+    pos += cbor_head(&buf[pos], 2, len);
+    memcpy(&buf[pos], data, len);
+    pos += len;
+    if (off == 0) {
+        pos += cbor_key(&buf[pos], "len");
+        pos += cbor_head(&buf[pos], 0, img_len);
+        if (sha_len) {
+            pos += cbor_key(&buf[pos], "sha");
+            pos += cbor_head(&buf[pos], 2, sha_len);
+            memcpy(&buf[pos], sha, sha_len);
+            pos += sha_len;
+        }
+    }
+    pos += cbor_key(&buf[pos], "off");
+    pos += cbor_head(&buf[pos], 0, off);
+    hdr->nh_len = htons(pos - sizeof(*hdr));
+
+    rx_clear();
+    tx_msg(buf, pos);
+    assert(rx_console_rsp(&rc, rsp_off) == 0);
+
+    return rc;
+}
+
+void
+tx_img_state_read(void)
+{
+    struct nmgr_hdr hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.nh_op = NMGR_OP_READ;
+    hdr.nh_group = htons(MGMT_GROUP_ID_IMAGE);
+    hdr.nh_id = IMGMGR_NMGR_ID_STATE;
+
+    tx_msg(&hdr, sizeof(hdr));
+}
+
 TEST_SUITE(boot_serial_suite)
 {
     boot_serial_setup();
@@ -62,6 +221,10 @@ TEST_SUITE(boot_serial_suite)
     boot_serial_empty_img_msg();
     boot_serial_img_msg();
     boot_serial_upload_bigger_image();
+    boot_serial_codec();
+    boot_serial_bin_frame();
+    boot_serial_upload_write_behind();
+    boot_serial_upload_resume();
 }
 
 int
@@ -43,6 +43,35 @@ extern "C" {
 
 void tx_msg(void *src, int len);
 
+/*
+ * Everything written to the serial port, since the last rx_clear().
+ */
+extern char rx_buf[];
+extern int rx_len;
+
+void test_uart_write(const char *str, int len);
+void rx_clear(void);
+
+/*
+ * Decodes the "rc" and the "off" of the response in an SMP packet; *off is
+ * left at UINT32_MAX if the response has no offset.
+ */
+int rx_rsp_decode(const uint8_t *pkt, int len, int32_t *rc, uint32_t *off);
+
+/*
+ * Sends an upload request with the chunk of the image at off; img_len and the
+ * sha, if sha_len is not 0, are only sent with the first chunk. Returns the
+ * "rc" of the response, and sets *rsp_off to its "off".
+ */
+int32_t tx_upload(const uint8_t *data, int len, uint32_t off, uint32_t img_len,
+                  const uint8_t *sha, int sha_len, uint32_t *rsp_off);
+
+/*
+ * Sends an image state request, before which the uploaded data that is held
+ * for write-behind is programmed.
+ */
+void tx_img_state_read(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,262 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include <setjmp.h>
+
+#include "boot_test.h"
+#include "boot_serial/boot_serial.h"
+
+#if MYNEWT_VAL(BOOT_SERIAL_BINARY_FRAMING)
+/*
+ * Frames read by boot_serial_start(), which never returns; once they have
+ * all been read, the test jumps back out of it.
+ */
+static const uint8_t *bin_in;
+static int bin_in_len;
+static jmp_buf bin_in_done;
+
+static int
+bin_uart_read(char *str, int cnt, int *newline)
+{
+    int n;
+
+    if (bin_in_len == 0) {
+        longjmp(bin_in_done, 1);
+    }
+
+    /* A line at a time, as the console does */
+    for (n = 0; n < bin_in_len && n < cnt; n++) {
+        str[n] = bin_in[n];
+        if (str[n] == '\n') {
+            n++;
+            break;
+        }
+    }
+    bin_in += n;
+    bin_in_len -= n;
+    *newline = (str[n - 1] == '\n');
+
+    return n;
+}
+
+static const struct boot_uart_funcs bin_uart = {
+    .read = bin_uart_read,
+    .write = test_uart_write,
+};
+
+static uint32_t
+bin_crc32(const uint8_t *data, int len)
+{
+    uint32_t crc = 0xffffffff;
+    int i;
+
+    while (len--) {
+        crc ^= *data++;
+        for (i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+
+    return ~crc;
+}
+
+/*
+ * Appends the CRC32 to an SMP packet of up to 250 bytes and writes it to out
+ * as a binary frame, returning the length of the frame.
+ */
+static int
+bin_frame(uint8_t *out, const uint8_t *pkt, int len)
+{
+    uint8_t data[256];
+    uint32_t crc = bin_crc32(pkt, len);
+    int code_pos = 2;
+    int wr = 3;
+    int i;
+
+    assert(len + 4 <= 254);
+    memcpy(data, pkt, len);
+    data[len++] = crc >> 24;
+    data[len++] = crc >> 16;
+    data[len++] = crc >> 8;
+    data[len++] = crc;
+
+    out[0] = BOOT_SERIAL_BIN_START1;
+    out[1] = BOOT_SERIAL_BIN_START2;
+    for (i = 0; i < len; i++) {
+        if (data[i] == 0) {
+            out[code_pos] = (wr - code_pos) ^ '\n';
+            code_pos = wr++;
+        } else {
+            out[wr++] = data[i] ^ '\n';
+        }
+    }
+    out[code_pos] = (wr - code_pos) ^ '\n';
+    out[wr++] = '\n';
+
+    return wr;
+}
+
+/*
+ * Decodes the binary frame at the start of in, to the SMP packet in pkt.
+ * Returns the length of the packet, and sets *used to that of the frame.
+ */
+static int
+bin_unframe(uint8_t *pkt, const char *in, int len, int *used)
+{
+    const uint8_t *p = (const uint8_t *)in;
+    int rd = 2;
+    int wr = 0;
+    int code;
+    int i;
+
+    assert(len > 3 && p[0] == BOOT_SERIAL_BIN_START1 && p[1] == BOOT_SERIAL_BIN_START2);
+    while (p[rd] != '\n') {
+        code = p[rd++] ^ '\n';
+        assert(code > 0 && rd + code - 1 < len);
+        for (i = 1; i < code; i++) {
+            pkt[wr++] = p[rd++] ^ '\n';
+        }
+        if (code != 0xff && p[rd] != '\n') {
+            pkt[wr++] = 0;
+        }
+    }
+    *used = rd + 1;
+
+    assert(wr > sizeof(struct nmgr_hdr) + 4);
+    wr -= 4;
+    assert(bin_crc32(pkt, wr) == ((uint32_t)pkt[wr] << 24 | (uint32_t)pkt[wr + 1] << 16 |
+                                  (uint32_t)pkt[wr + 2] << 8 | pkt[wr + 3]));
+
+    return wr;
+}
+
+static int
+bin_upload_pkt(uint8_t *pkt, const uint8_t *img)
+{
+    struct nmgr_hdr *hdr = (struct nmgr_hdr *)pkt;
+
+    /* 00000000  a3 64 64 61 74 61 58 20  |.ddataX |
+     * 00000008  (32 bytes of image data)
+     * 00000028  63 6c 65 6e 18 20 63 6f  |clen. co|
+     * 00000030  66 66 00                 |ff.|
+     */
+    static const uint8_t payload_start[] = {
+        0xa3, 0x64, 0x64, 0x61, 0x74, 0x61, 0x58, 0x20,
+    };
+    static const uint8_t payload_end[] = {
+        0x63, 0x6c, 0x65, 0x6e, 0x18, 0x20, 0x63, 0x6f,
+        0x66, 0x66, 0x00,
+    };
+    int len = sizeof(*hdr);
+
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->nh_op = NMGR_OP_WRITE;
+    hdr->nh_group = htons(MGMT_GROUP_ID_IMAGE);
+    hdr->nh_id = IMGMGR_NMGR_ID_UPLOAD;
+
+    memcpy(&pkt[len], payload_start, sizeof(payload_start));
+    len += sizeof(payload_start);
+    memcpy(&pkt[len], img, 32);
+    len += 32;
+    memcpy(&pkt[len], payload_end, sizeof(payload_end));
+    len += sizeof(payload_end);
+    hdr->nh_len = htons(len - sizeof(*hdr));
+
+    return len;
+}
+#endif /* MYNEWT_VAL(BOOT_SERIAL_BINARY_FRAMING) */
+
+TEST_CASE(boot_serial_bin_frame)
+{
+#if MYNEWT_VAL(BOOT_SERIAL_BINARY_FRAMING)
+    const struct boot_uart_funcs *uf = boot_uf;
+    uint8_t img[32];
+    uint8_t bad_img[32];
+    uint8_t pkt[128];
+    uint8_t in[3 * 128];
+    struct nmgr_hdr *hdr;
+    const struct flash_area *fap;
+    int in_len = 0;
+    int len;
+    int used;
+    int pos;
+    int32_t rc;
+    uint32_t off;
+    int i;
+
+    /* Holds zeroes and newlines, which the framing has to get rid of */
+    for (i = 0; i < sizeof(img); i++) {
+        img[i] = i * 5;
+        bad_img[i] = ~img[i];
+    }
+
+    /* A complete image in a single upload request */
+    len = bin_upload_pkt(pkt, img);
+    in_len += bin_frame(&in[in_len], pkt, len);
+
+    /* The upload restarted with other data, in a frame with a bad CRC */
+    len = bin_upload_pkt(pkt, bad_img);
+    i = bin_frame(&in[in_len], pkt, len);
+    in[in_len + i - 2] ^= 0x01;
+    in_len += i;
+
+    /* A request of another group, with an empty payload */
+    hdr = (struct nmgr_hdr *)pkt;
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->nh_op = NMGR_OP_WRITE;
+    hdr->nh_group = htons(MGMT_GROUP_ID_DEFAULT);
+    hdr->nh_id = NMGR_ID_CONS_ECHO_CTRL;
+    in_len += bin_frame(&in[in_len], pkt, sizeof(*hdr));
+    assert(in_len <= sizeof(in));
+
+    rx_clear();
+    bin_in = in;
+    bin_in_len = in_len;
+    if (setjmp(bin_in_done) == 0) {
+        boot_serial_start(&bin_uart);
+    }
+    boot_uf = uf;
+
+    /* Only the frames with a good CRC are answered, in binary frames */
+    pos = 0;
+    len = bin_unframe(pkt, &rx_buf[pos], rx_len - pos, &used);
+    pos += used;
+    hdr = (struct nmgr_hdr *)pkt;
+    assert(hdr->nh_op == NMGR_OP_WRITE + 1);
+    assert(ntohs(hdr->nh_group) == MGMT_GROUP_ID_IMAGE);
+    assert(hdr->nh_id == IMGMGR_NMGR_ID_UPLOAD);
+    assert(rx_rsp_decode(pkt, len, &rc, &off) == 0);
+    assert(rc == 0 && off == sizeof(img));
+
+    len = bin_unframe(pkt, &rx_buf[pos], rx_len - pos, &used);
+    pos += used;
+    assert(ntohs(hdr->nh_group) == MGMT_GROUP_ID_DEFAULT);
+    assert(hdr->nh_id == NMGR_ID_CONS_ECHO_CTRL);
+    assert(rx_rsp_decode(pkt, len, &rc, &off) == 0);
+    assert(rc == 0 && off == UINT32_MAX);
+    assert(pos == rx_len);
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_PRIMARY(0), &fap);
+    assert(rc == 0);
+
+    rc = flash_area_read(fap, 0, bad_img, sizeof(bad_img));
+    assert(rc == 0);
+    assert(!memcmp(bad_img, img, sizeof(img)));
+    flash_area_close(fap);
+#endif
+}
@@ -0,0 +1,75 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "boot_test.h"
+#include "boot_serial_codec.h"
+
+#define CODEC_TEST_MAX   600
+
+/*
+ * Checks the serial recovery codec against the CRC and base64 libraries it
+ * replaced.
+ */
+TEST_CASE(boot_serial_codec)
+{
+    static uint8_t data[CODEC_TEST_MAX];
+    static char ref[BASE64_ENCODE_SIZE(CODEC_TEST_MAX) + 1];
+    static uint8_t buf[BOOT_SERIAL_BASE64_SIZE(CODEC_TEST_MAX) + 4];
+    uint16_t crc;
+    size_t len;
+    int ref_len;
+    int rc;
+    int i;
+
+    for (i = 0; i < CODEC_TEST_MAX; i++) {
+        data[i] = (uint8_t)(i * 167 + (i >> 3));
+    }
+
+    /* CRC-16/XMODEM check value */
+    assert(boot_serial_crc16(0, "123456789", 9) == 0x31c3);
+
+    for (len = 0; len < CODEC_TEST_MAX; len++) {
+        crc = crc16_ccitt(CRC16_INITIAL_CRC, data, len);
+        assert(boot_serial_crc16(0, data, len) == crc);
+        assert(boot_serial_crc16(boot_serial_crc16(0, data, len / 2),
+                                 &data[len / 2], len - len / 2) == crc);
+
+        /* Encoded over the data itself */
+        ref_len = base64_encode(data, len, ref, 1);
+        memcpy(buf, data, len);
+        assert(boot_serial_base64_encode((char *)buf, buf, len) == (size_t)ref_len);
+        assert((size_t)ref_len == BOOT_SERIAL_BASE64_SIZE(len));
+        assert(!memcmp(buf, ref, ref_len));
+
+        /* Decoded over the encoding, and in front of it */
+        rc = boot_serial_base64_decode(buf, (char *)buf, ref_len);
+        assert(rc == (int)len);
+        assert(!memcmp(buf, data, len));
+
+        memcpy(&buf[4], ref, ref_len);
+        rc = boot_serial_base64_decode(buf, (char *)&buf[4], ref_len);
+        assert(rc == (int)len);
+        assert(!memcmp(buf, data, len));
+    }
+
+    assert(boot_serial_base64_decode(buf, "AAA", 3) == -1);
+    assert(boot_serial_base64_decode(buf, "AA=A", 4) == -1);
+    assert(boot_serial_base64_decode(buf, "A\nAA", 4) == -1);
+    assert(boot_serial_base64_decode(buf, "AA\xc1" "A", 4) == -1);
+}
@@ -58,6 +58,9 @@ TEST_CASE(boot_serial_img_msg)
     len = sizeof(*hdr) + sizeof payload;
     tx_msg(buf, len);
 
+    /* Data held for write-behind is programmed before another request */
+    tx_img_state_read();
+
     /*
      * Validate contents inside the primary slot
      */
@@ -103,6 +103,9 @@ TEST_CASE(boot_serial_upload_bigger_image)
         tx_msg(buf, len);
     }
 
+    /* Data held for write-behind is programmed before another request */
+    tx_img_state_read();
+
     /*
      * Validate contents inside the primary slot
      */
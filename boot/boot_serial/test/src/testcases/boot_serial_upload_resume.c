@@ -0,0 +1,231 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "boot_test.h"
+
+#if MYNEWT_VAL(BOOT_SERIAL_UPLOAD_RESUME)
+/*
+ * The journal kept by boot_serial: a header starting with its magic, then
+ * records of the offsets up to which the image was programmed.
+ */
+#define JRNL_MAGIC      0x4a504c55
+#define JRNL_HDR_SIZE   48
+
+struct jrnl_rec {
+    uint32_t off;
+    uint32_t off_inv;
+};
+
+#define RESUME_CHUNK    128
+#define RESUME_IMG_MAX  (5 * 4096)
+
+static uint8_t resume_img[RESUME_IMG_MAX];
+static uint32_t resume_img_len;
+static uint32_t sector_size;
+
+static const uint8_t sha_a[32] = { 0x5a, 0x01, 0x02, 0x03 };
+static const uint8_t sha_b[32] = { 0xa5, 0x01, 0x02, 0x03 };
+
+static uint32_t
+align_up(uint32_t n, uint32_t align)
+{
+    return (n + align - 1) / align * align;
+}
+
+static bool
+is_erased(const struct flash_area *fap, const void *data, uint32_t len)
+{
+    const uint8_t *p = data;
+
+    while (len--) {
+        if (*p++ != flash_area_erased_val(fap)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Uploads the image from off until at least until, returning the offset
+ * reached; starting at 0 starts a new upload.
+ */
+static uint32_t
+upload(const uint8_t *sha, uint32_t off, uint32_t until)
+{
+    uint32_t rsp_off;
+    uint32_t len;
+    int32_t rc;
+
+    while (off < until) {
+        len = resume_img_len - off < RESUME_CHUNK ? resume_img_len - off : RESUME_CHUNK;
+        rc = tx_upload(&resume_img[off], len, off, resume_img_len, sha, sizeof(sha_a),
+                       &rsp_off);
+        assert(rc == 0);
+        assert(rsp_off == off + len);
+        off = rsp_off;
+    }
+
+    return off;
+}
+
+/*
+ * Restarts the upload, as the client does after a reset: returns the offset
+ * from which the response to the first chunk asks to go on.
+ */
+static uint32_t
+restart(const uint8_t *sha, const uint8_t *chunk)
+{
+    uint32_t rsp_off;
+    int32_t rc;
+
+    rc = tx_upload(chunk, RESUME_CHUNK, 0, resume_img_len, sha, sizeof(sha_a), &rsp_off);
+    assert(rc == 0);
+
+    return rsp_off;
+}
+
+static void
+check_slot(const struct flash_area *fap, uint32_t off, const uint8_t *data, uint32_t len)
+{
+    uint8_t buf[64];
+    uint32_t n;
+    int rc;
+
+    while (len > 0) {
+        n = len < sizeof(buf) ? len : sizeof(buf);
+        rc = flash_area_read(fap, off, buf, n);
+        assert(rc == 0);
+        if (data != NULL) {
+            assert(!memcmp(buf, data, n));
+            data += n;
+        } else {
+            assert(is_erased(fap, buf, n));
+        }
+        off += n;
+        len -= n;
+    }
+}
+
+/*
+ * Returns the offset of the first free record of the journal of the upload in
+ * progress.
+ */
+static uint32_t
+jrnl_free_rec(const struct flash_area *fap)
+{
+    struct flash_sector sector;
+    struct jrnl_rec rec;
+    uint32_t magic = 0;
+    uint32_t off;
+    int rc;
+
+    for (off = 0; off < flash_area_get_size(fap); off += flash_sector_get_size(&sector)) {
+        rc = flash_area_get_sector(fap, off, &sector);
+        assert(rc == 0);
+        rc = flash_area_read(fap, off, &magic, sizeof(magic));
+        assert(rc == 0);
+        if (magic == JRNL_MAGIC) {
+            break;
+        }
+    }
+    assert(magic == JRNL_MAGIC);
+
+    off += align_up(JRNL_HDR_SIZE, flash_area_align(fap));
+    while (1) {
+        rc = flash_area_read(fap, off, &rec, sizeof(rec));
+        assert(rc == 0);
+        if (is_erased(fap, &rec, sizeof(rec))) {
+            return off;
+        }
+        off += align_up(sizeof(rec), flash_area_align(fap));
+    }
+}
+#endif /* MYNEWT_VAL(BOOT_SERIAL_UPLOAD_RESUME) */
+
+TEST_CASE(boot_serial_upload_resume)
+{
+#if MYNEWT_VAL(BOOT_SERIAL_UPLOAD_RESUME)
+    uint8_t chunk[RESUME_CHUNK];
+    const struct flash_area *fap;
+    struct flash_sector sector;
+    struct jrnl_rec rec;
+    uint32_t off;
+    int rc;
+    int i;
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_PRIMARY(0), &fap);
+    assert(rc == 0);
+
+    /* An image of a few sectors, which does not end on a sector boundary */
+    rc = flash_area_get_sector(fap, 0, &sector);
+    assert(rc == 0);
+    sector_size = flash_sector_get_size(&sector);
+    resume_img_len = 4 * sector_size + 100;
+    assert(resume_img_len <= sizeof(resume_img));
+    for (i = 0; i < resume_img_len; i++) {
+        resume_img[i] = i * 3 + 11;
+    }
+
+    /*
+     * Interrupted past the third sector: the upload goes on from the last
+     * sector known to be complete, and what was programmed after it is
+     * erased and sent again.
+     */
+    upload(sha_a, 0, 2 * sector_size + 300);
+    off = restart(sha_a, resume_img);
+    assert(off == 2 * sector_size);
+    check_slot(fap, off, NULL, 3 * sector_size - off);
+    upload(sha_a, off, resume_img_len);
+    check_slot(fap, 0, resume_img, resume_img_len);
+
+    /*
+     * A record torn by the reset is ignored, and the records after the
+     * restart go after it.
+     */
+    upload(sha_a, 0, 2 * sector_size + 300);
+    rec.off = 3 * sector_size;
+    rec.off_inv = ~rec.off | 0xffff0000;
+    rc = flash_area_write(fap, jrnl_free_rec(fap), &rec, sizeof(rec));
+    assert(rc == 0);
+    off = restart(sha_a, resume_img);
+    assert(off == 2 * sector_size);
+    upload(sha_a, off, 3 * sector_size + 300);
+    off = restart(sha_a, resume_img);
+    assert(off == 3 * sector_size);
+    upload(sha_a, off, resume_img_len);
+    check_slot(fap, 0, resume_img, resume_img_len);
+
+    /* Another SHA is another image, uploaded from the start */
+    upload(sha_a, 0, 2 * sector_size + 300);
+    off = restart(sha_b, resume_img);
+    assert(off == RESUME_CHUNK);
+    check_slot(fap, sector_size, NULL, 2 * sector_size);
+
+    /* So is an image starting with other data */
+    upload(sha_a, 0, 2 * sector_size + 300);
+    memcpy(chunk, resume_img, sizeof(chunk));
+    chunk[0] ^= 0xff;
+    off = restart(sha_a, chunk);
+    assert(off == RESUME_CHUNK);
+    check_slot(fap, sector_size, NULL, 2 * sector_size);
+
+    flash_area_close(fap);
+#endif
+}
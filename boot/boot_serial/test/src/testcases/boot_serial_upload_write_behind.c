@@ -0,0 +1,92 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "boot_test.h"
+
+#define WB_RING_SIZE MYNEWT_VAL(BOOT_SERIAL_WRITE_BEHIND_SIZE)
+
+#if WB_RING_SIZE > 0
+static void
+check_primary_slot(const uint8_t *img, uint32_t len)
+{
+    const struct flash_area *fap;
+    uint8_t buf[64];
+    uint32_t off;
+    uint32_t n;
+    int rc;
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_PRIMARY(0), &fap);
+    assert(rc == 0);
+
+    for (off = 0; off < len; off += n) {
+        n = len - off < sizeof(buf) ? len - off : sizeof(buf);
+        rc = flash_area_read(fap, off, buf, n);
+        assert(rc == 0);
+        assert(!memcmp(buf, &img[off], n));
+    }
+
+    flash_area_close(fap);
+}
+#endif
+
+TEST_CASE(boot_serial_upload_write_behind)
+{
+#if WB_RING_SIZE > 0
+    /* Not a multiple of the write alignment, so that its end is padded */
+    static uint8_t img[WB_RING_SIZE * 8 + 41];
+    uint32_t rsp_off;
+    uint32_t off;
+    uint32_t len;
+    int32_t rc;
+    int i;
+
+    for (i = 0; i < sizeof(img); i++) {
+        img[i] = i * 7 + 1;
+    }
+
+    /*
+     * The chunks wrap around the end of the ring, which their size does not
+     * divide, and every fourth one is larger than the ring: of that one, the
+     * ring takes what it has room for once the data before it is programmed,
+     * and the response requests the rest.
+     */
+    off = 0;
+    for (i = 0; off < sizeof(img); i++) {
+        len = (i % 4 == 3) ? WB_RING_SIZE + 72 : 48;
+        if (len > sizeof(img) - off) {
+            len = sizeof(img) - off;
+        }
+
+        rc = tx_upload(&img[off], len, off, sizeof(img), NULL, 0, &rsp_off);
+        assert(rc == 0);
+        assert(rsp_off == off + (len < WB_RING_SIZE ? len : WB_RING_SIZE));
+
+        if (i == 5) {
+            /* Another request sees all of the data accepted so far */
+            tx_img_state_read();
+            check_primary_slot(img, rsp_off);
+        }
+
+        off = rsp_off;
+    }
+
+    /* The last chunk has the whole image programmed */
+    check_primary_slot(img, sizeof(img));
+#endif
+}
@@ -19,8 +19,13 @@
 #ifndef H_BOOTUTIL_BENCH_H__
 #define H_BOOTUTIL_BENCH_H__
 
+#include <stdint.h>
 #include "ignore.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #ifdef MCUBOOT_USE_BENCH
 
 /* The platform-specific benchmark code should define a
@@ -65,4 +70,75 @@ typedef int bench_state_t;
 
 #endif /* not MCUBOOT_USE_BENCH */
 
+/*
+ * Phases of the boot that are timed when MCUBOOT_BENCH_PHASES is enabled.
+ * Phases may nest, e.g. erases and copies are also part of swap steps.
+ */
+#define BOOT_BENCH_HDR_READ     0   /* Reading an image header */
+#define BOOT_BENCH_HASH         1   /* Hashing an image */
+#define BOOT_BENCH_SIG_VERIFY   2   /* Verifying an image signature */
+#define BOOT_BENCH_KEY_UNWRAP   3   /* Decrypting an image encryption key */
+#define BOOT_BENCH_SWAP_STEP    4   /* Swapping or moving one swap unit */
+#define BOOT_BENCH_ERASE        5   /* Erasing a region */
+#define BOOT_BENCH_COPY         6   /* Copying a region between slots */
+#define BOOT_BENCH_PHASE_COUNT  7
+
+/*
+ * Totals of one phase. With MCUBOOT_DATA_SHARING_BOOTINFO the totals of all
+ * phases are saved, as an array indexed by phase, to the shared data area
+ * under BLINFO_BOOT_TIMING once all images are loaded.
+ */
+struct boot_bench_phase {
+    uint32_t count;     /* Number of times the phase completed */
+    uint32_t bytes;     /* Number of bytes processed */
+    uint32_t cycles;    /* Time spent, as counted by plat_bench_cycles() */
+};
+
+#ifdef MCUBOOT_BENCH_PHASES
+
+#ifndef MCUBOOT_USE_BENCH
+#error "MCUBOOT_BENCH_PHASES requires MCUBOOT_USE_BENCH"
+#endif
+
+/*
+ * The platform-specific benchmark code should also define
+ * plat_bench_cycles(), which returns a free running uint32_t counter.
+ */
+typedef uint32_t bench_phase_t;
+
+void boot_bench_phase_add(int phase, uint32_t bytes, uint32_t cycles);
+const struct boot_bench_phase *boot_bench_phases(void);
+
+/*
+ * Calling `boot_bench_phase_start()` before a phase and
+ * `boot_bench_phase_stop()` after it adds the time spent, and the number of
+ * bytes processed, to the totals of the phase.
+ */
+#define boot_bench_phase_start(_start) do { \
+    *(_start) = plat_bench_cycles(); \
+} while (0)
+
+#define boot_bench_phase_stop(_start, _phase, _bytes) do { \
+    boot_bench_phase_add((_phase), (_bytes), plat_bench_cycles() - *(_start)); \
+} while (0)
+
+#else /* not MCUBOOT_BENCH_PHASES */
+
+typedef int bench_phase_t;
+
+#define boot_bench_phase_start(_start) do { \
+    IGNORE(_start); \
+} while (0)
+
+#define boot_bench_phase_stop(_start, _phase, _bytes) do { \
+    IGNORE(_start); \
+    IGNORE(_bytes); \
+} while (0)
+
+#endif /* not MCUBOOT_BENCH_PHASES */
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* not H_BOOTUTIL_BENCH_H__ */
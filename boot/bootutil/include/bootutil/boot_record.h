@@ -82,6 +82,15 @@ int boot_save_shared_data(const struct image_header *hdr,
                           const uint8_t active_slot,
                           const struct image_max_size *max_app_sizes);
 
+/**
+ * Add the boot phase timing totals collected with MCUBOOT_BENCH_PHASES to
+ * the shared memory area between the bootloader and runtime SW, under
+ * BLINFO_BOOT_TIMING.
+ *
+ * @return                    0 on success; nonzero on failure.
+ */
+int boot_save_bench_data(void);
+
 #ifdef __cplusplus
 }
 #endif
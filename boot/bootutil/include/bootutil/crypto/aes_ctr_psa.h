@@ -16,6 +16,8 @@
 #include "bootutil/enc_key_public.h"
 #include <psa/crypto.h>
 
+#define BOOT_ENC_BLOCK_SIZE (16)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
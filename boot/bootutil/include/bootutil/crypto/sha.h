@@ -284,6 +284,26 @@ static inline int bootutil_sha_finish(bootutil_sha_context *ctx,
 }
 #endif /* MCUBOOT_USE_CC310 */
 
+#if defined(MCUBOOT_HASH_HW_ENGINE)
+/*
+ * Streaming SHA engine provided by the port, which reads the data to hash
+ * itself (e.g. by DMA), from RAM or from memory-mapped flash. It computes
+ * the same hash as bootutil_sha_*(). The engine is used by one hash at a
+ * time: boot_hw_sha_init() returns nonzero if it is unavailable, in which
+ * case the software backend is used instead. It is released again by
+ * boot_hw_sha_drop(), which is called in all cases once init succeeded.
+ *
+ * Data passed to boot_hw_sha_update_async() must not be modified until
+ * boot_hw_sha_wait() has returned. An implementation is free to complete
+ * the update before returning.
+ */
+int boot_hw_sha_init(void);
+int boot_hw_sha_update_async(const void *data, uint32_t data_len);
+int boot_hw_sha_wait(void);
+int boot_hw_sha_finish(uint8_t *output);
+void boot_hw_sha_drop(void);
+#endif /* MCUBOOT_HASH_HW_ENGINE */
+
 #ifdef __cplusplus
 }
 #endif
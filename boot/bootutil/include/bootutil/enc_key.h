@@ -39,9 +39,21 @@
 extern "C" {
 #endif
 
+#ifndef MCUBOOT_ENC_KEYSTREAM_BLOCKS
+#define MCUBOOT_ENC_KEYSTREAM_BLOCKS 8
+#endif
+
 struct enc_key_data {
     uint8_t valid;
     bootutil_aes_ctr_context aes_ctr;
+#if !defined(MCUBOOT_USE_CUSTOM_CRYPTO)
+    /* Keystream of the payload from ks_off, generated ahead and kept between
+     * calls so that consecutive chunks do not restart the counter.
+     */
+    uint32_t ks_off;
+    uint32_t ks_len;
+    uint8_t ks[MCUBOOT_ENC_KEYSTREAM_BLOCKS * BOOT_ENC_BLOCK_SIZE];
+#endif
 };
 
 /**
@@ -68,9 +80,10 @@ int boot_enc_load(struct boot_loader_state *state, int slot,
                   const struct image_header *hdr, const struct flash_area *fap,
                   struct boot_status *bs);
 bool boot_enc_valid(const struct enc_key_data *enc_state);
-void boot_enc_encrypt(struct enc_key_data *enc_state,
+/* Encrypt or decrypt in place; return 0 on success, nonzero on failure */
+int boot_enc_encrypt(struct enc_key_data *enc_state,
         uint32_t off, uint32_t sz, uint32_t blk_off, uint8_t *buf);
-void boot_enc_decrypt(struct enc_key_data *enc_state,
+int boot_enc_decrypt(struct enc_key_data *enc_state,
         uint32_t off, uint32_t sz, uint32_t blk_off, uint8_t *buf);
 /* Note that boot_enc_zeorize takes BOOT_CURR_ENC, not BOOT_CURR_ENC_SLOT */
 void boot_enc_zeroize(struct enc_key_data *enc_state);
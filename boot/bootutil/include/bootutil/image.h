@@ -82,6 +82,12 @@ extern "C" {
 #define IMAGE_F_COMPRESSED_LZMA2         0x00000400
 #define IMAGE_F_COMPRESSED_ARM_THUMB_FLT 0x00000800
 
+/*
+ * Indicates that the image payload is a patch to be applied to the image
+ * in the primary slot, see IMAGE_TLV_DELTA_BASE.
+ */
+#define IMAGE_F_DELTA                    0x00001000
+
 /*
  * ECSDA224 is with NIST P-224
  * ECSDA256 is with NIST P-256
@@ -134,6 +140,15 @@ extern "C" {
 #define IMAGE_TLV_COMP_DEC_SIZE     0x73    /* Compressed decrypted image size */
 #define IMAGE_TLV_UUID_VID          0x74    /* Vendor unique identifier */
 #define IMAGE_TLV_UUID_CID          0x75    /* Device class unique identifier */
+#define IMAGE_TLV_SECTOR_HASHES     0x76    /*
+                                             * Sector size followed by the hash of
+                                             * each sector of the image hdr and body
+                                             */
+#define IMAGE_TLV_DELTA_BASE        0x77    /*
+                                             * Size of the image the patch of a
+                                             * delta image produces, followed by
+                                             * the shaX hash of the base image
+                                             */
                                             /*
                                              * vendor reserved TLVs at xxA0-xxFF,
                                              * where xx denotes the upper byte
@@ -199,6 +214,8 @@ STRUCT_PACKED image_tlv {
 #define MUST_DECOMPRESS(fap, idx, hdr) \
     (flash_area_get_id(fap) == FLASH_AREA_IMAGE_SECONDARY(idx) && IS_COMPRESSED(hdr))
 
+#define IS_DELTA(hdr) ((hdr)->ih_flags & IMAGE_F_DELTA)
+
 _Static_assert(sizeof(struct image_header) == IMAGE_HEADER_SIZE,
                "struct image_header not required size");
 
@@ -212,6 +229,33 @@ fih_ret bootutil_img_validate(struct boot_loader_state *state,
                               uint8_t *seed, int seed_len, uint8_t *out_hash
 );
 
+#if !defined(MCUBOOT_SIGN_PURE)
+/*
+ * Same as bootutil_img_validate(), except that the image is not read to
+ * compute its hash; the given hash, computed by the caller over the header,
+ * payload and protected TLVs of the image, is checked against the image TLVs
+ * instead.
+ */
+fih_ret bootutil_img_validate_with_hash(struct boot_loader_state *state,
+                                        struct image_header *hdr,
+                                        const struct flash_area *fap,
+                                        const uint8_t *hash);
+#endif
+
+#if defined(MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY) || \
+    (defined(MCUBOOT_SECTOR_HASHES) && !defined(MCUBOOT_SIGN_PURE))
+/*
+ * Check the TLVs of the image without hashing it: a valid signature of the
+ * hash held in the hash TLV must be present, and the security counter and UUID
+ * TLVs must be acceptable. The signed hash is returned in out_hash; the image
+ * is only valid if its hash, computed separately, matches it.
+ */
+fih_ret bootutil_img_check_tlvs(struct boot_loader_state *state,
+                                struct image_header *hdr,
+                                const struct flash_area *fap,
+                                uint8_t *out_hash);
+#endif
+
 struct image_tlv_iter {
     const struct image_header *hdr;
     const struct flash_area *fap;
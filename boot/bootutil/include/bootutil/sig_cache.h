@@ -0,0 +1,94 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __BOOTUTIL_SIG_CACHE_H__
+#define __BOOTUTIL_SIG_CACHE_H__
+
+/**
+ * @file sig_cache.h
+ *
+ * Interface to be implemented by the platform when MCUBOOT_SIG_CACHE is
+ * enabled, to keep the result of the last successful signature verification
+ * of each image, e.g. in retained RAM or in a dedicated flash area.
+ *
+ * @note The entries are authenticated with boot_sig_cache_mac(), so the
+ *       storage does not need to be protected, but the MAC key must be
+ *       unique to the device and not readable by the images.
+ */
+
+#include <stdint.h>
+#include "bootutil/crypto/sha.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BOOT_SIG_CACHE_MAC_SIZE 32
+
+/** A signature verified with success: the hash of an image was signed by a key. */
+struct boot_sig_cache_entry {
+    /* Hash of the image */
+    uint8_t digest[IMAGE_HASH_SIZE];
+    /* Hash of the public key which the signature was checked with, or zeros
+     * with MCUBOOT_BUILTIN_KEY
+     */
+    uint8_t key_hash[IMAGE_HASH_SIZE];
+    /* Security counter of the image when the signature was checked, 0
+     * without MCUBOOT_HW_ROLLBACK_PROT
+     */
+    uint32_t security_cnt;
+    uint8_t key_id;
+    uint8_t pad[3];
+    /* Computed over all of the above */
+    uint8_t mac[BOOT_SIG_CACHE_MAC_SIZE];
+};
+
+/**
+ * Reads the entry of an image.
+ *
+ * @param image_index       Index of the image (from 0).
+ * @param entry             Entry to fill.
+ *
+ * @return                  0 on success; nonzero if there is none.
+ */
+int boot_sig_cache_read(uint32_t image_index, struct boot_sig_cache_entry *entry);
+
+/**
+ * Replaces the entry of an image.
+ *
+ * @param image_index       Index of the image (from 0).
+ * @param entry             New entry.
+ *
+ * @return                  0 on success; nonzero on failure.
+ */
+int boot_sig_cache_write(uint32_t image_index, const struct boot_sig_cache_entry *entry);
+
+/**
+ * Computes the MAC of an entry, e.g. HMAC-SHA256 with a device-unique key.
+ *
+ * @param data              Data to authenticate.
+ * @param len               Length of the data.
+ * @param mac               Buffer of BOOT_SIG_CACHE_MAC_SIZE bytes for the MAC.
+ *
+ * @return                  0 on success; nonzero on failure.
+ */
+int boot_sig_cache_mac(const void *data, uint32_t len, uint8_t *mac);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BOOTUTIL_SIG_CACHE_H__ */
@@ -31,6 +31,7 @@
 #if defined(MCUBOOT_MEASURED_BOOT) || defined(MCUBOOT_DATA_SHARING)
 #include "bootutil/boot_record.h"
 #include "bootutil/boot_status.h"
+#include "bootutil/bench.h"
 #include "bootutil_priv.h"
 #include "bootutil/image.h"
 #include "flash_map_backend/flash_map_backend.h"
@@ -391,4 +392,14 @@ int boot_save_shared_data(const struct image_header *hdr, const struct flash_are
 
     return rc;
 }
+
+#ifdef MCUBOOT_BENCH_PHASES
+int boot_save_bench_data(void)
+{
+    return boot_add_data_to_shared_area(TLV_MAJOR_BLINFO, BLINFO_BOOT_TIMING,
+                                        sizeof(struct boot_bench_phase) *
+                                        BOOT_BENCH_PHASE_COUNT,
+                                        (const uint8_t *)boot_bench_phases());
+}
+#endif /* MCUBOOT_BENCH_PHASES */
 #endif /* MCUBOOT_DATA_SHARING_BOOTINFO */
@@ -34,6 +34,7 @@
 #include "bootutil/enc_key.h"
 #endif
 #include "bootutil/bootutil_log.h"
+#include "bootutil/bench.h"
 
 BOOT_LOG_MODULE_DECLARE(mcuboot);
 
@@ -59,6 +60,11 @@ boot_trailer_info_sz(void)
 #ifdef MCUBOOT_SWAP_USING_OFFSET
            /* TLV size for both slots */
            BOOT_MAX_ALIGN                         +
+#endif
+#ifdef MCUBOOT_VALIDATED_HASH_CACHE
+           /* validated image hash + revoked flag */
+           BOOT_HASH_CACHE_ALIGN_SIZE             +
+           BOOT_MAX_ALIGN                         +
 #endif
            BOOT_MAGIC_ALIGN_SIZE
            );
@@ -81,9 +87,31 @@ boot_status_entry_sz(uint32_t min_write_sz)
 #endif
 }
 
+#ifdef MCUBOOT_SWAP_STATUS_JOURNAL
+static inline uint32_t
+boot_status_journal_sz(uint32_t min_write_sz)
+{
+    return BOOT_STATUS_JOURNAL_RECORDS *
+           ALIGN_UP(sizeof(struct boot_status_record), min_write_sz);
+}
+
+bool
+boot_status_journal_used(uint32_t min_write_sz)
+{
+    return boot_status_journal_sz(min_write_sz) <
+           BOOT_STATUS_MAX_ENTRIES * boot_status_entry_sz(min_write_sz);
+}
+#endif
+
 uint32_t
 boot_status_sz(uint32_t min_write_sz)
 {
+#ifdef MCUBOOT_SWAP_STATUS_JOURNAL
+    if (boot_status_journal_used(min_write_sz)) {
+        return boot_status_journal_sz(min_write_sz);
+    }
+#endif
+
     return BOOT_STATUS_MAX_ENTRIES * boot_status_entry_sz(min_write_sz);
 }
 
@@ -100,6 +128,25 @@ uint32_t boot_scratch_trailer_sz(uint32_t min_write_sz)
 }
 #endif
 
+uint32_t
+boot_io_chunk_sz(const struct flash_area *fa, uint32_t max_sz)
+{
+#if defined(MCUBOOT_FLASH_AREA_OPTIMAL_IO_SIZE)
+    uint32_t io_sz = flash_area_get_optimal_io_size(fa);
+
+    /* Use as many whole I/O units as fit, unless a single one is bigger
+     * than what the caller can take.
+     */
+    if (io_sz > 0 && io_sz <= max_sz) {
+        return max_sz - (max_sz % io_sz);
+    }
+#else
+    (void)fa;
+#endif
+
+    return max_sz;
+}
+
 #if defined(MCUBOOT_MINIMAL_SCRAMBLE)
 /**
  * Get size of header aligned to device erase unit or write block, depending on whether device has
@@ -215,11 +262,351 @@ boot_trailer_scramble_offset(const struct flash_area *fa, size_t alignment, size
     return ret;
 }
 
+#ifdef MCUBOOT_SKIP_ERASED_SECTORS
+/*
+ * Checks whether a region of a flash area reads as erased, with the blank
+ * check of the flash map backend if there is one.
+ */
+static bool
+boot_region_is_erased(const struct flash_area *fa, uint32_t off, uint32_t size)
+{
+#ifdef MCUBOOT_FLASH_AREA_IS_ERASED
+    return flash_area_is_erased(fa, off, size);
+#else
+    uint8_t buf[BOOT_TMPBUF_SZ];
+    uint32_t end = off + size;
+    uint32_t len;
+
+    for (; off < end; off += len) {
+        len = end - off;
+        if (len > sizeof(buf)) {
+            len = sizeof(buf);
+        }
+
+        if (flash_area_read(fa, off, buf, len) != 0 ||
+            !bootutil_buffer_is_erased(fa, buf, len)) {
+            return false;
+        }
+    }
+
+    return true;
+#endif
+}
+#endif /* MCUBOOT_SKIP_ERASED_SECTORS */
+
+/*
+ * Erases whole sectors, unless they are erased already and
+ * MCUBOOT_SKIP_ERASED_SECTORS is enabled.
+ */
+static int
+boot_erase_sectors(const struct flash_area *fa, uint32_t off, uint32_t size)
+{
+#ifdef MCUBOOT_SKIP_ERASED_SECTORS
+    if (boot_region_is_erased(fa, off, size)) {
+        BOOT_LOG_DBG("boot_erase_sectors: already erased, offset %" PRIu32
+                     ", size %" PRIu32, off, size);
+        return 0;
+    }
+#endif
+
+    return flash_area_erase(fa, off, size);
+}
+
+#ifdef MCUBOOT_SECTOR_INDEX
+void
+boot_sector_index_init(struct boot_sector_index *idx)
+{
+    idx->num_runs = 0;
+}
+
 int
-boot_erase_region(const struct flash_area *fa, uint32_t off, uint32_t size, bool backwards)
+boot_sector_index_add(struct boot_sector_index *idx, uint32_t off, uint32_t size)
+{
+    struct boot_sector_run *run;
+
+    if (size == 0) {
+        goto fail;
+    }
+
+    if (idx->num_runs > 0) {
+        run = &idx->runs[idx->num_runs - 1];
+
+        if (off == run->off + run->size * run->count && size == run->size) {
+            /* Same size and adjacent, extend the current run */
+            run->count++;
+            return 0;
+        }
+
+        if (off < run->off + run->size * run->count) {
+            goto fail;
+        }
+    }
+
+    if (idx->num_runs == MCUBOOT_SECTOR_INDEX_MAX_RUNS) {
+        goto fail;
+    }
+
+    run = &idx->runs[idx->num_runs];
+    run->off = off;
+    run->size = size;
+    run->count = 1;
+    idx->num_runs++;
+
+    return 0;
+
+fail:
+    idx->num_runs = 0;
+    return -1;
+}
+
+int
+boot_sector_index_build(struct boot_sector_index *idx, const struct flash_area *fa)
 {
+    struct flash_sector sector;
+    uint32_t off = 0;
+    uint32_t next;
+    int rc;
+
+    boot_sector_index_init(idx);
+
+    while (off < flash_area_get_size(fa)) {
+        rc = flash_area_get_sector(fa, off, &sector);
+        if (rc < 0) {
+            goto fail;
+        }
+
+        rc = boot_sector_index_add(idx, flash_sector_get_off(&sector),
+                                   flash_sector_get_size(&sector));
+        if (rc != 0) {
+            return rc;
+        }
+
+        next = flash_sector_get_off(&sector) + flash_sector_get_size(&sector);
+        if (next <= off) {
+            rc = -1;
+            goto fail;
+        }
+        off = next;
+    }
+
+    BOOT_LOG_DBG("boot_sector_index_build: flash_area %p, %" PRIu32 " runs",
+                 fa, idx->num_runs);
+
+    return 0;
+
+fail:
+    boot_sector_index_init(idx);
+    return rc;
+}
+
+int
+boot_sector_index_find(const struct boot_sector_index *idx, uint32_t off,
+                       uint32_t *sector_off, uint32_t *sector_size)
+{
+    const struct boot_sector_run *run;
+    uint32_t lo = 0;
+    uint32_t hi = idx->num_runs;
+    uint32_t mid;
+    uint32_t n;
+
+    /* Find the last run starting at or below off */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (idx->runs[mid].off <= off) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == 0) {
+        return -1;
+    }
+
+    run = &idx->runs[lo - 1];
+    n = (off - run->off) / run->size;
+    if (n >= run->count) {
+        return -1;
+    }
+
+    *sector_off = run->off + n * run->size;
+    *sector_size = run->size;
+
+    return 0;
+}
+
+int
+boot_sector_index_get(const struct boot_sector_index *idx, uint32_t n,
+                      uint32_t *sector_off, uint32_t *sector_size)
+{
+    const struct boot_sector_run *run;
+    uint32_t i;
+
+    for (i = 0; i < idx->num_runs; i++) {
+        run = &idx->runs[i];
+
+        if (n < run->count) {
+            *sector_off = run->off + n * run->size;
+            *sector_size = run->size;
+            return 0;
+        }
+
+        n -= run->count;
+    }
+
+    *sector_off = 0;
+    *sector_size = 0;
+
+    return -1;
+}
+
+uint32_t
+boot_sector_index_count(const struct boot_sector_index *idx)
+{
+    uint32_t count = 0;
+    uint32_t i;
+
+    for (i = 0; i < idx->num_runs; i++) {
+        count += idx->runs[i].count;
+    }
+
+    return count;
+}
+#endif /* MCUBOOT_SECTOR_INDEX */
+
+/*
+ * Gets the offset and size of the sector containing off, from the sector
+ * index of the flash area when there is one that covers it.
+ */
+static int
+boot_area_get_sector(const struct flash_area *fa, const struct boot_sector_index *idx,
+                     uint32_t off, uint32_t *sector_off, uint32_t *sector_size)
+{
+    struct flash_sector sector;
+    int rc;
+
+#ifdef MCUBOOT_SECTOR_INDEX
+    if (idx != NULL && boot_sector_index_find(idx, off, sector_off, sector_size) == 0) {
+        return 0;
+    }
+#else
+    (void)idx;
+#endif
+
+    rc = flash_area_get_sector(fa, off, &sector);
+    if (rc < 0) {
+        return rc;
+    }
+
+    *sector_off = flash_sector_get_off(&sector);
+    *sector_size = flash_sector_get_size(&sector);
+
+    return 0;
+}
+
+#ifdef MCUBOOT_FLASH_AREA_ERASE_RANGE
+/*
+ * Erases the sectors overlapping the given region with as few
+ * flash_area_erase() calls as possible, each at most max_sz bytes long
+ * unless a single sector is larger, and each starting and ending on a
+ * sector boundary.
+ */
+static int
+boot_erase_region_batched(const struct flash_area *fa, const struct boot_sector_index *idx,
+                          uint32_t off, uint32_t size, bool backwards, uint32_t max_sz)
+{
+    uint32_t sector_off;
+    uint32_t sector_size;
+    uint32_t start;
+    uint32_t end;
+    uint32_t chunk_start;
+    uint32_t chunk_end;
+    int rc;
+
+    if (size == 0) {
+        return 0;
+    }
+
+    /* Extend the region to whole sectors */
+    rc = boot_area_get_sector(fa, idx, off, &sector_off, &sector_size);
+    if (rc < 0) {
+        return rc;
+    }
+    start = sector_off;
+
+    rc = boot_area_get_sector(fa, idx, off + size - 1, &sector_off, &sector_size);
+    if (rc < 0) {
+        return rc;
+    }
+    end = sector_off + sector_size;
+
+    while (start < end) {
+        chunk_start = start;
+        chunk_end = end;
+
+        if (end - start > max_sz) {
+            if (backwards) {
+                /* Round the start of the chunk up to a sector boundary, or
+                 * down if the sector alone is larger than max_sz.
+                 */
+                rc = boot_area_get_sector(fa, idx, end - max_sz, &sector_off, &sector_size);
+                if (rc < 0) {
+                    return rc;
+                }
+
+                chunk_start = sector_off;
+                if (chunk_start < end - max_sz &&
+                    chunk_start + sector_size < end) {
+                    chunk_start += sector_size;
+                }
+            } else {
+                /* Round the end of the chunk down to a sector boundary, or
+                 * up if the sector alone is larger than max_sz.
+                 */
+                rc = boot_area_get_sector(fa, idx, start + max_sz, &sector_off, &sector_size);
+                if (rc < 0) {
+                    return rc;
+                }
+
+                chunk_end = sector_off;
+                if (chunk_end <= start) {
+                    chunk_end += sector_size;
+                }
+            }
+        }
+
+        rc = boot_erase_sectors(fa, chunk_start, chunk_end - chunk_start);
+        if (rc < 0) {
+            return rc;
+        }
+
+        MCUBOOT_WATCHDOG_FEED();
+
+        if (backwards) {
+            end = chunk_start;
+        } else {
+            start = chunk_end;
+        }
+    }
+
+    return 0;
+}
+#endif /* MCUBOOT_FLASH_AREA_ERASE_RANGE */
+
+/*
+ * Erases a region, with the sectors looked up in idx, if not NULL, before
+ * asking the flash map backend.
+ */
+static int
+boot_erase_region_common(const struct flash_area *fa, const struct boot_sector_index *idx,
+                         uint32_t off, uint32_t size, bool backwards)
+{
+    bench_phase_t bench;
+    uint32_t total_size = size;
     int rc = 0;
 
+    boot_bench_phase_start(&bench);
+
     BOOT_LOG_DBG("boot_erase_region: flash_area %p, offset %" PRIu32 ""
                  ", size %" PRIu32 ", backwards == %" PRIu8,
                  fa, off, size, (int)backwards);
@@ -229,19 +616,30 @@ boot_erase_region(const struct flash_area *fa, uint32_t off, uint32_t size, bool
         goto end;
     } else if (device_requires_erase(fa)) {
         uint32_t end_offset = 0;
-        struct flash_sector sector;
+        uint32_t sector_off;
+        uint32_t sector_size;
+#ifdef MCUBOOT_FLASH_AREA_ERASE_RANGE
+        uint32_t max_erase_sz = flash_area_get_max_erase_size(fa);
+#endif
 
         BOOT_LOG_DBG("boot_erase_region: device with erase");
 
+#ifdef MCUBOOT_FLASH_AREA_ERASE_RANGE
+        if (max_erase_sz != 0) {
+            rc = boot_erase_region_batched(fa, idx, off, size, backwards, max_erase_sz);
+            goto end;
+        }
+#endif
+
         if (backwards) {
             /* Get the lowest page offset first */
-            rc = flash_area_get_sector(fa, off, &sector);
+            rc = boot_area_get_sector(fa, idx, off, &sector_off, &sector_size);
 
             if (rc < 0) {
                 goto end;
             }
 
-            end_offset = flash_sector_get_off(&sector);
+            end_offset = sector_off;
 
             /* Set boundary condition, the highest probable offset to erase, within
              * last sector to erase
@@ -249,31 +647,27 @@ boot_erase_region(const struct flash_area *fa, uint32_t off, uint32_t size, bool
             off += size - 1;
         } else {
             /* Get the highest page offset first */
-            rc = flash_area_get_sector(fa, (off + size - 1), &sector);
+            rc = boot_area_get_sector(fa, idx, (off + size - 1), &sector_off, &sector_size);
 
             if (rc < 0) {
                 goto end;
             }
 
-            end_offset = flash_sector_get_off(&sector);
+            end_offset = sector_off;
         }
 
         while (true) {
-            /* Size to read in this iteration */
-            size_t csize;
-
             /* Get current sector and, also, correct offset */
-            rc = flash_area_get_sector(fa, off, &sector);
+            rc = boot_area_get_sector(fa, idx, off, &sector_off, &sector_size);
 
             if (rc < 0) {
                 goto end;
             }
 
-            /* Corrected offset and size of current sector to erase */
-            off = flash_sector_get_off(&sector);
-            csize = flash_sector_get_size(&sector);
+            /* Corrected offset of current sector to erase */
+            off = sector_off;
 
-            rc = flash_area_erase(fa, off, csize);
+            rc = boot_erase_sectors(fa, off, sector_size);
 
             if (rc < 0) {
                 goto end;
@@ -293,7 +687,7 @@ boot_erase_region(const struct flash_area *fa, uint32_t off, uint32_t size, bool
                 off -= 1;
             } else {
                 /* Move up to next sector */
-                off += csize;
+                off += sector_size;
 
                 if (off > end_offset) {
                     /* Reached the end offset in range and already erased it */
@@ -311,9 +705,25 @@ boot_erase_region(const struct flash_area *fa, uint32_t off, uint32_t size, bool
     }
 
 end:
+    boot_bench_phase_stop(&bench, BOOT_BENCH_ERASE, total_size);
     return rc;
 }
 
+int
+boot_erase_region(const struct flash_area *fa, uint32_t off, uint32_t size, bool backwards)
+{
+    return boot_erase_region_common(fa, NULL, off, size, backwards);
+}
+
+#ifdef MCUBOOT_SECTOR_INDEX
+int
+boot_erase_region_indexed(const struct flash_area *fa, const struct boot_sector_index *idx,
+                          uint32_t off, uint32_t size, bool backwards)
+{
+    return boot_erase_region_common(fa, idx, off, size, backwards);
+}
+#endif
+
 int
 boot_scramble_region(const struct flash_area *fa, uint32_t off, uint32_t size, bool backwards)
 {
@@ -34,6 +34,7 @@
 #include <stdint.h>
 #include <flash_map_backend/flash_map_backend.h>
 #include <mcuboot_config/mcuboot_config.h>
+#include <bootutil/bootutil_public.h>
 
 #if MCUBOOT_SWAP_USING_MOVE
 #define BOOT_STATUS_MOVE_STATE_COUNT    1
@@ -50,6 +51,86 @@
 #define BOOT_MAX_IMG_SECTORS            MCUBOOT_MAX_IMG_SECTORS
 #define BOOT_STATUS_MAX_ENTRIES         BOOT_MAX_IMG_SECTORS
 
+#ifdef MCUBOOT_SWAP_STATUS_JOURNAL
+#if !defined(MCUBOOT_SWAP_USING_MOVE) && !defined(MCUBOOT_SWAP_USING_OFFSET)
+#error "MCUBOOT_SWAP_STATUS_JOURNAL requires MCUBOOT_SWAP_USING_MOVE or MCUBOOT_SWAP_USING_OFFSET"
+#endif
+#ifdef MCUBOOT_ENC_IMAGES
+#error "MCUBOOT_SWAP_STATUS_JOURNAL is not supported with MCUBOOT_ENC_IMAGES"
+#endif
+
+/* Number of swap steps each journal record is written for */
+#ifndef MCUBOOT_SWAP_STATUS_JOURNAL_GROUP
+#define MCUBOOT_SWAP_STATUS_JOURNAL_GROUP   8
+#endif
+
+#if MCUBOOT_SWAP_STATUS_JOURNAL_GROUP < 1
+#error "MCUBOOT_SWAP_STATUS_JOURNAL_GROUP must be at least 1"
+#endif
+
+/*
+ * Number of resets during a swap the journal has room for. A reset while a
+ * record is written leaves it torn, and the record is written again after
+ * the torn one.
+ */
+#ifndef MCUBOOT_SWAP_STATUS_JOURNAL_RESUMES
+#define MCUBOOT_SWAP_STATUS_JOURNAL_RESUMES 8
+#endif
+
+/* Size of the truncated hashes held by journal records */
+#define BOOT_STATUS_JOURNAL_HASH_SZ     8
+
+/*
+ * With the journal, the swap status is not kept as one entry per swap step
+ * but as records written one after the other, each before a group of up to
+ * MCUBOOT_SWAP_STATUS_JOURNAL_GROUP steps. A record holds, for each step of
+ * its group, the hash of the data the step writes: when resuming, the steps
+ * whose destination already holds it are done. Groups do not span the move
+ * and swap phases, so each phase has its own groups.
+ */
+#define BOOT_STATUS_JOURNAL_GROUPS(steps)                                   \
+    (((steps) + MCUBOOT_SWAP_STATUS_JOURNAL_GROUP - 1) /                    \
+     MCUBOOT_SWAP_STATUS_JOURNAL_GROUP)
+
+#ifdef MCUBOOT_SWAP_USING_MOVE
+#define BOOT_STATUS_JOURNAL_RECORDS                                         \
+    (BOOT_STATUS_JOURNAL_GROUPS(BOOT_STATUS_MAX_ENTRIES *                   \
+                                BOOT_STATUS_MOVE_STATE_COUNT) +             \
+     BOOT_STATUS_JOURNAL_GROUPS(BOOT_STATUS_MAX_ENTRIES *                   \
+                                BOOT_STATUS_SWAP_STATE_COUNT) +             \
+     MCUBOOT_SWAP_STATUS_JOURNAL_RESUMES)
+#else
+#define BOOT_STATUS_JOURNAL_RECORDS                                         \
+    (BOOT_STATUS_JOURNAL_GROUPS(BOOT_STATUS_MAX_ENTRIES *                   \
+                                BOOT_STATUS_SWAP_STATE_COUNT) +             \
+     MCUBOOT_SWAP_STATUS_JOURNAL_RESUMES)
+#endif
+
+struct boot_status_record {
+    uint32_t entry;     /* Status entry of the first step of the group */
+    uint32_t count;     /* Number of steps in the group */
+    uint8_t hash[MCUBOOT_SWAP_STATUS_JOURNAL_GROUP][BOOT_STATUS_JOURNAL_HASH_SZ];
+    uint8_t check[BOOT_STATUS_JOURNAL_HASH_SZ]; /* Hash of the fields above */
+};
+
+/* Size of struct boot_status_record, for the preprocessor */
+#define BOOT_STATUS_JOURNAL_RECORD_SZ                                       \
+    (8 + (MCUBOOT_SWAP_STATUS_JOURNAL_GROUP + 1) * BOOT_STATUS_JOURNAL_HASH_SZ)
+
+/*
+ * A record takes 8 bytes per step and 16 bytes more, so the journal is only
+ * smaller than one entry per step with writes of 16 bytes or more. It is only
+ * used when it is smaller for the write size of the slots, the swap status
+ * being otherwise kept one entry per step; it must at least be for the
+ * largest write size supported.
+ */
+#if BOOT_STATUS_JOURNAL_RECORDS *                                           \
+    ALIGN_UP(BOOT_STATUS_JOURNAL_RECORD_SZ, BOOT_MAX_ALIGN) >=              \
+    BOOT_STATUS_MAX_ENTRIES * BOOT_STATUS_STATE_COUNT * BOOT_MAX_ALIGN
+#error "MCUBOOT_SWAP_STATUS_JOURNAL is not smaller than the swap status it replaces with writes of BOOT_MAX_ALIGN bytes"
+#endif
+#endif
+
 #define BOOT_STATUS_SOURCE_NONE         0
 #define BOOT_STATUS_SOURCE_SCRATCH      1
 #define BOOT_STATUS_SOURCE_PRIMARY_SLOT 2
@@ -68,6 +149,33 @@
 #define device_requires_erase(fa) (true)
 #endif
 
+#ifdef MCUBOOT_SECTOR_INDEX
+#ifndef MCUBOOT_SECTOR_INDEX_MAX_RUNS
+#define MCUBOOT_SECTOR_INDEX_MAX_RUNS   4
+#endif
+
+/** A run of adjacent sectors of the same size. */
+struct boot_sector_run {
+    uint32_t off;       /* Offset of the first sector within the area */
+    uint32_t size;      /* Size of each sector */
+    uint32_t count;     /* Number of sectors */
+};
+
+/**
+ * Sector layout of a flash area, run length encoded so that the sector
+ * containing an offset can be found without querying the flash map backend.
+ * An index with no runs is empty, e.g. because the layout did not fit, and
+ * lookups through it fall back to flash_area_get_sector().
+ */
+struct boot_sector_index {
+    uint32_t num_runs;
+    struct boot_sector_run runs[MCUBOOT_SECTOR_INDEX_MAX_RUNS];
+};
+#else
+/* Only passed around as a NULL pointer without the index */
+struct boot_sector_index;
+#endif /* MCUBOOT_SECTOR_INDEX */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -78,6 +186,15 @@ extern "C" {
  */
 uint32_t boot_status_sz(uint32_t min_write_sz);
 
+#ifdef MCUBOOT_SWAP_STATUS_JOURNAL
+/**
+ * Whether the swap status is kept as a journal with writes of min_write_sz
+ * bytes, which is only the case when it takes less space than one entry per
+ * swap step.
+ */
+bool boot_status_journal_used(uint32_t min_write_sz);
+#endif
+
 /**
  * Amount of space used to maintain progress information for all swap
  * operations as well as to save information required when doing a swap,
@@ -105,6 +222,19 @@ uint32_t boot_scratch_trailer_sz(uint32_t min_write_sz);
  */
 int boot_trailer_scramble_offset(const struct flash_area *fa, size_t alignment, size_t *off);
 
+/**
+ * Get the size of bulk transfers to do on a flash area, given the size of the
+ * buffer available. The result is the largest multiple of the optimal I/O
+ * size of the device that fits in the buffer, or the size of the buffer if
+ * the flash map backend does not report an optimal I/O size.
+ *
+ * @param fa      The flash_area to transfer data from or to.
+ * @param max_sz  Size of the buffer used for transfers.
+ *
+ * @return Size of the transfers, never larger than @p max_sz.
+ */
+uint32_t boot_io_chunk_sz(const struct flash_area *fa, uint32_t max_sz);
+
 /**
  * Erases a region of device that requires erase prior to write; does
  * nothing on devices without erase.
@@ -119,6 +249,91 @@ int boot_trailer_scramble_offset(const struct flash_area *fa, size_t alignment,
  */
 int boot_erase_region(const struct flash_area *fap, uint32_t off, uint32_t sz, bool backwards);
 
+#ifdef MCUBOOT_SECTOR_INDEX
+/**
+ * Empties a sector index.
+ *
+ * @param idx  The index to empty.
+ */
+void boot_sector_index_init(struct boot_sector_index *idx);
+
+/**
+ * Appends a sector to a sector index; sectors must be added in increasing
+ * offset order. On failure the index is left empty.
+ *
+ * @param idx   The index to add the sector to.
+ * @param off   The offset of the sector within the flash area.
+ * @param size  The size of the sector.
+ *
+ * @return 0 on success; nonzero if the sector is out of order or the index
+ *         has no room left for a new run.
+ */
+int boot_sector_index_add(struct boot_sector_index *idx, uint32_t off, uint32_t size);
+
+/**
+ * Builds the sector index of a flash area, querying the flash map backend
+ * once per sector.
+ *
+ * @param idx  The index to fill.
+ * @param fa   The flash_area to index.
+ *
+ * @return 0 on success; nonzero on failure, in which case the index is empty.
+ */
+int boot_sector_index_build(struct boot_sector_index *idx, const struct flash_area *fa);
+
+/**
+ * Finds the sector containing an offset.
+ *
+ * @param idx          The index to search.
+ * @param off          The offset within the flash area.
+ * @param sector_off   Pointer to variable to store the offset of the sector.
+ * @param sector_size  Pointer to variable to store the size of the sector.
+ *
+ * @return 0 on success; nonzero if the index is empty or does not cover @p off.
+ */
+int boot_sector_index_find(const struct boot_sector_index *idx, uint32_t off,
+                           uint32_t *sector_off, uint32_t *sector_size);
+
+/**
+ * Gets a sector by its number.
+ *
+ * @param idx          The index to search.
+ * @param n            The number of the sector, counting from the start of the area.
+ * @param sector_off   Pointer to variable to store the offset of the sector.
+ * @param sector_size  Pointer to variable to store the size of the sector.
+ *
+ * @return 0 on success; nonzero if the index holds fewer than @p n + 1 sectors,
+ *         in which case both are set to 0.
+ */
+int boot_sector_index_get(const struct boot_sector_index *idx, uint32_t n,
+                          uint32_t *sector_off, uint32_t *sector_size);
+
+/**
+ * Gets the number of sectors in a sector index.
+ *
+ * @param idx  The index.
+ *
+ * @return The number of sectors, 0 if the index is empty.
+ */
+uint32_t boot_sector_index_count(const struct boot_sector_index *idx);
+
+/**
+ * Same as boot_erase_region(), with the sectors to erase looked up in the
+ * given index of the flash area rather than by the flash map backend.
+ *
+ * @param fa         The flash_area containing the region to erase.
+ * @param idx        The sector index of @p fa, or NULL.
+ * @param off        The offset within the flash area to start the erase.
+ * @param size       The number of bytes to erase.
+ * @param backwards  If set to true will erase from end to start addresses, otherwise erases from
+ *                   start to end addresses.
+ *
+ * @return 0 on success; nonzero on failure.
+ */
+int boot_erase_region_indexed(const struct flash_area *fa, const struct boot_sector_index *idx,
+                              uint32_t off, uint32_t size, bool backwards);
+#endif /* MCUBOOT_SECTOR_INDEX */
+
 /**
  * Removes data from specified region either by writing erase value in place of data or by doing
  * erase, if device has such hardware requirement.
@@ -156,6 +371,76 @@ int boot_scramble_region(const struct flash_area *fap, uint32_t off, uint32_t sz
  */
 int boot_scramble_slot(const struct flash_area *fap, int slot);
 
+#ifdef MCUBOOT_FLASH_AREA_OPTIMAL_IO_SIZE
+/**
+ * Returns the transfer size the device of the flash area is most efficient
+ * with, e.g. its program page or erase block size; to be provided by the flash
+ * map backend when MCUBOOT_FLASH_AREA_OPTIMAL_IO_SIZE is enabled.
+ *
+ * @return Optimal transfer size in bytes, or 0 if unknown.
+ */
+uint32_t flash_area_get_optimal_io_size(const struct flash_area *fa);
+#endif /* MCUBOOT_FLASH_AREA_OPTIMAL_IO_SIZE */
+
+#ifdef MCUBOOT_FLASH_AREA_IS_ERASED
+/**
+ * Checks whether a region of a flash area is erased, e.g. with the blank
+ * check command of the device; to be provided by the flash map backend when
+ * MCUBOOT_FLASH_AREA_IS_ERASED is enabled. Used by MCUBOOT_SKIP_ERASED_SECTORS
+ * instead of reading the region back.
+ *
+ * @return true if the whole region is erased; false if it is not, or if
+ *         that could not be determined.
+ */
+bool flash_area_is_erased(const struct flash_area *fa, uint32_t off, uint32_t len);
+#endif /* MCUBOOT_FLASH_AREA_IS_ERASED */
+
+#ifdef MCUBOOT_FLASH_AREA_ERASE_RANGE
+/**
+ * Returns the largest number of bytes flash_area_erase() should be given in
+ * one call, for a region that starts and ends on sector boundaries; to be
+ * provided by the flash map backend when MCUBOOT_FLASH_AREA_ERASE_RANGE is
+ * enabled. This lets the backend use block or chip erase commands, while
+ * keeping each call short enough for the watchdog to be fed in between.
+ *
+ * @return Maximum erase size in bytes, or 0 to erase one sector per call.
+ */
+uint32_t flash_area_get_max_erase_size(const struct flash_area *fa);
+#endif /* MCUBOOT_FLASH_AREA_ERASE_RANGE */
+
+#ifdef MCUBOOT_FLASH_AREA_ASYNC
+/*
+ * Asynchronous flash access, to be provided by the flash map backend when
+ * MCUBOOT_FLASH_AREA_ASYNC is enabled. A transfer started by one of the
+ * *_async functions owns the passed buffer until flash_area_async_wait()
+ * returns for the same device; the backend may also complete the transfer
+ * before returning.
+ */
+
+/**
+ * Starts reading @p len bytes at @p off of the area into @p dst.
+ *
+ * @return 0 if the transfer was started; nonzero on failure.
+ */
+int flash_area_read_async(const struct flash_area *fa, uint32_t off, void *dst,
+                          uint32_t len);
+
+/**
+ * Starts programming @p len bytes from @p src at @p off of the area.
+ *
+ * @return 0 if the transfer was started; nonzero on failure.
+ */
+int flash_area_write_async(const struct flash_area *fa, uint32_t off, const void *src,
+                           uint32_t len);
+
+/**
+ * Waits for all transfers started on the device of the area to complete.
+ *
+ * @return 0 if all transfers succeeded; nonzero on failure.
+ */
+int flash_area_async_wait(const struct flash_area *fa);
+#endif /* MCUBOOT_FLASH_AREA_ASYNC */
+
 #ifdef __cplusplus
 }
 #endif
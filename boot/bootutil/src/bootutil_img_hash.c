@@ -28,6 +28,7 @@
 
 #include <stdint.h>
 #include <inttypes.h>
+#include <string.h>
 #include <flash_map_backend/flash_map_backend.h>
 
 #include "bootutil/crypto/sha.h"
@@ -39,6 +40,144 @@
 BOOT_LOG_MODULE_DECLARE(mcuboot);
 
 #ifndef MCUBOOT_SIGN_PURE
+#ifdef MCUBOOT_HASH_HW_ENGINE
+/*
+ * Hash the image with the SHA engine of the port. Images in RAM or in
+ * directly hashed storage are handed to the engine as a whole. Otherwise
+ * tmp_buf is split in two, so that the next chunk is read, and decrypted if
+ * needed, while the engine hashes the previous one.
+ *
+ * @return 0 on success; nonzero if the engine is unavailable or anything
+ *         failed, in which case the image must be hashed in software.
+ */
+static int
+bootutil_img_hash_hw(struct boot_loader_state *state,
+                     struct image_header *hdr, const struct flash_area *fap,
+                     uint8_t *tmp_buf, uint32_t tmp_buf_sz, uint8_t *hash_result,
+                     uint8_t *seed, int seed_len)
+{
+    uint32_t size;
+    int rc;
+#if !defined(MCUBOOT_HASH_STORAGE_DIRECTLY) && !defined(MCUBOOT_RAM_LOAD)
+    uint8_t *buf;
+    uint32_t hdr_size;
+    uint32_t tlv_off;
+    uint32_t off;
+    uint32_t blk_sz;
+    uint32_t max_sz;
+    uint32_t read_off = 0;
+    int cur = 0;
+#endif
+#ifdef MCUBOOT_HASH_STORAGE_DIRECTLY
+    uintptr_t base = 0;
+#endif
+#if defined(MCUBOOT_ENC_IMAGES) && !defined(MCUBOOT_HASH_STORAGE_DIRECTLY) && \
+    !defined(MCUBOOT_RAM_LOAD)
+    int image_index = (state == NULL) ? 0 : BOOT_CURR_IMG(state);
+#endif
+
+    (void)state;
+
+    if (boot_hw_sha_init() != 0) {
+        return -1;
+    }
+
+    rc = 0;
+    if (seed && (seed_len > 0)) {
+        rc = boot_hw_sha_update_async(seed, seed_len);
+        if (rc == 0) {
+            rc = boot_hw_sha_wait();
+        }
+    }
+
+    size = hdr->ih_hdr_size + hdr->ih_img_size + hdr->ih_protect_tlv_size;
+
+#if defined(MCUBOOT_HASH_STORAGE_DIRECTLY)
+    (void)tmp_buf;
+    (void)tmp_buf_sz;
+    if (flash_device_base(flash_area_get_device_id(fap), &base) != 0) {
+        base = 0;
+    }
+    if (rc == 0) {
+        rc = boot_hw_sha_update_async((void *)(base + flash_area_get_off(fap)), size);
+    }
+#elif defined(MCUBOOT_RAM_LOAD)
+    (void)fap;
+    (void)tmp_buf;
+    (void)tmp_buf_sz;
+    if (rc == 0) {
+        rc = boot_hw_sha_update_async((void *)(IMAGE_RAM_BASE + hdr->ih_load_addr), size);
+    }
+#else
+#if defined(MCUBOOT_SWAP_USING_OFFSET)
+    read_off = boot_get_state_secondary_offset(state, fap);
+#endif
+    hdr_size = hdr->ih_hdr_size;
+    tlv_off = hdr_size + hdr->ih_img_size;
+    max_sz = boot_io_chunk_sz(fap, tmp_buf_sz / 2);
+    if (max_sz == 0) {
+        rc = -1;
+    }
+    (void)tlv_off;
+
+    for (off = 0; rc == 0 && off < size; off += blk_sz) {
+        blk_sz = size - off;
+        if (blk_sz > max_sz) {
+            blk_sz = max_sz;
+        }
+#ifdef MCUBOOT_ENC_IMAGES
+        if ((off < hdr_size) && ((off + blk_sz) > hdr_size)) {
+            blk_sz = hdr_size - off;
+        }
+        if ((off < tlv_off) && ((off + blk_sz) > tlv_off)) {
+            blk_sz = tlv_off - off;
+        }
+#endif
+
+        /* The engine may still be hashing the other half of tmp_buf */
+        buf = tmp_buf + cur * max_sz;
+        rc = flash_area_read(fap, read_off + off, buf, blk_sz);
+        if (rc != 0) {
+            break;
+        }
+#ifdef MCUBOOT_ENC_IMAGES
+        if (MUST_DECRYPT(fap, image_index, hdr) && off >= hdr_size && off < tlv_off) {
+            int slot = flash_area_id_to_multi_image_slot(image_index,
+                            flash_area_get_id(fap));
+
+            rc = boot_enc_decrypt(BOOT_CURR_ENC_SLOT(state, slot), off - hdr_size,
+                                  blk_sz, (off - hdr_size) & 0xf, buf);
+            if (rc != 0) {
+                break;
+            }
+        }
+#endif
+
+        rc = boot_hw_sha_wait();
+        if (rc == 0) {
+            rc = boot_hw_sha_update_async(buf, blk_sz);
+        }
+        cur ^= 1;
+    }
+#endif /* MCUBOOT_HASH_STORAGE_DIRECTLY */
+
+    /* Always wait, the engine must not be left reading tmp_buf */
+    if (boot_hw_sha_wait() != 0) {
+        rc = -1;
+    }
+    if (rc == 0) {
+        rc = boot_hw_sha_finish(hash_result);
+    }
+    boot_hw_sha_drop();
+
+    if (rc != 0) {
+        BOOT_LOG_DBG("bootutil_img_hash: SHA engine failed (%d), hashing in software", rc);
+    }
+
+    return rc;
+}
+#endif /* MCUBOOT_HASH_HW_ENGINE */
+
 /*
  * Compute SHA hash over the image.
  * (SHA384 if ECDSA-P384 is being used,
@@ -60,6 +199,7 @@ bootutil_img_hash(struct boot_loader_state *state,
     int rc;
     uint32_t off;
     uint32_t blk_sz;
+    uint32_t max_sz;
 #endif
 #ifdef MCUBOOT_HASH_STORAGE_DIRECTLY
     uintptr_t base = 0;
@@ -80,6 +220,7 @@ bootutil_img_hash(struct boot_loader_state *state,
     (void)tlv_off;
 #ifdef MCUBOOT_RAM_LOAD
     (void)blk_sz;
+    (void)max_sz;
     (void)off;
     (void)rc;
     (void)fap;
@@ -111,6 +252,13 @@ bootutil_img_hash(struct boot_loader_state *state,
     sector_off = boot_get_state_secondary_offset(state, fap);
 #endif
 
+#ifdef MCUBOOT_HASH_HW_ENGINE
+    if (bootutil_img_hash_hw(state, hdr, fap, tmp_buf, tmp_buf_sz, hash_result,
+                             seed, seed_len) == 0) {
+        return 0;
+    }
+#endif
+
     bootutil_sha_init(&sha_ctx);
 
     /* in some cases (split image) the hash is seeded with data from
@@ -143,10 +291,12 @@ bootutil_img_hash(struct boot_loader_state *state,
                         (void*)(IMAGE_RAM_BASE + hdr->ih_load_addr),
                         size);
 #else
+    max_sz = boot_io_chunk_sz(fap, tmp_buf_sz);
+
     for (off = 0; off < size; off += blk_sz) {
         blk_sz = size - off;
-        if (blk_sz > tmp_buf_sz) {
-            blk_sz = tmp_buf_sz;
+        if (blk_sz > max_sz) {
+            blk_sz = max_sz;
         }
 #ifdef MCUBOOT_ENC_IMAGES
         /* The only data that is encrypted in an image is the payload;
@@ -181,8 +331,12 @@ bootutil_img_hash(struct boot_loader_state *state,
 
             if (off >= hdr_size && off < tlv_off) {
                 blk_off = (off - hdr_size) & 0xf;
-                boot_enc_decrypt(BOOT_CURR_ENC_SLOT(state, slot), off - hdr_size,
-                                 blk_sz, blk_off, tmp_buf);
+                rc = boot_enc_decrypt(BOOT_CURR_ENC_SLOT(state, slot), off - hdr_size,
+                                      blk_sz, blk_off, tmp_buf);
+                if (rc) {
+                    bootutil_sha_drop(&sha_ctx);
+                    return rc;
+                }
             }
         }
 #endif
@@ -196,3 +350,131 @@ bootutil_img_hash(struct boot_loader_state *state,
     return 0;
 }
 #endif /* !MCUBOOT_SIGN_PURE */
+
+#if defined(MCUBOOT_SECTOR_HASHES)
+/*
+ * Check the sectors of the image hdr and body that overlap the range
+ * [off, off + len) against the hashes in the IMAGE_TLV_SECTOR_HASHES TLV.
+ *
+ * The TLV is in the protected area, so that once the image signature has
+ * been checked, each sector can be trusted on its own. It holds the sector
+ * size as a 32-bit little endian value followed by one hash per sector,
+ * the last sector possibly being shorter.
+ *
+ * @return 0 if all sectors in the range match; BOOT_EFILE if the image has
+ *         no sector hashes; BOOT_EBADIMAGE, with the offset of the first
+ *         bad sector in @p bad_off, on mismatch; other nonzero values on
+ *         failure or if the TLV is malformed.
+ */
+int
+bootutil_img_check_sectors(struct boot_loader_state *state,
+                           struct image_header *hdr, const struct flash_area *fap,
+                           uint32_t off, uint32_t len,
+                           uint8_t *tmp_buf, uint32_t tmp_buf_sz,
+                           uint32_t *bad_off)
+{
+    bootutil_sha_context sha_ctx;
+    struct image_tlv_iter it;
+    uint8_t hash[IMAGE_HASH_SIZE];
+    uint8_t expected[IMAGE_HASH_SIZE];
+    uint32_t tlv_off;
+    uint16_t tlv_len;
+    uint32_t sector_sz;
+    uint32_t hashed_sz;
+    uint32_t sector_end;
+    uint32_t end;
+    uint32_t pos;
+    uint32_t blk_sz;
+    uint32_t max_sz;
+    uint32_t base = 0;
+    int rc;
+
+    if (hdr->ih_protect_tlv_size == 0) {
+        return BOOT_EFILE;
+    }
+
+#if defined(MCUBOOT_SWAP_USING_OFFSET)
+    base = boot_get_state_secondary_offset(state, fap);
+    it.start_off = base;
+#else
+    (void)state;
+#endif
+
+    rc = bootutil_tlv_iter_begin(&it, hdr, fap, IMAGE_TLV_SECTOR_HASHES, true);
+    if (rc) {
+        return rc;
+    }
+
+    rc = bootutil_tlv_iter_next(&it, &tlv_off, &tlv_len, NULL);
+    if (rc > 0) {
+        return BOOT_EFILE;
+    } else if (rc < 0) {
+        return BOOT_EFLASH;
+    }
+
+    if (tlv_len < sizeof(sector_sz)) {
+        return -1;
+    }
+
+    rc = LOAD_IMAGE_DATA(hdr, fap, tlv_off, &sector_sz, sizeof(sector_sz));
+    if (rc) {
+        return BOOT_EFLASH;
+    }
+
+    hashed_sz = hdr->ih_hdr_size + hdr->ih_img_size;
+    if (sector_sz == 0 ||
+        tlv_len != sizeof(sector_sz) +
+                   (hashed_sz / sector_sz + (hashed_sz % sector_sz != 0)) *
+                   IMAGE_HASH_SIZE) {
+        return -1;
+    }
+
+    /* Only the image hdr and body are covered, extend the range to whole
+     * sectors.
+     */
+    if (off >= hashed_sz || len == 0) {
+        return 0;
+    }
+    end = (len > hashed_sz - off) ? hashed_sz : off + len;
+    off -= off % sector_sz;
+
+    max_sz = boot_io_chunk_sz(fap, tmp_buf_sz);
+
+    for (; off < end; off = sector_end) {
+        sector_end = (sector_sz > hashed_sz - off) ? hashed_sz : off + sector_sz;
+
+        bootutil_sha_init(&sha_ctx);
+        for (pos = off; pos < sector_end; pos += blk_sz) {
+            blk_sz = sector_end - pos;
+            if (blk_sz > max_sz) {
+                blk_sz = max_sz;
+            }
+
+            rc = LOAD_IMAGE_DATA(hdr, fap, base + pos, tmp_buf, blk_sz);
+            if (rc) {
+                bootutil_sha_drop(&sha_ctx);
+                return BOOT_EFLASH;
+            }
+            bootutil_sha_update(&sha_ctx, tmp_buf, blk_sz);
+        }
+        bootutil_sha_finish(&sha_ctx, hash);
+        bootutil_sha_drop(&sha_ctx);
+
+        rc = LOAD_IMAGE_DATA(hdr, fap,
+                             tlv_off + sizeof(sector_sz) + (off / sector_sz) * IMAGE_HASH_SIZE,
+                             expected, sizeof(expected));
+        if (rc) {
+            return BOOT_EFLASH;
+        }
+
+        if (memcmp(hash, expected, sizeof(hash)) != 0) {
+            if (bad_off != NULL) {
+                *bad_off = off;
+            }
+            return BOOT_EBADIMAGE;
+        }
+    }
+
+    return 0;
+}
+#endif /* MCUBOOT_SECTOR_HASHES */
@@ -35,6 +35,7 @@
 #include "bootutil_loader.h"
 #include "bootutil/boot_record.h"
 #include "bootutil/boot_hooks.h"
+#include "bootutil/bench.h"
 #ifdef MCUBOOT_ENC_IMAGES
 #include "bootutil/enc_key.h"
 #endif
@@ -115,12 +116,41 @@ boot_check_header_valid(struct boot_loader_state *state, int slot)
     if (IS_COMPRESSED(hdr)) {
         return false;
     }
-#else
+#elif !defined(MCUBOOT_OVERWRITE_ONLY)
+    /* Decompression is left to the port */
     if ((hdr->ih_flags & IMAGE_F_COMPRESSED_LZMA1) &&
         (hdr->ih_flags & IMAGE_F_COMPRESSED_LZMA2))
     {
         return false;
     }
+#else
+    if (IS_COMPRESSED(hdr)) {
+        /* Only LZMA2 images, with or without the ARM thumb filter, which
+         * are not encrypted, can be decompressed into the primary slot.
+         */
+        if (slot == BOOT_SLOT_PRIMARY || IS_ENCRYPTED(hdr) ||
+            (hdr->ih_flags & IMAGE_F_COMPRESSED_LZMA1) ||
+            !(hdr->ih_flags & IMAGE_F_COMPRESSED_LZMA2)) {
+            return false;
+        }
+
+        if (boot_decompressed_size(hdr, fap, &size) != 0 ||
+            size > flash_area_get_size(BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY)) -
+                   boot_trailer_sz(BOOT_WRITE_SZ(state))) {
+            return false;
+        }
+    }
+#endif
+
+#if !defined(MCUBOOT_DELTA_UPDATES)
+    if (IS_DELTA(hdr)) {
+        return false;
+    }
+#else
+    /* A delta image only carries an update, it cannot run */
+    if (IS_DELTA(hdr) && slot == BOOT_SLOT_PRIMARY) {
+        return false;
+    }
 #endif
 
     return true;
@@ -129,6 +159,7 @@ boot_check_header_valid(struct boot_loader_state *state, int slot)
 int
 boot_read_image_headers(struct boot_loader_state *state, bool require_all, struct boot_status *bs)
 {
+    bench_phase_t bench;
     int rc;
     int i;
 
@@ -137,7 +168,9 @@ boot_read_image_headers(struct boot_loader_state *state, bool require_all, struc
                             BOOT_CURR_IMG(state), i, boot_img_hdr(state, i));
         if (rc == BOOT_HOOK_REGULAR)
         {
+            boot_bench_phase_start(&bench);
             rc = boot_read_image_header(state, i, boot_img_hdr(state, i), bs);
+            boot_bench_phase_stop(&bench, BOOT_BENCH_HDR_READ, sizeof(struct image_header));
         }
         if (rc != 0) {
             /* If `require_all` is set, fail on any single fail, otherwise
@@ -157,14 +190,132 @@ boot_read_image_headers(struct boot_loader_state *state, bool require_all, struc
     return 0;
 }
 
+#ifdef MCUBOOT_VALIDATED_HASH_CACHE
+/**
+ * Checks whether the image in a slot may be validated against the hash kept
+ * in the trailer of the slot: that is the case for images which are run in
+ * place, as the boot loader does not write to their slot before booting them.
+ */
+static bool
+boot_hash_cache_usable(int slot)
+{
+#if defined(MCUBOOT_DIRECT_XIP)
+    (void)slot;
+    return true;
+#else
+    return slot == BOOT_SLOT_PRIMARY;
+#endif
+}
+#endif
+
+#ifdef MCUBOOT_HASH_WORKER
+static void
+boot_hash_ahead_run(void *arg)
+{
+    TARGET_STATIC uint8_t tmpbuf[BOOT_IO_BUF_SZ] __attribute__((aligned(4)));
+    struct boot_hash_ahead *ahead = arg;
+    int rc;
+
+    /* Unencrypted images only, so no state is needed */
+    rc = bootutil_img_hash(NULL, &ahead->hdr, ahead->area, tmpbuf, BOOT_IO_BUF_SZ,
+                           ahead->hash, NULL, 0);
+    ahead->valid = (rc == 0);
+}
+
+/**
+ * Checks whether a hash computed ahead, or being computed, is that of the
+ * image currently in a slot.
+ */
+static bool
+boot_hash_ahead_matches(struct boot_loader_state *state, uint8_t image, uint32_t slot)
+{
+    struct boot_hash_ahead *ahead = &state->hash_ahead[image];
+
+    return ahead->slot == slot && ahead->area == state->imgs[image][slot].area &&
+           memcmp(&ahead->hdr, &state->imgs[image][slot].hdr, sizeof(ahead->hdr)) == 0;
+}
+
+void
+boot_hash_ahead(struct boot_loader_state *state, uint8_t image, uint32_t slot)
+{
+    struct boot_hash_ahead *ahead = &state->hash_ahead[image];
+    const struct image_header *hdr = &state->imgs[image][slot].hdr;
+
+    if (boot_hash_ahead_matches(state, image, slot) &&
+        (ahead->valid || (state->hash_running && state->hash_running_img == image))) {
+        /* Already hashed or being hashed */
+        return;
+    }
+
+    boot_hash_join(state);
+    ahead->valid = false;
+
+    if (hdr->ih_magic != IMAGE_MAGIC || IS_ENCRYPTED(hdr) ||
+        (hdr->ih_flags & IMAGE_F_NON_BOOTABLE)) {
+        return;
+    }
+
+    ahead->area = state->imgs[image][slot].area;
+    ahead->hdr = *hdr;
+    ahead->slot = slot;
+
+    if (boot_worker_start(boot_hash_ahead_run, ahead) == 0) {
+        state->hash_running = true;
+        state->hash_running_img = image;
+    }
+}
+
+void
+boot_hash_join(struct boot_loader_state *state)
+{
+    if (state->hash_running) {
+        boot_worker_join();
+        state->hash_running = false;
+    }
+}
+
+/**
+ * Takes the hash computed ahead for a slot of the current image, if the
+ * header of the slot has not changed since.
+ *
+ * @return true if the hash was copied to @p hash, false otherwise.
+ */
+static bool
+boot_hash_take(struct boot_loader_state *state, int slot, uint8_t *hash)
+{
+    uint8_t image = BOOT_CURR_IMG(state);
+    struct boot_hash_ahead *ahead = &state->hash_ahead[image];
+
+    /* Only wait for the worker if it is hashing this image */
+    if (state->hash_running && state->hash_running_img == image) {
+        boot_hash_join(state);
+    }
+
+    if (!ahead->valid || !boot_hash_ahead_matches(state, image, slot)) {
+        return false;
+    }
+
+    ahead->valid = false;
+    memcpy(hash, ahead->hash, IMAGE_HASH_SIZE);
+    return true;
+}
+#endif /* MCUBOOT_HASH_WORKER */
+
 fih_ret
 boot_check_image(struct boot_loader_state *state, struct boot_status *bs, int slot)
 {
-    TARGET_STATIC uint8_t tmpbuf[BOOT_TMPBUF_SZ];
+    TARGET_STATIC uint8_t tmpbuf[BOOT_IO_BUF_SZ] __attribute__((aligned(4)));
     int rc;
     FIH_DECLARE(fih_rc, FIH_FAILURE);
     const struct flash_area *fap = NULL;
     struct image_header *hdr;
+#ifdef MCUBOOT_VALIDATED_HASH_CACHE
+    struct boot_hash_cache rec;
+    uint32_t hashed_sz;
+#endif
+#ifdef MCUBOOT_HASH_WORKER
+    uint8_t hash[IMAGE_HASH_SIZE];
+#endif
 
     fap = BOOT_IMG_AREA(state, slot);
     assert(fap != NULL);
@@ -174,6 +325,44 @@ boot_check_image(struct boot_loader_state *state, struct boot_status *bs, int sl
     (void)bs;
     (void)rc;
 
+#ifdef MCUBOOT_VALIDATED_HASH_CACHE
+    hashed_sz = hdr->ih_hdr_size + hdr->ih_img_size + hdr->ih_protect_tlv_size;
+
+    if (boot_hash_cache_usable(slot) && boot_read_hash_cache(fap, &rec) == 0 &&
+        rec.size == hashed_sz) {
+        /* The cached hash still has to match the hash TLV of the image and
+         * pass the signature check.
+         */
+        FIH_CALL(bootutil_img_validate_with_hash, fih_rc, state, hdr, fap, rec.hash);
+        if (FIH_EQ(fih_rc, FIH_SUCCESS)) {
+            BOOT_LOG_DBG("boot_check_image: slot %d validated from cached hash", slot);
+            FIH_RET(fih_rc);
+        }
+
+        BOOT_LOG_WRN("Image in slot %d does not match its cached hash", slot);
+        (void)boot_invalidate_hash_cache(fap);
+    }
+#endif
+
+#ifdef MCUBOOT_HASH_WORKER
+    if (boot_hash_take(state, slot, hash)) {
+        FIH_CALL(bootutil_img_validate_with_hash, fih_rc, state, hdr, fap, hash);
+        if (FIH_EQ(fih_rc, FIH_SUCCESS)) {
+            BOOT_LOG_DBG("boot_check_image: slot %d validated from hash computed ahead", slot);
+#ifdef MCUBOOT_VALIDATED_HASH_CACHE
+            if (boot_hash_cache_usable(slot)) {
+                memcpy(rec.hash, hash, IMAGE_HASH_SIZE);
+                rec.size = hashed_sz;
+                (void)boot_write_hash_cache(fap, &rec);
+            }
+#endif
+            FIH_RET(fih_rc);
+        }
+
+        /* The slot may have been written since it was hashed */
+    }
+#endif
+
     /* In the case of ram loading the image has already been decrypted as it is
      * decrypted when copied in ram
      */
@@ -190,8 +379,21 @@ boot_check_image(struct boot_loader_state *state, struct boot_status *bs, int sl
     }
 #endif
 
-    FIH_CALL(bootutil_img_validate, fih_rc, state, hdr, fap, tmpbuf, BOOT_TMPBUF_SZ,
+#ifdef MCUBOOT_VALIDATED_HASH_CACHE
+    FIH_CALL(bootutil_img_validate, fih_rc, state, hdr, fap, tmpbuf, BOOT_IO_BUF_SZ,
+             NULL, 0, rec.hash);
+
+    if (boot_hash_cache_usable(slot) && FIH_EQ(fih_rc, FIH_SUCCESS)) {
+        rec.size = hashed_sz;
+        rc = boot_write_hash_cache(fap, &rec);
+        if (rc != 0) {
+            BOOT_LOG_DBG("boot_check_image: hash of slot %d not cached: %d", slot, rc);
+        }
+    }
+#else
+    FIH_CALL(bootutil_img_validate, fih_rc, state, hdr, fap, tmpbuf, BOOT_IO_BUF_SZ,
              NULL, 0, NULL);
+#endif
 
     FIH_RET(fih_rc);
 }
@@ -178,6 +178,45 @@ int boot_open_all_flash_areas(struct boot_loader_state *state);
  */
 void boot_close_all_flash_areas(struct boot_loader_state *state);
 
+#ifdef MCUBOOT_HASH_WORKER
+/*
+ * Worker functions which must be provided by the port when
+ * MCUBOOT_HASH_WORKER is enabled, to run a function on another core or
+ * thread. Only one function is started at a time.
+ */
+
+/**
+ * Starts running fn(arg) on the worker.
+ *
+ * @return 0 on success; nonzero if it could not be started, in which case
+ *         fn is not called.
+ */
+int boot_worker_start(void (*fn)(void *arg), void *arg);
+
+/**
+ * Waits for the function started last to return.
+ */
+void boot_worker_join(void);
+
+/**
+ * Starts hashing the image in a slot of another image on the worker, for
+ * boot_check_image() to use when that image is checked. Does nothing if the
+ * header of the slot is not that of an unencrypted image.
+ *
+ * @param state Bootloader state.
+ * @param image Index of the image.
+ * @param slot  Slot number.
+ */
+void boot_hash_ahead(struct boot_loader_state *state, uint8_t image, uint32_t slot);
+
+/**
+ * Waits for the hash started by boot_hash_ahead(), if any.
+ *
+ * @param state Bootloader state.
+ */
+void boot_hash_join(struct boot_loader_state *state);
+#endif /* MCUBOOT_HASH_WORKER */
+
 #ifdef __cplusplus
 }
 #endif
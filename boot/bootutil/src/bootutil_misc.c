@@ -38,6 +38,7 @@
 #include "bootutil_priv.h"
 #include "bootutil_misc.h"
 #include "bootutil/bootutil_log.h"
+#include "bootutil/bench.h"
 #include "bootutil/fault_injection_hardening.h"
 #ifdef MCUBOOT_ENC_IMAGES
 #include "bootutil/enc_key.h"
@@ -53,7 +54,28 @@
 
 BOOT_LOG_MODULE_DECLARE(mcuboot);
 
-#if !defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0
+#ifdef MCUBOOT_BENCH_PHASES
+static struct boot_bench_phase boot_bench_phase_totals[BOOT_BENCH_PHASE_COUNT];
+
+void
+boot_bench_phase_add(int phase, uint32_t bytes, uint32_t cycles)
+{
+    struct boot_bench_phase *totals = &boot_bench_phase_totals[phase];
+
+    totals->count++;
+    totals->bytes += bytes;
+    totals->cycles += cycles;
+}
+
+const struct boot_bench_phase *
+boot_bench_phases(void)
+{
+    return boot_bench_phase_totals;
+}
+#endif /* MCUBOOT_BENCH_PHASES */
+
+#if (!defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0) && \
+    !defined(MCUBOOT_COMPACT_SECTORS)
 
 #if (!defined(MCUBOOT_DIRECT_XIP) && !defined(MCUBOOT_RAM_LOAD)) || \
 defined(MCUBOOT_SERIAL_IMG_GRP_SLOT_INFO)
@@ -62,7 +84,7 @@ defined(MCUBOOT_SERIAL_IMG_GRP_SLOT_INFO)
  */
 static struct boot_sector_buffer sector_buffers;
 #endif
-#endif /* !defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0 */
+#endif /* (!MCUBOOT_LOGICAL_SECTOR_SIZE || MCUBOOT_LOGICAL_SECTOR_SIZE == 0) && !MCUBOOT_COMPACT_SECTORS */
 
 /**
  * @brief Determine if the data at two memory addresses is equal
@@ -144,6 +166,188 @@ boot_status_off(const struct flash_area *fap)
     return flash_area_get_size(fap) - off_from_end;
 }
 
+void
+boot_status_window_init(struct boot_status_window *win,
+                        const struct flash_area *fap,
+                        uint32_t write_sz, int max_entries)
+{
+    assert(write_sz > 0 && write_sz <= BOOT_STATUS_WINDOW_SZ);
+
+    win->fap = fap;
+    win->off = boot_status_off(fap);
+    win->write_sz = write_sz;
+    win->max_entries = max_entries;
+    win->first = 0;
+    win->count = 0;
+}
+
+int
+boot_status_window_get(struct boot_status_window *win, int idx,
+                       uint8_t *status)
+{
+    int per_window;
+    int rc;
+
+    assert(idx >= 0 && idx < win->max_entries);
+
+    if (idx < win->first || idx >= win->first + win->count) {
+        /* Windows start on multiples of their size, so that scanning the
+         * entries in either direction reads each of them only once.
+         */
+        per_window = BOOT_STATUS_WINDOW_SZ / win->write_sz;
+        win->first = idx - (idx % per_window);
+        win->count = win->max_entries - win->first;
+        if (win->count > per_window) {
+            win->count = per_window;
+        }
+
+        rc = flash_area_read(win->fap, win->off + win->first * win->write_sz,
+                             win->buf, win->count * win->write_sz);
+        if (rc < 0) {
+            win->count = 0;
+            return BOOT_EFLASH;
+        }
+    }
+
+    *status = win->buf[(idx - win->first) * win->write_sz];
+    return 0;
+}
+
+int
+boot_status_window_find_set(struct boot_status_window *win, int idx)
+{
+    uint8_t status;
+    size_t len;
+    size_t off;
+    int rc;
+
+    while (idx < win->max_entries) {
+        rc = boot_status_window_get(win, idx, &status);
+        if (rc != 0) {
+            return rc;
+        }
+
+        /* The padding of written entries stays erased, so the first byte
+         * that is not erased belongs to the first written entry.
+         */
+        len = (win->first + win->count - idx) * win->write_sz;
+        off = bootutil_buffer_first_not_erased(win->fap,
+                  &win->buf[(idx - win->first) * win->write_sz], len);
+        idx += off / win->write_sz;
+        if (off == len) {
+            continue;
+        }
+
+        if (off % win->write_sz == 0) {
+            return idx;
+        }
+
+        /* Only the padding of this entry was written, skip it */
+        idx++;
+    }
+
+    return win->max_entries;
+}
+
+#ifdef MCUBOOT_SWAP_STATUS_JOURNAL
+_Static_assert(sizeof(struct boot_status_record) == BOOT_STATUS_JOURNAL_RECORD_SZ,
+               "Invalid size for swap status journal records");
+
+/* Computes the check of a journal record, over the fields before it */
+static void
+boot_status_journal_check(const struct boot_status_record *rec, uint8_t *check)
+{
+    bootutil_sha_context sha_ctx;
+    uint8_t hash[IMAGE_HASH_SIZE];
+
+    bootutil_sha_init(&sha_ctx);
+    bootutil_sha_update(&sha_ctx, rec, offsetof(struct boot_status_record, check));
+    bootutil_sha_finish(&sha_ctx, hash);
+    bootutil_sha_drop(&sha_ctx);
+
+    memcpy(check, hash, BOOT_STATUS_JOURNAL_HASH_SZ);
+}
+
+/*
+ * Scans the journal records, which are written one after the other up to the
+ * first erased one. Records which do not pass their check were torn by a
+ * reset, and are skipped. Sets rec to the last intact record, with a zero
+ * count if there is none, and free_idx to the index of the first erased
+ * record.
+ */
+static int
+boot_status_journal_scan(const struct flash_area *fap,
+                         struct boot_status_record *rec, int *free_idx)
+{
+    struct boot_status_record cur;
+    uint8_t check[BOOT_STATUS_JOURNAL_HASH_SZ];
+    uint32_t rec_sz = ALIGN_UP(sizeof(cur), flash_area_align(fap));
+    uint32_t off = boot_status_off(fap);
+    int i;
+
+    memset(rec, 0, sizeof(*rec));
+    for (i = 0; i < BOOT_STATUS_JOURNAL_RECORDS; i++) {
+        if (flash_area_read(fap, off + i * rec_sz, &cur, sizeof(cur)) != 0) {
+            return BOOT_EFLASH;
+        }
+
+        if (bootutil_buffer_is_erased(fap, &cur, sizeof(cur))) {
+            break;
+        }
+
+        boot_status_journal_check(&cur, check);
+        if (memcmp(check, cur.check, sizeof(check)) == 0 && cur.count > 0 &&
+            cur.count <= MCUBOOT_SWAP_STATUS_JOURNAL_GROUP) {
+            *rec = cur;
+        }
+    }
+
+    *free_idx = i;
+    return 0;
+}
+
+int
+boot_status_journal_read(const struct flash_area *fap, struct boot_status_record *rec)
+{
+    int free_idx;
+
+    return boot_status_journal_scan(fap, rec, &free_idx);
+}
+
+int
+boot_status_journal_write(const struct flash_area *fap, struct boot_status_record *rec)
+{
+    struct boot_status_record last;
+    uint8_t buf[ALIGN_UP(sizeof(struct boot_status_record), BOOT_MAX_ALIGN)];
+    uint32_t rec_sz = ALIGN_UP(sizeof(*rec), flash_area_align(fap));
+    int free_idx;
+    int rc;
+
+    assert(rec_sz <= sizeof(buf));
+
+    rc = boot_status_journal_scan(fap, &last, &free_idx);
+    if (rc != 0) {
+        return rc;
+    }
+
+    if (free_idx == BOOT_STATUS_JOURNAL_RECORDS) {
+        BOOT_LOG_ERR("Swap status journal full");
+        return BOOT_ENOMEM;
+    }
+
+    boot_status_journal_check(rec, rec->check);
+    memset(buf, flash_area_erased_val(fap), sizeof(buf));
+    memcpy(buf, rec, sizeof(*rec));
+
+    rc = flash_area_write(fap, boot_status_off(fap) + free_idx * rec_sz, buf, rec_sz);
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    return 0;
+}
+#endif /* MCUBOOT_SWAP_STATUS_JOURNAL */
+
 #ifdef MCUBOOT_ENC_IMAGES
 static inline uint32_t
 boot_enc_key_off(const struct flash_area *fap, uint8_t slot)
@@ -218,6 +422,47 @@ boot_read_swap_size(const struct flash_area *fap, uint32_t *swap_size)
     return rc;
 }
 
+int
+boot_read_trailer_snapshot(const struct flash_area *fap,
+                           struct boot_trailer_snapshot *snap)
+{
+    uint32_t len;
+    int rc;
+
+#ifdef MCUBOOT_ENC_IMAGES
+    snap->off = boot_enc_key_off(fap, BOOT_NUM_SLOTS - 1);
+#else
+    snap->off = boot_swap_size_off(fap);
+#endif
+    snap->fap = fap;
+
+    len = flash_area_get_size(fap) - snap->off;
+    assert(len <= sizeof(snap->buf));
+    rc = flash_area_read(fap, snap->off, snap->buf, len);
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    return 0;
+}
+
+uint32_t
+boot_snapshot_swap_size(const struct boot_trailer_snapshot *snap)
+{
+    uint32_t swap_size;
+
+    memcpy(&swap_size, &snap->buf[boot_swap_size_off(snap->fap) - snap->off],
+           sizeof(swap_size));
+
+    return swap_size;
+}
+
+uint8_t
+boot_snapshot_swap_info(const struct boot_trailer_snapshot *snap)
+{
+    return snap->buf[boot_swap_info_off(snap->fap) - snap->off];
+}
+
 #ifdef MCUBOOT_SWAP_USING_OFFSET
 int
 boot_read_unprotected_tlv_sizes(const struct flash_area *fap, uint16_t *tlv_size_primary,
@@ -241,11 +486,10 @@ boot_read_unprotected_tlv_sizes(const struct flash_area *fap, uint16_t *tlv_size
 
 #ifdef MCUBOOT_ENC_IMAGES
 bool
-boot_read_enc_key(const struct flash_area *fap, uint8_t slot, struct boot_status *bs)
+boot_read_enc_key(const struct boot_trailer_snapshot *snap, uint8_t slot,
+                  struct boot_status *bs)
 {
-    uint32_t off;
     uint32_t i;
-    int rc;
     uint8_t *read_dst;
     uint32_t read_size;
 
@@ -262,35 +506,30 @@ boot_read_enc_key(const struct flash_area *fap, uint8_t slot, struct boot_status
     read_size = BOOT_ENC_KEY_ALIGN_SIZE;
 #endif
 
-    off = boot_enc_key_off(fap, slot);
+    memcpy(read_dst, &snap->buf[boot_enc_key_off(snap->fap, slot) - snap->off],
+           read_size);
 
-    rc = flash_area_read(fap, off, read_dst, read_size);
-    if (rc == 0) {
-        for (i = 0; i < read_size; i++) {
-            if (read_dst[i] != 0xff) {
-                break;
-            }
+    for (i = 0; i < read_size; i++) {
+        if (read_dst[i] != 0xff) {
+            break;
         }
+    }
 
-        if (i == read_size) {
-            BOOT_LOG_ERR("boot_read_enc_key: No key, read all 0xFF");
-            return false;
-        }
+    if (i == read_size) {
+        BOOT_LOG_ERR("boot_read_enc_key: No key, read all 0xFF");
+        return false;
+    }
 #if MCUBOOT_SWAP_SAVE_ENCTLV
-        else {
-            /* read_dst is the same as bs->enctlv[slot], and serves as a source
-             * of the encrypted key.
-             */
-            rc = boot_decrypt_key(bs->enctlv[slot], bs->enckey[slot]);
-            if (rc != 0) {
-                return false;
-            }
+    else {
+        /* read_dst is the same as bs->enctlv[slot], and serves as a source
+         * of the encrypted key.
+         */
+        if (boot_decrypt_key(bs->enctlv[slot], bs->enckey[slot]) != 0) {
+            return false;
         }
-#endif
-        return true;
     }
-
-    return false;
+#endif
+    return true;
 }
 #endif
 
@@ -325,6 +564,56 @@ boot_write_unprotected_tlv_sizes(const struct flash_area *fap, uint16_t tlv_size
 }
 #endif
 
+#ifdef MCUBOOT_VALIDATED_HASH_CACHE
+/**
+ * Stores the validated image hash record in the trailer of a slot. On devices
+ * that require erase, the record is only written if its place in the trailer
+ * is still erased.
+ *
+ * @returns 0 on success, != 0 on error.
+ */
+int
+boot_write_hash_cache(const struct flash_area *fap, const struct boot_hash_cache *rec)
+{
+    uint8_t buf[BOOT_HASH_CACHE_ALIGN_SIZE + BOOT_MAX_ALIGN];
+    uint32_t off;
+    uint32_t len;
+    int rc;
+
+    off = boot_hash_cache_off(fap);
+
+    if (device_requires_erase(fap)) {
+        rc = flash_area_read(fap, off, buf, sizeof(buf));
+        if (rc != 0) {
+            return BOOT_EFLASH;
+        }
+
+        if (!bootutil_buffer_is_erased(fap, buf, sizeof(buf))) {
+            return BOOT_EBADSTATUS;
+        }
+
+        /* Leave the revoked flag erased */
+        len = BOOT_HASH_CACHE_ALIGN_SIZE;
+    } else {
+        /* Also clears the revoked flag */
+        len = sizeof(buf);
+    }
+
+    memset(buf, flash_area_erased_val(fap), sizeof(buf));
+    memcpy(buf, rec, sizeof(*rec));
+
+    BOOT_LOG_DBG("writing hash cache; fa_id=%d off=0x%lx (0x%lx)",
+                 flash_area_get_id(fap), (unsigned long)off,
+                 (unsigned long)flash_area_get_off(fap) + off);
+    rc = flash_area_write(fap, off, buf, len);
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    return 0;
+}
+#endif
+
 #ifdef MCUBOOT_ENC_IMAGES
 int
 boot_write_enc_keys(const struct flash_area *fap, const struct boot_status *bs)
@@ -363,6 +652,11 @@ uint32_t bootutil_max_image_size(struct boot_loader_state *state, const struct f
       || defined(MCUBOOT_SWAP_USING_SCRATCH)
     (void) fap;
     return app_max_size(state);
+#elif defined(MCUBOOT_VALIDATED_HASH_CACHE) && \
+      (defined(MCUBOOT_OVERWRITE_ONLY) || defined(MCUBOOT_DIRECT_XIP))
+    /* An image must not be able to carry its own validated hash record */
+    (void) state;
+    return boot_hash_cache_off(fap);
 #elif defined(MCUBOOT_OVERWRITE_ONLY)
     (void) state;
     return boot_swap_info_off(fap);
@@ -435,13 +729,94 @@ done:
 
 #if (!defined(MCUBOOT_DIRECT_XIP) && !defined(MCUBOOT_RAM_LOAD)) || \
 defined(MCUBOOT_SERIAL_IMG_GRP_SLOT_INFO)
-#if !defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0
+#if defined(MCUBOOT_COMPACT_SECTORS)
+int
+boot_initialize_area(struct boot_loader_state *state, int flash_area)
+{
+    const struct flash_area *fa;
+    struct boot_sector_index *out_index;
+    uint32_t *out_num_sectors;
+    uint32_t num_sectors;
+    int rc;
+
+    if (flash_area == FLASH_AREA_IMAGE_PRIMARY(BOOT_CURR_IMG(state))) {
+        fa = BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY);
+        out_index = &BOOT_IMG(state, BOOT_SLOT_PRIMARY).sector_index;
+        out_num_sectors = &BOOT_IMG(state, BOOT_SLOT_PRIMARY).num_sectors;
+#if BOOT_NUM_SLOTS > 1
+    } else if (flash_area == FLASH_AREA_IMAGE_SECONDARY(BOOT_CURR_IMG(state))) {
+        fa = BOOT_IMG_AREA(state, BOOT_SLOT_SECONDARY);
+        out_index = &BOOT_IMG(state, BOOT_SLOT_SECONDARY).sector_index;
+        out_num_sectors = &BOOT_IMG(state, BOOT_SLOT_SECONDARY).num_sectors;
+#if MCUBOOT_SWAP_USING_SCRATCH
+    } else if (flash_area == FLASH_AREA_IMAGE_SCRATCH) {
+        fa = state->scratch.area;
+        out_index = &state->scratch.sector_index;
+        out_num_sectors = &state->scratch.num_sectors;
+#endif
+#endif
+    } else {
+        return BOOT_EFLASH;
+    }
+
+    /* The index is the only record of the layout, so it has to fit */
+    rc = boot_sector_index_build(out_index, fa);
+    if (rc != 0) {
+        BOOT_LOG_ERR("boot_initialize_area: layout of area %d does not fit "
+                     "MCUBOOT_SECTOR_INDEX_MAX_RUNS", flash_area);
+        return BOOT_EFLASH;
+    }
+
+    /* Same limit as the sector arrays, the swap status is sized for it */
+    num_sectors = boot_sector_index_count(out_index);
+    if (num_sectors > BOOT_MAX_IMG_SECTORS) {
+        return BOOT_EFLASH;
+    }
+
+    *out_num_sectors = num_sectors;
+    return 0;
+}
+
+#elif !defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0
+#if defined(MCUBOOT_SECTOR_INDEX)
+/*
+ * Builds the sector index of a flash area from its sector layout, as read
+ * into the state; the index is left empty if the layout does not fit.
+ */
+static void
+boot_index_sectors(struct boot_sector_index *idx, const boot_sector_t *sectors,
+                   uint32_t num_sectors)
+{
+    uint32_t i;
+
+    boot_sector_index_init(idx);
+
+    for (i = 0; i < num_sectors; i++) {
+#ifdef MCUBOOT_USE_FLASH_AREA_GET_SECTORS
+        uint32_t off = flash_sector_get_off(&sectors[i]) - flash_sector_get_off(&sectors[0]);
+        uint32_t size = flash_sector_get_size(&sectors[i]);
+#else
+        uint32_t off = flash_area_get_off(&sectors[i]) - flash_area_get_off(&sectors[0]);
+        uint32_t size = flash_area_get_size(&sectors[i]);
+#endif
+
+        if (boot_sector_index_add(idx, off, size) != 0) {
+            BOOT_LOG_DBG("boot_index_sectors: layout does not fit the index");
+            break;
+        }
+    }
+}
+#endif /* MCUBOOT_SECTOR_INDEX */
+
 int
 boot_initialize_area(struct boot_loader_state *state, int flash_area)
 {
     uint32_t num_sectors = BOOT_MAX_IMG_SECTORS;
     boot_sector_t *out_sectors;
     uint32_t *out_num_sectors;
+#if defined(MCUBOOT_SECTOR_INDEX)
+    struct boot_sector_index *out_index;
+#endif
     int rc;
 
     num_sectors = BOOT_MAX_IMG_SECTORS;
@@ -449,14 +824,23 @@ boot_initialize_area(struct boot_loader_state *state, int flash_area)
     if (flash_area == FLASH_AREA_IMAGE_PRIMARY(BOOT_CURR_IMG(state))) {
         out_sectors = BOOT_IMG(state, BOOT_SLOT_PRIMARY).sectors;
         out_num_sectors = &BOOT_IMG(state, BOOT_SLOT_PRIMARY).num_sectors;
+#if defined(MCUBOOT_SECTOR_INDEX)
+        out_index = &BOOT_IMG(state, BOOT_SLOT_PRIMARY).sector_index;
+#endif
 #if BOOT_NUM_SLOTS > 1
     } else if (flash_area == FLASH_AREA_IMAGE_SECONDARY(BOOT_CURR_IMG(state))) {
         out_sectors = BOOT_IMG(state, BOOT_SLOT_SECONDARY).sectors;
         out_num_sectors = &BOOT_IMG(state, BOOT_SLOT_SECONDARY).num_sectors;
+#if defined(MCUBOOT_SECTOR_INDEX)
+        out_index = &BOOT_IMG(state, BOOT_SLOT_SECONDARY).sector_index;
+#endif
 #if MCUBOOT_SWAP_USING_SCRATCH
     } else if (flash_area == FLASH_AREA_IMAGE_SCRATCH) {
         out_sectors = state->scratch.sectors;
         out_num_sectors = &state->scratch.num_sectors;
+#if defined(MCUBOOT_SECTOR_INDEX)
+        out_index = &state->scratch.sector_index;
+#endif
 #endif
 #endif
     } else {
@@ -473,6 +857,9 @@ boot_initialize_area(struct boot_loader_state *state, int flash_area)
         return rc;
     }
     *out_num_sectors = num_sectors;
+#if defined(MCUBOOT_SECTOR_INDEX)
+    boot_index_sectors(out_index, out_sectors, num_sectors);
+#endif
     return 0;
 }
 
@@ -586,17 +973,29 @@ boot_initialize_area(struct boot_loader_state *state, int flash_area)
 {
     size_t area_size;
     uint32_t *out_num_sectors;
+#if defined(MCUBOOT_SECTOR_INDEX)
+    struct boot_sector_index *out_index;
+#endif
 
     if (flash_area == FLASH_AREA_IMAGE_PRIMARY(BOOT_CURR_IMG(state))) {
         area_size = flash_area_get_size(BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY));
         out_num_sectors = &BOOT_IMG(state, BOOT_SLOT_PRIMARY).num_sectors;
+#if defined(MCUBOOT_SECTOR_INDEX)
+        out_index = &BOOT_IMG(state, BOOT_SLOT_PRIMARY).sector_index;
+#endif
     } else if (flash_area == FLASH_AREA_IMAGE_SECONDARY(BOOT_CURR_IMG(state))) {
         area_size = flash_area_get_size(BOOT_IMG_AREA(state, BOOT_SLOT_SECONDARY));
         out_num_sectors = &BOOT_IMG(state, BOOT_SLOT_SECONDARY).num_sectors;
+#if defined(MCUBOOT_SECTOR_INDEX)
+        out_index = &BOOT_IMG(state, BOOT_SLOT_SECONDARY).sector_index;
+#endif
 #if MCUBOOT_SWAP_USING_SCRATCH
     } else if (flash_area == FLASH_AREA_IMAGE_SCRATCH) {
         area_size = flash_area_get_size(state->scratch.area);
         out_num_sectors = &state->scratch.num_sectors;
+#if defined(MCUBOOT_SECTOR_INDEX)
+        out_index = &state->scratch.sector_index;
+#endif
 #endif
     } else {
         return BOOT_EFLASH;
@@ -604,6 +1003,12 @@ boot_initialize_area(struct boot_loader_state *state, int flash_area)
 
     ASSERT(area_size % MCUBOOT_LOGICAL_SECTOR_SIZE == 0);
     *out_num_sectors = area_size / MCUBOOT_LOGICAL_SECTOR_SIZE;
+#if defined(MCUBOOT_SECTOR_INDEX)
+    /* Logical sectors may span several erase pages, which are looked up
+     * by the flash map backend, so the index is left empty.
+     */
+    boot_sector_index_init(out_index);
+#endif
 
     return 0;
 }
@@ -641,7 +1046,8 @@ boot_read_sectors(struct boot_loader_state *state, struct boot_sector_buffer *se
 
     image_index = BOOT_CURR_IMG(state);
 
-#if !defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0
+#if (!defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0) && \
+    !defined(MCUBOOT_COMPACT_SECTORS)
     if (sectors == NULL) {
         sectors = &sector_buffers;
     }
@@ -657,7 +1063,7 @@ boot_read_sectors(struct boot_loader_state *state, struct boot_sector_buffer *se
 #endif
 #else
     (void)sectors;
-#endif /* !defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0 */
+#endif /* (!MCUBOOT_LOGICAL_SECTOR_SIZE || MCUBOOT_LOGICAL_SECTOR_SIZE == 0) && !MCUBOOT_COMPACT_SECTORS */
 
     rc = boot_initialize_area(state, FLASH_AREA_IMAGE_PRIMARY(image_index));
     if (rc != 0) {
@@ -712,6 +1118,33 @@ boot_read_sectors(struct boot_loader_state *state, struct boot_sector_buffer *se
 }
 #endif
 
+int
+boot_erase_img_region(const struct boot_loader_state *state, const struct flash_area *fap,
+                      uint32_t off, uint32_t sz, bool backwards)
+{
+#if defined(MCUBOOT_SECTOR_INDEX) && !defined(MCUBOOT_DIRECT_XIP) && !defined(MCUBOOT_RAM_LOAD)
+    const struct boot_sector_index *idx = NULL;
+
+    if (fap == BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY)) {
+        idx = &BOOT_IMG(state, BOOT_SLOT_PRIMARY).sector_index;
+#if BOOT_NUM_SLOTS > 1
+    } else if (fap == BOOT_IMG_AREA(state, BOOT_SLOT_SECONDARY)) {
+        idx = &BOOT_IMG(state, BOOT_SLOT_SECONDARY).sector_index;
+#if MCUBOOT_SWAP_USING_SCRATCH
+    } else if (fap == state->scratch.area) {
+        idx = &state->scratch.sector_index;
+#endif
+#endif
+    }
+
+    return boot_erase_region_indexed(fap, idx, off, sz, backwards);
+#else
+    (void)state;
+
+    return boot_erase_region(fap, off, sz, backwards);
+#endif
+}
+
 #if defined(MCUBOOT_SERIAL_IMG_GRP_SLOT_INFO)
 static int
 boot_read_sectors_recovery(struct boot_loader_state *state)
@@ -760,7 +1193,8 @@ void boot_fetch_slot_state_sizes(void)
         /* With logical sectors there are no per-slot sector arrays to point
          * at: boot_initialize_area() derives the count from the area size.
          */
-#if !defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0
+#if (!defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0) && \
+    !defined(MCUBOOT_COMPACT_SECTORS)
         BOOT_IMG(state, BOOT_SLOT_PRIMARY).sectors = sector_buffers.primary[image_index];
 #if BOOT_NUM_SLOTS > 1
         BOOT_IMG(state, BOOT_SLOT_SECONDARY).sectors = sector_buffers.secondary[image_index];
@@ -768,7 +1202,7 @@ void boot_fetch_slot_state_sizes(void)
         state->scratch.sectors = sector_buffers.scratch;
 #endif
 #endif
-#endif /* !defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0 */
+#endif /* (!MCUBOOT_LOGICAL_SECTOR_SIZE || MCUBOOT_LOGICAL_SECTOR_SIZE == 0) && !MCUBOOT_COMPACT_SECTORS */
 
         /* Determine the sector layout of the image slots and scratch area. */
         rc = boot_read_sectors_recovery(state);
@@ -44,6 +44,12 @@
 #include "bootutil/enc_key.h"
 #endif
 
+#if defined(MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY) || defined(MCUBOOT_VALIDATED_HASH_CACHE) || \
+    defined(MCUBOOT_HASH_WORKER) || defined(MCUBOOT_SWAP_STATUS_JOURNAL) || \
+    defined(MCUBOOT_SECTOR_HASHES)
+#include "bootutil/crypto/sha.h"
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -69,8 +75,46 @@ _Static_assert((MCUBOOT_LOGICAL_SECTOR_SIZE &
 #error "MCUBOOT_VERIFY_LOGICAL_SECTORS requires a non-zero MCUBOOT_LOGICAL_SECTOR_SIZE"
 #endif
 
+#if defined(MCUBOOT_COMPACT_SECTORS) && \
+    (!defined(MCUBOOT_SECTOR_INDEX) || \
+     (defined(MCUBOOT_LOGICAL_SECTOR_SIZE) && MCUBOOT_LOGICAL_SECTOR_SIZE != 0))
+#error "MCUBOOT_COMPACT_SECTORS requires MCUBOOT_SECTOR_INDEX and no MCUBOOT_LOGICAL_SECTOR_SIZE"
+#endif
+
+#if defined(MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY) && \
+    (!defined(MCUBOOT_OVERWRITE_ONLY) || defined(MCUBOOT_SIGN_PURE))
+#error "MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY requires MCUBOOT_OVERWRITE_ONLY and a hash based signature"
+#endif
+
+#if defined(MCUBOOT_VALIDATED_HASH_CACHE) && \
+    (defined(MCUBOOT_RAM_LOAD) || defined(MCUBOOT_SIGN_PURE))
+#error "MCUBOOT_VALIDATED_HASH_CACHE is not supported with MCUBOOT_RAM_LOAD or MCUBOOT_SIGN_PURE"
+#endif
+
+#if defined(MCUBOOT_SIG_CACHE) && defined(MCUBOOT_SIGN_PURE)
+#error "MCUBOOT_SIG_CACHE is not supported with MCUBOOT_SIGN_PURE"
+#endif
+
+#if defined(MCUBOOT_HASH_WORKER) && \
+    (defined(MCUBOOT_RAM_LOAD) || defined(MCUBOOT_SIGN_PURE))
+#error "MCUBOOT_HASH_WORKER is not supported with MCUBOOT_RAM_LOAD or MCUBOOT_SIGN_PURE"
+#endif
+
 #define BOOT_TMPBUF_SZ  256
 
+/*
+ * Size of the buffers used for bulk flash transfers, when copying and
+ * hashing images. Transfers are further sized down to a multiple of the
+ * optimal I/O size of the flash device, if the flash map backend reports it.
+ */
+#if defined(MCUBOOT_IO_BUF_SIZE)
+#define BOOT_IO_BUF_SZ  MCUBOOT_IO_BUF_SIZE
+_Static_assert((MCUBOOT_IO_BUF_SIZE % BOOT_MAX_ALIGN) == 0,
+               "MCUBOOT_IO_BUF_SIZE must be a multiple of BOOT_MAX_ALIGN");
+#else
+#define BOOT_IO_BUF_SZ  1024
+#endif
+
 /** Number of image slots in flash; currently limited to two. */
 #if defined(MCUBOOT_SINGLE_APPLICATION_SLOT) || defined(MCUBOOT_SINGLE_APPLICATION_SLOT_RAM_LOAD)
 #define BOOT_NUM_SLOTS                  1
@@ -133,6 +177,9 @@ struct boot_status {
 #endif
 #endif
     int source;           /* Which slot contains swap status metadata */
+#ifdef MCUBOOT_SWAP_STATUS_JOURNAL
+    struct boot_status_record journal; /* Record of the group of steps under way */
+#endif
 };
 
 #define BOOT_STATUS_IDX_0   1
@@ -151,6 +198,14 @@ struct boot_status {
  *  ~    Swap status (BOOT_MAX_IMG_SECTORS * min-write-size * 3)    ~
  *  ~                                                               ~
  *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *  ~       Validated image hash (IMAGE_HASH_SIZE octets) [**]      ~
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *  |              Validated image size (4 octets) [**]             |
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *  |            0xff padding to BOOT_MAX_ALIGN as needed [**]      |
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *  | Hash revoked  |  0xff padding (BOOT_MAX_ALIGN minus 1 octet)  |
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
  *  |                 Encryption key 0 (16 octets) [*]              |
  *  |                                                               |
  *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
@@ -183,6 +238,8 @@ struct boot_status {
  *
  * [*]: Only present if the encryption option is enabled
  *      (`MCUBOOT_ENC_IMAGES`).
+ * [**]: Only present if the validated image hash cache is enabled
+ *       (`MCUBOOT_VALIDATED_HASH_CACHE`).
  */
 
 union boot_img_magic_t
@@ -206,6 +263,20 @@ extern const union boot_img_magic_t boot_img_magic;
 
 _Static_assert(sizeof(boot_img_magic) == BOOT_MAGIC_SZ, "Invalid size for image magic");
 
+#ifdef MCUBOOT_VALIDATED_HASH_CACHE
+/**
+ * Hash of an image that passed validation, kept in the trailer of its slot so
+ * that the image does not need to be hashed again on the next boot.
+ */
+struct boot_hash_cache {
+    uint8_t hash[IMAGE_HASH_SIZE];
+    /* Number of bytes of the slot covered by the hash. */
+    uint32_t size;
+};
+
+#define BOOT_HASH_CACHE_ALIGN_SIZE  ALIGN_UP(sizeof(struct boot_hash_cache), BOOT_MAX_ALIGN)
+#endif
+
 #if !defined(MCUBOOT_DIRECT_XIP) && !defined(MCUBOOT_RAM_LOAD)
 #define ARE_SLOTS_EQUIVALENT()    0
 #else
@@ -240,10 +311,14 @@ struct boot_loader_state {
     struct {
         struct image_header hdr;
         const struct flash_area *area;
-#if !defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0
+#if (!defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0) && \
+    !defined(MCUBOOT_COMPACT_SECTORS)
         boot_sector_t *sectors;
 #endif
         uint32_t num_sectors;
+#if defined(MCUBOOT_SECTOR_INDEX)
+        struct boot_sector_index sector_index;
+#endif
 #if defined(MCUBOOT_SWAP_USING_OFFSET)
         uint16_t unprotected_tlv_size;
 #endif
@@ -252,10 +327,14 @@ struct boot_loader_state {
 #if MCUBOOT_SWAP_USING_SCRATCH
     struct {
         const struct flash_area *area;
-#if !defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0
+#if (!defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0) && \
+    !defined(MCUBOOT_COMPACT_SECTORS)
         boot_sector_t *sectors;
 #endif
         uint32_t num_sectors;
+#if defined(MCUBOOT_SECTOR_INDEX)
+        struct boot_sector_index sector_index;
+#endif
     } scratch;
 #endif
 
@@ -278,6 +357,46 @@ struct boot_loader_state {
     bool img_mask[BOOT_IMAGE_NUMBER];
 #endif
 
+#if defined(MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY)
+    /* When not NULL, boot_copy_region() feeds the first copy_hash_sz bytes
+     * of the destination region, as written, to this hash context.
+     */
+    bootutil_sha_context *copy_hash;
+    uint32_t copy_hash_sz;
+    /* Hash of the image in the secondary slot whose signature was verified
+     * by boot_validate_slot(), which the hash computed on copy must match.
+     */
+    struct {
+        bool valid;
+        uint8_t hash[IMAGE_HASH_SIZE];
+    } signed_hash[BOOT_IMAGE_NUMBER];
+#endif
+
+#if defined(MCUBOOT_HASH_WORKER)
+    /* Hash of the image in a slot, computed ahead by the worker while the
+     * previous image is validated. See boot_hash_ahead().
+     */
+    struct boot_hash_ahead {
+        const struct flash_area *area;
+        struct image_header hdr;
+        uint8_t slot;
+        /* The hash is available */
+        bool valid;
+        uint8_t hash[IMAGE_HASH_SIZE];
+    } hash_ahead[BOOT_IMAGE_NUMBER];
+    /* The worker is hashing an image and has not been joined yet */
+    bool hash_running;
+    uint8_t hash_running_img;
+#endif
+
+#if defined(MCUBOOT_SECTOR_HASHES) && !defined(MCUBOOT_OVERWRITE_ONLY)
+    /* Range [lo, hi) of the primary slot written by boot_copy_region()
+     * while resuming an interrupted swap; empty when lo >= hi.
+     */
+    uint32_t primary_written_lo;
+    uint32_t primary_written_hi;
+#endif
+
 #if defined(MCUBOOT_DIRECT_XIP) || defined(MCUBOOT_RAM_LOAD)
     struct slot_usage_t {
         /* Index of the slot chosen to be loaded */
@@ -315,11 +434,131 @@ fih_ret bootutil_verify_sig(uint8_t *msg, uint32_t mlen, uint8_t *sig,
 
 fih_ret boot_fih_memequal(const void *s1, const void *s2, size_t n);
 
+#ifdef MCUBOOT_SECTOR_HASHES
+int bootutil_img_check_sectors(struct boot_loader_state *state,
+                               struct image_header *hdr, const struct flash_area *fap,
+                               uint32_t off, uint32_t len,
+                               uint8_t *tmp_buf, uint32_t tmp_buf_sz,
+                               uint32_t *bad_off);
+#endif
+
+#ifdef MCUBOOT_DELTA_UPDATES
+/**
+ * Applies the delta image in the secondary slot of the current image, once
+ * validated, to the image in the primary slot, leaving the full image in the
+ * secondary slot and its header in the boot loader state.
+ *
+ * @return 0 on success; nonzero if the delta image cannot be applied, in
+ *         which case the secondary slot may not hold a valid image anymore.
+ */
+int boot_delta_apply(struct boot_loader_state *state);
+
+/**
+ * Completes the rebuild of a full image from a delta image interrupted by a
+ * reset, if there is one in the secondary slot of the current image.
+ *
+ * @return 0 if there was none, or on success; nonzero on failure.
+ */
+int boot_delta_resume(struct boot_loader_state *state);
+#endif
+
+#if defined(MCUBOOT_DECOMPRESS_IMAGES) && defined(MCUBOOT_OVERWRITE_ONLY)
+/**
+ * Gets the size, TLVs included, of the image the compressed image in fap
+ * decompresses to.
+ *
+ * @return 0 on success; nonzero if the compressed image is invalid.
+ */
+int boot_decompressed_size(const struct image_header *hdr, const struct flash_area *fap,
+                           uint32_t *size);
+
+/**
+ * Decompresses the compressed image in the secondary slot of the current
+ * image, from fap_src to fap_dst, which must be erased, checking the hash
+ * of the decompressed image on the way.
+ *
+ * @param size  Receives the size of the decompressed image.
+ *
+ * @return 0 on success; BOOT_EBADIMAGE if the compressed image is invalid
+ *         or does not decompress to the expected image; other nonzero
+ *         values on flash errors.
+ */
+int boot_decompress_image(struct boot_loader_state *state, const struct flash_area *fap_src,
+                          const struct flash_area *fap_dst, uint32_t *size);
+#endif
+
 const struct flash_area *boot_find_status(const struct boot_loader_state *state,
                                           int image_index);
 int boot_magic_compatible_check(uint8_t tbl_val, uint8_t val);
 int boot_status_entries(int image_index, const struct flash_area *fap);
 uint32_t boot_status_off(const struct flash_area *fap);
+
+/*
+ * Number of bytes of swap status entries read from flash at once, when
+ * looking for the interrupted swap step.
+ */
+#define BOOT_STATUS_WINDOW_SZ 128
+
+/*
+ * Window over the swap status entries of a trailer, refilled with a single
+ * flash read whenever an entry outside of it is requested.
+ */
+struct boot_status_window {
+    const struct flash_area *fap;
+    uint32_t off;       /* Offset of the status entries in fap */
+    uint32_t write_sz;  /* Distance between two entries */
+    int max_entries;
+    int first;          /* First entry held in buf */
+    int count;          /* Number of entries held in buf */
+    uint8_t buf[BOOT_STATUS_WINDOW_SZ];
+};
+
+/**
+ * Prepares a window over the max_entries swap status entries of fap, which
+ * are write_sz bytes apart.
+ */
+void boot_status_window_init(struct boot_status_window *win,
+                             const struct flash_area *fap,
+                             uint32_t write_sz, int max_entries);
+
+/**
+ * Gets the first byte of status entry idx, reading the entries around it
+ * from flash if they are not in the window yet.
+ *
+ * @return 0 on success; BOOT_EFLASH on read error.
+ */
+int boot_status_window_get(struct boot_status_window *win, int idx,
+                           uint8_t *status);
+
+/**
+ * Finds the first status entry, from idx on, whose first byte is not
+ * erased, scanning a whole window at once.
+ *
+ * @return the index of the entry; max_entries if all of them are erased;
+ *         BOOT_EFLASH on read error.
+ */
+int boot_status_window_find_set(struct boot_status_window *win, int idx);
+
+#ifdef MCUBOOT_SWAP_STATUS_JOURNAL
+/**
+ * Reads the swap status journal of fap.
+ *
+ * @param rec Set to the last intact record, or given a zero count when no
+ *            swap is under way.
+ *
+ * @return 0 on success; BOOT_EFLASH on read error.
+ */
+int boot_status_journal_read(const struct flash_area *fap, struct boot_status_record *rec);
+
+/**
+ * Appends rec to the swap status journal of fap, after computing its check.
+ *
+ * @return 0 on success; BOOT_ENOMEM if the journal is full; BOOT_EFLASH on
+ *         error.
+ */
+int boot_status_journal_write(const struct flash_area *fap, struct boot_status_record *rec);
+#endif
+
 int boot_read_swap_state(const struct flash_area *fap,
                          struct boot_swap_state *state);
 int boot_write_magic(const struct flash_area *fap);
@@ -334,12 +573,52 @@ int boot_write_trailer(const struct flash_area *fap, uint32_t off,
 int boot_write_trailer_flag(const struct flash_area *fap, uint32_t off,
                             uint8_t flag_val);
 int boot_read_swap_size(const struct flash_area *fap, uint32_t *swap_size);
+
+#ifdef MCUBOOT_ENC_IMAGES
+#if MCUBOOT_SWAP_SAVE_ENCTLV
+#define BOOT_TRAILER_SNAPSHOT_KEYS_SZ (BOOT_ENC_TLV_ALIGN_SIZE * BOOT_NUM_SLOTS)
+#else
+#define BOOT_TRAILER_SNAPSHOT_KEYS_SZ (BOOT_ENC_KEY_ALIGN_SIZE * BOOT_NUM_SLOTS)
+#endif
+#else
+#define BOOT_TRAILER_SNAPSHOT_KEYS_SZ 0
+#endif
+
+/*
+ * swap_size, unprotected TLV sizes, swap_info, copy_done, image_ok, the
+ * magic, and the padding of an area whose size is not a multiple of
+ * BOOT_MAX_ALIGN.
+ */
+#define BOOT_TRAILER_SNAPSHOT_SZ \
+    (BOOT_TRAILER_SNAPSHOT_KEYS_SZ + BOOT_MAX_ALIGN * 6 + BOOT_MAGIC_ALIGN_SIZE)
+
+/*
+ * Copy of the fields of a trailer that follow the swap status entries, from
+ * the encryption keys to the magic, taken with a single flash read.
+ */
+struct boot_trailer_snapshot {
+    const struct flash_area *fap;
+    uint32_t off;   /* Offset of buf in fap */
+    uint8_t buf[BOOT_TRAILER_SNAPSHOT_SZ];
+};
+
+int boot_read_trailer_snapshot(const struct flash_area *fap,
+                               struct boot_trailer_snapshot *snap);
+uint32_t boot_snapshot_swap_size(const struct boot_trailer_snapshot *snap);
+uint8_t boot_snapshot_swap_info(const struct boot_trailer_snapshot *snap);
+
 #if defined(MCUBOOT_SWAP_USING_OFFSET)
 int boot_write_unprotected_tlv_sizes(const struct flash_area *fap, uint16_t tlv_size_primary,
                                      uint16_t tlv_size_secondary);
 int boot_read_unprotected_tlv_sizes(const struct flash_area *fap, uint16_t *tlv_size_primary,
                                     uint16_t *tlv_size_secondary);
 #endif
+#ifdef MCUBOOT_VALIDATED_HASH_CACHE
+uint32_t boot_hash_cache_off(const struct flash_area *fap);
+int boot_read_hash_cache(const struct flash_area *fap, struct boot_hash_cache *rec);
+int boot_write_hash_cache(const struct flash_area *fap, const struct boot_hash_cache *rec);
+int boot_invalidate_hash_cache(const struct flash_area *fap);
+#endif
 int boot_slots_compatible(struct boot_loader_state *state);
 uint32_t boot_status_internal_off(const struct boot_status *bs, int elem_sz);
 int boot_read_image_header(struct boot_loader_state *state, int slot,
@@ -359,7 +638,7 @@ bool boot_status_is_reset(const struct boot_status *bs);
 
 #ifdef MCUBOOT_ENC_IMAGES
 int boot_write_enc_keys(const struct flash_area *fap, const struct boot_status *bs);
-bool boot_read_enc_key(const struct flash_area *fap, uint8_t slot,
+bool boot_read_enc_key(const struct boot_trailer_snapshot *snap, uint8_t slot,
                        struct boot_status *bs);
 #endif
 
@@ -373,6 +652,16 @@ bool boot_read_enc_key(const struct flash_area *fap, uint8_t slot,
 bool bootutil_buffer_is_erased(const struct flash_area *area,
                                const void *buffer, size_t len);
 
+/**
+ * Finds the first byte of a buffer that is not erased according to what the
+ * erase value for the flash device provided in `flash_area` is.
+ *
+ * @returns the offset of the first byte that is not erased, or len if all
+ * of them are.
+ */
+size_t bootutil_buffer_first_not_erased(const struct flash_area *area,
+                                        const void *buffer, size_t len);
+
 /**
  * Opens the flash areas of all images.
  *
@@ -404,6 +693,23 @@ void boot_close_all_flash_areas(struct boot_loader_state *state);
 int boot_read_sectors(struct boot_loader_state *state, struct boot_sector_buffer *sectors);
 #endif
 
+/**
+ * Erases a region of one of the flash areas of the current image, as
+ * boot_erase_region() does, with the sectors looked up in the sector layout
+ * read by boot_read_sectors() when MCUBOOT_SECTOR_INDEX is enabled.
+ *
+ * @param state      Bootloader state.
+ * @param fap        The flash_area containing the region to erase.
+ * @param off        The offset within the flash area to start the erase.
+ * @param sz         The number of bytes to erase.
+ * @param backwards  If set to true will erase from end to start addresses, otherwise erases from
+ *                   start to end addresses.
+ *
+ * @return 0 on success; nonzero on failure.
+ */
+int boot_erase_img_region(const struct boot_loader_state *state, const struct flash_area *fap,
+                          uint32_t off, uint32_t sz, bool backwards);
+
 /**
  * Safe (non-overflowing) uint32_t addition.  Returns true, and stores
  * the result in *dest if it can be done without overflow.  Otherwise,
@@ -489,7 +795,37 @@ boot_img_slot_off(struct boot_loader_state *state, size_t slot)
     return flash_area_get_off(BOOT_IMG_AREA(state, slot));
 }
 
-#if !defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0
+#if defined(MCUBOOT_COMPACT_SECTORS)
+
+static inline size_t
+boot_img_sector_size(const struct boot_loader_state *state,
+                     size_t slot, size_t sector)
+{
+    uint32_t off;
+    uint32_t size;
+
+    (void)boot_sector_index_get(&BOOT_IMG(state, slot).sector_index, sector, &off, &size);
+
+    return size;
+}
+
+/*
+ * Offset of the sector from the beginning of the image, NOT the flash
+ * device.
+ */
+static inline uint32_t
+boot_img_sector_off(const struct boot_loader_state *state, size_t slot,
+                    size_t sector)
+{
+    uint32_t off;
+    uint32_t size;
+
+    (void)boot_sector_index_get(&BOOT_IMG(state, slot).sector_index, sector, &off, &size);
+
+    return off;
+}
+
+#elif !defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0
 #ifndef MCUBOOT_USE_FLASH_AREA_GET_SECTORS
 
 static inline size_t
@@ -167,6 +167,30 @@ boot_swap_info_off(const struct flash_area *fap)
     return boot_copy_done_off(fap) - BOOT_MAX_ALIGN;
 }
 
+#ifdef MCUBOOT_VALIDATED_HASH_CACHE
+static inline uint32_t
+boot_hash_cache_revoked_off(const struct flash_area *fap)
+{
+    uint32_t off = boot_swap_size_off(fap);
+
+#ifdef MCUBOOT_ENC_IMAGES
+#if MCUBOOT_SWAP_SAVE_ENCTLV
+    off -= BOOT_ENC_TLV_ALIGN_SIZE * 2;
+#else
+    off -= BOOT_ENC_KEY_ALIGN_SIZE * 2;
+#endif
+#endif
+
+    return off - BOOT_MAX_ALIGN;
+}
+
+uint32_t
+boot_hash_cache_off(const struct flash_area *fap)
+{
+    return boot_hash_cache_revoked_off(fap) - BOOT_HASH_CACHE_ALIGN_SIZE;
+}
+#endif
+
 /**
  * Determines if a status source table is satisfied by the specified magic
  * code.
@@ -193,25 +217,63 @@ boot_magic_compatible_check(uint8_t tbl_val, uint8_t val)
     }
 }
 
-bool bootutil_buffer_is_erased(const struct flash_area *area,
-                               const void *buffer, size_t len)
+size_t bootutil_buffer_first_not_erased(const struct flash_area *area,
+                                        const void *buffer, size_t len)
 {
-    size_t i;
-    uint8_t *u8b;
+    const uint8_t *u8b = buffer;
+    uintptr_t erased_word;
+    uintptr_t word;
     uint8_t erased_val;
+    size_t i = 0;
 
-    if (buffer == NULL || len == 0) {
-        return false;
+    erased_val = flash_area_erased_val(area);
+
+    /* Bytes before the first aligned word */
+    while (i < len && ((uintptr_t)&u8b[i] % sizeof(uintptr_t)) != 0) {
+        if (u8b[i] != erased_val) {
+            return i;
+        }
+        i++;
     }
 
-    erased_val = flash_area_erased_val(area);
-    for (i = 0, u8b = (uint8_t *)buffer; i < len; i++) {
+    /* Whole words, compared against erased_val repeated in every byte */
+    erased_word = (UINTPTR_MAX / 0xff) * erased_val;
+    while (len - i >= sizeof(uintptr_t)) {
+        memcpy(&word, &u8b[i], sizeof(word));
+        if (word != erased_word) {
+            break;
+        }
+        i += sizeof(uintptr_t);
+    }
+
+    /* Bytes after the last word, or within the word that differs */
+    while (i < len) {
         if (u8b[i] != erased_val) {
-            return false;
+            return i;
         }
+        i++;
+    }
+
+    return len;
+}
+
+bool bootutil_buffer_is_erased(const struct flash_area *area,
+                               const void *buffer, size_t len)
+{
+    if (buffer == NULL || len == 0) {
+        return false;
     }
 
-    return true;
+    return bootutil_buffer_first_not_erased(area, buffer, len) == len;
+}
+
+static uint8_t
+boot_flag_parse(const struct flash_area *fap, uint8_t flag)
+{
+    if (bootutil_buffer_is_erased(fap, &flag, sizeof flag)) {
+        return BOOT_FLAG_UNSET;
+    }
+    return boot_flag_decode(flag);
 }
 
 static int
@@ -223,47 +285,44 @@ boot_read_flag(const struct flash_area *fap, uint8_t *flag, uint32_t off)
     if (rc < 0) {
         return BOOT_EFLASH;
     }
-    if (bootutil_buffer_is_erased(fap, flag, sizeof *flag)) {
-        *flag = BOOT_FLAG_UNSET;
-    } else {
-        *flag = boot_flag_decode(*flag);
-    }
+    *flag = boot_flag_parse(fap, *flag);
 
     return 0;
 }
 
-static inline int
-boot_read_copy_done(const struct flash_area *fap, uint8_t *copy_done)
-{
-    return boot_read_flag(fap, copy_done, boot_copy_done_off(fap));
-}
-
-
 int
 boot_read_swap_state(const struct flash_area *fap,
                      struct boot_swap_state *state)
 {
-    uint8_t magic[BOOT_MAGIC_SZ];
-    uint32_t off;
+    /* swap_info, copy_done, image_ok and magic, with the alignment padding
+     * of an area whose size is not a multiple of BOOT_MAX_ALIGN.
+     */
+    uint8_t buf[BOOT_MAGIC_ALIGN_SIZE + BOOT_MAX_ALIGN * 4];
+    const uint8_t *magic;
+    uint32_t base;
+    uint32_t len;
     uint8_t swap_info;
     int rc;
 
-    off = boot_magic_off(fap);
-    rc = flash_area_read(fap, off, magic, BOOT_MAGIC_SZ);
+    /* The flags are next to each other at the end of the trailer, read them
+     * with the magic at once rather than one by one.
+     */
+    base = boot_swap_info_off(fap);
+    len = flash_area_get_size(fap) - base;
+    assert(len <= sizeof(buf));
+    rc = flash_area_read(fap, base, buf, len);
     if (rc < 0) {
         return BOOT_EFLASH;
     }
+
+    magic = &buf[boot_magic_off(fap) - base];
     if (bootutil_buffer_is_erased(fap, magic, BOOT_MAGIC_SZ)) {
         state->magic = BOOT_MAGIC_UNSET;
     } else {
         state->magic = boot_magic_decode(magic);
     }
 
-    off = boot_swap_info_off(fap);
-    rc = flash_area_read(fap, off, &swap_info, sizeof swap_info);
-    if (rc < 0) {
-        return BOOT_EFLASH;
-    }
+    swap_info = buf[0];
 
     /* Extract the swap type and image number */
     state->swap_type = BOOT_GET_SWAP_TYPE(swap_info);
@@ -275,12 +334,10 @@ boot_read_swap_state(const struct flash_area *fap,
         state->image_num = 0;
     }
 
-    rc = boot_read_copy_done(fap, &state->copy_done);
-    if (rc) {
-        return BOOT_EFLASH;
-    }
+    state->copy_done = boot_flag_parse(fap, buf[boot_copy_done_off(fap) - base]);
+    state->image_ok = boot_flag_parse(fap, buf[boot_image_ok_off(fap) - base]);
 
-    return boot_read_image_ok(fap, &state->image_ok);
+    return 0;
 }
 
 int
@@ -503,6 +560,69 @@ boot_write_copy_done(const struct flash_area *fap)
     return boot_write_trailer_flag(fap, off, BOOT_FLAG_SET);
 }
 
+#ifdef MCUBOOT_VALIDATED_HASH_CACHE
+/**
+ * Reads the validated image hash record from the trailer of a slot.
+ *
+ * @return 0 if there is a record which has not been revoked;
+ *         BOOT_EBADSTATUS if there is none; BOOT_EFLASH on read failure.
+ */
+int
+boot_read_hash_cache(const struct flash_area *fap, struct boot_hash_cache *rec)
+{
+    uint8_t revoked;
+    int rc;
+
+    rc = flash_area_read(fap, boot_hash_cache_revoked_off(fap), &revoked, sizeof(revoked));
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    if (!bootutil_buffer_is_erased(fap, &revoked, sizeof(revoked))) {
+        return BOOT_EBADSTATUS;
+    }
+
+    rc = flash_area_read(fap, boot_hash_cache_off(fap), rec, sizeof(*rec));
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    if (bootutil_buffer_is_erased(fap, rec, sizeof(*rec))) {
+        return BOOT_EBADSTATUS;
+    }
+
+    return 0;
+}
+
+/**
+ * Revokes the validated image hash record of a slot, if there is one, so that
+ * the image is hashed again on the next boot. To be called before the
+ * contents of the slot are changed.
+ *
+ * @returns 0 on success, != 0 on error.
+ */
+int
+boot_invalidate_hash_cache(const struct flash_area *fap)
+{
+    struct boot_hash_cache rec;
+    uint32_t off;
+    int rc;
+
+    rc = boot_read_hash_cache(fap, &rec);
+    if (rc == BOOT_EBADSTATUS) {
+        return 0;
+    } else if (rc != 0) {
+        return rc;
+    }
+
+    off = boot_hash_cache_revoked_off(fap);
+    BOOT_LOG_DBG("revoking hash cache; fa_id=%d off=0x%lx (0x%lx)",
+                 flash_area_get_id(fap), (unsigned long)off,
+                 (unsigned long)(flash_area_get_off(fap) + off));
+    return boot_write_trailer_flag(fap, off, BOOT_FLAG_SET);
+}
+#endif
+
 #ifndef MCUBOOT_BOOTUTIL_LIB_FOR_DIRECT_XIP
 
 static int flash_area_to_image(const struct flash_area *fa)
@@ -555,6 +675,12 @@ boot_set_next(const struct flash_area *fa, bool active, bool confirm)
 
     case BOOT_MAGIC_UNSET:
         if (!active) {
+#ifdef MCUBOOT_VALIDATED_HASH_CACHE
+            rc = boot_invalidate_hash_cache(fa);
+            if (rc != 0) {
+                break;
+            }
+#endif
             rc = boot_write_magic(fa);
 
             if (rc == 0 && confirm) {
@@ -617,6 +743,13 @@ boot_set_next(const struct flash_area *fa, bool active, bool confirm)
 
     switch (slot_state.magic) {
     case BOOT_MAGIC_UNSET:
+#ifdef MCUBOOT_VALIDATED_HASH_CACHE
+        /* The slot holds a new image */
+        rc = boot_invalidate_hash_cache(fa);
+        if (rc != 0) {
+            break;
+        }
+#endif
         /* Magic is needed for MCUboot to even consider booting an image */
         rc = boot_write_magic(fa);
         if (rc != 0) {
@@ -0,0 +1,1165 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Decompression of compressed images.
+ *
+ * The payload of a compressed image (IMAGE_F_COMPRESSED_LZMA2) is a two byte
+ * header, holding the dictionary size and the literal and position bits
+ * (see docs/compression_format.md), followed by a raw LZMA2 stream, which
+ * may have been made with the ARM thumb branch filter applied first
+ * (IMAGE_F_COMPRESSED_ARM_THUMB_FLT). The protected TLVs give the size
+ * (IMAGE_TLV_DECOMP_SIZE), hash (IMAGE_TLV_DECOMP_SHA) and signature
+ * (IMAGE_TLV_DECOMP_SIGNATURE) of the image that was compressed.
+ *
+ * The image is decompressed straight into the primary slot: its header is
+ * the one of the compressed image with the compression flags, sizes and
+ * decompression TLVs taken out, and its unprotected TLVs hold the
+ * decompressed hash and signature. Everything covered by the hash is hashed
+ * as it is written and checked against IMAGE_TLV_DECOMP_SHA.
+ *
+ * The LZMA dictionary is not kept in RAM: the most recent output is held in
+ * a window 1.5 KiB larger than the MCUBOOT_DECOMPRESSION_BUFFER_SIZE bytes
+ * written to flash at once, and matches further back are read from the
+ * primary slot, where that output has been written already. As the ARM
+ * thumb filter only changes the branch instructions it finds, which it can
+ * find the same way in its output, the filter is applied again to what is
+ * read from flash to get the dictionary back.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bootutil/bootutil.h"
+#include "bootutil/image.h"
+#include "bootutil/crypto/sha.h"
+#include "bootutil/fault_injection_hardening.h"
+#include "bootutil_priv.h"
+#include "bootutil_loader.h"
+#include "bootutil/bootutil_log.h"
+
+#include "mcuboot_config/mcuboot_config.h"
+
+/* With the swap upgrade strategies, decompression is left to the port */
+#if defined(MCUBOOT_DECOMPRESS_IMAGES) && defined(MCUBOOT_OVERWRITE_ONLY)
+
+#if defined(MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY) || defined(MCUBOOT_SIGN_PURE)
+#error "MCUBOOT_DECOMPRESS_IMAGES is not supported with MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY or MCUBOOT_SIGN_PURE"
+#endif
+
+BOOT_LOG_MODULE_DECLARE(mcuboot);
+
+#ifndef MCUBOOT_DECOMPRESSION_BUFFER_SIZE
+#define MCUBOOT_DECOMPRESSION_BUFFER_SIZE 4096
+#endif
+
+#if MCUBOOT_DECOMPRESSION_BUFFER_SIZE < 16
+#error "MCUBOOT_DECOMPRESSION_BUFFER_SIZE must be at least 16"
+#endif
+
+/* Size of the writes to the primary slot */
+#define BOOT_DECOMP_OUT_SZ      ALIGN_UP(MCUBOOT_DECOMPRESSION_BUFFER_SIZE, BOOT_MAX_ALIGN)
+
+/* Output is passed on to be written once this much of it is waiting */
+#define BOOT_DECOMP_FLUSH_SZ    1024
+
+/*
+ * Size of the window holding the most recent output. Besides what waits to
+ * be flushed and what the writer holds, it leaves room for a match (up to
+ * 273 bytes) and the lookahead of the ARM thumb filter, so that the window
+ * always holds what is not in flash yet.
+ */
+#define BOOT_DECOMP_WIN_SZ      (BOOT_DECOMP_OUT_SZ + BOOT_DECOMP_FLUSH_SZ + 512)
+
+/* Size of the buffer the compressed data is read through */
+#define BOOT_DECOMP_IN_SZ       128
+
+/* Size of the chunks read back from flash or passed through the filter */
+#define BOOT_DECOMP_CHUNK_SZ    64
+
+#define LZMA_STATES             12
+#define LZMA_LIT_STATES         7
+#define LZMA_POS_STATES_MAX     16
+#define LZMA_LITERAL_CODERS_MAX 16      /* LZMA2 limits lc + lp to 4 */
+#define LZMA_LITERAL_SIZE       0x300
+#define LZMA_MATCH_LEN_MIN      2
+#define LZMA_LEN_LOW_SYMBOLS    8
+#define LZMA_LEN_MID_SYMBOLS    8
+#define LZMA_LEN_HIGH_SYMBOLS   256
+#define LZMA_DIST_STATES        4
+#define LZMA_DIST_SLOTS         64
+#define LZMA_DIST_MODEL_START   4
+#define LZMA_DIST_MODEL_END     14
+#define LZMA_FULL_DISTANCES     128
+#define LZMA_ALIGN_BITS         4
+
+#define LZMA_PROB_BITS          11
+#define LZMA_PROB_INIT          (1 << (LZMA_PROB_BITS - 1))
+#define LZMA_MOVE_BITS          5
+#define LZMA_RC_TOP             (1U << 24)
+
+struct boot_decomp_len {
+    uint16_t choice;
+    uint16_t choice2;
+    uint16_t low[LZMA_POS_STATES_MAX][LZMA_LEN_LOW_SYMBOLS];
+    uint16_t mid[LZMA_POS_STATES_MAX][LZMA_LEN_MID_SYMBOLS];
+    uint16_t high[LZMA_LEN_HIGH_SYMBOLS];
+};
+
+/* Probabilities of the LZMA model, all uint16_t so that they can be reset
+ * as an array.
+ */
+struct boot_decomp_probs {
+    uint16_t is_match[LZMA_STATES][LZMA_POS_STATES_MAX];
+    uint16_t is_rep[LZMA_STATES];
+    uint16_t is_rep0[LZMA_STATES];
+    uint16_t is_rep1[LZMA_STATES];
+    uint16_t is_rep2[LZMA_STATES];
+    uint16_t is_rep0_long[LZMA_STATES][LZMA_POS_STATES_MAX];
+    uint16_t dist_slot[LZMA_DIST_STATES][LZMA_DIST_SLOTS];
+    uint16_t dist_special[LZMA_FULL_DISTANCES - LZMA_DIST_MODEL_END];
+    uint16_t dist_align[1 << LZMA_ALIGN_BITS];
+    struct boot_decomp_len match_len;
+    struct boot_decomp_len rep_len;
+    uint16_t literal[LZMA_LITERAL_CODERS_MAX][LZMA_LITERAL_SIZE];
+};
+
+/* What the TLVs of the compressed image say about the decompressed one */
+struct boot_decomp_info {
+    uint32_t img_size;          /* Size of the decompressed body */
+    uint32_t prot_sz;           /* Size of its protected TLV area */
+    uint32_t unprot_sz;         /* Size of its unprotected TLV area */
+    uint32_t sha_off;           /* Offset of IMAGE_TLV_DECOMP_SHA */
+    uint32_t sig_off;           /* Offset of IMAGE_TLV_DECOMP_SIGNATURE */
+    uint16_t sig_len;           /* Its length, 0 if there is none */
+};
+
+struct boot_decomp_ctx {
+    /* Compressed input */
+    const struct flash_area *fap_src;
+    uint32_t in_off;            /* Offset of the input left to read */
+    uint32_t in_end;            /* End of the input */
+    uint32_t in_pos;            /* Position in in_buf */
+    uint32_t in_len;            /* Bytes in in_buf */
+    uint32_t in_count;          /* Input used by the current chunk */
+
+    /* Range decoder */
+    uint32_t range;
+    uint32_t code;
+
+    /* LZMA state */
+    uint32_t state;
+    uint32_t rep0;
+    uint32_t rep1;
+    uint32_t rep2;
+    uint32_t rep3;
+    uint32_t lc;
+    uint32_t lp_mask;
+    uint32_t pb_mask;
+
+    /* Decompressed output */
+    const struct flash_area *fap_dst;
+    bool thumb;                 /* ARM thumb filter to undo */
+    uint32_t body_off;          /* Offset of the body in the primary slot */
+    uint32_t out_pos;           /* Size of the body produced */
+    uint32_t out_end;           /* Size of the body once done */
+    uint32_t dict_start;        /* out_pos at the last dictionary reset */
+    uint32_t win_pos;           /* Position of out_pos in win */
+    uint32_t flushed;           /* Size of the body passed to the writer */
+
+    /* Writer */
+    uint32_t wr_off;            /* Offset of wr_buf in the primary slot */
+    uint32_t wr_len;            /* Bytes in wr_buf */
+    bool hashing;               /* Data written is covered by the hash */
+    bootutil_sha_context sha;
+
+    int rc;                     /* First error met, 0 if none */
+
+    struct boot_decomp_probs probs;
+    uint8_t in_buf[BOOT_DECOMP_IN_SZ];
+    uint8_t win[BOOT_DECOMP_WIN_SZ];
+    uint8_t wr_buf[BOOT_DECOMP_OUT_SZ] __attribute__((aligned(4)));
+};
+
+/*
+ * Writes data to the primary slot, after what was written so far.
+ */
+static void
+boot_decomp_write(struct boot_decomp_ctx *ctx, const uint8_t *data, uint32_t len)
+{
+    uint32_t chunk;
+
+    if (ctx->hashing) {
+        bootutil_sha_update(&ctx->sha, data, len);
+    }
+
+    while (len > 0 && ctx->rc == 0) {
+        chunk = sizeof(ctx->wr_buf) - ctx->wr_len;
+        if (chunk > len) {
+            chunk = len;
+        }
+        memcpy(&ctx->wr_buf[ctx->wr_len], data, chunk);
+        ctx->wr_len += chunk;
+        data += chunk;
+        len -= chunk;
+
+        if (ctx->wr_len == sizeof(ctx->wr_buf)) {
+            if (flash_area_write(ctx->fap_dst, ctx->wr_off, ctx->wr_buf, ctx->wr_len) != 0) {
+                ctx->rc = BOOT_EFLASH;
+            }
+            ctx->wr_off += ctx->wr_len;
+            ctx->wr_len = 0;
+
+            MCUBOOT_WATCHDOG_FEED();
+        }
+    }
+}
+
+/*
+ * Writes what is left in the write buffer, padded to the write size.
+ */
+static void
+boot_decomp_write_flush(struct boot_decomp_ctx *ctx)
+{
+    uint32_t align;
+    uint32_t len;
+
+    if (ctx->rc != 0 || ctx->wr_len == 0) {
+        return;
+    }
+
+    align = flash_area_align(ctx->fap_dst);
+    len = ALIGN_UP(ctx->wr_len, align);
+    memset(&ctx->wr_buf[ctx->wr_len], flash_area_erased_val(ctx->fap_dst), len - ctx->wr_len);
+
+    if (flash_area_write(ctx->fap_dst, ctx->wr_off, ctx->wr_buf, len) != 0) {
+        ctx->rc = BOOT_EFLASH;
+    }
+    ctx->wr_off += ctx->wr_len;
+    ctx->wr_len = 0;
+}
+
+/*
+ * Copies len bytes of the compressed image at off to the primary slot.
+ */
+static void
+boot_decomp_write_from(struct boot_decomp_ctx *ctx, uint32_t off, uint32_t len)
+{
+    uint8_t buf[BOOT_DECOMP_CHUNK_SZ];
+    uint32_t chunk;
+
+    while (len > 0 && ctx->rc == 0) {
+        chunk = (len > sizeof(buf)) ? sizeof(buf) : len;
+        if (flash_area_read(ctx->fap_src, off, buf, chunk) != 0) {
+            ctx->rc = BOOT_EFLASH;
+            return;
+        }
+        boot_decomp_write(ctx, buf, chunk);
+        off += chunk;
+        len -= chunk;
+    }
+}
+
+static void
+boot_decomp_write_tlv(struct boot_decomp_ctx *ctx, uint16_t type, uint16_t len)
+{
+    struct image_tlv tlv;
+
+    tlv.it_type = type;
+    tlv.it_len = len;
+    boot_decomp_write(ctx, (const uint8_t *)&tlv, sizeof(tlv));
+}
+
+/*
+ * Undoes (or, with encode, applies again) the ARM thumb filter on buf,
+ * which holds the body from pos. Only the BL instructions starting before
+ * end, relative to buf, are changed, all of which must have the 4 bytes of
+ * the instruction in buf.
+ */
+static void
+boot_decomp_thumb(uint8_t *buf, uint32_t pos, uint32_t end, uint32_t len, bool encode)
+{
+    uint32_t i;
+    uint32_t src;
+    uint32_t dest;
+
+    /* Instructions are at even offsets of the body */
+    for (i = pos & 1; i < end && i + 4 <= len; i += 2) {
+        if ((buf[i + 1] & 0xf8) != 0xf0 || (buf[i + 3] & 0xf8) != 0xf8) {
+            continue;
+        }
+
+        src = ((uint32_t)(buf[i + 1] & 7) << 19) | ((uint32_t)buf[i] << 11) |
+              ((uint32_t)(buf[i + 3] & 7) << 8) | buf[i + 2];
+        src <<= 1;
+        if (encode) {
+            dest = src + (pos + i + 4);
+        } else {
+            dest = src - (pos + i + 4);
+        }
+        dest >>= 1;
+
+        buf[i + 1] = 0xf0 | ((dest >> 19) & 7);
+        buf[i] = (uint8_t)(dest >> 11);
+        buf[i + 3] = 0xf8 | ((dest >> 8) & 7);
+        buf[i + 2] = (uint8_t)dest;
+        i += 2;
+    }
+}
+
+/*
+ * Copies len bytes of the window, starting with the body at pos, which
+ * must still be in the window.
+ */
+static void
+boot_decomp_win_read(const struct boot_decomp_ctx *ctx, uint32_t pos, uint8_t *buf, uint32_t len)
+{
+    uint32_t idx;
+    uint32_t back;
+
+    back = ctx->out_pos - pos;
+    idx = (ctx->win_pos >= back) ? ctx->win_pos - back : ctx->win_pos + BOOT_DECOMP_WIN_SZ - back;
+
+    while (len > 0) {
+        *buf++ = ctx->win[idx];
+        if (++idx == BOOT_DECOMP_WIN_SZ) {
+            idx = 0;
+        }
+        len--;
+    }
+}
+
+/*
+ * Passes the output in the window on to the writer, all of it if final,
+ * else all but what the ARM thumb filter needs to look ahead.
+ */
+static void
+boot_decomp_flush(struct boot_decomp_ctx *ctx, bool final)
+{
+    uint8_t buf[BOOT_DECOMP_CHUNK_SZ + 8];
+    uint32_t end;
+    uint32_t start;
+    uint32_t chunk;
+    uint32_t len;
+
+    end = final ? ctx->out_pos : ctx->out_pos - 4;
+
+    while (ctx->flushed < end && ctx->rc == 0) {
+        chunk = end - ctx->flushed;
+        if (chunk > BOOT_DECOMP_CHUNK_SZ) {
+            chunk = BOOT_DECOMP_CHUNK_SZ;
+        }
+
+        if (!ctx->thumb) {
+            boot_decomp_win_read(ctx, ctx->flushed, buf, chunk);
+            boot_decomp_write(ctx, buf, chunk);
+        } else {
+            /* An instruction starting up to 3 bytes earlier may reach the
+             * chunk, and one starting in it may reach 3 bytes further.
+             */
+            start = (ctx->flushed >= 4) ? ctx->flushed - 4 : 0;
+            len = ctx->flushed + chunk + 3;
+            if (len > ctx->out_pos) {
+                len = ctx->out_pos;
+            }
+            len -= start;
+
+            boot_decomp_win_read(ctx, start, buf, len);
+            boot_decomp_thumb(buf, start, ctx->flushed + chunk - start, len, false);
+            boot_decomp_write(ctx, &buf[ctx->flushed - start], chunk);
+        }
+
+        ctx->flushed += chunk;
+    }
+}
+
+/*
+ * Reads up to len bytes of the body from pos, a position of the output
+ * which is in flash already, as the LZMA decoder produced them. Returns the
+ * number of bytes read.
+ */
+static uint32_t
+boot_decomp_flash_read(struct boot_decomp_ctx *ctx, uint32_t pos, uint8_t *buf, uint32_t len)
+{
+    uint8_t tmp[BOOT_DECOMP_CHUNK_SZ + 8];
+    uint32_t written;
+    uint32_t start;
+    uint32_t end;
+
+    written = ctx->wr_off - ctx->body_off;
+    if (len > BOOT_DECOMP_CHUNK_SZ) {
+        len = BOOT_DECOMP_CHUNK_SZ;
+    }
+    if (len > written - 3 - pos) {
+        len = written - 3 - pos;
+    }
+
+    if (!ctx->thumb) {
+        if (flash_area_read(ctx->fap_dst, ctx->body_off + pos, buf, len) != 0) {
+            ctx->rc = BOOT_EFLASH;
+            return 0;
+        }
+        return len;
+    }
+
+    start = (pos >= 4) ? pos - 4 : 0;
+    end = pos + len + 3;
+    if (flash_area_read(ctx->fap_dst, ctx->body_off + start, tmp, end - start) != 0) {
+        ctx->rc = BOOT_EFLASH;
+        return 0;
+    }
+
+    boot_decomp_thumb(tmp, start, pos + len - start, end - start, true);
+    memcpy(buf, &tmp[pos - start], len);
+
+    return len;
+}
+
+static inline void
+boot_decomp_put(struct boot_decomp_ctx *ctx, uint8_t byte)
+{
+    ctx->win[ctx->win_pos] = byte;
+    if (++ctx->win_pos == BOOT_DECOMP_WIN_SZ) {
+        ctx->win_pos = 0;
+    }
+    ctx->out_pos++;
+}
+
+/*
+ * Byte of the output at distance dist + 1 back.
+ */
+static inline uint8_t
+boot_decomp_get(const struct boot_decomp_ctx *ctx, uint32_t dist)
+{
+    uint32_t idx;
+
+    idx = (ctx->win_pos > dist) ? ctx->win_pos - dist - 1
+                                : ctx->win_pos + BOOT_DECOMP_WIN_SZ - dist - 1;
+
+    return ctx->win[idx];
+}
+
+/*
+ * Tells whether the output at pos is still in the window, rather than only
+ * in flash.
+ */
+static inline bool
+boot_decomp_in_win(const struct boot_decomp_ctx *ctx, uint32_t pos)
+{
+    return ctx->wr_off <= ctx->body_off || pos + 4 >= ctx->wr_off - ctx->body_off;
+}
+
+/*
+ * Byte of the output at distance dist + 1 back, wherever it is.
+ */
+static uint8_t
+boot_decomp_dict_byte(struct boot_decomp_ctx *ctx, uint32_t dist)
+{
+    uint8_t byte = 0;
+
+    if (boot_decomp_in_win(ctx, ctx->out_pos - dist - 1)) {
+        return boot_decomp_get(ctx, dist);
+    }
+
+    (void)boot_decomp_flash_read(ctx, ctx->out_pos - dist - 1, &byte, 1);
+
+    return byte;
+}
+
+/*
+ * Repeats len bytes of the output from distance dist + 1 back.
+ */
+static void
+boot_decomp_repeat(struct boot_decomp_ctx *ctx, uint32_t dist, uint32_t len)
+{
+    uint8_t buf[BOOT_DECOMP_CHUNK_SZ];
+    uint32_t pos;
+    uint32_t chunk;
+    uint32_t i;
+
+    while (len > 0 && ctx->rc == 0) {
+        pos = ctx->out_pos - dist - 1;
+
+        if (boot_decomp_in_win(ctx, pos)) {
+            boot_decomp_put(ctx, boot_decomp_get(ctx, dist));
+            len--;
+            continue;
+        }
+
+        chunk = boot_decomp_flash_read(ctx, pos, buf, len);
+        for (i = 0; i < chunk; i++) {
+            boot_decomp_put(ctx, buf[i]);
+        }
+        len -= chunk;
+    }
+}
+
+static inline uint8_t
+boot_decomp_in_byte(struct boot_decomp_ctx *ctx)
+{
+    uint32_t len;
+
+    if (ctx->in_pos == ctx->in_len) {
+        len = ctx->in_end - ctx->in_off;
+        if (len == 0) {
+            ctx->rc = BOOT_EBADIMAGE;
+            return 0;
+        }
+        if (len > sizeof(ctx->in_buf)) {
+            len = sizeof(ctx->in_buf);
+        }
+        if (flash_area_read(ctx->fap_src, ctx->in_off, ctx->in_buf, len) != 0) {
+            ctx->rc = BOOT_EFLASH;
+            return 0;
+        }
+        ctx->in_off += len;
+        ctx->in_pos = 0;
+        ctx->in_len = len;
+    }
+
+    ctx->in_count++;
+
+    return ctx->in_buf[ctx->in_pos++];
+}
+
+static inline void
+boot_decomp_rc_normalize(struct boot_decomp_ctx *ctx)
+{
+    if (ctx->range < LZMA_RC_TOP) {
+        ctx->range <<= 8;
+        ctx->code = (ctx->code << 8) | boot_decomp_in_byte(ctx);
+    }
+}
+
+static inline uint32_t
+boot_decomp_rc_bit(struct boot_decomp_ctx *ctx, uint16_t *prob)
+{
+    uint32_t bound;
+
+    boot_decomp_rc_normalize(ctx);
+
+    bound = (ctx->range >> LZMA_PROB_BITS) * *prob;
+    if (ctx->code < bound) {
+        ctx->range = bound;
+        *prob += ((1 << LZMA_PROB_BITS) - *prob) >> LZMA_MOVE_BITS;
+        return 0;
+    }
+
+    ctx->range -= bound;
+    ctx->code -= bound;
+    *prob -= *prob >> LZMA_MOVE_BITS;
+
+    return 1;
+}
+
+/*
+ * Decodes a symbol of bits bits, most significant bit first.
+ */
+static uint32_t
+boot_decomp_rc_bittree(struct boot_decomp_ctx *ctx, uint16_t *probs, uint32_t bits)
+{
+    uint32_t symbol = 1;
+    uint32_t limit = 1U << bits;
+
+    while (symbol < limit) {
+        symbol = (symbol << 1) | boot_decomp_rc_bit(ctx, &probs[symbol]);
+    }
+
+    return symbol - limit;
+}
+
+/*
+ * Decodes bits bits, least significant bit first, adding them to *dest.
+ * The probabilities used are probs[0] to probs[2^bits - 2].
+ */
+static void
+boot_decomp_rc_bittree_reverse(struct boot_decomp_ctx *ctx, uint16_t *probs, uint32_t *dest,
+                               uint32_t bits)
+{
+    uint32_t symbol = 1;
+    uint32_t bit;
+    uint32_t i;
+
+    for (i = 0; i < bits; i++) {
+        bit = boot_decomp_rc_bit(ctx, &probs[symbol - 1]);
+        symbol = (symbol << 1) | bit;
+        *dest += bit << i;
+    }
+}
+
+/*
+ * Decodes bits bits of equal probabilities, appending them to *dest.
+ */
+static void
+boot_decomp_rc_direct(struct boot_decomp_ctx *ctx, uint32_t *dest, uint32_t bits)
+{
+    uint32_t mask;
+
+    while (bits-- > 0) {
+        boot_decomp_rc_normalize(ctx);
+        ctx->range >>= 1;
+        ctx->code -= ctx->range;
+        mask = 0U - (ctx->code >> 31);
+        ctx->code += ctx->range & mask;
+        *dest = (*dest << 1) + (mask + 1);
+    }
+}
+
+static uint32_t
+boot_decomp_len(struct boot_decomp_ctx *ctx, struct boot_decomp_len *len, uint32_t pos_state)
+{
+    if (!boot_decomp_rc_bit(ctx, &len->choice)) {
+        return LZMA_MATCH_LEN_MIN + boot_decomp_rc_bittree(ctx, len->low[pos_state], 3);
+    }
+
+    if (!boot_decomp_rc_bit(ctx, &len->choice2)) {
+        return LZMA_MATCH_LEN_MIN + LZMA_LEN_LOW_SYMBOLS +
+               boot_decomp_rc_bittree(ctx, len->mid[pos_state], 3);
+    }
+
+    return LZMA_MATCH_LEN_MIN + LZMA_LEN_LOW_SYMBOLS + LZMA_LEN_MID_SYMBOLS +
+           boot_decomp_rc_bittree(ctx, len->high, 8);
+}
+
+static void
+boot_decomp_literal(struct boot_decomp_ctx *ctx)
+{
+    uint16_t *probs;
+    uint32_t prev;
+    uint32_t pos;
+    uint32_t symbol;
+    uint32_t match_byte;
+    uint32_t match_bit;
+    uint32_t offset;
+    uint32_t bit;
+
+    pos = ctx->out_pos - ctx->dict_start;
+    prev = (pos > 0) ? boot_decomp_get(ctx, 0) : 0;
+    probs = ctx->probs.literal[((pos & ctx->lp_mask) << ctx->lc) + (prev >> (8 - ctx->lc))];
+
+    if (ctx->state < LZMA_LIT_STATES) {
+        symbol = boot_decomp_rc_bittree(ctx, probs, 8);
+    } else {
+        /* Matched literal, decoded along the byte after the last match */
+        symbol = 1;
+        match_byte = (uint32_t)boot_decomp_dict_byte(ctx, ctx->rep0) << 1;
+        offset = 0x100;
+        do {
+            match_bit = match_byte & offset;
+            match_byte <<= 1;
+            bit = boot_decomp_rc_bit(ctx, &probs[offset + match_bit + symbol]);
+            symbol = (symbol << 1) | bit;
+            offset = bit ? match_bit : (offset & ~match_bit);
+        } while (symbol < 0x100);
+        symbol &= 0xff;
+    }
+
+    boot_decomp_put(ctx, (uint8_t)symbol);
+
+    if (ctx->state < 4) {
+        ctx->state = 0;
+    } else if (ctx->state < 10) {
+        ctx->state -= 3;
+    } else {
+        ctx->state -= 6;
+    }
+}
+
+/*
+ * Decodes a match and returns its length, its distance being left in rep0.
+ */
+static uint32_t
+boot_decomp_match(struct boot_decomp_ctx *ctx, uint32_t pos_state)
+{
+    uint32_t len;
+    uint32_t slot;
+    uint32_t bits;
+
+    ctx->state = (ctx->state < LZMA_LIT_STATES) ? 7 : 10;
+    ctx->rep3 = ctx->rep2;
+    ctx->rep2 = ctx->rep1;
+    ctx->rep1 = ctx->rep0;
+
+    len = boot_decomp_len(ctx, &ctx->probs.match_len, pos_state);
+
+    slot = boot_decomp_rc_bittree(ctx, ctx->probs.dist_slot[
+                                  (len < LZMA_DIST_STATES + LZMA_MATCH_LEN_MIN) ?
+                                  len - LZMA_MATCH_LEN_MIN : LZMA_DIST_STATES - 1], 6);
+    if (slot < LZMA_DIST_MODEL_START) {
+        ctx->rep0 = slot;
+        return len;
+    }
+
+    bits = (slot >> 1) - 1;
+    ctx->rep0 = (2 | (slot & 1)) << bits;
+    if (slot < LZMA_DIST_MODEL_END) {
+        boot_decomp_rc_bittree_reverse(ctx, &ctx->probs.dist_special[ctx->rep0 - slot],
+                                       &ctx->rep0, bits);
+    } else {
+        ctx->rep0 = 2 | (slot & 1);
+        boot_decomp_rc_direct(ctx, &ctx->rep0, bits - LZMA_ALIGN_BITS);
+        ctx->rep0 <<= LZMA_ALIGN_BITS;
+        boot_decomp_rc_bittree_reverse(ctx, ctx->probs.dist_align, &ctx->rep0, LZMA_ALIGN_BITS);
+    }
+
+    return len;
+}
+
+/*
+ * Decodes a repeated match and returns its length, its distance being left
+ * in rep0.
+ */
+static uint32_t
+boot_decomp_rep_match(struct boot_decomp_ctx *ctx, uint32_t pos_state)
+{
+    uint32_t dist;
+
+    if (!boot_decomp_rc_bit(ctx, &ctx->probs.is_rep0[ctx->state])) {
+        if (!boot_decomp_rc_bit(ctx, &ctx->probs.is_rep0_long[ctx->state][pos_state])) {
+            /* Single byte from the last distance */
+            ctx->state = (ctx->state < LZMA_LIT_STATES) ? 9 : 11;
+            return 1;
+        }
+    } else {
+        if (!boot_decomp_rc_bit(ctx, &ctx->probs.is_rep1[ctx->state])) {
+            dist = ctx->rep1;
+        } else {
+            if (!boot_decomp_rc_bit(ctx, &ctx->probs.is_rep2[ctx->state])) {
+                dist = ctx->rep2;
+            } else {
+                dist = ctx->rep3;
+                ctx->rep3 = ctx->rep2;
+            }
+            ctx->rep2 = ctx->rep1;
+        }
+        ctx->rep1 = ctx->rep0;
+        ctx->rep0 = dist;
+    }
+
+    ctx->state = (ctx->state < LZMA_LIT_STATES) ? 8 : 11;
+
+    return boot_decomp_len(ctx, &ctx->probs.rep_len, pos_state);
+}
+
+static void
+boot_decomp_lzma_reset(struct boot_decomp_ctx *ctx)
+{
+    uint16_t *probs = (uint16_t *)&ctx->probs;
+    size_t i;
+
+    for (i = 0; i < sizeof(ctx->probs) / sizeof(uint16_t); i++) {
+        probs[i] = LZMA_PROB_INIT;
+    }
+
+    ctx->state = 0;
+    ctx->rep0 = 0;
+    ctx->rep1 = 0;
+    ctx->rep2 = 0;
+    ctx->rep3 = 0;
+}
+
+/*
+ * Decodes an LZMA chunk of unpacked bytes from packed bytes of input.
+ */
+static void
+boot_decomp_lzma_chunk(struct boot_decomp_ctx *ctx, uint32_t unpacked, uint32_t packed)
+{
+    uint32_t end;
+    uint32_t pos_state;
+    uint32_t len;
+    int i;
+
+    end = ctx->out_pos + unpacked;
+    ctx->in_count = 0;
+
+    /* The range decoder starts over with each chunk */
+    if (boot_decomp_in_byte(ctx) != 0) {
+        ctx->rc = BOOT_EBADIMAGE;
+    }
+    ctx->range = 0xffffffff;
+    ctx->code = 0;
+    for (i = 0; i < 4; i++) {
+        ctx->code = (ctx->code << 8) | boot_decomp_in_byte(ctx);
+    }
+
+    while (ctx->out_pos < end && ctx->rc == 0) {
+        pos_state = (ctx->out_pos - ctx->dict_start) & ctx->pb_mask;
+
+        if (!boot_decomp_rc_bit(ctx, &ctx->probs.is_match[ctx->state][pos_state])) {
+            boot_decomp_literal(ctx);
+        } else {
+            if (boot_decomp_rc_bit(ctx, &ctx->probs.is_rep[ctx->state])) {
+                len = boot_decomp_rep_match(ctx, pos_state);
+            } else {
+                len = boot_decomp_match(ctx, pos_state);
+            }
+
+            /* Matches stay within the chunk and the dictionary */
+            if (len > end - ctx->out_pos || ctx->rep0 >= ctx->out_pos - ctx->dict_start) {
+                ctx->rc = BOOT_EBADIMAGE;
+                break;
+            }
+
+            boot_decomp_repeat(ctx, ctx->rep0, len);
+        }
+
+        if (ctx->out_pos - ctx->flushed >= BOOT_DECOMP_FLUSH_SZ) {
+            boot_decomp_flush(ctx, false);
+        }
+    }
+
+    boot_decomp_rc_normalize(ctx);
+    if (ctx->rc == 0 && (ctx->in_count != packed || ctx->code != 0)) {
+        ctx->rc = BOOT_EBADIMAGE;
+    }
+}
+
+/*
+ * Copies an uncompressed chunk of len bytes of input.
+ */
+static void
+boot_decomp_copy_chunk(struct boot_decomp_ctx *ctx, uint32_t len)
+{
+    while (len-- > 0 && ctx->rc == 0) {
+        boot_decomp_put(ctx, boot_decomp_in_byte(ctx));
+
+        if (ctx->out_pos - ctx->flushed >= BOOT_DECOMP_FLUSH_SZ) {
+            boot_decomp_flush(ctx, false);
+        }
+    }
+}
+
+/*
+ * Decodes the LZMA2 stream of the compressed image.
+ */
+static void
+boot_decomp_lzma2(struct boot_decomp_ctx *ctx)
+{
+    uint8_t control;
+    uint8_t props;
+    uint32_t unpacked;
+    uint32_t packed;
+    uint32_t lc;
+    uint32_t lp;
+    uint32_t pb;
+    bool have_props = false;
+    bool first = true;
+
+    while (ctx->rc == 0) {
+        control = boot_decomp_in_byte(ctx);
+        if (control == 0x00) {
+            /* End of stream */
+            break;
+        }
+
+        /* The first chunk resets the dictionary */
+        if (first && control != 0x01 && control < 0xe0) {
+            ctx->rc = BOOT_EBADIMAGE;
+            break;
+        }
+        first = false;
+
+        if (control == 0x01 || control >= 0xe0) {
+            ctx->dict_start = ctx->out_pos;
+        }
+
+        if (control < 0x80) {
+            if (control > 0x02) {
+                ctx->rc = BOOT_EBADIMAGE;
+                break;
+            }
+
+            unpacked = (uint32_t)boot_decomp_in_byte(ctx) << 8;
+            unpacked += (uint32_t)boot_decomp_in_byte(ctx) + 1;
+            if (unpacked > ctx->out_end - ctx->out_pos) {
+                ctx->rc = BOOT_EBADIMAGE;
+                break;
+            }
+
+            boot_decomp_copy_chunk(ctx, unpacked);
+            continue;
+        }
+
+        unpacked = (uint32_t)(control & 0x1f) << 16;
+        unpacked += (uint32_t)boot_decomp_in_byte(ctx) << 8;
+        unpacked += (uint32_t)boot_decomp_in_byte(ctx) + 1;
+        packed = (uint32_t)boot_decomp_in_byte(ctx) << 8;
+        packed += (uint32_t)boot_decomp_in_byte(ctx) + 1;
+
+        if (control >= 0xc0) {
+            /* New properties */
+            props = boot_decomp_in_byte(ctx);
+            lc = props % 9;
+            lp = (props / 9) % 5;
+            pb = props / 45;
+            if (lc + lp > 4 || pb > 4) {
+                ctx->rc = BOOT_EBADIMAGE;
+                break;
+            }
+            ctx->lc = lc;
+            ctx->lp_mask = (1U << lp) - 1;
+            ctx->pb_mask = (1U << pb) - 1;
+            have_props = true;
+        }
+
+        if (!have_props || unpacked > ctx->out_end - ctx->out_pos) {
+            ctx->rc = BOOT_EBADIMAGE;
+            break;
+        }
+
+        if (control >= 0xa0) {
+            boot_decomp_lzma_reset(ctx);
+        }
+
+        boot_decomp_lzma_chunk(ctx, unpacked, packed);
+    }
+
+    if (ctx->rc == 0 && ctx->out_pos != ctx->out_end) {
+        ctx->rc = BOOT_EBADIMAGE;
+    }
+}
+
+static bool
+boot_decomp_is_sig_tlv(uint16_t type)
+{
+    return type == IMAGE_TLV_RSA2048_PSS || type == IMAGE_TLV_ECDSA_SIG ||
+           type == IMAGE_TLV_RSA3072_PSS || type == IMAGE_TLV_ED25519;
+}
+
+static bool
+boot_decomp_is_comp_tlv(uint16_t type)
+{
+    return type == IMAGE_TLV_DECOMP_SIZE || type == IMAGE_TLV_DECOMP_SHA ||
+           type == IMAGE_TLV_DECOMP_SIGNATURE || type == IMAGE_TLV_COMP_DEC_SIZE;
+}
+
+/*
+ * Goes through the TLVs of the compressed image to find out about the
+ * decompressed one. With a context, also writes the protected (prot) or
+ * unprotected TLVs of the decompressed image, the latter holding the hash
+ * given.
+ */
+static int
+boot_decomp_tlvs(const struct image_header *hdr, const struct flash_area *fap,
+                 struct boot_decomp_info *info, struct boot_decomp_ctx *ctx, bool prot,
+                 const uint8_t *hash)
+{
+    struct image_tlv_iter it;
+    struct image_tlv_info tlv_info;
+    uint32_t off;
+    uint16_t len;
+    uint16_t type;
+    bool is_prot;
+    int rc;
+
+    if (ctx == NULL) {
+        memset(info, 0, sizeof(*info));
+    } else if (!prot || info->prot_sz > 0) {
+        tlv_info.it_magic = prot ? IMAGE_TLV_PROT_INFO_MAGIC : IMAGE_TLV_INFO_MAGIC;
+        tlv_info.it_tlv_tot = prot ? info->prot_sz : info->unprot_sz;
+        boot_decomp_write(ctx, (const uint8_t *)&tlv_info, sizeof(tlv_info));
+    }
+
+    rc = bootutil_tlv_iter_begin(&it, hdr, fap, IMAGE_TLV_ANY, false);
+    if (rc != 0) {
+        return BOOT_EBADIMAGE;
+    }
+
+    while (true) {
+        rc = bootutil_tlv_iter_next(&it, &off, &len, &type);
+        if (rc < 0) {
+            return BOOT_EBADIMAGE;
+        } else if (rc > 0) {
+            break;
+        }
+
+        is_prot = bootutil_tlv_iter_is_prot(&it, off);
+
+        if (ctx == NULL) {
+            if (!is_prot) {
+                if (type == EXPECTED_HASH_TLV) {
+                    info->unprot_sz += sizeof(struct image_tlv) + IMAGE_HASH_SIZE;
+                } else if (type == IMAGE_TLV_KEYHASH || type == IMAGE_TLV_PUBKEY) {
+                    info->unprot_sz += sizeof(struct image_tlv) + len;
+                } else if (boot_decomp_is_sig_tlv(type) && info->sig_len > 0) {
+                    info->unprot_sz += sizeof(struct image_tlv) + info->sig_len;
+                }
+            } else if (!boot_decomp_is_comp_tlv(type)) {
+                info->prot_sz += sizeof(struct image_tlv) + len;
+            } else if (type == IMAGE_TLV_DECOMP_SIZE) {
+                if (len != sizeof(info->img_size) ||
+                    flash_area_read(fap, off, &info->img_size, len) != 0) {
+                    return BOOT_EBADIMAGE;
+                }
+            } else if (type == IMAGE_TLV_DECOMP_SHA) {
+                if (len != IMAGE_HASH_SIZE) {
+                    return BOOT_EBADIMAGE;
+                }
+                info->sha_off = off;
+            } else if (type == IMAGE_TLV_DECOMP_SIGNATURE) {
+                info->sig_off = off;
+                info->sig_len = len;
+            }
+        } else if (prot && is_prot && !boot_decomp_is_comp_tlv(type)) {
+            boot_decomp_write_from(ctx, off - sizeof(struct image_tlv),
+                                   sizeof(struct image_tlv) + len);
+        } else if (!prot && !is_prot) {
+            if (type == EXPECTED_HASH_TLV) {
+                boot_decomp_write_tlv(ctx, type, IMAGE_HASH_SIZE);
+                boot_decomp_write(ctx, hash, IMAGE_HASH_SIZE);
+            } else if (type == IMAGE_TLV_KEYHASH || type == IMAGE_TLV_PUBKEY) {
+                boot_decomp_write_from(ctx, off - sizeof(struct image_tlv),
+                                       sizeof(struct image_tlv) + len);
+            } else if (boot_decomp_is_sig_tlv(type) && info->sig_len > 0) {
+                boot_decomp_write_tlv(ctx, type, info->sig_len);
+                boot_decomp_write_from(ctx, info->sig_off, info->sig_len);
+            }
+        }
+    }
+
+    if (ctx == NULL) {
+        if (info->img_size == 0 || info->sha_off == 0) {
+            return BOOT_EBADIMAGE;
+        }
+        if (info->prot_sz > 0) {
+            info->prot_sz += sizeof(struct image_tlv_info);
+        }
+        info->unprot_sz += sizeof(struct image_tlv_info);
+        if (info->prot_sz > UINT16_MAX || info->unprot_sz > UINT16_MAX) {
+            return BOOT_EBADIMAGE;
+        }
+    }
+
+    return (ctx != NULL) ? ctx->rc : 0;
+}
+
+int
+boot_decompressed_size(const struct image_header *hdr, const struct flash_area *fap,
+                       uint32_t *size)
+{
+    struct boot_decomp_info info;
+    int rc;
+
+    rc = boot_decomp_tlvs(hdr, fap, &info, NULL, false, NULL);
+    if (rc != 0) {
+        return rc;
+    }
+
+    if (!boot_u32_safe_add(size, hdr->ih_hdr_size, info.img_size) ||
+        !boot_u32_safe_add(size, *size, info.prot_sz) ||
+        !boot_u32_safe_add(size, *size, info.unprot_sz)) {
+        return BOOT_EBADIMAGE;
+    }
+
+    return 0;
+}
+
+int
+boot_decompress_image(struct boot_loader_state *state, const struct flash_area *fap_src,
+                      const struct flash_area *fap_dst, uint32_t *size)
+{
+    TARGET_STATIC struct boot_decomp_ctx ctx;
+    const struct image_header *src_hdr;
+    struct image_header hdr;
+    struct boot_decomp_info info;
+    uint8_t lzma2_hdr[2];
+    uint8_t hash[IMAGE_HASH_SIZE];
+    uint8_t expected[IMAGE_HASH_SIZE];
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
+    int rc;
+
+    src_hdr = boot_img_hdr(state, BOOT_SLOT_SECONDARY);
+
+    if (!(src_hdr->ih_flags & IMAGE_F_COMPRESSED_LZMA2) || IS_ENCRYPTED(src_hdr) ||
+        src_hdr->ih_img_size < sizeof(lzma2_hdr)) {
+        BOOT_LOG_ERR("Image %d: unsupported compressed image", BOOT_CURR_IMG(state));
+        return BOOT_EBADIMAGE;
+    }
+
+    rc = boot_decomp_tlvs(src_hdr, fap_src, &info, NULL, false, NULL);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = flash_area_read(fap_src, src_hdr->ih_hdr_size, lzma2_hdr, sizeof(lzma2_hdr));
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+    if (lzma2_hdr[0] > 40) {
+        return BOOT_EBADIMAGE;
+    }
+
+    memset(&ctx, 0, offsetof(struct boot_decomp_ctx, probs));
+    ctx.fap_src = fap_src;
+    ctx.in_off = src_hdr->ih_hdr_size + sizeof(lzma2_hdr);
+    ctx.in_end = src_hdr->ih_hdr_size + src_hdr->ih_img_size;
+    ctx.fap_dst = fap_dst;
+    ctx.thumb = (src_hdr->ih_flags & IMAGE_F_COMPRESSED_ARM_THUMB_FLT) != 0;
+    ctx.body_off = src_hdr->ih_hdr_size;
+    ctx.out_end = info.img_size;
+    ctx.hashing = true;
+
+    BOOT_LOG_INF("Image %d: decompressing 0x%x bytes to 0x%x bytes", BOOT_CURR_IMG(state),
+                 (unsigned int)src_hdr->ih_img_size, (unsigned int)info.img_size);
+
+    bootutil_sha_init(&ctx.sha);
+
+    /* Header of the image as it was before compression */
+    hdr = *src_hdr;
+    hdr.ih_flags &= ~COMPRESSIONFLAGS;
+    hdr.ih_img_size = info.img_size;
+    hdr.ih_protect_tlv_size = (uint16_t)info.prot_sz;
+    boot_decomp_write(&ctx, (const uint8_t *)&hdr, sizeof(hdr));
+    boot_decomp_write_from(&ctx, sizeof(hdr), hdr.ih_hdr_size - sizeof(hdr));
+
+    boot_decomp_lzma2(&ctx);
+    boot_decomp_flush(&ctx, true);
+
+    rc = boot_decomp_tlvs(src_hdr, fap_src, &info, &ctx, true, NULL);
+
+    bootutil_sha_finish(&ctx.sha, hash);
+    bootutil_sha_drop(&ctx.sha);
+    ctx.hashing = false;
+
+    if (rc != 0) {
+        BOOT_LOG_ERR("Image %d: decompression failed", BOOT_CURR_IMG(state));
+        return rc;
+    }
+
+    if (flash_area_read(fap_src, info.sha_off, expected, sizeof(expected)) != 0) {
+        return BOOT_EFLASH;
+    }
+
+    FIH_CALL(boot_fih_memequal, fih_rc, hash, expected, sizeof(hash));
+    if (FIH_NOT_EQ(fih_rc, FIH_SUCCESS)) {
+        BOOT_LOG_ERR("Image %d: decompressed image hash mismatch", BOOT_CURR_IMG(state));
+        return BOOT_EBADIMAGE;
+    }
+
+    rc = boot_decomp_tlvs(src_hdr, fap_src, &info, &ctx, false, hash);
+    boot_decomp_write_flush(&ctx);
+    if (rc == 0) {
+        rc = ctx.rc;
+    }
+
+    *size = ctx.wr_off;
+
+    return rc;
+}
+
+#endif /* MCUBOOT_DECOMPRESS_IMAGES && MCUBOOT_OVERWRITE_ONLY */
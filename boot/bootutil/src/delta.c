@@ -0,0 +1,708 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Delta images.
+ *
+ * The payload of a delta image (IMAGE_F_DELTA) is a patch which, applied to
+ * the image in the primary slot, gives a full signed image. The patch is a
+ * sequence of operations, each starting with a LEB128 encoded value whose
+ * lowest bit is the operation and the other bits its length:
+ *
+ *  - BOOT_DELTA_OP_COPY copies length bytes from the base image; the value
+ *    is followed by the zigzag LEB128 encoded distance from the end of the
+ *    previous copy to the start of this one;
+ *  - BOOT_DELTA_OP_INSERT copies the length bytes which follow it.
+ *
+ * The protected IMAGE_TLV_DELTA_BASE TLV holds the size of the full image
+ * followed by the hash of the base image, so that the patch is only applied
+ * to the image it was made for.
+ *
+ * The full image is rebuilt in the secondary slot, in place of the delta
+ * image, after which the upgrade goes on as with any full image, starting
+ * with its validation. As the full image overwrites the patch, the header
+ * and patch are first moved to the end of the slot, and the offset they were
+ * moved to is written to the swap size field of the secondary slot trailer,
+ * which is otherwise unused. Until then the delta image is untouched; after,
+ * a reset restarts the rebuild from the moved patch. The rebuild writes the
+ * block of the full image which holds the header last, so that the slot only
+ * holds a full image when the rebuild is done.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bootutil/bootutil.h"
+#include "bootutil/image.h"
+#include "bootutil/crypto/sha.h"
+#include "bootutil_priv.h"
+#include "bootutil_loader.h"
+#include "bootutil/bootutil_log.h"
+
+#include "mcuboot_config/mcuboot_config.h"
+
+#ifdef MCUBOOT_DELTA_UPDATES
+
+#if defined(MCUBOOT_DIRECT_XIP) || defined(MCUBOOT_RAM_LOAD) || \
+    defined(MCUBOOT_SINGLE_APPLICATION_SLOT)
+#error "MCUBOOT_DELTA_UPDATES requires an upgrade strategy with a secondary slot"
+#endif
+#if defined(MCUBOOT_ENC_IMAGES) || defined(MCUBOOT_SIGN_PURE)
+#error "MCUBOOT_DELTA_UPDATES is not supported with MCUBOOT_ENC_IMAGES or MCUBOOT_SIGN_PURE"
+#endif
+
+BOOT_LOG_MODULE_DECLARE(mcuboot);
+
+#define BOOT_DELTA_OP_COPY      0
+#define BOOT_DELTA_OP_INSERT    1
+
+/* Size of the buffer the patch is read through */
+#define BOOT_DELTA_IN_SZ        64
+
+struct boot_delta_base {
+    uint32_t size;                      /* Size of the full image */
+    uint8_t hash[IMAGE_HASH_SIZE];      /* Hash of the base image */
+};
+
+struct boot_delta_ctx {
+    const struct flash_area *fap_base;  /* Area holding the base image */
+    const struct flash_area *fap;       /* Area holding the patch and output */
+    uint32_t base_off;                  /* End of the last copy from the base */
+    uint32_t in_off;                    /* Offset of the patch left to read */
+    uint32_t in_end;                    /* End of the patch */
+    uint32_t in_pos;                    /* Position in in_buf */
+    uint32_t in_len;                    /* Bytes in in_buf */
+    uint32_t out_off;                   /* Offset of the full image */
+    uint32_t out_pos;                   /* Size of the full image produced */
+    uint32_t out_lo;                    /* Part of the full image written... */
+    uint32_t out_hi;                    /* ...in this pass */
+    uint32_t out_limit;                 /* Offset the output must stay below */
+    uint32_t erased_end;                /* End of the output erased so far */
+    uint32_t buf_pos;                   /* Position in the full image of buf */
+    uint32_t buf_len;                   /* Bytes in buf */
+    uint8_t in_buf[BOOT_DELTA_IN_SZ];
+    uint8_t buf[BOOT_IO_BUF_SZ];
+};
+
+/*
+ * Offset in the secondary slot of the images to upgrade to.
+ */
+static uint32_t
+boot_delta_img_off(struct boot_loader_state *state)
+{
+#if defined(MCUBOOT_SWAP_USING_OFFSET)
+    return boot_img_sector_size(state, BOOT_SLOT_SECONDARY, 0);
+#else
+    (void)state;
+    return 0;
+#endif
+}
+
+/*
+ * Start and end of the sector of fap containing off.
+ */
+static int
+boot_delta_sector(const struct flash_area *fap, uint32_t off, uint32_t *start, uint32_t *end)
+{
+    struct flash_sector sector;
+    int rc;
+
+    rc = flash_area_get_sector(fap, off, &sector);
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    *start = flash_sector_get_off(&sector);
+    *end = *start + flash_sector_get_size(&sector);
+
+    return 0;
+}
+
+static int
+boot_delta_read_byte(struct boot_delta_ctx *ctx, uint8_t *byte)
+{
+    uint32_t len;
+
+    if (ctx->in_pos == ctx->in_len) {
+        if (ctx->in_off == ctx->in_end) {
+            return BOOT_EBADIMAGE;
+        }
+
+        len = ctx->in_end - ctx->in_off;
+        if (len > sizeof(ctx->in_buf)) {
+            len = sizeof(ctx->in_buf);
+        }
+        if (flash_area_read(ctx->fap, ctx->in_off, ctx->in_buf, len) != 0) {
+            return BOOT_EFLASH;
+        }
+
+        ctx->in_off += len;
+        ctx->in_pos = 0;
+        ctx->in_len = len;
+    }
+
+    *byte = ctx->in_buf[ctx->in_pos++];
+
+    return 0;
+}
+
+/*
+ * Skips len bytes of the patch.
+ */
+static int
+boot_delta_skip(struct boot_delta_ctx *ctx, uint32_t len)
+{
+    uint32_t chunk;
+
+    while (len > 0) {
+        if (ctx->in_pos == ctx->in_len) {
+            /* Nothing buffered, skip in flash */
+            if (ctx->in_off == ctx->in_end) {
+                return BOOT_EBADIMAGE;
+            }
+
+            chunk = ctx->in_end - ctx->in_off;
+            if (chunk > len) {
+                chunk = len;
+            }
+            ctx->in_off += chunk;
+        } else {
+            chunk = ctx->in_len - ctx->in_pos;
+            if (chunk > len) {
+                chunk = len;
+            }
+            ctx->in_pos += chunk;
+        }
+        len -= chunk;
+    }
+
+    return 0;
+}
+
+static int
+boot_delta_read_varint(struct boot_delta_ctx *ctx, uint32_t *val)
+{
+    uint8_t byte;
+    uint32_t shift;
+    int rc;
+
+    *val = 0;
+    for (shift = 0; shift < 32; shift += 7) {
+        rc = boot_delta_read_byte(ctx, &byte);
+        if (rc != 0) {
+            return rc;
+        }
+
+        if (shift == 28 && (byte & 0xf0) != 0) {
+            return BOOT_EBADIMAGE;
+        }
+
+        *val |= (uint32_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return 0;
+        }
+    }
+
+    return BOOT_EBADIMAGE;
+}
+
+static bool
+boot_delta_at_end(const struct boot_delta_ctx *ctx)
+{
+    return ctx->in_pos == ctx->in_len && ctx->in_off == ctx->in_end;
+}
+
+/*
+ * Writes the output buffered so far, erasing the sectors it goes to first.
+ */
+static int
+boot_delta_flush(struct boot_delta_ctx *ctx)
+{
+    uint32_t off;
+    uint32_t len;
+    uint32_t align;
+    uint32_t start;
+    uint32_t end;
+    int rc;
+
+    if (ctx->buf_len == 0) {
+        return 0;
+    }
+
+    off = ctx->out_off + ctx->buf_pos;
+    len = ctx->buf_len;
+
+    /* Pad the end of the image to the write size */
+    align = flash_area_align(ctx->fap);
+    if (len % align != 0) {
+        memset(&ctx->buf[len], flash_area_erased_val(ctx->fap), align - len % align);
+        len += align - len % align;
+    }
+
+    if (off + len > ctx->out_limit) {
+        BOOT_LOG_ERR("Delta image produces too large an image");
+        return BOOT_EBADIMAGE;
+    }
+
+    while (ctx->erased_end < off + len) {
+        rc = boot_delta_sector(ctx->fap, ctx->erased_end, &start, &end);
+        if (rc != 0) {
+            return rc;
+        }
+
+        rc = boot_erase_region(ctx->fap, start, end - start, false);
+        if (rc != 0) {
+            return BOOT_EFLASH;
+        }
+        ctx->erased_end = end;
+    }
+
+    if (flash_area_write(ctx->fap, off, ctx->buf, len) != 0) {
+        return BOOT_EFLASH;
+    }
+
+    ctx->buf_pos += ctx->buf_len;
+    ctx->buf_len = 0;
+
+    MCUBOOT_WATCHDOG_FEED();
+
+    return 0;
+}
+
+/*
+ * Produces len bytes of the full image, copied from the base image at
+ * base_off or from the patch. Only the bytes within [out_lo, out_hi) are
+ * read and written, the others are skipped.
+ */
+static int
+boot_delta_output(struct boot_delta_ctx *ctx, bool from_base, uint32_t base_off, uint32_t len)
+{
+    uint32_t skip;
+    uint32_t chunk;
+    uint32_t i;
+    int rc;
+
+    while (len > 0) {
+        if (ctx->out_pos < ctx->out_lo) {
+            skip = ctx->out_lo - ctx->out_pos;
+        } else if (ctx->out_pos >= ctx->out_hi) {
+            skip = len;
+        } else {
+            skip = 0;
+        }
+
+        if (skip > 0) {
+            if (skip > len) {
+                skip = len;
+            }
+            if (from_base) {
+                base_off += skip;
+            } else {
+                rc = boot_delta_skip(ctx, skip);
+                if (rc != 0) {
+                    return rc;
+                }
+            }
+            ctx->out_pos += skip;
+            len -= skip;
+            continue;
+        }
+
+        if (ctx->buf_len == 0) {
+            ctx->buf_pos = ctx->out_pos;
+        }
+
+        chunk = sizeof(ctx->buf) - ctx->buf_len;
+        if (chunk > len) {
+            chunk = len;
+        }
+        if (chunk > ctx->out_hi - ctx->out_pos) {
+            chunk = ctx->out_hi - ctx->out_pos;
+        }
+
+        if (from_base) {
+            if (flash_area_read(ctx->fap_base, base_off, &ctx->buf[ctx->buf_len], chunk) != 0) {
+                return BOOT_EFLASH;
+            }
+            base_off += chunk;
+        } else {
+            for (i = 0; i < chunk; i++) {
+                rc = boot_delta_read_byte(ctx, &ctx->buf[ctx->buf_len + i]);
+                if (rc != 0) {
+                    return rc;
+                }
+            }
+        }
+
+        ctx->buf_len += chunk;
+        ctx->out_pos += chunk;
+        len -= chunk;
+
+        if (ctx->buf_len == sizeof(ctx->buf)) {
+            rc = boot_delta_flush(ctx);
+            if (rc != 0) {
+                return rc;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Runs the patch at [patch_off, patch_end) of the secondary slot, writing
+ * the part of the full image within [out_lo, out_hi), which is erased first
+ * unless erased is set.
+ */
+static int
+boot_delta_run(struct boot_loader_state *state, struct boot_delta_ctx *ctx,
+               uint32_t patch_off, uint32_t patch_end, uint32_t out_lo, uint32_t out_hi,
+               bool erased)
+{
+    uint32_t base_sz;
+    uint32_t val;
+    uint32_t len;
+    uint32_t dist;
+    int32_t base_off;
+    int rc;
+
+    ctx->fap_base = BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY);
+    ctx->fap = BOOT_IMG_AREA(state, BOOT_SLOT_SECONDARY);
+    ctx->base_off = 0;
+    ctx->in_off = patch_off;
+    ctx->in_end = patch_end;
+    ctx->in_pos = 0;
+    ctx->in_len = 0;
+    ctx->out_off = boot_delta_img_off(state);
+    ctx->out_pos = 0;
+    ctx->out_lo = out_lo;
+    ctx->out_hi = out_hi;
+    ctx->erased_end = ctx->out_off + (erased ? out_hi : out_lo);
+    ctx->buf_pos = 0;
+    ctx->buf_len = 0;
+
+    base_sz = flash_area_get_size(ctx->fap_base);
+
+    while (!boot_delta_at_end(ctx) && ctx->out_pos < out_hi) {
+        rc = boot_delta_read_varint(ctx, &val);
+        if (rc != 0) {
+            return rc;
+        }
+        len = val >> 1;
+
+        if ((val & 1) == BOOT_DELTA_OP_COPY) {
+            rc = boot_delta_read_varint(ctx, &dist);
+            if (rc != 0) {
+                return rc;
+            }
+
+            /* Zigzag decoding */
+            base_off = (int32_t)ctx->base_off + (int32_t)((dist >> 1) ^ (~(dist & 1) + 1));
+            if (base_off < 0 || (uint32_t)base_off > base_sz || len > base_sz - base_off) {
+                return BOOT_EBADIMAGE;
+            }
+
+            rc = boot_delta_output(ctx, true, base_off, len);
+            ctx->base_off = base_off + len;
+        } else {
+            rc = boot_delta_output(ctx, false, 0, len);
+        }
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    return boot_delta_flush(ctx);
+}
+
+/*
+ * Rebuilds the full image from the delta image moved to moved_off in the
+ * secondary slot, writing the block holding its header last.
+ */
+static int
+boot_delta_patch(struct boot_loader_state *state, uint32_t moved_off, uint32_t trailer_off)
+{
+    TARGET_STATIC struct boot_delta_ctx ctx;
+    const struct flash_area *fap;
+    struct image_header hdr;
+    uint32_t img_off;
+    uint32_t patch_off;
+    uint32_t patch_end;
+    uint32_t first_off;
+    uint32_t first_end;
+    uint32_t hdr_end;
+    int rc;
+
+    fap = BOOT_IMG_AREA(state, BOOT_SLOT_SECONDARY);
+
+    rc = flash_area_read(fap, moved_off, &hdr, sizeof(hdr));
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    patch_off = moved_off + hdr.ih_hdr_size;
+    if (hdr.ih_magic != IMAGE_MAGIC || !IS_DELTA(&hdr) ||
+        !boot_u32_safe_add(&patch_end, patch_off, hdr.ih_img_size) || patch_end > trailer_off) {
+        return BOOT_EBADIMAGE;
+    }
+
+    img_off = boot_delta_img_off(state);
+    rc = boot_delta_sector(fap, img_off, &first_off, &first_end);
+    if (rc != 0) {
+        return rc;
+    }
+
+    BOOT_LOG_INF("Image %d: applying delta image", BOOT_CURR_IMG(state));
+
+    /* The full image must stay below the moved delta image */
+    ctx.out_limit = moved_off;
+
+    /* The block holding the header, at the start of the first sector, goes last */
+    hdr_end = first_end - img_off;
+    if (hdr_end > sizeof(ctx.buf)) {
+        hdr_end = sizeof(ctx.buf);
+    }
+
+    rc = boot_delta_run(state, &ctx, patch_off, patch_end, first_end - img_off, UINT32_MAX,
+                        false);
+    if (rc == 0) {
+        rc = boot_erase_region(fap, first_off, first_end - first_off, false);
+        if (rc != 0) {
+            rc = BOOT_EFLASH;
+        }
+    }
+    if (rc == 0) {
+        rc = boot_delta_run(state, &ctx, patch_off, patch_end, hdr_end, first_end - img_off,
+                            true);
+    }
+    if (rc == 0) {
+        rc = boot_delta_run(state, &ctx, patch_off, patch_end, 0, hdr_end, true);
+    }
+    if (rc != 0) {
+        BOOT_LOG_ERR("Image %d: failed applying delta image", BOOT_CURR_IMG(state));
+        return rc;
+    }
+
+#if defined(MCUBOOT_SWAP_USING_OFFSET)
+    state->secondary_offset[BOOT_CURR_IMG(state)] = img_off;
+#endif
+
+    return boot_read_image_headers(state, false, NULL);
+}
+
+/*
+ * Reads the IMAGE_TLV_DELTA_BASE TLV of the delta image in the secondary slot.
+ */
+static int
+boot_delta_read_base(struct boot_loader_state *state, struct boot_delta_base *base)
+{
+    const struct flash_area *fap;
+    struct image_tlv_iter it;
+    uint32_t off;
+    uint16_t len;
+    int rc;
+
+    fap = BOOT_IMG_AREA(state, BOOT_SLOT_SECONDARY);
+#if defined(MCUBOOT_SWAP_USING_OFFSET)
+    it.start_off = boot_get_state_secondary_offset(state, fap);
+#endif
+
+    rc = bootutil_tlv_iter_begin(&it, boot_img_hdr(state, BOOT_SLOT_SECONDARY), fap,
+                                 IMAGE_TLV_DELTA_BASE, true);
+    if (rc != 0) {
+        return BOOT_EBADIMAGE;
+    }
+
+    rc = bootutil_tlv_iter_next(&it, &off, &len, NULL);
+    if (rc != 0 || len != sizeof(*base)) {
+        return BOOT_EBADIMAGE;
+    }
+
+    if (flash_area_read(fap, off, base, sizeof(*base)) != 0) {
+        return BOOT_EFLASH;
+    }
+
+    return 0;
+}
+
+/*
+ * Checks that the image in the primary slot is the one the delta image in
+ * the secondary slot was made for.
+ */
+static int
+boot_delta_check_base(struct boot_loader_state *state, const struct boot_delta_base *base)
+{
+    const struct flash_area *fap;
+    struct image_tlv_iter it;
+    uint8_t hash[IMAGE_HASH_SIZE];
+    uint32_t off;
+    uint16_t len;
+    int rc;
+
+    fap = BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY);
+#if defined(MCUBOOT_SWAP_USING_OFFSET)
+    it.start_off = 0;
+#endif
+
+    if (boot_img_hdr(state, BOOT_SLOT_PRIMARY)->ih_magic != IMAGE_MAGIC) {
+        return BOOT_EBADIMAGE;
+    }
+
+    rc = bootutil_tlv_iter_begin(&it, boot_img_hdr(state, BOOT_SLOT_PRIMARY), fap,
+                                 EXPECTED_HASH_TLV, false);
+    if (rc != 0) {
+        return BOOT_EBADIMAGE;
+    }
+
+    rc = bootutil_tlv_iter_next(&it, &off, &len, NULL);
+    if (rc != 0 || len != sizeof(hash)) {
+        return BOOT_EBADIMAGE;
+    }
+
+    if (flash_area_read(fap, off, hash, sizeof(hash)) != 0) {
+        return BOOT_EFLASH;
+    }
+
+    if (memcmp(hash, base->hash, sizeof(hash)) != 0) {
+        return BOOT_EBADIMAGE;
+    }
+
+    return 0;
+}
+
+int
+boot_delta_resume(struct boot_loader_state *state)
+{
+    const struct flash_area *fap;
+    struct image_header hdr;
+    uint32_t moved_off;
+    size_t trailer_off;
+    int rc;
+
+    fap = BOOT_IMG_AREA(state, BOOT_SLOT_SECONDARY);
+
+    rc = boot_read_swap_size(fap, &moved_off);
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    if (bootutil_buffer_is_erased(fap, &moved_off, sizeof(moved_off))) {
+        return 0;
+    }
+
+    /* Only resume while the slot does not hold a full image yet */
+    rc = flash_area_read(fap, boot_delta_img_off(state), &hdr, sizeof(hdr));
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    if (hdr.ih_magic == IMAGE_MAGIC && !IS_DELTA(&hdr)) {
+        return 0;
+    }
+
+    rc = boot_trailer_scramble_offset(fap, BOOT_WRITE_SZ(state), &trailer_off);
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    if (moved_off >= trailer_off) {
+        return 0;
+    }
+
+    return boot_delta_patch(state, moved_off, trailer_off);
+}
+
+int
+boot_delta_apply(struct boot_loader_state *state)
+{
+    const struct flash_area *fap;
+    struct image_header *hdr;
+    struct boot_delta_base base;
+    uint32_t img_off;
+    uint32_t patch_sz;
+    uint32_t out_end;
+    uint32_t moved_off;
+    uint32_t unused;
+    size_t trailer_off;
+    int rc;
+
+    fap = BOOT_IMG_AREA(state, BOOT_SLOT_SECONDARY);
+    hdr = boot_img_hdr(state, BOOT_SLOT_SECONDARY);
+    img_off = boot_delta_img_off(state);
+
+    rc = boot_delta_read_base(state, &base);
+    if (rc != 0) {
+        BOOT_LOG_ERR("Image %d: delta image without base", BOOT_CURR_IMG(state));
+        return rc;
+    }
+
+    rc = boot_delta_check_base(state, &base);
+    if (rc != 0) {
+        BOOT_LOG_ERR("Image %d: delta image not made for the image in the primary slot",
+                     BOOT_CURR_IMG(state));
+        return rc;
+    }
+
+    /*
+     * The header and patch are moved to the sectors just before the
+     * trailer, which must neither overlap them nor the full image.
+     */
+    rc = boot_trailer_scramble_offset(fap, BOOT_WRITE_SZ(state), &trailer_off);
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    patch_sz = ALIGN_UP(hdr->ih_hdr_size + hdr->ih_img_size, BOOT_WRITE_SZ(state));
+    if (base.size == 0 || patch_sz > trailer_off || base.size > trailer_off) {
+        goto too_large;
+    }
+
+    rc = boot_delta_sector(fap, trailer_off - patch_sz, &moved_off, &unused);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = boot_delta_sector(fap, img_off + base.size - 1, &unused, &out_end);
+    if (rc != 0) {
+        return rc;
+    }
+
+    if (moved_off < img_off + patch_sz || moved_off < out_end) {
+        goto too_large;
+    }
+
+    rc = boot_erase_region(fap, moved_off, trailer_off - moved_off, false);
+    if (rc == 0) {
+        rc = boot_copy_region(state, fap, fap, img_off, moved_off, patch_sz);
+    }
+    if (rc == 0) {
+        rc = boot_write_swap_size(fap, moved_off);
+    }
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    return boot_delta_patch(state, moved_off, trailer_off);
+
+too_large:
+    BOOT_LOG_ERR("Image %d: not enough space in the secondary slot to apply delta image",
+                 BOOT_CURR_IMG(state));
+    return BOOT_ENOMEM;
+}
+
+#endif /* MCUBOOT_DELTA_UPDATES */
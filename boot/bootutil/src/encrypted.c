@@ -51,6 +51,7 @@
 #include "bootutil/sign_key.h"
 #include "bootutil/crypto/common.h"
 #include "bootutil/bootutil_log.h"
+#include "bootutil/bench.h"
 
 BOOT_LOG_MODULE_DECLARE(mcuboot);
 
@@ -589,6 +590,7 @@ boot_enc_load(struct boot_loader_state *state, int slot,
 #else
     uint8_t buf[BOOT_ENC_TLV_SIZE];
 #endif
+    bench_phase_t bench;
     int rc;
 
     BOOT_LOG_DBG("boot_enc_load: slot %d", slot);
@@ -630,13 +632,18 @@ boot_enc_load(struct boot_loader_state *state, int slot,
         return -1;
     }
 
-    return boot_decrypt_key(buf, bs->enckey[slot]);
+    boot_bench_phase_start(&bench);
+    rc = boot_decrypt_key(buf, bs->enckey[slot]);
+    boot_bench_phase_stop(&bench, BOOT_BENCH_KEY_UNWRAP, BOOT_ENC_TLV_SIZE);
+
+    return rc;
 }
 
 int
 boot_enc_init(struct enc_key_data *enc_state)
 {
     bootutil_aes_ctr_init(&enc_state->aes_ctr);
+    enc_state->ks_len = 0;
     return 0;
 }
 
@@ -644,6 +651,8 @@ int
 boot_enc_drop(struct enc_key_data *enc_state)
 {
     bootutil_aes_ctr_drop(&enc_state->aes_ctr);
+    bootutil_wipe_memory(enc_state->ks, sizeof(enc_state->ks));
+    enc_state->ks_len = 0;
     enc_state->valid = 0;
     return 0;
 }
@@ -653,6 +662,9 @@ boot_enc_set_key(struct enc_key_data *enc_state, const uint8_t *key)
 {
     int rc;
 
+    /* Any keystream left was generated with the previous key */
+    enc_state->ks_len = 0;
+
     rc = bootutil_aes_ctr_set_key(&enc_state->aes_ctr, key);
     if (rc != 0) {
         boot_enc_drop(enc_state);
@@ -670,48 +682,96 @@ boot_enc_valid(const struct enc_key_data *enc_state)
     return enc_state->valid;
 }
 
-void
-boot_enc_encrypt(struct enc_key_data *enc, uint32_t off,
-             uint32_t sz, uint32_t blk_off, uint8_t *buf)
+/*
+ * Generates the keystream of MCUBOOT_ENC_KEYSTREAM_BLOCKS counter blocks
+ * from the block at off, in a single call to the AES backend.
+ */
+static int
+boot_enc_fill_keystream(struct enc_key_data *enc, uint32_t off)
 {
-    uint8_t nonce[16];
+    uint8_t nonce[BOOT_ENC_BLOCK_SIZE];
+    uint32_t blk;
 
-    /* Nothing to do with size == 0 */
-    if (sz == 0) {
-       return;
+    blk = off / BOOT_ENC_BLOCK_SIZE;
+    memset(nonce, 0, 12);
+    nonce[12] = (uint8_t)(blk >> 24);
+    nonce[13] = (uint8_t)(blk >> 16);
+    nonce[14] = (uint8_t)(blk >> 8);
+    nonce[15] = (uint8_t)blk;
+
+    /* The keystream is the encryption of zeroes */
+    memset(enc->ks, 0, sizeof(enc->ks));
+    if (bootutil_aes_ctr_encrypt(&enc->aes_ctr, nonce, enc->ks, sizeof(enc->ks), 0,
+                                 enc->ks) != 0) {
+        enc->ks_len = 0;
+        return -1;
     }
 
-    memset(nonce, 0, 12);
-    off >>= 4;
-    nonce[12] = (uint8_t)(off >> 24);
-    nonce[13] = (uint8_t)(off >> 16);
-    nonce[14] = (uint8_t)(off >> 8);
-    nonce[15] = (uint8_t)off;
+    enc->ks_off = blk * BOOT_ENC_BLOCK_SIZE;
+    enc->ks_len = sizeof(enc->ks);
 
-    assert(enc->valid == 1);
-    bootutil_aes_ctr_encrypt(&enc->aes_ctr, nonce, buf, sz, blk_off, buf);
+    return 0;
 }
 
-void
-boot_enc_decrypt(struct enc_key_data *enc, uint32_t off,
-             uint32_t sz, uint32_t blk_off, uint8_t *buf)
+/*
+ * Encrypts or decrypts sz bytes of the payload at off, in place, with the
+ * keystream kept in enc, generating more of it as needed.
+ *
+ * Returns 0 on success, -1 if the keystream could not be generated, in which
+ * case buf is only partly processed.
+ */
+static int
+boot_enc_crypt(struct enc_key_data *enc, uint32_t off, uint32_t sz, uint8_t *buf)
 {
-    uint8_t nonce[16];
+    const uint8_t *ks;
+    uint32_t chunk;
+    uint32_t i;
+
+    assert(enc->valid == 1);
 
-    /* Nothing to do with size == 0 */
-    if (sz == 0) {
-       return;
+    while (sz > 0) {
+        if (enc->ks_len == 0 || off < enc->ks_off || off - enc->ks_off >= enc->ks_len) {
+            if (boot_enc_fill_keystream(enc, off) != 0) {
+                return -1;
+            }
+        }
+
+        ks = &enc->ks[off - enc->ks_off];
+        chunk = enc->ks_len - (off - enc->ks_off);
+        if (chunk > sz) {
+            chunk = sz;
+        }
+
+        for (i = 0; i < chunk; i++) {
+            buf[i] ^= ks[i];
+        }
+
+        buf += chunk;
+        off += chunk;
+        sz -= chunk;
     }
 
-    memset(nonce, 0, 12);
-    off >>= 4;
-    nonce[12] = (uint8_t)(off >> 24);
-    nonce[13] = (uint8_t)(off >> 16);
-    nonce[14] = (uint8_t)(off >> 8);
-    nonce[15] = (uint8_t)off;
+    return 0;
+}
 
-    assert(enc->valid == 1);
-    bootutil_aes_ctr_decrypt(&enc->aes_ctr, nonce, buf, sz, blk_off, buf);
+/*
+ * In CTR mode, the position in the block, blk_off, follows from off, so
+ * both functions ignore it.
+ */
+int
+boot_enc_encrypt(struct enc_key_data *enc, uint32_t off,
+             uint32_t sz, uint32_t blk_off, uint8_t *buf)
+{
+    (void)blk_off;
+    return boot_enc_crypt(enc, off, sz, buf);
+}
+
+int
+boot_enc_decrypt(struct enc_key_data *enc, uint32_t off,
+             uint32_t sz, uint32_t blk_off, uint8_t *buf)
+{
+    (void)blk_off;
+    return boot_enc_crypt(enc, off, sz, buf);
 }
 
 /**
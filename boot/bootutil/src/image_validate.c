@@ -44,6 +44,7 @@
 
 #include "mcuboot_config/mcuboot_config.h"
 #include "bootutil/bootutil_log.h"
+#include "bootutil/bench.h"
 
 BOOT_LOG_MODULE_DECLARE(mcuboot);
 #if defined(MCUBOOT_UUID_VID) || defined(MCUBOOT_UUID_CID)
@@ -53,6 +54,9 @@ BOOT_LOG_MODULE_DECLARE(mcuboot);
 #ifdef MCUBOOT_ENC_IMAGES
 #include "bootutil/enc_key.h"
 #endif
+#ifdef MCUBOOT_SIG_CACHE
+#include "bootutil/sig_cache.h"
+#endif
 #include "bootutil_priv.h"
 
 /*
@@ -161,6 +165,84 @@ static int bootutil_check_for_pure(const struct image_header *hdr, const struct
 }
 #endif
 
+#if defined(MCUBOOT_SIG_CACHE) && defined(EXPECTED_SIG_TLV)
+/*
+ * Verify the signature of an image hash like bootutil_verify_sig(), unless
+ * the platform kept an authenticated record of the same hash being signed
+ * by the same key. The record is replaced after each successful verification
+ * of another hash, but not by the other signatures of the hash it already
+ * records, so that an image signed with several keys still hits on its first
+ * signature. It also holds the stored security counter of the image, so that
+ * raising the counter revokes it.
+ */
+static fih_ret
+bootutil_verify_sig_cached(int image_index, uint8_t *hash, uint8_t *sig, size_t slen,
+                           uint8_t key_id)
+{
+    struct boot_sig_cache_entry entry;
+    struct boot_sig_cache_entry cached;
+    bool usable = true;
+    bool same_image = false;
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
+#ifdef MCUBOOT_HW_ROLLBACK_PROT
+    fih_int security_cnt;
+#endif
+#ifndef MCUBOOT_BUILTIN_KEY
+    bootutil_sha_context sha_ctx;
+#endif
+
+    memset(&entry, 0, sizeof(entry));
+    memcpy(entry.digest, hash, IMAGE_HASH_SIZE);
+    entry.key_id = key_id;
+
+#ifndef MCUBOOT_BUILTIN_KEY
+    if (bootutil_keys[key_id].key == NULL) {
+        usable = false;
+    } else {
+        bootutil_sha_init(&sha_ctx);
+        bootutil_sha_update(&sha_ctx, bootutil_keys[key_id].key, *bootutil_keys[key_id].len);
+        bootutil_sha_finish(&sha_ctx, entry.key_hash);
+        bootutil_sha_drop(&sha_ctx);
+    }
+#endif
+
+#ifdef MCUBOOT_HW_ROLLBACK_PROT
+    FIH_CALL(boot_nv_security_counter_get, fih_rc, image_index, &security_cnt);
+    if (FIH_EQ(fih_rc, FIH_SUCCESS)) {
+        entry.security_cnt = (uint32_t)fih_int_decode(security_cnt);
+    } else {
+        usable = false;
+    }
+#endif
+
+    if (usable && boot_sig_cache_mac(&entry, offsetof(struct boot_sig_cache_entry, mac),
+                                     entry.mac) != 0) {
+        usable = false;
+    }
+
+    if (usable && boot_sig_cache_read(image_index, &cached) == 0) {
+        FIH_CALL(boot_fih_memequal, fih_rc, &entry, &cached, sizeof(entry));
+        if (FIH_EQ(fih_rc, FIH_SUCCESS)) {
+            BOOT_LOG_DBG("bootutil_img_validate: signature found in cache");
+            FIH_RET(fih_rc);
+        }
+
+        /* Only the key differs: keep the record of the other signature */
+        same_image = memcmp(cached.digest, entry.digest, sizeof(entry.digest)) == 0 &&
+                     cached.security_cnt == entry.security_cnt;
+    }
+
+    FIH_CALL(bootutil_verify_sig, fih_rc, hash, IMAGE_HASH_SIZE, sig, slen, key_id);
+
+    if (usable && !same_image && FIH_EQ(fih_rc, FIH_SUCCESS) &&
+        boot_sig_cache_write(image_index, &entry) != 0) {
+        BOOT_LOG_DBG("bootutil_img_validate: signature not cached");
+    }
+
+    FIH_RET(fih_rc);
+}
+#endif /* MCUBOOT_SIG_CACHE && EXPECTED_SIG_TLV */
+
 #ifdef MCUBOOT_USE_TLV_ALLOW_LIST
 /*
  * The following list of TLVs are the only entries allowed in the unprotected
@@ -193,19 +275,58 @@ static const uint16_t allowed_unprot_tlvs[] = {
 };
 #endif
 
+#if defined(MCUBOOT_SECTOR_HASHES) && defined(EXPECTED_HASH_TLV) && \
+    !defined(MCUBOOT_SIGN_PURE)
 /*
- * Verify the integrity of the image.
+ * Called when the image hash does not match, to report where the image
+ * got corrupted. The sector hashes are not authenticated at this point, so
+ * this is only a diagnostic aid and does not change the outcome.
+ */
+static void
+bootutil_img_log_bad_sector(struct boot_loader_state *state,
+                            struct image_header *hdr, const struct flash_area *fap,
+                            uint8_t *tmp_buf, uint32_t tmp_buf_sz)
+{
+    uint32_t bad_off;
+    int rc;
+
+    if (tmp_buf == NULL) {
+        return;
+    }
+
+#ifdef MCUBOOT_ENC_IMAGES
+    /* Sector hashes are over the plaintext image */
+    if (MUST_DECRYPT(fap, (state == NULL ? 0 : BOOT_CURR_IMG(state)), hdr)) {
+        return;
+    }
+#endif
+
+    rc = bootutil_img_check_sectors(state, hdr, fap, 0, UINT32_MAX, tmp_buf, tmp_buf_sz,
+                                    &bad_off);
+    if (rc == BOOT_EBADIMAGE) {
+        BOOT_LOG_ERR("Image corrupted in sector at offset 0x%" PRIx32, bad_off);
+    }
+}
+#endif
+
+/*
+ * Verify the integrity of the image, using the given image hash instead of
+ * computing it when precomputed_hash is not NULL. When tlvs_only is set, the
+ * image is not hashed: the signature is verified against the hash held in the
+ * hash TLV, which is returned in out_hash for the caller to compare with the
+ * hash of the image once it has computed it.
  * Return non-zero if image could not be validated/does not validate.
  */
-fih_ret
-bootutil_img_validate(struct boot_loader_state *state,
-                      struct image_header *hdr, const struct flash_area *fap,
-                      uint8_t *tmp_buf, uint32_t tmp_buf_sz, uint8_t *seed,
-                      int seed_len, uint8_t *out_hash
-                     )
+static fih_ret
+bootutil_img_validate_common(struct boot_loader_state *state,
+                             struct image_header *hdr, const struct flash_area *fap,
+                             uint8_t *tmp_buf, uint32_t tmp_buf_sz, uint8_t *seed,
+                             int seed_len, uint8_t *out_hash,
+                             const uint8_t *precomputed_hash, bool tlvs_only)
 {
 #if (defined(EXPECTED_KEY_TLV) && defined(MCUBOOT_HW_KEY)) || \
     (defined(EXPECTED_SIG_TLV) && defined(MCUBOOT_BUILTIN_KEY)) || \
+    (defined(EXPECTED_SIG_TLV) && defined(MCUBOOT_SIG_CACHE)) || \
     defined(MCUBOOT_HW_ROLLBACK_PROT) || \
     defined(MCUBOOT_UUID_VID) || defined(MCUBOOT_UUID_CID)
     int image_index = (state == NULL ? 0 : BOOT_CURR_IMG(state));
@@ -234,6 +355,7 @@ bootutil_img_validate(struct boot_loader_state *state,
     int image_hash_valid = 0;
     uint8_t hash[IMAGE_HASH_SIZE];
 #endif
+    bench_phase_t bench;
     int rc = 0;
     FIH_DECLARE(fih_rc, FIH_FAILURE);
 #if defined(MCUBOOT_SIGN_PURE)
@@ -256,9 +378,30 @@ bootutil_img_validate(struct boot_loader_state *state,
     BOOT_LOG_DBG("bootutil_img_validate: flash area %p", fap);
 
 #if defined(EXPECTED_HASH_TLV) && !defined(MCUBOOT_SIGN_PURE)
-    rc = bootutil_img_hash(state, hdr, fap, tmp_buf, tmp_buf_sz, hash, seed, seed_len);
-    if (rc) {
-        goto out;
+    if (tlvs_only) {
+        rc = bootutil_tlv_iter_begin(&it, hdr, fap, EXPECTED_HASH_TLV, false);
+        if (rc) {
+            goto out;
+        }
+        rc = bootutil_tlv_iter_next(&it, &off, &len, NULL);
+        if (rc != 0 || len != sizeof(hash)) {
+            rc = -1;
+            goto out;
+        }
+        rc = LOAD_IMAGE_DATA(hdr, fap, off, hash, sizeof(hash));
+        if (rc) {
+            goto out;
+        }
+    } else if (precomputed_hash != NULL) {
+        memcpy(hash, precomputed_hash, IMAGE_HASH_SIZE);
+    } else {
+        boot_bench_phase_start(&bench);
+        rc = bootutil_img_hash(state, hdr, fap, tmp_buf, tmp_buf_sz, hash, seed, seed_len);
+        if (rc) {
+            goto out;
+        }
+        boot_bench_phase_stop(&bench, BOOT_BENCH_HASH,
+                              hdr->ih_hdr_size + hdr->ih_img_size + hdr->ih_protect_tlv_size);
     }
 
     if (out_hash) {
@@ -346,6 +489,11 @@ bootutil_img_validate(struct boot_loader_state *state,
                 rc = -1;
                 goto out;
             }
+            if (tlvs_only) {
+                /* Loaded above, it is checked by the caller */
+                image_hash_valid = 1;
+                break;
+            }
             rc = LOAD_IMAGE_DATA(hdr, fap, off, buf, sizeof(hash));
             if (rc) {
                 goto out;
@@ -353,6 +501,9 @@ bootutil_img_validate(struct boot_loader_state *state,
 
             FIH_CALL(boot_fih_memequal, fih_rc, hash, buf, sizeof(hash));
             if (FIH_NOT_EQ(fih_rc, FIH_SUCCESS)) {
+#if defined(MCUBOOT_SECTOR_HASHES)
+                bootutil_img_log_bad_sector(state, hdr, fap, tmp_buf, tmp_buf_sz);
+#endif
                 FIH_SET(fih_rc, FIH_FAILURE);
                 goto out;
             }
@@ -410,8 +561,15 @@ bootutil_img_validate(struct boot_loader_state *state,
                 goto out;
             }
 #ifndef MCUBOOT_SIGN_PURE
+            boot_bench_phase_start(&bench);
+#ifdef MCUBOOT_SIG_CACHE
+            FIH_CALL(bootutil_verify_sig_cached, valid_signature, image_index, hash,
+                     buf, len, key_id);
+#else
             FIH_CALL(bootutil_verify_sig, valid_signature, hash, sizeof(hash),
                                                            buf, len, key_id);
+#endif
+            boot_bench_phase_stop(&bench, BOOT_BENCH_SIG_VERIFY, sizeof(hash));
 #else
             rc = flash_device_base(flash_area_get_device_id(fap), &base);
             if (rc != 0) {
@@ -426,9 +584,13 @@ bootutil_img_validate(struct boot_loader_state *state,
              * a device to memory. The pointer is beginning of image in flash,
              * so offset of area, the range is header + image + protected tlvs.
              */
+            boot_bench_phase_start(&bench);
             FIH_CALL(bootutil_verify_sig, valid_signature, (void *)(base + flash_area_get_off(fap)),
                      hdr->ih_hdr_size + hdr->ih_img_size + hdr->ih_protect_tlv_size,
                      buf, len, key_id);
+            boot_bench_phase_stop(&bench, BOOT_BENCH_SIG_VERIFY,
+                                  hdr->ih_hdr_size + hdr->ih_img_size +
+                                  hdr->ih_protect_tlv_size);
 #endif
             key_id = -1;
             break;
@@ -589,3 +751,55 @@ out:
 
     FIH_RET(fih_rc);
 }
+
+/*
+ * Verify the integrity of the image.
+ * Return non-zero if image could not be validated/does not validate.
+ */
+fih_ret
+bootutil_img_validate(struct boot_loader_state *state,
+                      struct image_header *hdr, const struct flash_area *fap,
+                      uint8_t *tmp_buf, uint32_t tmp_buf_sz, uint8_t *seed,
+                      int seed_len, uint8_t *out_hash
+                     )
+{
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
+
+    FIH_CALL(bootutil_img_validate_common, fih_rc, state, hdr, fap, tmp_buf, tmp_buf_sz,
+             seed, seed_len, out_hash, NULL, false);
+
+    FIH_RET(fih_rc);
+}
+
+#if !defined(MCUBOOT_SIGN_PURE)
+fih_ret
+bootutil_img_validate_with_hash(struct boot_loader_state *state,
+                                struct image_header *hdr,
+                                const struct flash_area *fap,
+                                const uint8_t *hash)
+{
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
+
+    FIH_CALL(bootutil_img_validate_common, fih_rc, state, hdr, fap, NULL, 0,
+             NULL, 0, NULL, hash, false);
+
+    FIH_RET(fih_rc);
+}
+#endif /* !MCUBOOT_SIGN_PURE */
+
+#if defined(MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY) || \
+    (defined(MCUBOOT_SECTOR_HASHES) && !defined(MCUBOOT_SIGN_PURE))
+fih_ret
+bootutil_img_check_tlvs(struct boot_loader_state *state,
+                        struct image_header *hdr,
+                        const struct flash_area *fap,
+                        uint8_t *out_hash)
+{
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
+
+    FIH_CALL(bootutil_img_validate_common, fih_rc, state, hdr, fap, NULL, 0,
+             NULL, 0, out_hash, NULL, true);
+
+    FIH_RET(fih_rc);
+}
+#endif /* MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY || MCUBOOT_SECTOR_HASHES */
@@ -43,6 +43,7 @@
 #include "bootutil_priv.h"
 #include "swap_priv.h"
 #include "bootutil/bootutil_log.h"
+#include "bootutil/bench.h"
 #include "bootutil/security_cnt.h"
 #include "bootutil/boot_record.h"
 #include "bootutil/fault_injection_hardening.h"
@@ -76,12 +77,6 @@ static struct image_max_size image_max_sizes[BOOT_IMAGE_NUMBER] = {0};
 /* Valid only for ARM Cortext M */
 #define RESET_OFFSET sizeof(uint32_t)
 
-#if BOOT_MAX_ALIGN > 1024
-#define BUF_SZ BOOT_MAX_ALIGN
-#else
-#define BUF_SZ 1024
-#endif
-
 #if defined(MCUBOOT_SWAP_USING_OFFSET) && defined(MCUBOOT_ENC_IMAGES)
 #define BOOT_COPY_REGION(state, fap_pri, fap_sec, pri_off, sec_off, sz, sector_off) \
         boot_copy_region(state, fap_pri, fap_sec, pri_off, sec_off, sz, sector_off)
@@ -387,6 +382,10 @@ boot_status_reset(struct boot_status *bs)
     bs->idx = BOOT_STATUS_IDX_0;
     bs->state = BOOT_STATUS_STATE_0;
     bs->swap_type = BOOT_SWAP_TYPE_NONE;
+
+#ifdef MCUBOOT_SWAP_STATUS_JOURNAL
+    memset(&bs->journal, 0, sizeof(bs->journal));
+#endif
 }
 
 bool
@@ -420,6 +419,15 @@ boot_write_status(const struct boot_loader_state *state, struct boot_status *bs)
     uint32_t align;
     uint8_t erased_val;
 
+#ifdef MCUBOOT_SWAP_STATUS_JOURNAL
+    /* The progress is journaled once per group of steps, before the first
+     * one, by swap_status_journal_begin().
+     */
+    if (boot_status_journal_used(BOOT_WRITE_SZ(state))) {
+        return 0;
+    }
+#endif
+
     /* NOTE: The first sector copied (that is the last sector on slot) contains
      *       the trailer. Since in the last step the primary slot is erased, the
      *       first two status writes go to the scratch which will be copied to
@@ -639,6 +647,24 @@ boot_validate_slot(struct boot_loader_state *state, int slot,
     } else {
         BOOT_HOOK_CALL_FIH(boot_image_check_hook, FIH_BOOT_HOOK_REGULAR,
                            fih_rc, BOOT_CURR_IMG(state), slot);
+#if defined(MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY)
+        if (slot != BOOT_SLOT_PRIMARY) {
+            state->signed_hash[BOOT_CURR_IMG(state)].valid = false;
+        }
+        if (FIH_EQ(fih_rc, FIH_BOOT_HOOK_REGULAR) && slot != BOOT_SLOT_PRIMARY) {
+            /* The image is hashed while it is copied to the primary slot.
+             * Everything else, including the signature of the hash in the
+             * hash TLV, is checked now, before the primary slot is erased;
+             * boot_copy_image() then only compares the hash it computed with
+             * that signed hash.
+             */
+            FIH_CALL(bootutil_img_check_tlvs, fih_rc, state, hdr, fap,
+                     state->signed_hash[BOOT_CURR_IMG(state)].hash);
+            if (FIH_EQ(fih_rc, FIH_SUCCESS)) {
+                state->signed_hash[BOOT_CURR_IMG(state)].valid = true;
+            }
+        }
+#endif
         if (FIH_EQ(fih_rc, FIH_BOOT_HOOK_REGULAR)) {
             FIH_CALL(boot_check_image, fih_rc, state, bs, slot);
         }
@@ -681,6 +707,13 @@ check_validity:
 #ifdef MCUBOOT_CHECK_HEADER_LOAD_ADDRESS
         internal_img_addr = secondary_hdr->ih_load_addr;
 #else
+#if defined(MCUBOOT_DECOMPRESS_IMAGES) && defined(MCUBOOT_OVERWRITE_ONLY)
+        /* The vector table of a compressed image cannot be read in place */
+        if (IS_COMPRESSED(secondary_hdr)) {
+            goto out;
+        }
+#endif
+
         /* This is platform specific code that should not be here */
         const uint32_t offset = secondary_hdr->ih_hdr_size + RESET_OFFSET;
         BOOT_LOG_DBG("Getting image %d internal addr from offset %u",
@@ -735,10 +768,33 @@ boot_validated_swap_type(struct boot_loader_state *state,
 
     swap_type = boot_swap_type_multi(BOOT_CURR_IMG(state));
     if (BOOT_IS_UPGRADE(swap_type)) {
+#ifdef MCUBOOT_DELTA_UPDATES
+        /* The patch of a delta image being applied may be gone already, so
+         * complete it before the slot is validated.
+         */
+        if (boot_delta_resume(state) != 0) {
+            BOOT_LOG_WRN("Image %d: could not complete applying delta image",
+                         BOOT_CURR_IMG(state));
+        }
+#endif
+
         /* Boot loader wants to switch to the secondary slot.
          * Ensure image is valid.
          */
         FIH_CALL(boot_validate_slot, fih_rc, state, BOOT_SLOT_SECONDARY, bs, swap_type);
+#ifdef MCUBOOT_DELTA_UPDATES
+        if (FIH_EQ(fih_rc, FIH_SUCCESS) &&
+            IS_DELTA(boot_img_hdr(state, BOOT_SLOT_SECONDARY))) {
+            /* Rebuild the full image, which is then validated as usual */
+            if (boot_delta_apply(state) == 0) {
+                FIH_CALL(boot_validate_slot, fih_rc, state, BOOT_SLOT_SECONDARY, bs, swap_type);
+            } else {
+                boot_scramble_slot(BOOT_IMG_AREA(state, BOOT_SLOT_SECONDARY),
+                                   BOOT_SLOT_SECONDARY);
+                fih_rc = FIH_NO_BOOTABLE_IMAGE;
+            }
+        }
+#endif
         if (FIH_NOT_EQ(fih_rc, FIH_SUCCESS)) {
             if (FIH_EQ(fih_rc, FIH_NO_BOOTABLE_IMAGE)) {
                 swap_type = BOOT_SWAP_TYPE_NONE;
@@ -754,10 +810,133 @@ boot_validated_swap_type(struct boot_loader_state *state,
 
 #if !defined(MCUBOOT_DIRECT_XIP) && !defined(MCUBOOT_RAM_LOAD)
 
+#ifdef MCUBOOT_FLASH_AREA_ASYNC
+/* One buffer is programmed while the next one is read and processed. */
+#define BOOT_COPY_BUF_COUNT 2
+
+#define boot_copy_read_start  flash_area_read_async
+#define boot_copy_write_start flash_area_write_async
+#define boot_copy_wait        flash_area_async_wait
+#else
+#define BOOT_COPY_BUF_COUNT 1
+
+/* Synchronous fallback: every transfer is complete when started. */
+#define boot_copy_read_start  flash_area_read
+#define boot_copy_write_start flash_area_write
+
+static inline int
+boot_copy_wait(const struct flash_area *fap)
+{
+    (void)fap;
+
+    return 0;
+}
+#endif
+
+#ifdef MCUBOOT_ENC_IMAGES
+/**
+ * Encrypts or decrypts, in place, the part of a chunk being copied by
+ * boot_copy_region() that belongs to the image payload; header and TLV
+ * data is left untouched.
+ *
+ * @param state                 Boot loader status information.
+ * @param hdr                   Header of the image being copied.
+ * @param source_slot           0 to encrypt, 1 to decrypt.
+ * @param abs_off               Offset of the chunk from the start of the
+ *                                  image.
+ * @param buf                   The chunk.
+ * @param chunk_sz              Size of the chunk.
+ *
+ * @return                      0 on success; nonzero on failure.
+ */
+static int
+boot_copy_region_crypt(struct boot_loader_state *state, struct image_header *hdr,
+                       int source_slot, uint32_t abs_off, uint8_t *buf,
+                       uint32_t chunk_sz)
+{
+    uint32_t tlv_off;
+    size_t blk_off = 0;
+    uint16_t idx = 0;
+    uint32_t blk_sz;
+    int rc = 0;
+
+    if (abs_off < hdr->ih_hdr_size) {
+        /* do not decrypt header */
+        if (abs_off + chunk_sz > hdr->ih_hdr_size) {
+            /* The lower part of the chunk contains header data */
+            blk_off = 0;
+            blk_sz = chunk_sz - (hdr->ih_hdr_size - abs_off);
+            idx = hdr->ih_hdr_size  - abs_off;
+        } else {
+            /* The chunk contains exclusively header data */
+            blk_sz = 0; /* nothing to decrypt */
+        }
+    } else {
+        idx = 0;
+        blk_sz = chunk_sz;
+        blk_off = (abs_off - hdr->ih_hdr_size) & 0xf;
+    }
+
+    if (blk_sz > 0)
+    {
+        tlv_off = BOOT_TLV_OFF(hdr);
+        if (abs_off + chunk_sz > tlv_off) {
+            /* do not decrypt TLVs */
+            if (abs_off >= tlv_off) {
+                blk_sz = 0;
+            } else {
+                blk_sz = tlv_off - abs_off - idx;
+            }
+        }
+        if (source_slot == 0) {
+            rc = boot_enc_encrypt(BOOT_CURR_ENC_SLOT(state, source_slot),
+                    (abs_off + idx) - hdr->ih_hdr_size, blk_sz,
+                    blk_off, &buf[idx]);
+        } else {
+            rc = boot_enc_decrypt(BOOT_CURR_ENC_SLOT(state, source_slot),
+                    (abs_off + idx) - hdr->ih_hdr_size, blk_sz,
+                    blk_off, &buf[idx]);
+        }
+    }
+
+    return rc;
+}
+#endif
+
+#ifdef MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY
+/**
+ * Feeds the part of a chunk copied by boot_copy_region() that is covered by
+ * the image hash to the hash computed on copy, if there is one.
+ *
+ * @param state                 Boot loader status information.
+ * @param off                   Offset of the chunk in the destination region.
+ * @param buf                   The chunk, as written.
+ * @param chunk_sz              Size of the chunk.
+ */
+static void
+boot_copy_region_hash(struct boot_loader_state *state, uint32_t off,
+                      const uint8_t *buf, uint32_t chunk_sz)
+{
+    if (state->copy_hash == NULL || off >= state->copy_hash_sz) {
+        return;
+    }
+
+    if (chunk_sz > state->copy_hash_sz - off) {
+        chunk_sz = state->copy_hash_sz - off;
+    }
+
+    bootutil_sha_update(state->copy_hash, buf, chunk_sz);
+}
+#endif
+
 /**
  * Copies the contents of one flash region to another.  You must erase the
  * destination region prior to calling this function.
  *
+ * With MCUBOOT_FLASH_AREA_ASYNC the copy is pipelined: while a chunk is being
+ * programmed to the destination, the next one is read from the source and,
+ * if needed, encrypted or decrypted.
+ *
  * @param flash_area_id_src     The ID of the source flash area.
  * @param flash_area_id_dst     The ID of the destination flash area.
  * @param off_src               The offset within the source flash area to
@@ -783,16 +962,17 @@ boot_copy_region(struct boot_loader_state *state,
                  uint32_t off_src, uint32_t off_dst, uint32_t sz)
 #endif
 {
+    bench_phase_t bench;
     uint32_t bytes_copied;
-    int chunk_sz;
+    uint32_t next_off;
+    uint32_t max_sz;
+    uint32_t chunk_sz;
+    uint32_t next_sz;
+    uint8_t cur;
+    uint8_t next;
     int rc;
 #ifdef MCUBOOT_ENC_IMAGES
-    uint32_t off = off_dst;
-    uint32_t tlv_off;
-    size_t blk_off;
-    struct image_header *hdr;
-    uint16_t idx;
-    uint32_t blk_sz;
+    struct image_header *hdr = NULL;
     uint8_t image_index = BOOT_CURR_IMG(state);
     bool encrypted_src;
     bool encrypted_dst;
@@ -805,11 +985,16 @@ boot_copy_region(struct boot_loader_state *state,
     /* In case of encryption enabled, we may have to do more work than
      * just copy bytes */
     bool only_copy = false;
+#if defined(MCUBOOT_SWAP_USING_OFFSET)
+    uint32_t abs_off = off_dst - sector_off;
+#else
+    uint32_t abs_off = off_dst;
+#endif
 #else
     (void)state;
 #endif
 
-    TARGET_STATIC uint8_t buf[BUF_SZ] __attribute__((aligned(4)));
+    TARGET_STATIC uint8_t buf[BOOT_COPY_BUF_COUNT][BOOT_IO_BUF_SZ] __attribute__((aligned(4)));
 
 #ifdef MCUBOOT_ENC_IMAGES
     encrypted_src = (flash_area_get_id(fap_src) != FLASH_AREA_IMAGE_PRIMARY(image_index));
@@ -825,6 +1010,10 @@ boot_copy_region(struct boot_loader_state *state,
             hdr = boot_img_hdr(state, BOOT_SLOT_SECONDARY);
             source_slot = 1;
         }
+
+        /* If the header does not indicate need for encryption/decryption,
+         * we just copy data. */
+        only_copy = !IS_ENCRYPTED(hdr);
     } else {
         /* In case when source and targe is the same area, this means that we
          * only have to copy bytes, no encryption or decryption.
@@ -833,79 +1022,101 @@ boot_copy_region(struct boot_loader_state *state,
     }
 #endif
 
-    bytes_copied = 0;
-    while (bytes_copied < sz) {
-        if (sz - bytes_copied > sizeof buf) {
-            chunk_sz = sizeof buf;
-        } else {
-            chunk_sz = sz - bytes_copied;
+    if (sz == 0) {
+        return 0;
+    }
+
+    boot_bench_phase_start(&bench);
+
+#if defined(MCUBOOT_SECTOR_HASHES) && !defined(MCUBOOT_OVERWRITE_ONLY)
+    if (fap_dst == BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY)) {
+        if (off_dst < state->primary_written_lo) {
+            state->primary_written_lo = off_dst;
+        }
+        if (off_dst + sz > state->primary_written_hi) {
+            state->primary_written_hi = off_dst + sz;
         }
+    }
+#endif
+
+    /* Transfers are sized to suit both devices, so that apart from the
+     * last one they stay aligned to the optimal I/O size.
+     */
+    max_sz = boot_io_chunk_sz(fap_src, boot_io_chunk_sz(fap_dst, BOOT_IO_BUF_SZ));
+
+    /* Fill the first buffer; every following read is started while the
+     * previous chunk is being written.
+     */
+    cur = 0;
+    chunk_sz = (sz > max_sz) ? max_sz : sz;
+    rc = boot_copy_read_start(fap_src, off_src, buf[cur], chunk_sz);
+    if (rc == 0) {
+        rc = boot_copy_wait(fap_src);
+    }
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
 
-        rc = flash_area_read(fap_src, off_src + bytes_copied, buf, chunk_sz);
+#ifdef MCUBOOT_ENC_IMAGES
+    if (!only_copy &&
+        boot_copy_region_crypt(state, hdr, source_slot, abs_off, buf[cur], chunk_sz) != 0) {
+        return BOOT_EBADIMAGE;
+    }
+#endif
+#ifdef MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY
+    boot_copy_region_hash(state, off_dst, buf[cur], chunk_sz);
+#endif
+
+    bytes_copied = 0;
+    while (bytes_copied < sz) {
+        rc = boot_copy_write_start(fap_dst, off_dst + bytes_copied, buf[cur], chunk_sz);
         if (rc != 0) {
             return BOOT_EFLASH;
         }
 
-#ifdef MCUBOOT_ENC_IMAGES
-        /* If only copy, then does not matter if header indicates need for
-         * encryption/decryption, we just copy data. */
-        if (!only_copy && IS_ENCRYPTED(hdr)) {
-#if defined(MCUBOOT_SWAP_USING_OFFSET)
-            uint32_t abs_off = off - sector_off + bytes_copied;
-#else
-            uint32_t abs_off = off + bytes_copied;
-#endif
-            if (abs_off < hdr->ih_hdr_size) {
-                /* do not decrypt header */
-                if (abs_off + chunk_sz > hdr->ih_hdr_size) {
-                    /* The lower part of the chunk contains header data */
-                    blk_off = 0;
-                    blk_sz = chunk_sz - (hdr->ih_hdr_size - abs_off);
-                    idx = hdr->ih_hdr_size  - abs_off;
-                } else {
-                    /* The chunk contains exclusively header data */
-                    blk_sz = 0; /* nothing to decrypt */
-                }
-            } else {
-                idx = 0;
-                blk_sz = chunk_sz;
-                blk_off = (abs_off - hdr->ih_hdr_size) & 0xf;
+        next = (cur + 1) % BOOT_COPY_BUF_COUNT;
+        next_off = bytes_copied + chunk_sz;
+        next_sz = 0;
+
+        if (next_off < sz) {
+            next_sz = (sz - next_off > max_sz) ? max_sz : (sz - next_off);
+
+            rc = boot_copy_read_start(fap_src, off_src + next_off, buf[next], next_sz);
+            if (rc == 0) {
+                rc = boot_copy_wait(fap_src);
+            }
+            if (rc != 0) {
+                (void)boot_copy_wait(fap_dst);
+                return BOOT_EFLASH;
             }
 
-            if (blk_sz > 0)
-            {
-                tlv_off = BOOT_TLV_OFF(hdr);
-                if (abs_off + chunk_sz > tlv_off) {
-                    /* do not decrypt TLVs */
-                    if (abs_off >= tlv_off) {
-                        blk_sz = 0;
-                    } else {
-                        blk_sz = tlv_off - abs_off - idx;
-                    }
-                }
-                if (source_slot == 0) {
-                    boot_enc_encrypt(BOOT_CURR_ENC_SLOT(state, source_slot),
-                            (abs_off + idx) - hdr->ih_hdr_size, blk_sz,
-                            blk_off, &buf[idx]);
-                } else {
-                    boot_enc_decrypt(BOOT_CURR_ENC_SLOT(state, source_slot),
-                            (abs_off + idx) - hdr->ih_hdr_size, blk_sz,
-                            blk_off, &buf[idx]);
-                }
+#ifdef MCUBOOT_ENC_IMAGES
+            if (!only_copy &&
+                boot_copy_region_crypt(state, hdr, source_slot, abs_off + next_off,
+                                       buf[next], next_sz) != 0) {
+                (void)boot_copy_wait(fap_dst);
+                return BOOT_EBADIMAGE;
             }
-        }
 #endif
+#ifdef MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY
+            boot_copy_region_hash(state, off_dst + next_off, buf[next], next_sz);
+#endif
+        }
 
-        rc = flash_area_write(fap_dst, off_dst + bytes_copied, buf, chunk_sz);
+        rc = boot_copy_wait(fap_dst);
         if (rc != 0) {
             return BOOT_EFLASH;
         }
 
-        bytes_copied += chunk_sz;
+        bytes_copied = next_off;
+        chunk_sz = next_sz;
+        cur = next;
 
         MCUBOOT_WATCHDOG_FEED();
     }
 
+    boot_bench_phase_stop(&bench, BOOT_BENCH_COPY, sz);
+
     return 0;
 }
 
@@ -935,6 +1146,15 @@ boot_copy_image(struct boot_loader_state *state, struct boot_status *bs)
     const struct flash_area *fap_primary_slot;
     const struct flash_area *fap_secondary_slot;
     uint8_t image_index;
+#ifdef MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY
+    bootutil_sha_context sha_ctx;
+    uint8_t hash[IMAGE_HASH_SIZE];
+    struct image_header *hdr;
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
+#endif
+#if defined(MCUBOOT_DECOMPRESS_IMAGES) && defined(MCUBOOT_OVERWRITE_ONLY)
+    uint32_t decomp_size;
+#endif
 
 #if defined(MCUBOOT_OVERWRITE_ONLY_FAST) || defined(MCUBOOT_SWAP_USING_MOVE) || defined(MCUBOOT_SWAP_USING_OFFSET)
     uint32_t sector;
@@ -949,6 +1169,16 @@ boot_copy_image(struct boot_loader_state *state, struct boot_status *bs)
     uint32_t src_size = 0;
     rc = boot_read_image_size(state, BOOT_SLOT_SECONDARY, &src_size);
     assert(rc == 0);
+#if defined(MCUBOOT_DECOMPRESS_IMAGES) && defined(MCUBOOT_OVERWRITE_ONLY)
+    if (IS_COMPRESSED(boot_img_hdr(state, BOOT_SLOT_SECONDARY))) {
+        /* Only as much as the decompressed image needs is erased */
+        rc = boot_decompressed_size(boot_img_hdr(state, BOOT_SLOT_SECONDARY),
+                                    BOOT_IMG_AREA(state, BOOT_SLOT_SECONDARY), &src_size);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+#endif
 #endif
 
     image_index = BOOT_CURR_IMG(state);
@@ -965,7 +1195,7 @@ boot_copy_image(struct boot_loader_state *state, struct boot_status *bs)
     sect_count = boot_img_num_sectors(state, BOOT_SLOT_PRIMARY);
     for (sect = 0, size = 0; sect < sect_count; sect++) {
         this_size = boot_img_sector_size(state, BOOT_SLOT_PRIMARY, sect);
-        rc = boot_erase_region(fap_primary_slot, size, this_size, false);
+        rc = boot_erase_img_region(state, fap_primary_slot, size, this_size, false);
         assert(rc == 0);
 
 #if defined(MCUBOOT_OVERWRITE_ONLY_FAST) || defined(MCUBOOT_SWAP_USING_MOVE) || defined(MCUBOOT_SWAP_USING_OFFSET)
@@ -989,7 +1219,7 @@ boot_copy_image(struct boot_loader_state *state, struct boot_status *bs)
         sector--;
     } while (sz < trailer_sz);
 
-    rc = boot_erase_region(fap_primary_slot, off, sz, false);
+    rc = boot_erase_img_region(state, fap_primary_slot, off, sz, false);
     assert(rc == 0);
 #endif
 
@@ -1008,18 +1238,89 @@ boot_copy_image(struct boot_loader_state *state, struct boot_status *bs)
     }
 #endif
 
-    BOOT_LOG_INF("Image %d copying the secondary slot to the primary slot: 0x%zx bytes",
-                 image_index, size);
+#ifdef MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY
+    /* The image was not hashed when the secondary slot was validated, the
+     * hash is computed over the data as it is copied instead.
+     */
+    hdr = boot_img_hdr(state, BOOT_SLOT_SECONDARY);
+    bootutil_sha_init(&sha_ctx);
+    state->copy_hash = &sha_ctx;
+    state->copy_hash_sz = hdr->ih_hdr_size + hdr->ih_img_size + hdr->ih_protect_tlv_size;
+#endif
+
+#if defined(MCUBOOT_DECOMPRESS_IMAGES) && defined(MCUBOOT_OVERWRITE_ONLY)
+    if (IS_COMPRESSED(boot_img_hdr(state, BOOT_SLOT_SECONDARY))) {
+        rc = boot_decompress_image(state, fap_secondary_slot, fap_primary_slot, &decomp_size);
+        if (rc == BOOT_EBADIMAGE) {
+            BOOT_LOG_ERR("Image %d in the secondary slot is not valid!", image_index);
+
+            /* Whatever was decompressed must never be booted; drop the
+             * update.
+             */
+            rc = boot_scramble_slot(fap_primary_slot, BOOT_SLOT_PRIMARY);
+            assert(rc == 0);
+            rc = boot_scramble_slot(fap_secondary_slot, BOOT_SLOT_SECONDARY);
+            assert(rc == 0);
+
+            BOOT_SWAP_TYPE(state) = BOOT_SWAP_TYPE_FAIL;
+            return 0;
+        }
+        size = decomp_size;
+    } else
+#endif
+    {
+        BOOT_LOG_INF("Image %d copying the secondary slot to the primary slot: 0x%zx bytes",
+                     image_index, size);
 #if defined(MCUBOOT_SWAP_USING_OFFSET)
-    rc = BOOT_COPY_REGION(state, fap_secondary_slot, fap_primary_slot,
-                          boot_img_sector_size(state, BOOT_SLOT_SECONDARY, 0), 0, size, 0);
+        rc = BOOT_COPY_REGION(state, fap_secondary_slot, fap_primary_slot,
+                              boot_img_sector_size(state, BOOT_SLOT_SECONDARY, 0), 0, size, 0);
 #else
-    rc = boot_copy_region(state, fap_secondary_slot, fap_primary_slot, 0, 0, size);
+        rc = boot_copy_region(state, fap_secondary_slot, fap_primary_slot, 0, 0, size);
+#endif
+    }
+
+#ifdef MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY
+    state->copy_hash = NULL;
+    if (rc == 0) {
+        bootutil_sha_finish(&sha_ctx, hash);
+    }
+    bootutil_sha_drop(&sha_ctx);
 #endif
+
     if (rc != 0) {
         return rc;
     }
 
+#ifdef MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY
+    /* Verify the copied image before anything marks it as installed. The
+     * image is fully validated if a hook vouched for it in place of the
+     * checks of boot_validate_slot().
+     */
+    if (size < state->copy_hash_sz) {
+        FIH_SET(fih_rc, FIH_FAILURE);
+    } else if (state->signed_hash[image_index].valid) {
+        FIH_CALL(boot_fih_memequal, fih_rc, hash, state->signed_hash[image_index].hash,
+                 sizeof(hash));
+    } else {
+        FIH_CALL(bootutil_img_validate_with_hash, fih_rc, state, hdr, fap_primary_slot, hash);
+    }
+
+    if (FIH_NOT_EQ(fih_rc, FIH_SUCCESS)) {
+        BOOT_LOG_ERR("Image %d in the secondary slot is not valid!", image_index);
+
+        /* The primary slot now holds an image that failed validation: make
+         * sure it is never booted, and drop the update.
+         */
+        rc = boot_scramble_slot(fap_primary_slot, BOOT_SLOT_PRIMARY);
+        assert(rc == 0);
+        rc = boot_scramble_slot(fap_secondary_slot, BOOT_SLOT_SECONDARY);
+        assert(rc == 0);
+
+        BOOT_SWAP_TYPE(state) = BOOT_SWAP_TYPE_FAIL;
+        return 0;
+    }
+#endif
+
 #if defined(MCUBOOT_OVERWRITE_ONLY_FAST) || defined(MCUBOOT_SWAP_USING_MOVE) || defined(MCUBOOT_SWAP_USING_OFFSET)
     rc = boot_write_magic(fap_primary_slot);
     if (rc != 0) {
@@ -1039,7 +1340,17 @@ boot_copy_image(struct boot_loader_state *state, struct boot_status *bs)
      * slot's image header must be passed since the image headers in the
      * boot_data structure have not been updated yet.
      */
-    rc = boot_update_security_counter(state, BOOT_SLOT_PRIMARY, BOOT_SLOT_SECONDARY);
+#if defined(MCUBOOT_DECOMPRESS_IMAGES) && defined(MCUBOOT_OVERWRITE_ONLY)
+    if (IS_COMPRESSED(boot_img_hdr(state, BOOT_SLOT_SECONDARY))) {
+        /* The decompressed image does not match the header of the secondary
+         * slot, but the compressed image holds the same security counter.
+         */
+        rc = boot_update_security_counter(state, BOOT_SLOT_SECONDARY, BOOT_SLOT_SECONDARY);
+    } else
+#endif
+    {
+        rc = boot_update_security_counter(state, BOOT_SLOT_PRIMARY, BOOT_SLOT_SECONDARY);
+    }
     if (rc != 0) {
         BOOT_LOG_ERR("Security counter update failed after image upgrade: %d", rc);
         return rc;
@@ -1090,6 +1401,7 @@ boot_copy_image(struct boot_loader_state *state, struct boot_status *bs)
 static int
 boot_swap_image(struct boot_loader_state *state, struct boot_status *bs)
 {
+    struct boot_trailer_snapshot snap;
     struct image_header *hdr;
     const struct flash_area *fap;
 #ifdef MCUBOOT_ENC_IMAGES
@@ -1170,9 +1482,10 @@ boot_swap_image(struct boot_loader_state *state, struct boot_status *bs)
 
         fap = boot_find_status(state, image_index);
         assert(fap != NULL);
-        rc = boot_read_swap_size(fap, &bs->swap_size);
+        rc = boot_read_trailer_snapshot(fap, &snap);
         assert(rc == 0);
 
+        bs->swap_size = boot_snapshot_swap_size(&snap);
         copy_size = bs->swap_size;
 
 #ifdef MCUBOOT_ENC_IMAGES
@@ -1180,7 +1493,7 @@ boot_swap_image(struct boot_loader_state *state, struct boot_status *bs)
 
             boot_enc_init(BOOT_CURR_ENC_SLOT(state, slot));
 
-            if (!boot_read_enc_key(fap, slot, bs)) {
+            if (!boot_read_enc_key(&snap, slot, bs)) {
                 BOOT_LOG_DBG("boot_swap_image: Failed loading key (%d, %d)",
                               image_index, slot);
             } else {
@@ -1191,7 +1504,10 @@ boot_swap_image(struct boot_loader_state *state, struct boot_status *bs)
         flash_area_close(fap);
     }
 
-    swap_run(state, bs, copy_size);
+    rc = swap_run(state, bs, copy_size);
+    if (rc != 0) {
+        return rc;
+    }
 
 #ifdef MCUBOOT_VALIDATE_PRIMARY_SLOT
     extern int boot_status_fails;
@@ -1223,6 +1539,13 @@ boot_perform_update(struct boot_loader_state *state, struct boot_status *bs)
 #endif
 
     /* At this point there are no aborted swaps. */
+#ifdef MCUBOOT_VALIDATED_HASH_CACHE
+    rc = boot_invalidate_hash_cache(BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY));
+    if (rc != 0) {
+        BOOT_LOG_WRN("Failed to revoke the cached hash of the primary slot: %d", rc);
+    }
+#endif
+
 #if defined(MCUBOOT_OVERWRITE_ONLY)
     rc = boot_copy_image(state, bs);
 #elif defined(MCUBOOT_BOOTSTRAP)
@@ -1243,6 +1566,14 @@ boot_perform_update(struct boot_loader_state *state, struct boot_status *bs)
     assert(rc == 0);
 
 #ifndef MCUBOOT_OVERWRITE_ONLY
+    if (rc != 0) {
+        /* The swap stopped before a step it could not record, it must stay
+         * under way in the trailer.
+         */
+        BOOT_SWAP_TYPE(state) = BOOT_SWAP_TYPE_PANIC;
+        return rc;
+    }
+
     /* The following state needs image_ok be explicitly set after the
      * swap was finished to avoid a new revert.
      */
@@ -1305,23 +1636,30 @@ boot_complete_partial_swap(struct boot_loader_state *state,
     rc = boot_swap_image(state, bs);
     assert(rc == 0);
 
-    BOOT_SWAP_TYPE(state) = bs->swap_type;
+    if (rc != 0) {
+        /* The swap stopped before a step it could not record, it must stay
+         * under way in the trailer.
+         */
+        BOOT_SWAP_TYPE(state) = BOOT_SWAP_TYPE_PANIC;
+    } else {
+        BOOT_SWAP_TYPE(state) = bs->swap_type;
 
-    /* The following states need image_ok be explicitly set after the
-     * swap was finished to avoid a new revert.
-     */
-    if (bs->swap_type == BOOT_SWAP_TYPE_REVERT ||
-        bs->swap_type == BOOT_SWAP_TYPE_PERM) {
-        rc = swap_set_image_ok(BOOT_CURR_IMG(state));
-        if (rc != 0) {
-            BOOT_SWAP_TYPE(state) = BOOT_SWAP_TYPE_PANIC;
+        /* The following states need image_ok be explicitly set after the
+         * swap was finished to avoid a new revert.
+         */
+        if (bs->swap_type == BOOT_SWAP_TYPE_REVERT ||
+            bs->swap_type == BOOT_SWAP_TYPE_PERM) {
+            rc = swap_set_image_ok(BOOT_CURR_IMG(state));
+            if (rc != 0) {
+                BOOT_SWAP_TYPE(state) = BOOT_SWAP_TYPE_PANIC;
+            }
         }
-    }
 
-    if (BOOT_IS_UPGRADE(bs->swap_type)) {
-        rc = swap_set_copy_done(BOOT_CURR_IMG(state));
-        if (rc != 0) {
-            BOOT_SWAP_TYPE(state) = BOOT_SWAP_TYPE_PANIC;
+        if (BOOT_IS_UPGRADE(bs->swap_type)) {
+            rc = swap_set_copy_done(BOOT_CURR_IMG(state));
+            if (rc != 0) {
+                BOOT_SWAP_TYPE(state) = BOOT_SWAP_TYPE_PANIC;
+            }
         }
     }
 
@@ -1335,6 +1673,119 @@ boot_complete_partial_swap(struct boot_loader_state *state,
 
     return rc;
 }
+
+#if defined(MCUBOOT_SECTOR_HASHES)
+/**
+ * Rejects the image left in the primary slot by a resumed swap that failed
+ * its sector hash check, even once the sector was read again.
+ *
+ * The image is always refused on this boot. The verdict is only persisted,
+ * by scrambling the header sector, once the TLVs of the image have been
+ * authenticated: the signature of the hash in the hash TLV must be valid and
+ * the image must not match that hash. Otherwise the sector hashes themselves
+ * may be what is wrong, and destroying the image would not be warranted; it
+ * is checked again on the next boot.
+ *
+ * @param state                 Boot loader status information.
+ * @param tmpbuf                Buffer used to hash the image.
+ * @param tmpbuf_sz             Size of tmpbuf.
+ */
+static void
+boot_reject_resumed_swap(struct boot_loader_state *state, uint8_t *tmpbuf,
+                         uint32_t tmpbuf_sz)
+{
+    struct image_header *hdr = boot_img_hdr(state, BOOT_SLOT_PRIMARY);
+#if !defined(MCUBOOT_SIGN_PURE) && \
+    (defined(MCUBOOT_SIGN_RSA) || defined(MCUBOOT_SIGN_EC256) || \
+     defined(MCUBOOT_SIGN_EC384) || defined(MCUBOOT_SIGN_EC) || \
+     defined(MCUBOOT_SIGN_ED25519))
+    const struct flash_area *fap = BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY);
+    uint8_t signed_hash[IMAGE_HASH_SIZE];
+    uint8_t hash[IMAGE_HASH_SIZE];
+    FIH_DECLARE(fih_rc, FIH_FAILURE);
+    int rc;
+
+    FIH_CALL(bootutil_img_check_tlvs, fih_rc, state, hdr, fap, signed_hash);
+    if (FIH_NOT_EQ(fih_rc, FIH_SUCCESS)) {
+        BOOT_LOG_ERR("Resumed swap: image TLVs not authenticated; Image=%u",
+                     BOOT_CURR_IMG(state));
+    } else {
+        rc = bootutil_img_hash(state, hdr, fap, tmpbuf, tmpbuf_sz, hash, NULL, 0);
+        if (rc == 0 && memcmp(hash, signed_hash, sizeof(hash)) != 0) {
+            rc = boot_scramble_region(fap, boot_img_sector_off(state, BOOT_SLOT_PRIMARY, 0),
+                                      boot_img_sector_size(state, BOOT_SLOT_PRIMARY, 0),
+                                      false);
+            if (rc != 0) {
+                BOOT_LOG_ERR("Failed scrambling primary header (%d); Image=%u", rc,
+                             BOOT_CURR_IMG(state));
+            }
+        }
+    }
+#else
+    (void)tmpbuf;
+    (void)tmpbuf_sz;
+#endif
+
+    /* The header already read into RAM is cleared, so that this boot refuses
+     * the image whether or not it was scrambled.
+     */
+    hdr->ih_magic = 0;
+}
+
+/**
+ * Checks the part of the primary slot that was rewritten while completing an
+ * interrupted swap against the sector hashes of the image now in it, so that
+ * a bad resume is caught without hashing the whole image. A sector that does
+ * not match its hash is read and checked again before the image is rejected,
+ * see boot_reject_resumed_swap(). Other errors are left to the full
+ * validation of the image.
+ *
+ * @param state                 Boot loader status information.
+ */
+static void
+boot_check_resumed_swap(struct boot_loader_state *state)
+{
+    TARGET_STATIC uint8_t tmpbuf[BOOT_IO_BUF_SZ] __attribute__((aligned(4)));
+    uint32_t bad_off;
+    int rc;
+
+    if (state->primary_written_lo >= state->primary_written_hi ||
+        !boot_check_header_valid(state, BOOT_SLOT_PRIMARY)) {
+        return;
+    }
+
+    rc = bootutil_img_check_sectors(state, boot_img_hdr(state, BOOT_SLOT_PRIMARY),
+                                    BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY),
+                                    state->primary_written_lo,
+                                    state->primary_written_hi - state->primary_written_lo,
+                                    tmpbuf, sizeof(tmpbuf), &bad_off);
+    if (rc == BOOT_EBADIMAGE) {
+        /* A bad read looks the same as a bad sector, so the sector is read
+         * again before deciding on it.
+         */
+        BOOT_LOG_WRN("Resumed swap: sector at offset 0x%" PRIx32 " does not match its hash,"
+                     " checking it again; Image=%u", bad_off, BOOT_CURR_IMG(state));
+        rc = bootutil_img_check_sectors(state, boot_img_hdr(state, BOOT_SLOT_PRIMARY),
+                                        BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY),
+                                        bad_off, 1, tmpbuf, sizeof(tmpbuf), &bad_off);
+    }
+
+    if (rc == BOOT_EFILE) {
+        BOOT_LOG_DBG("boot_check_resumed_swap: no sector hashes; Image=%u",
+                     BOOT_CURR_IMG(state));
+    } else if (rc == BOOT_EBADIMAGE) {
+        BOOT_LOG_ERR("Resumed swap corrupted sector at offset 0x%" PRIx32 "; Image=%u",
+                     bad_off, BOOT_CURR_IMG(state));
+        boot_reject_resumed_swap(state, tmpbuf, sizeof(tmpbuf));
+    } else if (rc != 0) {
+        /* A read error or malformed TLVs do not show the image is corrupted;
+         * the full validation decides on it.
+         */
+        BOOT_LOG_ERR("Failed checking resumed swap (%d); Image=%u", rc,
+                     BOOT_CURR_IMG(state));
+    }
+}
+#endif /* MCUBOOT_SECTOR_HASHES */
 #endif /* !MCUBOOT_OVERWRITE_ONLY */
 
 #if (BOOT_IMAGE_NUMBER > 1)
@@ -1492,6 +1943,10 @@ boot_prepare_image_for_update(struct boot_loader_state *state,
             /* Determine the type of swap operation being resumed from the
              * `swap-type` trailer field.
              */
+#if defined(MCUBOOT_SECTOR_HASHES)
+            state->primary_written_lo = UINT32_MAX;
+            state->primary_written_hi = 0;
+#endif
             rc = boot_complete_partial_swap(state, bs);
             assert(rc == 0);
 #endif
@@ -1512,6 +1967,10 @@ boot_prepare_image_for_update(struct boot_loader_state *state,
             rc = boot_read_image_headers(state, false, NULL);
             assert(rc == 0);
 
+#if defined(MCUBOOT_SECTOR_HASHES) && !defined(MCUBOOT_OVERWRITE_ONLY)
+            boot_check_resumed_swap(state);
+#endif
+
             /* Swap has finished set to NONE */
             BOOT_SWAP_TYPE(state) = BOOT_SWAP_TYPE_NONE;
         } else {
@@ -1679,6 +2138,32 @@ check_downgrade_prevention(struct boot_loader_state *state)
 #endif
 }
 
+#if defined(MCUBOOT_HASH_WORKER) && defined(MCUBOOT_VALIDATE_PRIMARY_SLOT) && \
+    (BOOT_IMAGE_NUMBER > 1)
+/**
+ * Starts hashing the primary slot of the next image on the worker, so that
+ * it is hashed while the current image is validated. Images which were
+ * upgraded are skipped, as their headers are only read again later.
+ *
+ * @param  state        Boot loader status information.
+ */
+static void
+boot_hash_next_image(struct boot_loader_state *state)
+{
+    uint8_t image;
+
+    for (image = BOOT_CURR_IMG(state) + 1; image < BOOT_IMAGE_NUMBER; image++) {
+        if (!state->img_mask[image]) {
+            break;
+        }
+    }
+
+    if (image < BOOT_IMAGE_NUMBER && state->swap_type[image] == BOOT_SWAP_TYPE_NONE) {
+        boot_hash_ahead(state, image, BOOT_SLOT_PRIMARY);
+    }
+}
+#endif
+
 fih_ret
 context_boot_go(struct boot_loader_state *state, struct boot_rsp *rsp)
 {
@@ -1691,12 +2176,13 @@ context_boot_go(struct boot_loader_state *state, struct boot_rsp *rsp)
 
     BOOT_LOG_DBG("context_boot_go");
 
-#if !defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0
+#if (!defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0) && \
+    !defined(MCUBOOT_COMPACT_SECTORS)
 #if defined(__BOOTSIM__)
     struct boot_sector_buffer sector_buf;
     sectors = &sector_buf;
 #endif
-#endif /* !defined(MCUBOOT_LOGICAL_SECTOR_SIZE) || MCUBOOT_LOGICAL_SECTOR_SIZE == 0 */
+#endif /* (!MCUBOOT_LOGICAL_SECTOR_SIZE || MCUBOOT_LOGICAL_SECTOR_SIZE == 0) && !MCUBOOT_COMPACT_SECTORS */
 
     has_upgrade = false;
 
@@ -1890,6 +2376,9 @@ context_boot_go(struct boot_loader_state *state, struct boot_rsp *rsp)
         }
 
 #ifdef MCUBOOT_VALIDATE_PRIMARY_SLOT
+#if defined(MCUBOOT_HASH_WORKER) && (BOOT_IMAGE_NUMBER > 1)
+        boot_hash_next_image(state);
+#endif
         FIH_CALL(boot_validate_slot, fih_rc, state, BOOT_SLOT_PRIMARY, NULL, 0);
         /* Check for all possible values is redundant in normal operation it
          * is meant to prevent FI attack.
@@ -1937,10 +2426,21 @@ context_boot_go(struct boot_loader_state *state, struct boot_rsp *rsp)
         FIH_PANIC;
     }
 
+#if defined(MCUBOOT_BENCH_PHASES) && defined(MCUBOOT_DATA_SHARING_BOOTINFO)
+    /* The timing is only informative, booting goes on without it */
+    if (boot_save_bench_data() != 0) {
+        BOOT_LOG_WRN("Failed to add boot timing to shared memory area");
+    }
+#endif
+
     fill_rsp(state, rsp);
 
     fih_rc = FIH_SUCCESS;
 out:
+#ifdef MCUBOOT_HASH_WORKER
+    boot_hash_join(state);
+#endif
+
     /*
      * Since the boot_status struct stores plaintext encryption keys, reset
      * them here to avoid the possibility of jumping into an image that could
@@ -2205,6 +2705,43 @@ boot_select_or_erase(struct boot_loader_state *state)
 }
 #endif /* MCUBOOT_DIRECT_XIP && MCUBOOT_DIRECT_XIP_REVERT */
 
+#if defined(MCUBOOT_HASH_WORKER) && (BOOT_IMAGE_NUMBER > 1)
+/**
+ * Starts hashing the slot which is likely to be loaded for the next image on
+ * the worker, so that it is hashed while the current image is validated.
+ *
+ * @param  state        Boot loader status information.
+ */
+static void
+boot_hash_next_image(struct boot_loader_state *state)
+{
+    uint8_t curr_img = BOOT_CURR_IMG(state);
+    uint32_t slot;
+    uint8_t image;
+
+    for (image = curr_img + 1; image < BOOT_IMAGE_NUMBER; image++) {
+        if (!state->img_mask[image]) {
+            break;
+        }
+    }
+
+    if (image == BOOT_IMAGE_NUMBER) {
+        return;
+    }
+
+    slot = state->slot_usage[image].active_slot;
+    if (slot == BOOT_SLOT_NONE) {
+        BOOT_CURR_IMG(state) = image;
+        slot = find_slot_with_highest_version(state);
+        BOOT_CURR_IMG(state) = curr_img;
+    }
+
+    if (slot != BOOT_SLOT_NONE) {
+        boot_hash_ahead(state, image, slot);
+    }
+}
+#endif
+
 /**
  * Tries to load a slot for all the images with validation.
  *
@@ -2288,6 +2825,9 @@ boot_load_and_validate_images(struct boot_loader_state *state)
             }
 #endif /* MCUBOOT_RAM_LOAD */
 
+#if defined(MCUBOOT_HASH_WORKER) && (BOOT_IMAGE_NUMBER > 1)
+            boot_hash_next_image(state);
+#endif
             FIH_CALL(boot_validate_slot, fih_rc, state, active_slot, NULL, 0);
             if (FIH_NOT_EQ(fih_rc, FIH_SUCCESS)) {
                 /* Image is invalid. */
@@ -2423,9 +2963,19 @@ context_boot_go(struct boot_loader_state *state, struct boot_rsp *rsp)
     print_loaded_images(state);
 #endif
 
+#if defined(MCUBOOT_BENCH_PHASES) && defined(MCUBOOT_DATA_SHARING_BOOTINFO)
+    /* The timing is only informative, booting goes on without it */
+    if (boot_save_bench_data() != 0) {
+        BOOT_LOG_WRN("Failed to add boot timing to shared memory area");
+    }
+#endif
+
     fill_rsp(state, rsp);
 
 close:
+#ifdef MCUBOOT_HASH_WORKER
+    boot_hash_join(state);
+#endif
     boot_close_all_flash_areas(state);
 
 out:
@@ -124,7 +124,7 @@ boot_decrypt_and_copy_image_to_sram(struct boot_loader_state *state,
      * 1. The whole image is copied to the RAM (header + payload + TLV).
      * 2. The encryption key is loaded from the TLV in flash.
      * 3. The image is then decrypted chunk by chunk in RAM (1 chunk
-     * is 1024 bytes). Only the payload section is decrypted.
+     * is BOOT_IO_BUF_SZ bytes). Only the payload section is decrypted.
      * 4. The image is authenticated in RAM.
      */
     const struct flash_area *fap_src = NULL;
@@ -134,7 +134,7 @@ boot_decrypt_and_copy_image_to_sram(struct boot_loader_state *state,
     uint32_t blk_sz;
     uint32_t bytes_copied = hdr->ih_hdr_size;
     uint32_t chunk_sz;
-    uint32_t max_sz = 1024;
+    uint32_t max_sz = BOOT_IO_BUF_SZ;
     uint16_t idx;
     uint8_t * cur_dst;
     int rc;
@@ -178,9 +178,13 @@ boot_decrypt_and_copy_image_to_sram(struct boot_loader_state *state,
              * Part of the chunk is encrypted payload */
             blk_sz = tlv_off - (bytes_copied);
         }
-        boot_enc_decrypt(BOOT_CURR_ENC_SLOT(state, slot),
+        rc = boot_enc_decrypt(BOOT_CURR_ENC_SLOT(state, slot),
                 (bytes_copied + idx) - hdr->ih_hdr_size, blk_sz,
                 blk_off, cur_dst);
+        if (rc != 0) {
+            rc = BOOT_EBADIMAGE;
+            goto done;
+        }
         bytes_copied += chunk_sz;
     }
     rc = 0;
@@ -62,7 +62,7 @@ swap_erase_trailer_sectors(const struct boot_loader_state *state,
             uint32_t sz = boot_img_sector_size(state, slot, sector);
             uint32_t off = boot_img_sector_off(state, slot, sector);
 
-            rc = boot_erase_region(fap, off, sz, false);
+            rc = boot_erase_img_region(state, fap, off, sz, false);
             assert(rc == 0);
 
             sector--;
@@ -154,11 +154,152 @@ swap_status_init(const struct boot_loader_state *state,
     return 0;
 }
 
+#ifdef MCUBOOT_SWAP_STATUS_JOURNAL
+/* Computes the truncated hash of sz bytes at off in fap */
+static int
+swap_status_journal_hash(const struct flash_area *fap, uint32_t off, uint32_t sz,
+                         uint8_t *out)
+{
+    bootutil_sha_context sha_ctx;
+    uint8_t buf[BOOT_TMPBUF_SZ];
+    uint8_t hash[IMAGE_HASH_SIZE];
+    uint32_t max_sz;
+    uint32_t blk_sz;
+    uint32_t pos;
+
+    max_sz = boot_io_chunk_sz(fap, sizeof(buf));
+
+    bootutil_sha_init(&sha_ctx);
+    for (pos = 0; pos < sz; pos += blk_sz) {
+        blk_sz = sz - pos;
+        if (blk_sz > max_sz) {
+            blk_sz = max_sz;
+        }
+
+        if (flash_area_read(fap, off + pos, buf, blk_sz) != 0) {
+            bootutil_sha_drop(&sha_ctx);
+            return BOOT_EFLASH;
+        }
+        bootutil_sha_update(&sha_ctx, buf, blk_sz);
+    }
+    bootutil_sha_finish(&sha_ctx, hash);
+    bootutil_sha_drop(&sha_ctx);
+
+    memcpy(out, hash, BOOT_STATUS_JOURNAL_HASH_SZ);
+
+    return 0;
+}
+
+/* Moves bs to the next swap step */
+static void
+swap_step_next(struct boot_status *bs)
+{
+    if (bs->op == BOOT_STATUS_OP_SWAP && bs->state == BOOT_STATUS_STATE_0) {
+        bs->state = BOOT_STATUS_STATE_1;
+    } else {
+        bs->idx++;
+        bs->state = BOOT_STATUS_STATE_0;
+    }
+}
+
+int
+swap_status_journal_begin(struct boot_loader_state *state, struct boot_status *bs)
+{
+    struct boot_status_record *rec = &bs->journal;
+    struct boot_status next = *bs;
+    struct swap_step step;
+    uint32_t last_idx;
+    uint32_t entry;
+    int rc;
+
+    if (!boot_status_journal_used(BOOT_WRITE_SZ(state))) {
+        return 0;
+    }
+
+    entry = boot_status_internal_off(bs, 1);
+
+    /* Until the first record is written, a swap restarts from its first
+     * step, which needs none.
+     */
+    if (entry == 0 || (rec->count > 0 && entry < rec->entry + rec->count)) {
+        return 0;
+    }
+
+    /* The data each step writes is hashed before any of them runs. None of
+     * them overwrites the source of a later one, nor the destination of an
+     * earlier one.
+     */
+    last_idx = find_last_idx(state, bs->swap_size);
+    memset(rec, 0, sizeof(*rec));
+    rec->entry = entry;
+    while (rec->count < MCUBOOT_SWAP_STATUS_JOURNAL_GROUP &&
+           swap_step_regions(state, &next, last_idx, &step)) {
+        rc = swap_status_journal_hash(step.src_fap, step.src_off, step.sz,
+                                      rec->hash[rec->count]);
+        if (rc != 0) {
+            return rc;
+        }
+
+        rec->count++;
+        swap_step_next(&next);
+    }
+
+    BOOT_LOG_DBG("writing swap status journal; entry=%" PRIu32 " count=%" PRIu32,
+                 rec->entry, rec->count);
+
+    return boot_status_journal_write(BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY), rec);
+}
+
+int
+swap_status_journal_resume(struct boot_loader_state *state, const struct flash_area *fap,
+                           struct boot_status *bs)
+{
+    uint8_t hash[BOOT_STATUS_JOURNAL_HASH_SZ];
+    struct swap_step step;
+    uint32_t swap_size;
+    uint32_t last_idx;
+    uint32_t i;
+    int rc;
+
+    if (bs->journal.count == 0) {
+        return 0;
+    }
+
+    rc = boot_read_swap_size(fap, &swap_size);
+    if (rc != 0) {
+        return BOOT_EFLASH;
+    }
+
+    /* Steps run in order, so the first one whose destination does not hold
+     * what it writes is where the swap was interrupted.
+     */
+    last_idx = find_last_idx(state, swap_size);
+    for (i = 0; i < bs->journal.count &&
+                swap_step_regions(state, bs, last_idx, &step); i++) {
+        rc = swap_status_journal_hash(step.dst_fap, step.dst_off, step.sz, hash);
+        if (rc != 0) {
+            return rc;
+        }
+
+        if (memcmp(hash, bs->journal.hash[i], sizeof(hash)) != 0) {
+            break;
+        }
+
+        swap_step_next(bs);
+    }
+
+    BOOT_LOG_DBG("swap status journal; entry=%" PRIu32 " steps done=%" PRIu32,
+                 bs->journal.entry, i);
+
+    return 0;
+}
+#endif /* MCUBOOT_SWAP_STATUS_JOURNAL */
+
 int
 swap_read_status(struct boot_loader_state *state, struct boot_status *bs)
 {
+    struct boot_trailer_snapshot snap;
     const struct flash_area *fap;
-    uint32_t off;
     uint8_t swap_info;
     int rc;
 
@@ -186,13 +327,13 @@ swap_read_status(struct boot_loader_state *state, struct boot_status *bs)
 
     rc = swap_read_status_bytes(fap, state, bs);
     if (rc == 0) {
-        off = boot_swap_info_off(fap);
-        rc = flash_area_read(fap, off, &swap_info, sizeof swap_info);
+        rc = boot_read_trailer_snapshot(fap, &snap);
         if (rc != 0) {
-            rc = BOOT_EFLASH;
             goto done;
         }
 
+        swap_info = boot_snapshot_swap_info(&snap);
+
         if (bootutil_buffer_is_erased(fap, &swap_info, sizeof swap_info)) {
             BOOT_SET_SWAP_INFO(swap_info, 0, BOOT_SWAP_TYPE_NONE);
             rc = 0;
@@ -200,6 +341,10 @@ swap_read_status(struct boot_loader_state *state, struct boot_status *bs)
 
         /* Extract the swap type info */
         bs->swap_type = BOOT_GET_SWAP_TYPE(swap_info);
+
+#ifdef MCUBOOT_SWAP_STATUS_JOURNAL
+        rc = swap_status_journal_resume(state, fap, bs);
+#endif
     }
 
 done:
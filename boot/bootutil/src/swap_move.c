@@ -25,6 +25,7 @@
 #include "bootutil_priv.h"
 #include "swap_priv.h"
 #include "bootutil/bootutil_log.h"
+#include "bootutil/bench.h"
 
 #include "mcuboot_config/mcuboot_config.h"
 
@@ -32,6 +33,25 @@ BOOT_LOG_MODULE_DECLARE(mcuboot);
 
 #ifdef MCUBOOT_SWAP_USING_MOVE
 
+/*
+ * Number of sectors moved and swapped at each step. The image is moved up by
+ * a whole unit, which takes that much room at the end of the primary slot.
+ */
+#ifndef MCUBOOT_SWAP_UNIT_SECTORS
+#define MCUBOOT_SWAP_UNIT_SECTORS 1
+#endif
+
+#if MCUBOOT_SWAP_UNIT_SECTORS < 1
+#error "MCUBOOT_SWAP_UNIT_SECTORS must be at least 1"
+#endif
+
+/* Size of a swap unit, the slots having sectors of a single size */
+static inline uint32_t
+boot_swap_unit_sz(struct boot_loader_state *state)
+{
+    return boot_img_sector_size(state, BOOT_SLOT_PRIMARY, 0) * MCUBOOT_SWAP_UNIT_SECTORS;
+}
+
 #if defined(MCUBOOT_VALIDATE_PRIMARY_SLOT)
 /*
  * FIXME: this might have to be updated for threaded sim
@@ -54,7 +74,7 @@ find_last_idx(struct boot_loader_state *state, uint32_t swap_size)
     uint32_t sz;
     uint32_t last_idx;
 
-    sector_sz = boot_img_sector_size(state, BOOT_SLOT_PRIMARY, 0);
+    sector_sz = boot_swap_unit_sz(state);
     sz = 0;
     last_idx = 0;
     while (1) {
@@ -92,7 +112,7 @@ boot_read_image_header(struct boot_loader_state *state, int slot,
         }
 
         last_idx = find_last_idx(state, swap_size);
-        sz = boot_img_sector_size(state, BOOT_SLOT_PRIMARY, 0);
+        sz = boot_swap_unit_sz(state);
 
         /*
          * Find the correct offset or slot where the image header is expected to
@@ -134,34 +154,75 @@ done:
     return rc;
 }
 
+/* Sets bs to the step of status entry found_idx, if any */
+static void
+swap_status_set_entry(struct boot_status *bs, int found_idx)
+{
+    int move_entries;
+
+    move_entries = BOOT_MAX_IMG_SECTORS * BOOT_STATUS_MOVE_STATE_COUNT;
+    if (found_idx == -1) {
+        /* no swap status found; nothing to do */
+    } else if (found_idx < move_entries) {
+        bs->op = BOOT_STATUS_OP_MOVE;
+        bs->idx = (found_idx  / BOOT_STATUS_MOVE_STATE_COUNT) + BOOT_STATUS_IDX_0;
+        bs->state = (found_idx % BOOT_STATUS_MOVE_STATE_COUNT) + BOOT_STATUS_STATE_0;;
+    } else {
+        bs->op = BOOT_STATUS_OP_SWAP;
+        bs->idx = ((found_idx - move_entries) / BOOT_STATUS_SWAP_STATE_COUNT) + BOOT_STATUS_IDX_0;
+        bs->state = ((found_idx - move_entries) % BOOT_STATUS_SWAP_STATE_COUNT) + BOOT_STATUS_STATE_0;
+    }
+}
+
 int
 swap_read_status_bytes(const struct flash_area *fap,
         struct boot_loader_state *state, struct boot_status *bs)
 {
-    uint32_t off;
+    struct boot_status_window win;
     uint8_t status;
-    int max_entries;
-    int found_idx;
-    uint8_t write_sz;
-    int move_entries;
-    int rc;
     int last_rc;
     int erased_sections;
+    int max_entries;
+    int found_idx;
     int i;
+    int rc;
 
     max_entries = boot_status_entries(BOOT_CURR_IMG(state), fap);
     if (max_entries < 0) {
         return BOOT_EBADARGS;
     }
 
+#ifdef MCUBOOT_SWAP_STATUS_JOURNAL
+    if (boot_status_journal_used(BOOT_WRITE_SZ(state))) {
+        rc = boot_status_journal_read(fap, &bs->journal);
+        if (rc != 0) {
+            return BOOT_EFLASH;
+        }
+
+        /* Resume from the first step of the group of the last record, the
+         * steps of the group which are done are skipped by
+         * swap_status_journal_resume().
+         */
+        swap_status_set_entry(bs, (bs->journal.count > 0) ? (int)bs->journal.entry : -1);
+        return 0;
+    }
+#endif
+
     erased_sections = 0;
     found_idx = -1;
     /* skip erased sectors at the end */
     last_rc = 1;
-    write_sz = BOOT_WRITE_SZ(state);
-    off = boot_status_off(fap);
+    boot_status_window_init(&win, fap, BOOT_WRITE_SZ(state), max_entries);
+    rc = boot_status_window_find_set(&win, 0);
+    if (rc < 0) {
+        return BOOT_EFLASH;
+    } else if (rc == max_entries) {
+        /* No swap status written, no need to look for the last entry */
+        return 0;
+    }
+
     for (i = max_entries; i > 0; i--) {
-        rc = flash_area_read(fap, off + (i - 1) * write_sz, &status, 1);
+        rc = boot_status_window_get(&win, i - 1, &status);
         if (rc < 0) {
             return BOOT_EFLASH;
         }
@@ -194,18 +255,7 @@ swap_read_status_bytes(const struct flash_area *fap,
 #endif
     }
 
-    move_entries = BOOT_MAX_IMG_SECTORS * BOOT_STATUS_MOVE_STATE_COUNT;
-    if (found_idx == -1) {
-        /* no swap status found; nothing to do */
-    } else if (found_idx < move_entries) {
-        bs->op = BOOT_STATUS_OP_MOVE;
-        bs->idx = (found_idx  / BOOT_STATUS_MOVE_STATE_COUNT) + BOOT_STATUS_IDX_0;
-        bs->state = (found_idx % BOOT_STATUS_MOVE_STATE_COUNT) + BOOT_STATUS_STATE_0;;
-    } else {
-        bs->op = BOOT_STATUS_OP_SWAP;
-        bs->idx = ((found_idx - move_entries) / BOOT_STATUS_SWAP_STATE_COUNT) + BOOT_STATUS_IDX_0;
-        bs->state = ((found_idx - move_entries) % BOOT_STATUS_SWAP_STATE_COUNT) + BOOT_STATUS_STATE_0;
-    }
+    swap_status_set_entry(bs, found_idx);
 
     return 0;
 }
@@ -239,22 +289,26 @@ boot_slots_compatible(struct boot_loader_state *state)
     num_sectors_pri = boot_img_num_sectors(state, BOOT_SLOT_PRIMARY);
     num_sectors_sec = boot_img_num_sectors(state, BOOT_SLOT_SECONDARY);
 
-    if ((num_sectors_pri != num_sectors_sec) &&
-            (num_sectors_pri != (num_sectors_sec + 1))) {
+    if ((num_sectors_pri < num_sectors_sec) ||
+            (num_sectors_pri > (num_sectors_sec + MCUBOOT_SWAP_UNIT_SECTORS))) {
         BOOT_LOG_WRN("Cannot upgrade: not a compatible amount of sectors");
         BOOT_LOG_DBG("slot0 sectors: %d, slot1 sectors: %d, usable slot0 sectors: %d",
                      (int)num_sectors_pri, (int)num_sectors_sec,
-                     (int)(num_sectors_pri - 1));
+                     (int)(num_sectors_pri - MCUBOOT_SWAP_UNIT_SECTORS));
         return 0;
     } else if (num_sectors_pri > BOOT_MAX_IMG_SECTORS) {
         BOOT_LOG_WRN("Cannot upgrade: more sectors than allowed");
         return 0;
     }
 
-    /* Optimal says primary has one more than secondary. Always. Both have trailers. */
-    if (num_sectors_pri != (num_sectors_sec + 1)) {
+    /*
+     * Optimal says primary has one swap unit more than secondary. Always. Both
+     * have trailers.
+     */
+    if (num_sectors_pri != (num_sectors_sec + MCUBOOT_SWAP_UNIT_SECTORS)) {
         BOOT_LOG_DBG("Non-optimal sector distribution, slot0 has %d usable sectors (%d assigned) "
-                     "but slot1 has %d assigned", (int)(num_sectors_pri - 1),
+                     "but slot1 has %d assigned",
+                     (int)(num_sectors_pri - MCUBOOT_SWAP_UNIT_SECTORS),
                      (int)num_sectors_pri, (int)num_sectors_sec);
     }
 
@@ -347,9 +401,9 @@ swap_status_source(struct boot_loader_state *state)
 }
 
 /*
- * "Moves" the sector located at idx - 1 to idx.
+ * "Moves" the swap unit located at idx - 1 to idx.
  */
-static void
+static int
 boot_move_sector_up(int idx, uint32_t sz, struct boot_loader_state *state,
         struct boot_status *bs, const struct flash_area *fap_pri,
         const struct flash_area *fap_sec)
@@ -364,8 +418,9 @@ boot_move_sector_up(int idx, uint32_t sz, struct boot_loader_state *state,
      */
 
     /* Calculate offset from start of image area. */
-    new_off = boot_img_sector_off(state, BOOT_SLOT_PRIMARY, idx);
-    old_off = boot_img_sector_off(state, BOOT_SLOT_PRIMARY, idx - 1);
+    new_off = boot_img_sector_off(state, BOOT_SLOT_PRIMARY, idx * MCUBOOT_SWAP_UNIT_SECTORS);
+    old_off = boot_img_sector_off(state, BOOT_SLOT_PRIMARY,
+                                  (idx - 1) * MCUBOOT_SWAP_UNIT_SECTORS);
 
     if (bs->idx == BOOT_STATUS_IDX_0) {
         if (bs->source != BOOT_STATUS_SOURCE_PRIMARY_SLOT) {
@@ -384,7 +439,13 @@ boot_move_sector_up(int idx, uint32_t sz, struct boot_loader_state *state,
         assert(rc == 0);
     }
 
-    rc = boot_erase_region(fap_pri, new_off, sz, false);
+    rc = swap_status_journal_begin(state, bs);
+    if (rc == BOOT_ENOMEM) {
+        return rc;
+    }
+    BOOT_STATUS_ASSERT(rc == 0);
+
+    rc = boot_erase_img_region(state, fap_pri, new_off, sz, false);
     assert(rc == 0);
 
     rc = boot_copy_region(state, fap_pri, fap_pri, old_off, new_off, sz);
@@ -394,9 +455,11 @@ boot_move_sector_up(int idx, uint32_t sz, struct boot_loader_state *state,
 
     bs->idx++;
     BOOT_STATUS_ASSERT(rc == 0);
+
+    return 0;
 }
 
-static void
+static int
 boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
         struct boot_status *bs, const struct flash_area *fap_pri,
         const struct flash_area *fap_sec)
@@ -406,12 +469,20 @@ boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
     uint32_t sec_off;
     int rc;
 
-    pri_up_off = boot_img_sector_off(state, BOOT_SLOT_PRIMARY, idx);
-    pri_off = boot_img_sector_off(state, BOOT_SLOT_PRIMARY, idx - 1);
-    sec_off = boot_img_sector_off(state, BOOT_SLOT_SECONDARY, idx - 1);
+    pri_up_off = boot_img_sector_off(state, BOOT_SLOT_PRIMARY, idx * MCUBOOT_SWAP_UNIT_SECTORS);
+    pri_off = boot_img_sector_off(state, BOOT_SLOT_PRIMARY,
+                                  (idx - 1) * MCUBOOT_SWAP_UNIT_SECTORS);
+    sec_off = boot_img_sector_off(state, BOOT_SLOT_SECONDARY,
+                                  (idx - 1) * MCUBOOT_SWAP_UNIT_SECTORS);
 
     if (bs->state == BOOT_STATUS_STATE_0) {
-        rc = boot_erase_region(fap_pri, pri_off, sz, false);
+        rc = swap_status_journal_begin(state, bs);
+        if (rc == BOOT_ENOMEM) {
+            return rc;
+        }
+        BOOT_STATUS_ASSERT(rc == 0);
+
+        rc = boot_erase_img_region(state, fap_pri, pri_off, sz, false);
         assert(rc == 0);
 
         rc = boot_copy_region(state, fap_sec, fap_pri, sec_off, pri_off, sz);
@@ -423,7 +494,13 @@ boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
     }
 
     if (bs->state == BOOT_STATUS_STATE_1) {
-        rc = boot_erase_region(fap_sec, sec_off, sz, false);
+        rc = swap_status_journal_begin(state, bs);
+        if (rc == BOOT_ENOMEM) {
+            return rc;
+        }
+        BOOT_STATUS_ASSERT(rc == 0);
+
+        rc = boot_erase_img_region(state, fap_sec, sec_off, sz, false);
         assert(rc == 0);
 
         rc = boot_copy_region(state, fap_pri, fap_sec, pri_up_off, sec_off, sz);
@@ -434,7 +511,51 @@ boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
         bs->state = BOOT_STATUS_STATE_0;
         BOOT_STATUS_ASSERT(rc == 0);
     }
+
+    return 0;
+}
+
+#ifdef MCUBOOT_SWAP_STATUS_JOURNAL
+bool
+swap_step_regions(struct boot_loader_state *state, const struct boot_status *bs,
+                  uint32_t last_idx, struct swap_step *step)
+{
+    uint32_t idx;
+
+    if (bs->idx > last_idx) {
+        return false;
+    }
+
+    step->sz = boot_swap_unit_sz(state);
+
+    if (bs->op == BOOT_STATUS_OP_MOVE) {
+        /* The unit boot_move_sector_up() moves at this step */
+        idx = last_idx - bs->idx + 1;
+        step->src_fap = BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY);
+        step->src_off = boot_img_sector_off(state, BOOT_SLOT_PRIMARY,
+                                            (idx - 1) * MCUBOOT_SWAP_UNIT_SECTORS);
+        step->dst_fap = BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY);
+        step->dst_off = boot_img_sector_off(state, BOOT_SLOT_PRIMARY,
+                                            idx * MCUBOOT_SWAP_UNIT_SECTORS);
+    } else if (bs->state == BOOT_STATUS_STATE_0) {
+        step->src_fap = BOOT_IMG_AREA(state, BOOT_SLOT_SECONDARY);
+        step->src_off = boot_img_sector_off(state, BOOT_SLOT_SECONDARY,
+                                            (bs->idx - 1) * MCUBOOT_SWAP_UNIT_SECTORS);
+        step->dst_fap = BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY);
+        step->dst_off = boot_img_sector_off(state, BOOT_SLOT_PRIMARY,
+                                            (bs->idx - 1) * MCUBOOT_SWAP_UNIT_SECTORS);
+    } else {
+        step->src_fap = BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY);
+        step->src_off = boot_img_sector_off(state, BOOT_SLOT_PRIMARY,
+                                            bs->idx * MCUBOOT_SWAP_UNIT_SECTORS);
+        step->dst_fap = BOOT_IMG_AREA(state, BOOT_SLOT_SECONDARY);
+        step->dst_off = boot_img_sector_off(state, BOOT_SLOT_SECONDARY,
+                                            (bs->idx - 1) * MCUBOOT_SWAP_UNIT_SECTORS);
+    }
+
+    return true;
 }
+#endif /* MCUBOOT_SWAP_STATUS_JOURNAL */
 
 /*
  * When starting a revert the swap status exists in the primary slot, and
@@ -485,23 +606,27 @@ fixup_revert(const struct boot_loader_state *state, struct boot_status *bs,
     }
 }
 
-void
+int
 swap_run(struct boot_loader_state *state, struct boot_status *bs,
          uint32_t copy_size)
 {
+    bench_phase_t bench;
     uint32_t sz;
     uint32_t sector_sz;
+    uint32_t unit_sz;
     uint32_t idx;
     uint32_t trailer_sz;
     uint32_t first_trailer_idx;
     uint32_t last_idx;
     const struct flash_area *fap_pri;
     const struct flash_area *fap_sec;
+    int rc;
 
     BOOT_LOG_INF("Starting swap using move algorithm.");
 
     last_idx = find_last_idx(state, copy_size);
     sector_sz = boot_img_sector_size(state, BOOT_SLOT_PRIMARY, 0);
+    unit_sz = boot_swap_unit_sz(state);
 
     /*
      * When starting a new swap upgrade, check that there is enough space.
@@ -519,13 +644,19 @@ swap_run(struct boot_loader_state *state, struct boot_status *bs,
             first_trailer_idx--;
         }
 
-        if (last_idx >= first_trailer_idx) {
+        /*
+         * The image, moved up by one unit, must end before the trailer, and
+         * its last unit must be within the secondary slot.
+         */
+        if ((last_idx + 1) * MCUBOOT_SWAP_UNIT_SECTORS > first_trailer_idx ||
+            last_idx * MCUBOOT_SWAP_UNIT_SECTORS >
+            boot_img_num_sectors(state, BOOT_SLOT_SECONDARY)) {
             BOOT_LOG_WRN("Not enough free space to run swap upgrade");
             BOOT_LOG_WRN("required %" PRIu32 " bytes but only %" PRIu32 " are available",
-                         (last_idx + 1) * sector_sz,
+                         (last_idx + 1) * unit_sz,
                          first_trailer_idx * sector_sz);
             bs->swap_type = BOOT_SWAP_TYPE_NONE;
-            return;
+            return 0;
         }
     }
 
@@ -541,7 +672,12 @@ swap_run(struct boot_loader_state *state, struct boot_status *bs,
         idx = last_idx;
         while (idx > 0) {
             if (idx <= (last_idx - bs->idx + 1)) {
-                boot_move_sector_up(idx, sector_sz, state, bs, fap_pri, fap_sec);
+                boot_bench_phase_start(&bench);
+                rc = boot_move_sector_up(idx, unit_sz, state, bs, fap_pri, fap_sec);
+                boot_bench_phase_stop(&bench, BOOT_BENCH_SWAP_STEP, unit_sz);
+                if (rc != 0) {
+                    return rc;
+                }
             }
             idx--;
         }
@@ -553,10 +689,17 @@ swap_run(struct boot_loader_state *state, struct boot_status *bs,
     idx = 1;
     while (idx <= last_idx) {
         if (idx >= bs->idx) {
-            boot_swap_sectors(idx, sector_sz, state, bs, fap_pri, fap_sec);
+            boot_bench_phase_start(&bench);
+            rc = boot_swap_sectors(idx, unit_sz, state, bs, fap_pri, fap_sec);
+            boot_bench_phase_stop(&bench, BOOT_BENCH_SWAP_STEP, unit_sz);
+            if (rc != 0) {
+                return rc;
+            }
         }
         idx++;
     }
+
+    return 0;
 }
 
 int app_max_size(struct boot_loader_state *state)
@@ -566,16 +709,20 @@ int app_max_size(struct boot_loader_state *state)
 
     size_t trailer_sz = boot_trailer_sz(BOOT_WRITE_SZ(state));
     size_t sector_sz = boot_img_sector_size(state, BOOT_SLOT_PRIMARY, 0);
-    size_t padding_sz = sector_sz;
+    size_t padding_sz = boot_swap_unit_sz(state);
 
     /* The trailer size needs to be sector-aligned */
     trailer_sz = ALIGN_UP(trailer_sz, sector_sz);
 
     /* The slot whose size is used to compute the maximum image size must be the one containing the
-     * padding required for the swap.
+     * padding required for the swap. The image is swapped in whole units, which must all fit
+     * before the trailer.
      */
-    available_pri_sz = boot_img_num_sectors(state, BOOT_SLOT_PRIMARY) * sector_sz - trailer_sz - padding_sz;
+    available_pri_sz = boot_img_num_sectors(state, BOOT_SLOT_PRIMARY) * sector_sz - trailer_sz;
+    available_pri_sz -= available_pri_sz % padding_sz;
+    available_pri_sz -= padding_sz;
     available_sec_sz = boot_img_num_sectors(state, BOOT_SLOT_SECONDARY) * sector_sz - trailer_sz;
+    available_sec_sz -= available_sec_sz % padding_sz;
 
     return (available_pri_sz < available_sec_sz ? available_pri_sz : available_sec_sz);
 }
@@ -26,6 +26,7 @@
 #include "bootutil_priv.h"
 #include "swap_priv.h"
 #include "bootutil/bootutil_log.h"
+#include "bootutil/bench.h"
 
 #include "mcuboot_config/mcuboot_config.h"
 
@@ -220,18 +221,29 @@ done:
     return rc;
 }
 
+/* Sets bs to the step of status entry found_idx, if any */
+static void swap_status_set_entry(struct boot_status *bs, int found_idx)
+{
+    if (found_idx == -1) {
+        /* no swap status found; nothing to do */
+    } else {
+        bs->op = BOOT_STATUS_OP_SWAP;
+        bs->idx = (found_idx / BOOT_STATUS_SWAP_STATE_COUNT) + BOOT_STATUS_IDX_0;
+        bs->state = (found_idx % BOOT_STATUS_SWAP_STATE_COUNT) + BOOT_STATUS_STATE_0;
+    }
+}
+
 int swap_read_status_bytes(const struct flash_area *fap, struct boot_loader_state *state,
                            struct boot_status *bs)
 {
-    uint32_t off;
+    struct boot_status_window win;
     uint8_t status;
-    int max_entries;
-    int found_idx;
-    uint8_t write_sz;
-    int rc;
     int last_rc;
     int erased_sections;
+    int max_entries;
+    int found_idx;
     int i;
+    int rc;
 
     max_entries = boot_status_entries(BOOT_CURR_IMG(state), fap);
 
@@ -239,14 +251,37 @@ int swap_read_status_bytes(const struct flash_area *fap, struct boot_loader_stat
         return BOOT_EBADARGS;
     }
 
+#ifdef MCUBOOT_SWAP_STATUS_JOURNAL
+    if (boot_status_journal_used(BOOT_WRITE_SZ(state))) {
+        rc = boot_status_journal_read(fap, &bs->journal);
+        if (rc != 0) {
+            return BOOT_EFLASH;
+        }
+
+        /* Resume from the first step of the group of the last record, the
+         * steps of the group which are done are skipped by
+         * swap_status_journal_resume().
+         */
+        swap_status_set_entry(bs, (bs->journal.count > 0) ? (int)bs->journal.entry : -1);
+        return 0;
+    }
+#endif
+
     erased_sections = 0;
     found_idx = -1;
     /* Skip erased sectors at the end */
     last_rc = 1;
-    write_sz = BOOT_WRITE_SZ(state);
-    off = boot_status_off(fap);
+    boot_status_window_init(&win, fap, BOOT_WRITE_SZ(state), max_entries);
+    rc = boot_status_window_find_set(&win, 0);
+    if (rc < 0) {
+        return BOOT_EFLASH;
+    } else if (rc == max_entries) {
+        /* No swap status written, no need to look for the last entry */
+        return 0;
+    }
+
     for (i = max_entries; i > 0; i--) {
-        rc = flash_area_read(fap, off + (i - 1) * write_sz, &status, 1);
+        rc = boot_status_window_get(&win, i - 1, &status);
         if (rc < 0) {
             return BOOT_EFLASH;
         }
@@ -279,13 +314,7 @@ int swap_read_status_bytes(const struct flash_area *fap, struct boot_loader_stat
 #endif
     }
 
-    if (found_idx == -1) {
-        /* no swap status found; nothing to do */
-    } else {
-        bs->op = BOOT_STATUS_OP_SWAP;
-        bs->idx = (found_idx / BOOT_STATUS_SWAP_STATE_COUNT) + BOOT_STATUS_IDX_0;
-        bs->state = (found_idx % BOOT_STATUS_SWAP_STATE_COUNT) + BOOT_STATUS_STATE_0;
-    }
+    swap_status_set_entry(bs, found_idx);
 
     return 0;
 }
@@ -417,10 +446,24 @@ int swap_status_source(struct boot_loader_state *state)
     return BOOT_STATUS_SOURCE_NONE;
 }
 
-static void boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
-                              struct boot_status *bs, const struct flash_area *fap_pri,
-                              const struct flash_area *fap_sec, bool skip_primary,
-                              bool skip_secondary)
+/*
+ * Number of sectors taken by the image in slot, beyond which the swap skips
+ * copying it. The size of its unprotected TLVs is the one saved in the swap
+ * status area, as it cannot be read back once the swap has started.
+ */
+static uint32_t boot_used_sectors(struct boot_loader_state *state, int slot,
+                                  uint16_t unprotected_tlv_size, uint32_t sector_sz)
+{
+    const struct image_header *hdr = &state->imgs[BOOT_CURR_IMG(state)][slot].hdr;
+
+    return (hdr->ih_hdr_size + hdr->ih_protect_tlv_size + unprotected_tlv_size +
+            hdr->ih_img_size + sector_sz - 1) / sector_sz;
+}
+
+static int boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
+                             struct boot_status *bs, const struct flash_area *fap_pri,
+                             const struct flash_area *fap_sec, bool skip_primary,
+                             bool skip_secondary)
 {
     uint32_t pri_off;
     uint32_t sec_off;
@@ -432,13 +475,19 @@ static void boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *st
     sec_up_off = boot_img_sector_off(state, BOOT_SLOT_PRIMARY, (idx + 1));
 
     if (bs->state == BOOT_STATUS_STATE_0) {
+        rc = swap_status_journal_begin(state, bs);
+        if (rc == BOOT_ENOMEM) {
+            return rc;
+        }
+        BOOT_STATUS_ASSERT(rc == 0);
+
         if (skip_primary == true) {
             BOOT_LOG_DBG("Skipping erase of secondary 0x%x and copy from primary 0x%x", sec_off,
                          pri_off);
         } else {
             /* Copy from slot 0 X to slot 1 X */
             BOOT_LOG_DBG("Erasing secondary 0x%x of 0x%x", sec_off, sz);
-            rc = boot_erase_region(fap_sec, sec_off, sz, false);
+            rc = boot_erase_img_region(state, fap_sec, sec_off, sz, false);
             assert(rc == 0);
 
             BOOT_LOG_DBG("Copying primary 0x%x -> secondary 0x%x of 0x%x", pri_off, sec_off, sz);
@@ -452,13 +501,19 @@ static void boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *st
     }
 
     if (bs->state == BOOT_STATUS_STATE_1) {
+        rc = swap_status_journal_begin(state, bs);
+        if (rc == BOOT_ENOMEM) {
+            return rc;
+        }
+        BOOT_STATUS_ASSERT(rc == 0);
+
         if (skip_secondary == true) {
             BOOT_LOG_DBG("Skipping erase of primary 0x%x and copy from secondary 0x%x", pri_off,
                          sec_up_off);
         } else {
             /* Erase slot 0 X */
             BOOT_LOG_DBG("Erasing primary 0x%x of 0x%x", pri_off, sz);
-            rc = boot_erase_region(fap_pri, pri_off, sz, false);
+            rc = boot_erase_img_region(state, fap_pri, pri_off, sz, false);
             assert(rc == 0);
 
             /* Copy from slot 1 (X + 1) to slot 0 X */
@@ -473,12 +528,14 @@ static void boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *st
         bs->state = BOOT_STATUS_STATE_0;
         BOOT_STATUS_ASSERT(rc == 0);
     }
+
+    return 0;
 }
 
-static void boot_swap_sectors_revert(int idx, uint32_t sz, struct boot_loader_state *state,
-                                     struct boot_status *bs, const struct flash_area *fap_pri,
-                                     const struct flash_area *fap_sec, uint32_t sector_sz,
-                                     bool skip_primary, bool skip_secondary)
+static int boot_swap_sectors_revert(int idx, uint32_t sz, struct boot_loader_state *state,
+                                    struct boot_status *bs, const struct flash_area *fap_pri,
+                                    const struct flash_area *fap_sec, uint32_t sector_sz,
+                                    bool skip_primary, bool skip_secondary)
 {
     uint32_t pri_off;
     uint32_t sec_off;
@@ -493,13 +550,19 @@ static void boot_swap_sectors_revert(int idx, uint32_t sz, struct boot_loader_st
     sec_up_off = boot_img_sector_off(state, BOOT_SLOT_PRIMARY, idx);
 
     if (bs->state == BOOT_STATUS_STATE_0) {
+        rc = swap_status_journal_begin(state, bs);
+        if (rc == BOOT_ENOMEM) {
+            return rc;
+        }
+        BOOT_STATUS_ASSERT(rc == 0);
+
         if (skip_primary == true) {
             BOOT_LOG_DBG("Skipping erase of secondary 0x%x and copy from primary 0x%x", sec_off,
                          pri_off);
         } else {
             /* Copy from slot 0 X to slot 1 X */
             BOOT_LOG_DBG("Erasing secondary 0x%x of 0x%x", sec_off, sz);
-            rc = boot_erase_region(fap_sec, sec_off, sz, false);
+            rc = boot_erase_img_region(state, fap_sec, sec_off, sz, false);
             assert(rc == 0);
 
             BOOT_LOG_DBG("Copying primary 0x%x -> secondary 0x%x of 0x%x", pri_off, sec_off, sz);
@@ -513,13 +576,19 @@ static void boot_swap_sectors_revert(int idx, uint32_t sz, struct boot_loader_st
     }
 
     if (bs->state == BOOT_STATUS_STATE_1) {
+        rc = swap_status_journal_begin(state, bs);
+        if (rc == BOOT_ENOMEM) {
+            return rc;
+        }
+        BOOT_STATUS_ASSERT(rc == 0);
+
         if (skip_secondary == true) {
             BOOT_LOG_DBG("Skipping erase of primary 0x%x and copy from secondary 0x%x", pri_off,
                          sec_up_off);
         } else {
             /* Erase slot 0 X */
             BOOT_LOG_DBG("Erasing primary 0x%x of 0x%x", pri_off, sz);
-            rc = boot_erase_region(fap_pri, pri_off, sz, false);
+            rc = boot_erase_img_region(state, fap_pri, pri_off, sz, false);
             assert(rc == 0);
 
             /* Copy from slot 1 (X + 1) to slot 0 X */
@@ -534,7 +603,70 @@ static void boot_swap_sectors_revert(int idx, uint32_t sz, struct boot_loader_st
         bs->state = BOOT_STATUS_STATE_0;
         BOOT_STATUS_ASSERT(rc == 0);
     }
+
+    return 0;
+}
+
+#ifdef MCUBOOT_SWAP_STATUS_JOURNAL
+bool swap_step_regions(struct boot_loader_state *state, const struct boot_status *bs,
+                       uint32_t last_idx, struct swap_step *step)
+{
+    uint32_t idx = bs->idx - BOOT_STATUS_IDX_0;
+    uint32_t sec_idx;
+    uint32_t sector_sz;
+    uint32_t used_sectors;
+    uint16_t unprotected_tlv_size_pri;
+    uint16_t unprotected_tlv_size_sec;
+
+    if (idx > last_idx) {
+        return false;
+    }
+
+    /* The sectors boot_swap_sectors() or boot_swap_sectors_revert() swaps at
+     * this step.
+     */
+    if (bs->swap_type == BOOT_SWAP_TYPE_REVERT ||
+        boot_swap_type_multi(BOOT_CURR_IMG(state)) == BOOT_SWAP_TYPE_REVERT) {
+        idx = last_idx - idx;
+        sec_idx = (bs->state == BOOT_STATUS_STATE_0) ? idx + 1 : idx;
+    } else {
+        sec_idx = (bs->state == BOOT_STATUS_STATE_0) ? idx : idx + 1;
+    }
+
+    sector_sz = boot_img_sector_size(state, BOOT_SLOT_PRIMARY, 0);
+    step->sz = sector_sz;
+
+    if (boot_read_unprotected_tlv_sizes(BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY),
+                                        &unprotected_tlv_size_pri,
+                                        &unprotected_tlv_size_sec) != 0) {
+        unprotected_tlv_size_pri = 0;
+        unprotected_tlv_size_sec = 0;
+    }
+
+    if (bs->state == BOOT_STATUS_STATE_0) {
+        step->src_fap = BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY);
+        step->src_off = boot_img_sector_off(state, BOOT_SLOT_PRIMARY, idx);
+        step->dst_fap = BOOT_IMG_AREA(state, BOOT_SLOT_SECONDARY);
+        step->dst_off = boot_img_sector_off(state, BOOT_SLOT_SECONDARY, sec_idx);
+        used_sectors = boot_used_sectors(state, BOOT_SLOT_PRIMARY, unprotected_tlv_size_pri,
+                                         sector_sz);
+    } else {
+        step->src_fap = BOOT_IMG_AREA(state, BOOT_SLOT_SECONDARY);
+        step->src_off = boot_img_sector_off(state, BOOT_SLOT_SECONDARY, sec_idx);
+        step->dst_fap = BOOT_IMG_AREA(state, BOOT_SLOT_PRIMARY);
+        step->dst_off = boot_img_sector_off(state, BOOT_SLOT_PRIMARY, idx);
+        used_sectors = boot_used_sectors(state, BOOT_SLOT_SECONDARY, unprotected_tlv_size_sec,
+                                         sector_sz);
+    }
+
+    if (idx > used_sectors) {
+        step->src_fap = step->dst_fap;
+        step->src_off = step->dst_off;
+    }
+
+    return true;
 }
+#endif /* MCUBOOT_SWAP_STATUS_JOURNAL */
 
 /*
  * When starting a revert the swap status exists in the primary slot, and
@@ -579,9 +711,10 @@ void fixup_revert(const struct boot_loader_state *state, struct boot_status *bs,
     }
 }
 
-void swap_run(struct boot_loader_state *state, struct boot_status *bs,
-              uint32_t copy_size)
+int swap_run(struct boot_loader_state *state, struct boot_status *bs,
+             uint32_t copy_size)
 {
+    bench_phase_t bench;
     uint32_t sz;
     uint32_t sector_sz;
     uint32_t idx;
@@ -627,7 +760,7 @@ void swap_run(struct boot_loader_state *state, struct boot_status *bs,
                          (last_idx + 1) * sector_sz,
                          first_trailer_idx * sector_sz);
             bs->swap_type = BOOT_SWAP_TYPE_NONE;
-            return;
+            return 0;
         }
     }
 
@@ -659,16 +792,10 @@ void swap_run(struct boot_loader_state *state, struct boot_status *bs,
 
     bs->op = BOOT_STATUS_OP_SWAP;
     idx = 0;
-    used_sectors_pri = ((state->imgs[BOOT_CURR_IMG(state)][BOOT_SLOT_PRIMARY].hdr.ih_hdr_size +
-        unprotected_tlv_size_pri +
-        state->imgs[BOOT_CURR_IMG(state)][BOOT_SLOT_PRIMARY].hdr.ih_protect_tlv_size +
-        state->imgs[BOOT_CURR_IMG(state)][BOOT_SLOT_PRIMARY].hdr.ih_img_size) + sector_sz - 1) /
-        sector_sz;
-    used_sectors_sec = ((state->imgs[BOOT_CURR_IMG(state)][BOOT_SLOT_SECONDARY].hdr.ih_hdr_size +
-        state->imgs[BOOT_CURR_IMG(state)][BOOT_SLOT_SECONDARY].hdr.ih_protect_tlv_size +
-        unprotected_tlv_size_sec +
-        state->imgs[BOOT_CURR_IMG(state)][BOOT_SLOT_SECONDARY].hdr.ih_img_size) + sector_sz - 1) /
-        sector_sz;
+    used_sectors_pri = boot_used_sectors(state, BOOT_SLOT_PRIMARY, unprotected_tlv_size_pri,
+                                         sector_sz);
+    used_sectors_sec = boot_used_sectors(state, BOOT_SLOT_SECONDARY, unprotected_tlv_size_sec,
+                                         sector_sz);
 
     if (bs->swap_type == BOOT_SWAP_TYPE_REVERT ||
         boot_swap_type_multi(BOOT_CURR_IMG(state)) == BOOT_SWAP_TYPE_REVERT) {
@@ -676,10 +803,15 @@ void swap_run(struct boot_loader_state *state, struct boot_status *bs,
             if (idx >= (bs->idx - BOOT_STATUS_IDX_0)) {
                 uint32_t mirror_idx = last_idx - idx;
 
-                boot_swap_sectors_revert(mirror_idx, sector_sz, state, bs, fap_pri, fap_sec,
-                                         sector_sz,
-                                         (mirror_idx > used_sectors_pri ? true : false),
-                                         (mirror_idx > used_sectors_sec ? true : false));
+                boot_bench_phase_start(&bench);
+                rc = boot_swap_sectors_revert(mirror_idx, sector_sz, state, bs, fap_pri,
+                                              fap_sec, sector_sz,
+                                              (mirror_idx > used_sectors_pri ? true : false),
+                                              (mirror_idx > used_sectors_sec ? true : false));
+                boot_bench_phase_stop(&bench, BOOT_BENCH_SWAP_STEP, sector_sz);
+                if (rc != 0) {
+                    return rc;
+                }
             }
 
             idx++;
@@ -697,14 +829,21 @@ void swap_run(struct boot_loader_state *state, struct boot_status *bs,
     } else {
         while (idx <= last_idx) {
             if (idx >= (bs->idx - BOOT_STATUS_IDX_0)) {
-                boot_swap_sectors(idx, sector_sz, state, bs, fap_pri, fap_sec,
-                                  (idx > used_sectors_pri ? true : false),
-                                  (idx > used_sectors_sec ? true : false));
+                boot_bench_phase_start(&bench);
+                rc = boot_swap_sectors(idx, sector_sz, state, bs, fap_pri, fap_sec,
+                                       (idx > used_sectors_pri ? true : false),
+                                       (idx > used_sectors_sec ? true : false));
+                boot_bench_phase_stop(&bench, BOOT_BENCH_SWAP_STEP, sector_sz);
+                if (rc != 0) {
+                    return rc;
+                }
             }
 
             idx++;
         }
     }
+
+    return 0;
 }
 
 int app_max_size(struct boot_loader_state *state)
@@ -96,10 +96,13 @@ int swap_set_image_ok(uint8_t image_index);
 /**
  * Start a new or resume an interrupted swap according to the parameters
  * found in the given boot_status.
+ *
+ * @return 0 on success; BOOT_ENOMEM if the swap was stopped, before a step
+ *         which could not be recorded in the swap status journal.
  */
-void swap_run(struct boot_loader_state *state,
-              struct boot_status *bs,
-              uint32_t copy_size);
+int swap_run(struct boot_loader_state *state,
+             struct boot_status *bs,
+             uint32_t copy_size);
 
 #if MCUBOOT_SWAP_USING_SCRATCH
 #define BOOT_SCRATCH_AREA(state) ((state)->scratch.area)
@@ -123,6 +126,64 @@ static inline size_t boot_scratch_area_size(const struct boot_loader_state *stat
  * slot.
  */
 bool swap_write_block_size_check(struct boot_loader_state *state);
+
+/**
+ * Returns the index of the last swap unit of an image of swap_size bytes, as
+ * iterated over by swap_run().
+ */
+uint32_t find_last_idx(struct boot_loader_state *state, uint32_t swap_size);
+
+#ifdef MCUBOOT_SWAP_STATUS_JOURNAL
+/**
+ * Regions of a swap step, which copies sz bytes from the source to the
+ * destination.
+ */
+struct swap_step {
+    const struct flash_area *src_fap;
+    uint32_t src_off;
+    const struct flash_area *dst_fap;
+    uint32_t dst_off;
+    uint32_t sz;
+};
+
+/**
+ * Gets the regions of the swap step bs is at. A step which skips the copy
+ * gets its destination as its source, the data it leaves there being what
+ * was already there.
+ *
+ * @return false if bs is past the last step of its operation.
+ */
+bool swap_step_regions(struct boot_loader_state *state, const struct boot_status *bs,
+                       uint32_t last_idx, struct swap_step *step);
+
+/**
+ * Called before each swap step: when bs is past the group of steps of its
+ * journal record, writes the record of a new group starting at bs.
+ *
+ * @return 0 on success; BOOT_ENOMEM if the journal has no room left for
+ *         the record, in which case the step must not be run; nonzero on
+ *         other failures.
+ */
+int swap_status_journal_begin(struct boot_loader_state *state, struct boot_status *bs);
+
+/**
+ * Moves bs, at the first step of the group of its journal record, past the
+ * steps of the group whose destination holds what they write.
+ *
+ * @return 0 on success; nonzero on failure.
+ */
+int swap_status_journal_resume(struct boot_loader_state *state, const struct flash_area *fap,
+                               struct boot_status *bs);
+#else
+static inline int
+swap_status_journal_begin(struct boot_loader_state *state, struct boot_status *bs)
+{
+    (void)state;
+    (void)bs;
+
+    return 0;
+}
+#endif /* MCUBOOT_SWAP_STATUS_JOURNAL */
 #endif /* defined(MCUBOOT_SWAP_USING_MOVE) || defined(MCUBOOT_SWAP_USING_OFFSET) */
 
 /**
@@ -25,6 +25,7 @@
 #include "bootutil_priv.h"
 #include "swap_priv.h"
 #include "bootutil/bootutil_log.h"
+#include "bootutil/bench.h"
 
 #include "mcuboot_config/mcuboot_config.h"
 
@@ -187,7 +188,7 @@ int
 swap_read_status_bytes(const struct flash_area *fap,
         struct boot_loader_state *state, struct boot_status *bs)
 {
-    uint32_t off;
+    struct boot_status_window win;
     uint8_t status;
     int max_entries;
     int found;
@@ -196,7 +197,6 @@ swap_read_status_bytes(const struct flash_area *fap,
     int rc;
     int i;
 
-    off = boot_status_off(fap);
     max_entries = boot_status_entries(BOOT_CURR_IMG(state), fap);
     if (max_entries < 0) {
         return BOOT_EBADARGS;
@@ -205,9 +205,15 @@ swap_read_status_bytes(const struct flash_area *fap,
     found = 0;
     found_idx = 0;
     invalid = 0;
-    for (i = 0; i < max_entries; i++) {
-        rc = flash_area_read(fap, off + i * BOOT_WRITE_SZ(state),
-                &status, 1);
+    boot_status_window_init(&win, fap, BOOT_WRITE_SZ(state), max_entries);
+    /* The entries before the first written one are all erased */
+    i = boot_status_window_find_set(&win, 0);
+    if (i < 0) {
+        return BOOT_EFLASH;
+    }
+
+    for (; i < max_entries; i++) {
+        rc = boot_status_window_get(&win, i, &status);
         if (rc < 0) {
             return BOOT_EFLASH;
         }
@@ -747,7 +753,8 @@ boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
 
     if (bs->state == BOOT_STATUS_STATE_0) {
         BOOT_LOG_DBG("erasing scratch area");
-        rc = boot_erase_region(fap_scratch, 0, flash_area_get_size(fap_scratch), false);
+        rc = boot_erase_img_region(state, fap_scratch, 0, flash_area_get_size(fap_scratch),
+                                   false);
         assert(rc == 0);
 
         if (bs->idx == BOOT_STATUS_IDX_0) {
@@ -770,7 +777,7 @@ boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
                 assert(rc == 0);
 
                 /* Erase the temporary trailer from the scratch area. */
-                rc = boot_erase_region(fap_scratch, 0,
+                rc = boot_erase_img_region(state, fap_scratch, 0,
                         flash_area_get_size(fap_scratch), false);
                 assert(rc == 0);
             }
@@ -813,7 +820,7 @@ boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
         }
 
         if (erase_sz > 0) {
-            rc = boot_erase_region(fap_secondary_slot, img_off, erase_sz, false);
+            rc = boot_erase_img_region(state, fap_secondary_slot, img_off, erase_sz, false);
             assert(rc == 0);
         }
 
@@ -846,7 +853,7 @@ boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
         }
 
         if (erase_sz > 0) {
-            rc = boot_erase_region(fap_primary_slot, img_off, erase_sz, false);
+            rc = boot_erase_img_region(state, fap_primary_slot, img_off, erase_sz, false);
             assert(rc == 0);
         }
 
@@ -915,10 +922,11 @@ boot_swap_sectors(int idx, uint32_t sz, struct boot_loader_state *state,
     }
 }
 
-void
+int
 swap_run(struct boot_loader_state *state, struct boot_status *bs,
          uint32_t copy_size)
 {
+    bench_phase_t bench;
     uint32_t sz;
     int first_sector_idx;
     int last_sector_idx;
@@ -932,13 +940,16 @@ swap_run(struct boot_loader_state *state, struct boot_status *bs,
     while (last_sector_idx >= 0) {
         sz = boot_copy_sz(state, last_sector_idx, &first_sector_idx);
         if (swap_idx >= (bs->idx - BOOT_STATUS_IDX_0)) {
+            boot_bench_phase_start(&bench);
             boot_swap_sectors(first_sector_idx, sz, state, bs);
+            boot_bench_phase_stop(&bench, BOOT_BENCH_SWAP_STEP, sz);
         }
 
         last_sector_idx = first_sector_idx - 1;
         swap_idx++;
     }
 
+    return 0;
 }
 #endif /* !MCUBOOT_OVERWRITE_ONLY */
 
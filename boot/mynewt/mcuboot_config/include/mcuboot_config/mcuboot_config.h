@@ -35,6 +35,16 @@
 #if MYNEWT_VAL(BOOT_SERIAL_MGMT_ECHO)
 #define MCUBOOT_BOOT_MGMT_ECHO 1
 #endif
+#if MYNEWT_VAL(BOOT_SERIAL_BINARY_FRAMING)
+#define MCUBOOT_SERIAL_BINARY_FRAMING 1
+#define MCUBOOT_SERIAL_BIN_WINDOW MYNEWT_VAL(BOOT_SERIAL_BINARY_FRAMING_WINDOW)
+#endif
+#if MYNEWT_VAL(BOOT_SERIAL_WRITE_BEHIND_SIZE) > 0
+#define MCUBOOT_SERIAL_WRITE_BEHIND_SIZE MYNEWT_VAL(BOOT_SERIAL_WRITE_BEHIND_SIZE)
+#endif
+#if MYNEWT_VAL(BOOT_SERIAL_UPLOAD_RESUME)
+#define MCUBOOT_SERIAL_UPLOAD_RESUME 1
+#endif
 #if MYNEWT_VAL(BOOTUTIL_VALIDATE_SLOT0)
 #define MCUBOOT_VALIDATE_PRIMARY_SLOT 1
 #endif
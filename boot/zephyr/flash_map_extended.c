@@ -331,3 +331,24 @@ int flash_area_get_sector(const struct flash_area *fap, off_t off,
     return 0;
 }
 #endif
+
+#ifdef MCUBOOT_FLASH_AREA_ERASE_RANGE
+uint32_t flash_area_get_max_erase_size(const struct flash_area *fap)
+{
+    ARG_UNUSED(fap);
+
+    /* flash_area_erase() takes any page aligned region, the driver picks
+     * the largest erase commands the device supports for it.
+     */
+    return CONFIG_BOOT_MAX_ERASE_SIZE;
+}
+#endif
+
+uint32_t flash_area_get_optimal_io_size(const struct flash_area *fap)
+{
+    /* Erase pages can be larger than the I/O buffers, and the generic flash
+     * API does not expose a program page size, so keep transfers aligned to
+     * whole write blocks.
+     */
+    return flash_area_align(fap);
+}
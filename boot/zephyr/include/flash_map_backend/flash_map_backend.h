@@ -101,6 +101,15 @@ static inline uint32_t flash_sector_get_size(const struct flash_sector *fs)
 int flash_area_get_sector(const struct flash_area *fa, off_t off,
                           struct flash_sector *fs);
 
+/* Returns the erase page size of the device of the given flash area, which
+ * MCUboot uses as the unit for bulk transfers; 0 if unknown.
+ */
+uint32_t flash_area_get_optimal_io_size(const struct flash_area *fa);
+
+/* Returns the largest page aligned region MCUboot erases in one call to
+ * flash_area_erase(); 0 to erase one page at a time.
+ */
+uint32_t flash_area_get_max_erase_size(const struct flash_area *fa);
 
 #if defined(CONFIG_MCUBOOT)
 static inline bool flash_area_erase_required(const struct flash_area *fa)
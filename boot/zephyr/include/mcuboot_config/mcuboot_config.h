@@ -79,11 +79,27 @@
 #define MCUBOOT_VALIDATE_PRIMARY_SLOT_ONCE
 #endif
 
+#ifdef CONFIG_BOOT_VALIDATED_HASH_CACHE
+#define MCUBOOT_VALIDATED_HASH_CACHE
+#endif
+
+#ifdef CONFIG_BOOT_SIG_CACHE
+#define MCUBOOT_SIG_CACHE
+#endif
+
+#ifdef CONFIG_BOOT_SECTOR_HASHES
+#define MCUBOOT_SECTOR_HASHES
+#endif
+
 #ifdef CONFIG_BOOT_UPGRADE_ONLY
 #define MCUBOOT_OVERWRITE_ONLY
 #define MCUBOOT_OVERWRITE_ONLY_FAST
 #endif
 
+#ifdef CONFIG_BOOT_UPGRADE_ONLY_HASH_ON_COPY
+#define MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY
+#endif
+
 #ifdef CONFIG_SINGLE_APPLICATION_SLOT
 #define MCUBOOT_SINGLE_APPLICATION_SLOT 1
 #define MCUBOOT_IMAGE_NUMBER    1
@@ -179,6 +195,10 @@
 #define MCUBOOT_AES_256
 #endif
 
+#ifdef CONFIG_BOOT_ENCRYPT_KEYSTREAM_BLOCKS
+#define MCUBOOT_ENC_KEYSTREAM_BLOCKS CONFIG_BOOT_ENCRYPT_KEYSTREAM_BLOCKS
+#endif
+
 /* Support for HMAC/HKDF using SHA512; this is used in key exchange where
  * HKDF is used for key expansion and HMAC is used for key verification.
  */
@@ -197,6 +217,11 @@
 
 #ifdef CONFIG_BOOT_DECOMPRESSION
 #define MCUBOOT_DECOMPRESS_IMAGES
+#define MCUBOOT_DECOMPRESSION_BUFFER_SIZE CONFIG_BOOT_DECOMPRESSION_BUFFER_SIZE
+#endif
+
+#ifdef CONFIG_BOOT_DELTA_UPDATES
+#define MCUBOOT_DELTA_UPDATES
 #endif
 
 /* Invoke hashing functions directly on storage device. This requires the device
@@ -218,6 +243,10 @@
 #define MCUBOOT_USE_BENCH 1
 #endif
 
+#ifdef CONFIG_BOOT_BENCH_PHASES
+#define MCUBOOT_BENCH_PHASES 1
+#endif
+
 #ifdef CONFIG_MCUBOOT_DOWNGRADE_PREVENTION
 #define MCUBOOT_DOWNGRADE_PREVENTION 1
 /* MCUBOOT_DOWNGRADE_PREVENTION_SECURITY_COUNTER is used later as bool value so it is
@@ -362,6 +391,11 @@
         CONFIG_BOOT_SERIAL_RAW_PROTOCOL_INPUT_TIMEOUT_MS
 #endif
 
+#ifdef CONFIG_BOOT_SERIAL_BINARY_FRAMING
+#define MCUBOOT_SERIAL_BINARY_FRAMING
+#define MCUBOOT_SERIAL_BIN_WINDOW CONFIG_BOOT_SERIAL_BINARY_FRAMING_WINDOW
+#endif
+
 #ifdef CONFIG_MCUBOOT_SERIAL
 #define MCUBOOT_SERIAL_RECOVERY
 #endif
@@ -415,6 +449,43 @@
  */
 #define MCUBOOT_USE_FLASH_AREA_GET_SECTORS
 
+/*
+ * The flash map backend reports the write block size as optimal I/O size,
+ * so that transfers done through the buffers below stay write block aligned.
+ */
+#define MCUBOOT_FLASH_AREA_OPTIMAL_IO_SIZE
+
+#ifdef CONFIG_BOOT_IO_BUF_SIZE
+#define MCUBOOT_IO_BUF_SIZE CONFIG_BOOT_IO_BUF_SIZE
+#endif
+
+#if defined(CONFIG_BOOT_MAX_ERASE_SIZE) && CONFIG_BOOT_MAX_ERASE_SIZE != 0
+#define MCUBOOT_FLASH_AREA_ERASE_RANGE
+#endif
+
+#ifdef CONFIG_BOOT_SKIP_ERASED_SECTORS
+#define MCUBOOT_SKIP_ERASED_SECTORS
+#endif
+
+#ifdef CONFIG_BOOT_SWAP_STATUS_JOURNAL
+#define MCUBOOT_SWAP_STATUS_JOURNAL
+#define MCUBOOT_SWAP_STATUS_JOURNAL_GROUP CONFIG_BOOT_SWAP_STATUS_JOURNAL_GROUP
+#define MCUBOOT_SWAP_STATUS_JOURNAL_RESUMES CONFIG_BOOT_SWAP_STATUS_JOURNAL_RESUMES
+#endif
+
+#ifdef CONFIG_BOOT_SWAP_UNIT_SECTORS
+#define MCUBOOT_SWAP_UNIT_SECTORS CONFIG_BOOT_SWAP_UNIT_SECTORS
+#endif
+
+#ifdef CONFIG_BOOT_SECTOR_INDEX
+#define MCUBOOT_SECTOR_INDEX
+#define MCUBOOT_SECTOR_INDEX_MAX_RUNS CONFIG_BOOT_SECTOR_INDEX_MAX_RUNS
+#endif
+
+#ifdef CONFIG_BOOT_COMPACT_SECTORS
+#define MCUBOOT_COMPACT_SECTORS
+#endif
+
 #if (defined(CONFIG_BOOT_USB_DFU_WAIT) || \
      defined(CONFIG_BOOT_USB_DFU_GPIO))
 #  ifndef CONFIG_MULTITHREADING
@@ -463,6 +534,14 @@
 #define MCUBOOT_SERIAL_UNALIGNED_BUFFER_SIZE CONFIG_BOOT_SERIAL_UNALIGNED_BUFFER_SIZE
 #endif
 
+#ifdef CONFIG_BOOT_SERIAL_WRITE_BEHIND_SIZE
+#define MCUBOOT_SERIAL_WRITE_BEHIND_SIZE CONFIG_BOOT_SERIAL_WRITE_BEHIND_SIZE
+#endif
+
+#ifdef CONFIG_BOOT_SERIAL_UPLOAD_RESUME
+#define MCUBOOT_SERIAL_UPLOAD_RESUME
+#endif
+
 #if defined(MCUBOOT_DATA_SHARING) && defined(ZEPHYR_VER_INCLUDE)
 #include <zephyr/app_version.h>
 
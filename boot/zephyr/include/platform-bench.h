@@ -37,4 +37,6 @@ typedef uint32_t bench_state_t;
     BOOT_LOG_ERR("bench: %" PRId32 " cycles", _stop_time - *(_s)); \
 } while (0)
 
+#define plat_bench_cycles() k_cycle_get_32()
+
 #endif /* not H_ZEPHYR_BENCH_H__ */
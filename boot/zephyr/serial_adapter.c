@@ -58,6 +58,18 @@ struct line_input {
 static struct device const *uart_dev;
 static struct line_input line_bufs[CONFIG_BOOT_LINE_BUFS];
 
+#ifdef CONFIG_BOOT_SERIAL_BINARY_FRAMING
+/*
+ * A binary frame of the largest packet takes up to BOOT_SERIAL_MAX_RECEIVE_SIZE
+ * bytes, in buffers of its own. The frames sent ahead in the upload window are
+ * queued while the one before them is being served, so the buffers must hold
+ * one frame more than the window.
+ */
+BUILD_ASSERT(CONFIG_BOOT_LINE_BUFS >= (CONFIG_BOOT_SERIAL_BINARY_FRAMING_WINDOW + 1) *
+	     DIV_ROUND_UP(CONFIG_BOOT_SERIAL_MAX_RECEIVE_SIZE, CONFIG_BOOT_MAX_LINE_INPUT_LEN),
+	     "BOOT_LINE_BUFS too small for BOOT_SERIAL_BINARY_FRAMING_WINDOW + 1 binary frames");
+#endif
+
 static sys_slist_t avail_queue;
 static sys_slist_t lines_queue;
 
@@ -121,11 +133,48 @@ console_read_raw(char *str, int str_size, int *newline)
 }
 #endif
 
+#ifdef CONFIG_BOOT_SERIAL_BINARY_FRAMING
+/*
+ * Binary frames may be longer than a line buffer, so lines are passed on in
+ * fragments and only the last one reports a newline. Like the raw protocol,
+ * the part of a fragment that does not fit in "str" is kept for the next
+ * call. Returns the number of bytes copied into "str", including the NUL
+ * terminating a full line when there is room for it.
+ */
+static int
+console_read_fragment(char *str, int str_size, int *newline)
+{
+	static char *pending;
+	static int pending_len;
+	int n;
+
+	if (pending_len == 0) {
+		pending_len = boot_uart_fifo_getline(&pending);
+		if (pending == NULL) {
+			*newline = 0;
+			return 0;
+		}
+	}
+
+	n = MIN(pending_len, str_size);
+	memcpy(str, pending, n);
+	pending += n;
+	pending_len -= n;
+	*newline = (pending_len == 0 && n > 0 && str[n - 1] == '\n');
+	if (*newline && n < str_size) {
+		str[n++] = '\0';
+	}
+	return n;
+}
+#endif
+
 int
 console_read(char *str, int str_size, int *newline)
 {
 #ifdef CONFIG_BOOT_SERIAL_RAW_PROTOCOL
 	return console_read_raw(str, str_size, newline);
+#elif defined(CONFIG_BOOT_SERIAL_BINARY_FRAMING)
+	return console_read_fragment(str, str_size, newline);
 #else
 	char *line;
 	int len;
@@ -253,9 +302,16 @@ boot_uart_fifo_callback(const struct device *dev, void *user_data)
 
 			memcpy(&cmd->line[cur], p, copy_len);
 			cur += copy_len;
+#ifdef CONFIG_BOOT_SERIAL_BINARY_FRAMING
+			/* Queue full buffers as fragments rather than truncate */
+			p += copy_len;
+
+			if (cur == CONFIG_BOOT_MAX_LINE_INPUT_LEN || (nl && p > nl)) {
+#else
 			p += chunk;
 
 			if (nl) {
+#endif
 				cmd->len = cur;
 				sys_slist_append(&lines_queue, &cmd->node);
 				cur = 0;
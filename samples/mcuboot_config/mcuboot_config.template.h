@@ -65,6 +65,11 @@
 /* Uncomment to only erase and overwrite those primary slot sectors needed
  * to install the new image, rather than the entire image slot. */
 /* #define MCUBOOT_OVERWRITE_ONLY_FAST */
+/* Uncomment to hash the upgrade image while it is copied to the primary
+ * slot, rather than in the secondary slot beforehand. Its signature is checked
+ * first, but the hash only after the copy, so a corrupted upgrade leaves no
+ * bootable image. */
+/* #define MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY */
 #endif
 
 /* Uncomment to enable the direct-xip code path. */
@@ -108,6 +113,11 @@
  * source - if implemented) instead of a key embedded in the bootloader. */
 /* #define MCUBOOT_ENC_BUILTIN_KEY */
 
+/* Number of 16-byte AES-CTR keystream blocks generated per call to the
+ * crypto backend and kept between chunks, for each slot of each image
+ * (8 by default). */
+/* #define MCUBOOT_ENC_KEYSTREAM_BLOCKS 8 */
+
 #if defined(MCUBOOT_ENCRYPT_RSA)    || \
     defined(MCUBOOT_ENCRYPT_KW)     || \
     defined(MCUBOOT_ENCRYPT_EC256)  || \
@@ -122,6 +132,47 @@
  */
 #define MCUBOOT_VALIDATE_PRIMARY_SLOT
 
+/* Uncomment to keep the hash of a validated image in the trailer of its slot,
+ * so that following boots only check the signature instead of hashing the
+ * whole image again. The record is revoked whenever the slot is rewritten. */
+/* #define MCUBOOT_VALIDATED_HASH_CACHE */
+
+/* Uncomment if your port provides boot_hw_sha_init() and the other SHA engine
+ * functions. Images are then hashed by the engine while the next chunk is
+ * read, with a fallback to the crypto backend. See the porting guide. */
+/* #define MCUBOOT_HASH_HW_ENGINE */
+
+/* Uncomment if your port provides boot_worker_start() and boot_worker_join(),
+ * to hash the next image on another core or thread while an image is
+ * validated. Only useful with several images, see the porting guide. */
+/* #define MCUBOOT_HASH_WORKER */
+
+/* Uncomment if your port provides boot_sig_cache_read(), boot_sig_cache_write()
+ * and boot_sig_cache_mac(), to skip the signature verification of an image
+ * whose hash was already verified with the same key. See the porting guide. */
+/* #define MCUBOOT_SIG_CACHE */
+
+/* Uncomment to use the sector hashes TLV added by imgtool's
+ * --sector-hash-size option: the part of the primary slot rewritten when
+ * completing an interrupted swap is checked against it, and the first
+ * corrupted sector of an image which fails validation is logged. */
+/* #define MCUBOOT_SECTOR_HASHES */
+
+/* Uncomment to accept delta images made by imgtool's delta command in the
+ * secondary slot. The full image is rebuilt from the delta image and the
+ * image in the primary slot before being upgraded to. Not supported with
+ * encrypted images, direct-xip, ram-load or a single application slot. */
+/* #define MCUBOOT_DELTA_UPDATES */
+
+/* Uncomment to accept LZMA2 compressed images, made by imgtool's sign command
+ * with --compression, in the secondary slot. They are decompressed into the
+ * primary slot, which requires MCUBOOT_OVERWRITE_ONLY. The decompressor writes
+ * MCUBOOT_DECOMPRESSION_BUFFER_SIZE bytes (4096 by default) at once, keeps a
+ * window 1.5 KiB larger than that and reads older data back from the primary
+ * slot. */
+/* #define MCUBOOT_DECOMPRESS_IMAGES */
+/* #define MCUBOOT_DECOMPRESSION_BUFFER_SIZE 4096 */
+
 /*
  * Flash abstraction
  */
@@ -130,6 +181,73 @@
  * See the flash APIs for more details. */
 /* #define MCUBOOT_USE_FLASH_AREA_GET_SECTORS */
 
+/* Uncomment if your flash map API supports flash_area_read_async(),
+ * flash_area_write_async() and flash_area_async_wait(). Flash copies done
+ * during upgrades then read the next chunk while the previous one is being
+ * programmed. See the flash APIs for more details. */
+/* #define MCUBOOT_FLASH_AREA_ASYNC */
+
+/* Uncomment if your flash map API supports flash_area_get_optimal_io_size().
+ * Bulk flash transfers are then sized to a multiple of the returned size.
+ * See the flash APIs for more details. */
+/* #define MCUBOOT_FLASH_AREA_OPTIMAL_IO_SIZE */
+
+/* Uncomment if your flash_area_erase() accepts regions spanning several
+ * sectors and your flash map API supports flash_area_get_max_erase_size().
+ * Adjacent sectors are then erased together, up to the returned size.
+ * See the flash APIs for more details. */
+/* #define MCUBOOT_FLASH_AREA_ERASE_RANGE */
+
+/* Uncomment to not erase sectors which are blank already. Without
+ * MCUBOOT_FLASH_AREA_IS_ERASED the sectors are read back, which is only
+ * safe on devices that allow programming data which reads as erased
+ * again, e.g. not on flash with ECC. */
+/* #define MCUBOOT_SKIP_ERASED_SECTORS */
+
+/* Uncomment to keep the swap status as a journal, with one record written
+ * before each group of MCUBOOT_SWAP_STATUS_JOURNAL_GROUP swap steps (8 if not
+ * defined) instead of one record per step of every sector. Only for
+ * MCUBOOT_SWAP_USING_MOVE or MCUBOOT_SWAP_USING_OFFSET, without
+ * MCUBOOT_ENC_IMAGES, and with a MCUBOOT_BOOT_MAX_ALIGN of 16 or more: the
+ * journal is only used on slots whose write size makes it smaller than one
+ * record per step. MCUBOOT_SWAP_STATUS_JOURNAL_RESUMES (8 if not defined) is
+ * the number of resets while a record is written a swap survives. */
+/* #define MCUBOOT_SWAP_STATUS_JOURNAL */
+/* #define MCUBOOT_SWAP_STATUS_JOURNAL_GROUP 8 */
+/* #define MCUBOOT_SWAP_STATUS_JOURNAL_RESUMES 8 */
+
+/* Number of sectors moved and swapped at each step with
+ * MCUBOOT_SWAP_USING_MOVE, 1 if not defined. The primary slot then needs
+ * that many sectors more than the secondary slot. */
+/* #define MCUBOOT_SWAP_UNIT_SECTORS 1 */
+
+/* Uncomment to look sectors up in an index of the slot layouts, kept as
+ * runs of equally sized sectors, instead of calling flash_area_get_sector()
+ * for each of them. MCUBOOT_SECTOR_INDEX_MAX_RUNS is the number of runs
+ * each index can hold; layouts needing more are not indexed. */
+/* #define MCUBOOT_SECTOR_INDEX */
+/* #define MCUBOOT_SECTOR_INDEX_MAX_RUNS 4 */
+
+/* Uncomment to keep the slot layouts only in the sector index, instead of
+ * also in arrays of MCUBOOT_MAX_IMG_SECTORS sectors per slot, to save RAM.
+ * Requires MCUBOOT_SECTOR_INDEX, and is not compatible with
+ * MCUBOOT_LOGICAL_SECTOR_SIZE. */
+/* #define MCUBOOT_COMPACT_SECTORS */
+
+/* Uncomment to accumulate the time spent in each phase of the boot, such as
+ * hashing, verifying signatures or erasing. Requires MCUBOOT_USE_BENCH, with
+ * the platform-bench.h of the port also defining plat_bench_cycles(). */
+/* #define MCUBOOT_BENCH_PHASES */
+
+/* Uncomment if your flash map API supports flash_area_is_erased(), e.g.
+ * through a blank check command of the device. See the flash APIs for more
+ * details. */
+/* #define MCUBOOT_FLASH_AREA_IS_ERASED */
+
+/* Size of the buffers used to copy and hash images; defaults to 1024 bytes.
+ * Must be a multiple of the flash write block size. */
+/* #define MCUBOOT_IO_BUF_SIZE 4096 */
+
 /* Default maximum number of flash sectors per image slot; change
  * as desirable. */
 #define MCUBOOT_MAX_IMG_SECTORS 128
@@ -0,0 +1,154 @@
+# SPDX-License-Identifier: Apache-2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""
+Patches of delta images.
+
+A patch is a sequence of operations, each starting with a LEB128 encoded
+value whose lowest bit is the operation and the other bits its length:
+
+- OP_COPY copies length bytes from the base image; the value is followed by
+  the zigzag LEB128 encoded distance from the end of the previous copy to the
+  start of this one;
+- OP_INSERT copies the length bytes which follow it.
+
+Patches are applied by the bootloader, see boot/bootutil/src/delta.c.
+"""
+
+OP_COPY = 0
+OP_INSERT = 1
+
+# Length of the blocks of the base image indexed to find matches
+BLOCK_SIZE = 8
+
+# Shortest copy worth an operation, inserting is cheaper below
+MIN_COPY = 16
+
+# Most candidate matches kept for a block
+MAX_CANDIDATES = 8
+
+
+def _varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7f
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def _zigzag(value):
+    return (value << 1) if value >= 0 else ((-value << 1) - 1)
+
+
+def _read_varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        if pos >= len(data) or shift > 28:
+            raise ValueError("Truncated or invalid patch")
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7f) << shift
+        if not byte & 0x80:
+            return value, pos
+        shift += 7
+
+
+def _match_len(base, base_pos, target, target_pos):
+    """Length of the common run of base and target from the given offsets."""
+    n = 0
+    limit = min(len(base) - base_pos, len(target) - target_pos)
+    step = 64
+    while n < limit:
+        m = min(step, limit - n)
+        if base[base_pos + n:base_pos + n + m] == target[target_pos + n:target_pos + n + m]:
+            n += m
+            continue
+        while n < limit and base[base_pos + n] == target[target_pos + n]:
+            n += 1
+        break
+    return n
+
+
+def diff(base, target):
+    """Returns the patch turning base into target."""
+    index = {}
+    for off in range(0, len(base) - BLOCK_SIZE + 1, BLOCK_SIZE):
+        candidates = index.setdefault(base[off:off + BLOCK_SIZE], [])
+        if len(candidates) < MAX_CANDIDATES:
+            candidates.append(off)
+
+    patch = bytearray()
+    base_end = 0
+    insert_start = 0
+
+    def insert(end):
+        if end > insert_start:
+            patch.extend(_varint(((end - insert_start) << 1) | OP_INSERT))
+            patch.extend(target[insert_start:end])
+
+    pos = 0
+    while pos + BLOCK_SIZE <= len(target):
+        best_off = best_len = best_back = 0
+        for off in index.get(bytes(target[pos:pos + BLOCK_SIZE]), ()):
+            length = _match_len(base, off, target, pos)
+            # Extend the match backwards over bytes which would be inserted
+            back = 0
+            while (back < pos - insert_start and back < off and
+                   base[off - back - 1] == target[pos - back - 1]):
+                back += 1
+            if length + back > best_len + best_back:
+                best_off, best_len, best_back = off, length, back
+        if best_len + best_back < MIN_COPY:
+            pos += 1
+            continue
+
+        insert(pos - best_back)
+        start = best_off - best_back
+        length = best_len + best_back
+        patch.extend(_varint((length << 1) | OP_COPY))
+        patch.extend(_varint(_zigzag(start - base_end)))
+        base_end = start + length
+        pos += best_len
+        insert_start = pos
+
+    insert(len(target))
+    return bytes(patch)
+
+
+def apply(base, patch):
+    """Applies a patch to base, as the bootloader does."""
+    out = bytearray()
+    base_end = 0
+    pos = 0
+    while pos < len(patch):
+        value, pos = _read_varint(patch, pos)
+        length = value >> 1
+        if value & 1 == OP_COPY:
+            dist, pos = _read_varint(patch, pos)
+            start = base_end + ((dist >> 1) ^ -(dist & 1))
+            if start < 0 or start + length > len(base):
+                raise ValueError("Patch copies from outside of the base image")
+            out.extend(base[start:start + length])
+            base_end = start + length
+        else:
+            if pos + length > len(patch):
+                raise ValueError("Truncated or invalid patch")
+            out.extend(patch[pos:pos + length])
+            pos += length
+    return bytes(out)
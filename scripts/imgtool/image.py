@@ -66,6 +66,7 @@ IMAGE_F = {
         'COMPRESSED_LZMA1':      0x0000200,
         'COMPRESSED_LZMA2':      0x0000400,
         'COMPRESSED_ARM_THUMB':  0x0000800,
+        'DELTA':                 0x0001000,
 }
 
 TLV_VALUES = {
@@ -93,6 +94,8 @@ TLV_VALUES = {
         'COMP_DEC_SIZE' : 0x73,
         'UUID_VID': 0x74,
         'UUID_CID': 0x75,
+        'SECTOR_HASHES': 0x76,
+        'DELTA_BASE': 0x77,
 }
 
 TLV_SIZE = 4
@@ -292,7 +295,8 @@ class Image:
                  overwrite_only=False, endian="little", load_addr=0,
                  rom_fixed=None, erased_val=None, save_enctlv=False,
                  security_counter=None, max_align=None,
-                 non_bootable=False, vid=None, cid=None):
+                 non_bootable=False, vid=None, cid=None,
+                 sector_hash_size=None):
 
         if load_addr and rom_fixed:
             raise click.UsageError("Can not set rom_fixed and load_addr at the same time")
@@ -324,6 +328,7 @@ class Image:
         self.non_bootable = non_bootable
         self.vid = vid
         self.cid = cid
+        self.sector_hash_size = sector_hash_size
 
         if self.max_align == DEFAULT_MAX_ALIGN:
             self.boot_magic = bytes([
@@ -615,11 +620,26 @@ class Image:
                 else:
                     self.payload.extend(pad)
 
+        if self.sector_hash_size is not None:
+            # Size of the sector hashes TLV: header ('HH') + sector size ('I')
+            # + one digest for each sector of the image header and body
+            sector_hash_num = -(-len(self.payload) // self.sector_hash_size)
+            sector_hash_tlv_len = 4 + sector_hash_num * hash_algorithm().digest_size
+            if protected_tlv_size == 0:
+                protected_tlv_size += TLV_INFO_SIZE
+            protected_tlv_size += TLV_SIZE + sector_hash_tlv_len
+            if sector_hash_tlv_len > 0xffff or protected_tlv_size > 0xffff:
+                msg = f"Too many sectors ({sector_hash_num}) for the sector hashes TLV, " \
+                      "use a larger sector hash size."
+                raise click.UsageError(msg)
+
         compression_flags = 0x0
         if compression_tlvs is not None and compression_type in ["lzma2", "lzma2armthumb"]:
             compression_flags = IMAGE_F['COMPRESSED_LZMA2']
             if compression_type == "lzma2armthumb":
                 compression_flags |= IMAGE_F['COMPRESSED_ARM_THUMB']
+        elif compression_tlvs is not None and compression_type == "delta":
+            compression_flags = IMAGE_F['DELTA']
         # This adds the header to the payload as well
         if encrypt_keylen == 256:
             self.add_header(enckey, protected_tlv_size, compression_flags, 256)
@@ -676,6 +696,16 @@ class Image:
                 for tag, value in custom_tlvs.items():
                     prot_tlv.add(tag, value)
 
+            if self.sector_hash_size is not None:
+                # Hashes of the image header and body, split in sectors. The
+                # last sector may be shorter.
+                payload = struct.pack(e + 'I', self.sector_hash_size)
+                for off in range(0, len(self.payload), self.sector_hash_size):
+                    sha = hash_algorithm()
+                    sha.update(self.payload[off:off + self.sector_hash_size])
+                    payload += sha.digest()
+                prot_tlv.add('SECTOR_HASHES', payload)
+
             protected_tlv_off = len(self.payload)
 
             self.payload += prot_tlv.get()
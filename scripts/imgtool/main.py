@@ -20,17 +20,20 @@
 import base64
 import getpass
 import lzma
+import os
 import re
 import struct
 import sys
 from pathlib import Path
 
 import click
+from intelhex import IntelHex
 
 import imgtool.keys as keys
+from imgtool import delta as imgdelta
 from imgtool import image, imgtool_version
 from imgtool.dumpinfo import dump_imginfo
-from imgtool.version import decode_version
+from imgtool.version import SemiSemVersion, decode_version
 
 from .keys import ECDSAUsageError, Ed25519UsageError, RSAUsageError, X25519UsageError
 
@@ -349,6 +352,13 @@ def validate_header_size(ctx, param, value):
     return value
 
 
+def validate_sector_hash_size(ctx, param, value):
+    if value is not None and (value < 256 or value & (value - 1)):
+        raise click.BadParameter(
+            "--sector-hash-size must be a power of two, at least 256")
+    return value
+
+
 def get_dependencies(ctx, param, value):
     if value is not None:
         versions = []
@@ -514,13 +524,19 @@ class BasedIntParamType(click.ParamType):
               help='Unique vendor identifier, format: (<raw_uuid>|<domain_name)>')
 @click.option('--cid', default=None, required=False,
               help='Unique image class identifier, format: (<raw_uuid>|<image_class_name>)')
+@click.option('--sector-hash-size', type=BasedIntParamType(), required=False,
+              callback=validate_sector_hash_size,
+              help='Add a protected TLV with the hash of each block of this '
+                   'many bytes of the image header and body, so that the '
+                   'bootloader can check parts of the image on their own. '
+                   'Usually the flash sector size.')
 def sign(key, public_key_format, align, version, pad_sig, header_size,
          pad_header, slot_size, pad, confirm, test, max_sectors, overwrite_only,
          endian, encrypt_keylen, encrypt, compression, infile, outfile,
          dependencies, load_addr, hex_addr, erased_val, save_enctlv,
          security_counter, boot_record, custom_tlv, custom_tlv_file, rom_fixed, max_align,
          clear, fix_sig, fix_sig_pubkey, sig_out, user_sha, hmac_sha, is_pure,
-         vector_to_sign, non_bootable, vid, cid):
+         vector_to_sign, non_bootable, vid, cid, sector_hash_size):
 
     if confirm or test:
         # Confirmed but non-padded images don't make much sense, because
@@ -533,7 +549,8 @@ def sign(key, public_key_format, align, version, pad_sig, header_size,
                       endian=endian, load_addr=load_addr, rom_fixed=rom_fixed,
                       erased_val=erased_val, save_enctlv=save_enctlv,
                       security_counter=security_counter, max_align=max_align,
-                      non_bootable=non_bootable, vid=vid, cid=cid)
+                      non_bootable=non_bootable, vid=vid, cid=cid,
+                      sector_hash_size=sector_hash_size)
     compression_tlvs = {}
     img.load(infile)
     key = load_key(key) if key else None
@@ -601,6 +618,11 @@ def sign(key, public_key_format, align, version, pad_sig, header_size,
             'and forbids sha selection by user.')
 
     if compression in ["lzma2", "lzma2armthumb"]:
+        if sector_hash_size is not None:
+            # The sector hashes of the decompressed image cannot be rebuilt
+            # from those of the compressed one.
+            raise click.UsageError(
+                "--sector-hash-size cannot be used with --compression")
         img.create(key, public_key_format, enckey, dependencies, boot_record,
                custom_tlvs, compression_tlvs, None, int(encrypt_keylen), clear,
                baked_signature, pub_key, vector_to_sign, user_sha=user_sha,
@@ -613,7 +635,8 @@ def sign(key, public_key_format, align, version, pad_sig, header_size,
                   load_addr=load_addr, rom_fixed=rom_fixed,
                   erased_val=erased_val, save_enctlv=save_enctlv,
                   security_counter=security_counter, max_align=max_align,
-                  vid=vid, cid=cid)
+                  non_bootable=non_bootable, vid=vid, cid=cid,
+                  sector_hash_size=sector_hash_size)
         compression_filters = [
             {"id": lzma.FILTER_LZMA2, "preset": comp_default_preset,
                 "dict_size": comp_default_dictsize, "lp": comp_default_lp,
@@ -663,6 +686,133 @@ def sign(key, public_key_format, align, version, pad_sig, header_size,
         save_signature(sig_out, new_signature)
 
 
+def read_signed_image(path, endian):
+    """Returns the header, body and TLVs of the signed image in a file,
+    along with its version, security counter and hash."""
+    ext = os.path.splitext(path)[1][1:].lower()
+    try:
+        if ext == image.INTEL_HEX_EXT:
+            data = IntelHex(path).tobinstr()
+        else:
+            with open(path, 'rb') as f:
+                data = f.read()
+    except FileNotFoundError:
+        raise click.UsageError(f"Image file {path} not found") from None
+
+    e = image.STRUCT_ENDIAN_DICT[endian]
+    magic, _, hdr_size, prot_size, img_size = struct.unpack(e + 'IIHHI', data[:16])
+    if magic != image.IMAGE_MAGIC:
+        raise click.UsageError(f"{path} is not a signed image")
+    version = SemiSemVersion(*struct.unpack(e + 'BBHI', data[20:28]))
+
+    tlv_off = hdr_size + img_size
+    tlvs = {}
+    for info_magic in (image.TLV_PROT_INFO_MAGIC, image.TLV_INFO_MAGIC):
+        magic, tlv_tot = struct.unpack(e + 'HH', data[tlv_off:tlv_off + image.TLV_INFO_SIZE])
+        if magic != info_magic:
+            if info_magic == image.TLV_PROT_INFO_MAGIC and prot_size == 0:
+                continue
+            raise click.UsageError(f"{path} has an invalid TLV area")
+        off = tlv_off + image.TLV_INFO_SIZE
+        while off < tlv_off + tlv_tot:
+            tlv_type, _, tlv_len = struct.unpack(e + 'BBH', data[off:off + image.TLV_SIZE])
+            tlvs.setdefault(tlv_type, data[off + image.TLV_SIZE:off + image.TLV_SIZE + tlv_len])
+            off += image.TLV_SIZE + tlv_len
+        tlv_off += tlv_tot
+
+    digest = None
+    for tlv_type in image.TLV_SHA_TO_SHA_AND_ALG:
+        if tlv_type in tlvs:
+            digest = tlvs[tlv_type]
+            break
+    if digest is None:
+        raise click.UsageError(f"{path} has no hash TLV")
+
+    security_counter = None
+    if image.TLV_VALUES['SEC_CNT'] in tlvs:
+        security_counter = struct.unpack(e + 'I', tlvs[image.TLV_VALUES['SEC_CNT']])[0]
+
+    return data[:tlv_off], hdr_size, version, security_counter, digest
+
+
+@click.argument('outfile')
+@click.argument('infile')
+@click.option('--base', metavar='filename', required=True,
+              help='Signed image the patch applies to, the one in the primary '
+                   'slot of the devices to update.')
+@click.option('-e', '--endian', type=click.Choice(['little', 'big']),
+              default='little', help="Select little or big endian")
+@click.option('-R', '--erased-val', type=click.Choice(['0', '0xff']),
+              required=False,
+              help='The value that is read back from erased flash.')
+@click.option('--overwrite-only', default=False, is_flag=True,
+              help='Use overwrite-only instead of swap upgrades')
+@click.option('-M', '--max-sectors', type=int,
+              help='When padding allow for this amount of sectors (defaults '
+                   'to 128)')
+@click.option('--confirm', default=False, is_flag=True,
+              help='When padding the image, mark it as confirmed (implies '
+                   '--pad)')
+@click.option('--test', default=False, is_flag=True,
+              help='When padding the image, mark it for a test swap (implies '
+                   '--pad)')
+@click.option('--pad', default=False, is_flag=True,
+              help='Pad image to --slot-size bytes, adding trailer magic')
+@click.option('-S', '--slot-size', type=BasedIntParamType(), required=True,
+              help='Size of the slot. If the slots have different sizes, use '
+              'the size of the secondary slot.')
+@click.option('--align', type=click.Choice(['1', '2', '4', '8', '16', '32']),
+              default='1',
+              required=False,
+              help='Alignment used by swap update modes.')
+@click.option('--max-align', type=click.Choice(['8', '16', '32']),
+              required=False,
+              help='Maximum flash alignment. Set if flash alignment of the '
+              'primary and secondary slot differ and any of them is larger '
+              'than 8.')
+@click.option('--public-key-format', type=click.Choice(['hash', 'full']),
+              default='hash', help='In what format to add the public key to '
+              'the image manifest: full key or hash of the key.')
+@click.option('-k', '--key', metavar='filename')
+@click.command(help='''Create a delta image, holding the patch from the signed
+               image given by --base to the signed image INFILE, which the
+               bootloader applies to the image in the primary slot.\n
+               INFILE, OUTFILE and --base are parsed as Intel HEX if the
+               params have .hex extension, otherwise binary format is used''')
+def delta(key, public_key_format, align, max_align, slot_size, pad, confirm,
+          test, max_sectors, overwrite_only, erased_val, endian, base, infile,
+          outfile):
+
+    if confirm or test:
+        pad = True
+
+    base_data, _, _, _, base_digest = read_signed_image(base, endian)
+    target_data, header_size, version, security_counter, _ = \
+        read_signed_image(infile, endian)
+
+    patch = imgdelta.diff(base_data, target_data)
+    if imgdelta.apply(base_data, patch) != target_data:
+        raise click.ClickException("Patch does not rebuild the image")
+    print(f"patch size: {len(patch)} bytes")
+    print(f"image size: {len(target_data)} bytes")
+
+    key = load_key(key) if key else None
+    img = image.Image(version=version, header_size=header_size,
+                      pad_header=True, pad=pad, confirm=confirm, test=test,
+                      align=int(align), slot_size=slot_size,
+                      max_sectors=max_sectors, overwrite_only=overwrite_only,
+                      endian=endian, erased_val=erased_val,
+                      security_counter=security_counter, max_align=max_align)
+    img.load_compressed(patch, b'')
+    delta_tlvs = {
+        'DELTA_BASE': struct.pack(img.get_struct_endian() + 'I',
+                                  len(target_data)) + base_digest,
+    }
+    img.create(key, public_key_format, None, compression_tlvs=delta_tlvs,
+               compression_type='delta')
+    img.save(outfile)
+
+
 class AliasesGroup(click.Group):
 
     _aliases = {
@@ -701,6 +851,7 @@ imgtool.add_command(getpriv)
 imgtool.add_command(keyinfo)
 imgtool.add_command(verify)
 imgtool.add_command(sign)
+imgtool.add_command(delta)
 imgtool.add_command(version)
 imgtool.add_command(dumpinfo)
 
@@ -12,6 +12,8 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
+from pathlib import Path
+
 import pytest
 
 # List of tests expected to fail for some reason
@@ -29,3 +31,8 @@ XFAILED_TESTS = {
 def pytest_runtest_setup(item):
     if item.nodeid in XFAILED_TESTS:
         pytest.xfail()
+
+
+@pytest.fixture
+def key_file() -> Path:
+    return Path(__file__).parents[2] / 'root-ec-p256.pem'
@@ -0,0 +1,65 @@
+# SPDX-License-Identifier: Apache-2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Helpers shared by the tests that sign images and inspect their TLVs."""
+
+import struct
+from pathlib import Path
+
+from click.testing import CliRunner
+from imgtool.image import TLV_INFO_SIZE, TLV_PROT_INFO_MAGIC, TLV_SIZE
+from imgtool.main import imgtool
+
+HEADER_SIZE = 0x200
+SLOT_SIZE = 0x7a000
+
+
+def sign(tmpdir: Path, key_file: Path, name: str, data: bytes,
+         version: str, *args: str) -> Path:
+    in_file = tmpdir / f'{name}.bin'
+    in_file.write_bytes(data)
+    out_file = tmpdir / f'{name}_signed.bin'
+
+    result = CliRunner().invoke(
+        imgtool,
+        [
+            'sign',
+            str(in_file),
+            str(out_file),
+            f'--header-size={HEADER_SIZE}',
+            f'--slot-size={SLOT_SIZE}',
+            f'--version={version}',
+            '--pad-header',
+            '--key', str(key_file),
+            *args,
+        ],
+    )
+    assert result.exit_code == 0, result.output
+    return out_file
+
+
+def protected_tlvs(img: bytes) -> dict:
+    _, _, hdr_size, prot_size, img_size = struct.unpack('<IIHHI', img[:16])
+    off = hdr_size + img_size
+    magic, tot = struct.unpack('<HH', img[off:off + TLV_INFO_SIZE])
+    assert magic == TLV_PROT_INFO_MAGIC
+    assert tot == prot_size
+    tlvs = {}
+    end = off + tot
+    off += TLV_INFO_SIZE
+    while off < end:
+        tlv_type, _, tlv_len = struct.unpack('<BBH', img[off:off + TLV_SIZE])
+        tlvs[tlv_type] = img[off + TLV_SIZE:off + TLV_SIZE + tlv_len]
+        off += TLV_SIZE + tlv_len
+    return tlvs
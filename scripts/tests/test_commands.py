@@ -23,6 +23,7 @@ from packaging.version import Version
 # all available imgtool commands
 COMMANDS = [
     "create",
+    "delta",
     "dumpinfo",
     "getpriv",
     "getpub",
@@ -12,11 +12,12 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
+import struct
 from pathlib import Path
 
 import pytest
 from click.testing import CliRunner
-from imgtool.image import Image
+from imgtool.image import IMAGE_F, Image
 from imgtool.main import (
     comp_default_dictsize,
     comp_default_lc,
@@ -31,11 +32,6 @@ HEADER_SIZE = 0x200
 SLOT_SIZE = 0x7a000
 
 
-@pytest.fixture
-def key_file() -> Path:
-    return Path(__file__).parents[2] / 'root-ec-p256.pem'
-
-
 def check_if_compressed(out_file: Path) -> bool:
     # Verify output file. There should be better solution to check
     # if the output file is correctly compressed with lzma2.
@@ -85,3 +81,47 @@ def test_lzma2_compression(tmpdir: Path, key_file: Path, compression: str, compr
     assert result.exit_code == 0
     assert out_file.exists()
     assert check_if_compressed(out_file) is compressed
+
+
+def sign_compressed(tmpdir: Path, key_file: Path, *args: str):
+    in_file = tmpdir / 'zephyr.bin'
+    with in_file.open("wb") as f:
+        f.write(b"hello world\x00\x00\x00\x00\x00" * 64)
+    out_file: Path = tmpdir / 'zephyr_signed.bin'
+
+    runner = CliRunner()
+    result = runner.invoke(
+        imgtool,
+        [
+            'sign',
+            str(in_file),
+            str(out_file),
+            f'--header-size={HEADER_SIZE}',
+            f'--slot-size={SLOT_SIZE}',
+            f'--version={VERSION}',
+            '--pad-header',
+            '--compression=lzma2',
+            f'--key={key_file}',
+            *args
+        ],
+    )
+    return result, out_file
+
+
+def test_lzma2_compression_keeps_flags(tmpdir: Path, key_file: Path):
+    """
+    The header of the compressed image must only differ from the one of
+    the image it decompresses to in the compression flags and sizes.
+    """
+    result, out_file = sign_compressed(tmpdir, key_file, '--non-bootable')
+    assert result.exit_code == 0
+
+    flags = struct.unpack('<I', out_file.read_binary()[16:20])[0]
+    assert flags & IMAGE_F['COMPRESSED_LZMA2']
+    assert flags & IMAGE_F['NON_BOOTABLE']
+
+
+def test_lzma2_compression_rejects_sector_hashes(tmpdir: Path, key_file: Path):
+    result, out_file = sign_compressed(tmpdir, key_file, '--sector-hash-size=4096')
+    assert result.exit_code != 0
+    assert '--sector-hash-size cannot be used with --compression' in result.output
@@ -0,0 +1,115 @@
+# SPDX-License-Identifier: Apache-2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import hashlib
+import random
+import struct
+from pathlib import Path
+
+import pytest
+from click.testing import CliRunner
+from helpers import HEADER_SIZE, SLOT_SIZE, protected_tlvs, sign
+from imgtool import delta
+from imgtool.image import IMAGE_F, TLV_VALUES
+from imgtool.main import imgtool
+
+
+def firmware(size: int, seed: int) -> bytes:
+    rng = random.Random(seed)
+    return bytes(rng.getrandbits(8) for _ in range(size))
+
+
+def make_delta(tmpdir: Path, key_file: Path, base: Path, target: Path):
+    out_file = tmpdir / 'delta.bin'
+    result = CliRunner().invoke(
+        imgtool,
+        [
+            'delta',
+            str(target),
+            str(out_file),
+            '--base', str(base),
+            f'--slot-size={SLOT_SIZE}',
+            '--key', str(key_file),
+        ],
+    )
+    return result, out_file
+
+
+@pytest.mark.parametrize("target_edit", ["none", "patched", "shifted", "new"])
+def test_diff_apply(target_edit):
+    base = firmware(0x4000, 1)
+    if target_edit == "none":
+        target = base
+    elif target_edit == "patched":
+        target = base[:0x1000] + b'\x55' * 64 + base[0x1040:]
+    elif target_edit == "shifted":
+        target = base[:0x800] + firmware(100, 2) + base[0x800:0x3000] + \
+            base[0x3800:]
+    else:
+        target = firmware(0x4000, 3)
+
+    patch = delta.diff(base, target)
+    assert delta.apply(base, patch) == target
+    if target_edit in ("none", "patched", "shifted"):
+        assert len(patch) < len(target) // 10
+
+
+def test_apply_rejects_bad_patch():
+    base = firmware(0x100, 1)
+    with pytest.raises(ValueError):
+        delta.apply(base, bytes([(0x200 << 1 | delta.OP_COPY) & 0x7f | 0x80,
+                                 0x200 >> 6, 0]))
+    with pytest.raises(ValueError):
+        delta.apply(base, bytes([(8 << 1) | delta.OP_INSERT, 1, 2]))
+
+
+def test_delta_image(tmpdir, key_file):
+    tmpdir = Path(tmpdir)
+    base_fw = firmware(0x8000, 1)
+    target_fw = base_fw[:0x2000] + b'new code' + base_fw[0x2000:]
+    base = sign(tmpdir, key_file, 'base', base_fw, '1.0.0')
+    target = sign(tmpdir, key_file, 'target', target_fw, '1.1.0')
+
+    result, out_file = make_delta(tmpdir, key_file, base, target)
+    assert result.exit_code == 0, result.output
+
+    img = out_file.read_bytes()
+    _, _, hdr_size, _, img_size, flags = struct.unpack('<IIHHII', img[:20])
+    assert flags & IMAGE_F['DELTA']
+    assert hdr_size == HEADER_SIZE
+    assert struct.unpack('<BBHI', img[20:28]) == (1, 1, 0, 0)
+
+    target_img = target.read_bytes()
+    base_img = base.read_bytes()
+    tlvs = protected_tlvs(img)
+    base_tlv = tlvs[TLV_VALUES['DELTA_BASE']]
+    full_size = struct.unpack('<I', base_tlv[:4])[0]
+    assert full_size == len(target_img)
+    base_hash = base_tlv[4:]
+    assert base_hash == hashlib.sha256(base_img[:HEADER_SIZE + 0x8000]).digest()
+
+    patch = img[hdr_size:hdr_size + img_size]
+    assert len(patch) < 0x1000
+    assert delta.apply(base_img, patch) == target_img
+
+
+def test_delta_image_not_signed(tmpdir, key_file):
+    tmpdir = Path(tmpdir)
+    base = tmpdir / 'base.bin'
+    base.write_bytes(firmware(0x1000, 1))
+    target = sign(tmpdir, key_file, 'target', firmware(0x1000, 2), '1.1.0')
+
+    result, _ = make_delta(tmpdir, key_file, base, target)
+    assert result.exit_code != 0
+    assert "not a signed image" in result.output
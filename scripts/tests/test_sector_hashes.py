@@ -0,0 +1,80 @@
+# SPDX-License-Identifier: Apache-2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import hashlib
+import struct
+from pathlib import Path
+
+import pytest
+from click.testing import CliRunner
+from helpers import HEADER_SIZE, SLOT_SIZE, protected_tlvs, sign
+from imgtool.image import TLV_VALUES
+from imgtool.main import imgtool
+
+VERSION = '2.0.0'
+
+
+def payload(size: int) -> bytes:
+    return bytes(i & 0xff for i in range(size))
+
+
+@pytest.mark.parametrize('size', [0x1000, 0x1234])
+def test_sector_hashes(tmpdir: Path, key_file: Path, size: int):
+    """
+    The sector hashes TLV holds the sector size and the hash of each sector
+    of the image header and body, the last one possibly shorter.
+    """
+    img = sign(Path(tmpdir), key_file, 'zephyr', payload(size), VERSION,
+               '--sector-hash-size=0x400').read_bytes()
+    tlvs = protected_tlvs(img)
+    value = tlvs[TLV_VALUES['SECTOR_HASHES']]
+
+    (sector_size,) = struct.unpack('<I', value[:4])
+    assert sector_size == 0x400
+
+    hashed = img[:HEADER_SIZE + size]
+    digests = [value[i:i + 32] for i in range(4, len(value), 32)]
+    assert len(digests) == -(-len(hashed) // sector_size)
+    for i, digest in enumerate(digests):
+        sector = hashed[i * sector_size:(i + 1) * sector_size]
+        assert digest == hashlib.sha256(sector).digest()
+
+
+def test_no_sector_hashes(tmpdir: Path, key_file: Path):
+    img = sign(Path(tmpdir), key_file, 'zephyr', payload(0x1000),
+               VERSION).read_bytes()
+    _, _, _, prot_size, _ = struct.unpack('<IIHHI', img[:16])
+    assert prot_size == 0
+
+
+@pytest.mark.parametrize('sector_size', ['0', '100', '0x300'])
+def test_bad_sector_hash_size(tmpdir: Path, key_file: Path, sector_size: str):
+    in_file = tmpdir / 'zephyr.bin'
+    with in_file.open("wb") as f:
+        f.write(bytes(0x1000))
+    runner = CliRunner()
+    result = runner.invoke(
+        imgtool,
+        [
+            'sign',
+            str(in_file),
+            str(tmpdir / 'zephyr_signed.bin'),
+            f'--header-size={HEADER_SIZE}',
+            f'--slot-size={SLOT_SIZE}',
+            f'--version={VERSION}',
+            '--pad-header',
+            f'--sector-hash-size={sector_size}',
+        ],
+    )
+    assert result.exit_code != 0
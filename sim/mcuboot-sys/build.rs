@@ -21,8 +21,10 @@ fn main() {
     let sig_ed25519 = env::var("CARGO_FEATURE_SIG_ED25519").is_ok();
     let sig_second_key = env::var("CARGO_FEATURE_SIG_SECOND_KEY").is_ok();
     let overwrite_only = env::var("CARGO_FEATURE_OVERWRITE_ONLY").is_ok();
+    let hash_on_copy = env::var("CARGO_FEATURE_OVERWRITE_ONLY_HASH_ON_COPY").is_ok();
     let swap_move = env::var("CARGO_FEATURE_SWAP_MOVE").is_ok();
     let swap_offset = env::var("CARGO_FEATURE_SWAP_OFFSET").is_ok();
+    let swap_unit = env::var("CARGO_FEATURE_SWAP_UNIT").is_ok();
     let validate_primary_slot =
                   env::var("CARGO_FEATURE_VALIDATE_PRIMARY_SLOT").is_ok();
     let enc_rsa = env::var("CARGO_FEATURE_ENC_RSA").is_ok();
@@ -48,11 +50,25 @@ fn main() {
     let mbedtls_v4 = env::var("CARGO_FEATURE_MBEDTLS_V4").is_ok();
     let logical_sectors_4k = env::var("CARGO_FEATURE_LOGICAL_SECTORS_4K").is_ok();
     let logical_sectors_128k = env::var("CARGO_FEATURE_LOGICAL_SECTORS_128K").is_ok();
+    let flash_async = env::var("CARGO_FEATURE_FLASH_ASYNC").is_ok();
+    let hw_sha = env::var("CARGO_FEATURE_HW_SHA").is_ok();
+    let hash_worker = env::var("CARGO_FEATURE_HASH_WORKER").is_ok();
+    let sig_cache = env::var("CARGO_FEATURE_SIG_CACHE").is_ok();
+    let validated_hash_cache = env::var("CARGO_FEATURE_VALIDATED_HASH_CACHE").is_ok();
+    let erase_range = env::var("CARGO_FEATURE_ERASE_RANGE").is_ok();
+    let skip_erased_sectors = env::var("CARGO_FEATURE_SKIP_ERASED_SECTORS").is_ok();
+    let sector_index = env::var("CARGO_FEATURE_SECTOR_INDEX").is_ok();
+    let compact_sectors = env::var("CARGO_FEATURE_COMPACT_SECTORS").is_ok();
+    let swap_status_journal = env::var("CARGO_FEATURE_SWAP_STATUS_JOURNAL").is_ok();
+    let decompression = env::var("CARGO_FEATURE_DECOMPRESSION").is_ok();
+    let delta = env::var("CARGO_FEATURE_DELTA").is_ok();
+    let sector_hashes = env::var("CARGO_FEATURE_SECTOR_HASHES").is_ok();
 
     let mut conf = CachedBuild::new();
     conf.conf.define("__BOOTSIM__", None);
     conf.conf.define("MCUBOOT_HAVE_LOGGING", None);
     conf.conf.define("MCUBOOT_USE_FLASH_AREA_GET_SECTORS", None);
+    conf.conf.define("MCUBOOT_FLASH_AREA_OPTIMAL_IO_SIZE", None);
     conf.conf.define("MCUBOOT_HAVE_ASSERT_H", None);
     conf.conf.define("MCUBOOT_MAX_IMG_SECTORS", Some("128"));
 
@@ -88,6 +104,22 @@ fn main() {
         panic!("Downgrade prevention requires overwrite only");
     }
 
+    if decompression && !overwrite_only {
+        panic!("Decompression requires overwrite only");
+    }
+
+    if hash_on_copy && decompression {
+        panic!("Hash on copy is not supported with decompression");
+    }
+
+    if delta && (ram_load || direct_xip) {
+        panic!("Delta images require an upgrade with a secondary slot");
+    }
+
+    if swap_unit && swap_offset {
+        panic!("Swap units of several sectors are only supported by swap-move");
+    }
+
     if bootstrap {
         conf.conf.define("MCUBOOT_BOOTSTRAP", None);
 
@@ -96,6 +128,54 @@ fn main() {
         }
     }
 
+    if flash_async {
+        conf.conf.define("MCUBOOT_FLASH_AREA_ASYNC", None);
+    }
+
+    if hw_sha {
+        conf.conf.define("MCUBOOT_HASH_HW_ENGINE", None);
+    }
+
+    if hash_worker {
+        conf.conf.define("MCUBOOT_HASH_WORKER", None);
+    }
+
+    if sig_cache {
+        conf.conf.define("MCUBOOT_SIG_CACHE", None);
+    }
+
+    if erase_range {
+        conf.conf.define("MCUBOOT_FLASH_AREA_ERASE_RANGE", None);
+    }
+
+    if skip_erased_sectors {
+        conf.conf.define("MCUBOOT_SKIP_ERASED_SECTORS", None);
+        conf.conf.define("MCUBOOT_FLASH_AREA_IS_ERASED", None);
+    }
+
+    if sector_index {
+        conf.conf.define("MCUBOOT_SECTOR_INDEX", None);
+    }
+
+    if compact_sectors {
+        conf.conf.define("MCUBOOT_COMPACT_SECTORS", None);
+    }
+
+    if swap_status_journal {
+        if !swap_move && !swap_offset {
+            panic!("The swap status journal requires swap-move or swap-offset");
+        }
+        if enc_rsa || enc_aes256_rsa || enc_kw || enc_aes256_kw || enc_ec256 ||
+           enc_ec256_mbedtls || enc_aes256_ec256 || enc_x25519 || enc_aes256_x25519 ||
+           custom_enc_crypto {
+            panic!("The swap status journal is not supported with encrypted images");
+        }
+        if !max_align_16 && !max_align_32 {
+            panic!("The swap status journal requires max-align-16 or max-align-32");
+        }
+        conf.conf.define("MCUBOOT_SWAP_STATUS_JOURNAL", None);
+    }
+
     if check_load_addr {
         conf.conf.define("MCUBOOT_CHECK_HEADER_LOAD_ADDRESS", None);
     }
@@ -104,10 +184,26 @@ fn main() {
         conf.conf.define("MCUBOOT_VALIDATE_PRIMARY_SLOT", None);
     }
 
+    if validated_hash_cache {
+        conf.conf.define("MCUBOOT_VALIDATED_HASH_CACHE", None);
+    }
+
     if downgrade_prevention {
         conf.conf.define("MCUBOOT_DOWNGRADE_PREVENTION", None);
     }
 
+    if decompression {
+        conf.conf.define("MCUBOOT_DECOMPRESS_IMAGES", None);
+    }
+
+    if delta {
+        conf.conf.define("MCUBOOT_DELTA_UPDATES", None);
+    }
+
+    if sector_hashes {
+        conf.conf.define("MCUBOOT_SECTOR_HASHES", None);
+    }
+
     if ram_load {
         conf.conf.define("MCUBOOT_RAM_LOAD", None);
     }
@@ -357,10 +453,17 @@ fn main() {
         conf.conf.define("MCUBOOT_OVERWRITE_ONLY", None);
     }
 
+    if hash_on_copy {
+        conf.conf.define("MCUBOOT_OVERWRITE_ONLY_HASH_ON_COPY", None);
+    }
+
     if swap_offset {
         conf.conf.define("MCUBOOT_SWAP_USING_OFFSET", None);
     } else if swap_move {
         conf.conf.define("MCUBOOT_SWAP_USING_MOVE", None);
+        if swap_unit {
+            conf.conf.define("MCUBOOT_SWAP_UNIT_SECTORS", Some("2"));
+        }
     } else if !overwrite_only && !direct_xip && !ram_load {
         conf.conf.define("CONFIG_BOOT_SWAP_USING_SCRATCH", None);
         conf.conf.define("MCUBOOT_SWAP_USING_SCRATCH", None);
@@ -616,6 +719,8 @@ fn main() {
     conf.file("../../boot/bootutil/src/swap_move.c");
     conf.file("../../boot/bootutil/src/swap_offset.c");
     conf.file("../../boot/bootutil/src/caps.c");
+    conf.file("../../boot/bootutil/src/decompression.c");
+    conf.file("../../boot/bootutil/src/delta.c");
     conf.file("../../boot/bootutil/src/bootutil_misc.c");
     conf.file("../../boot/bootutil/src/bootutil_area.c");
     conf.file("../../boot/bootutil/src/bootutil_loader.c");
@@ -443,14 +443,14 @@ boot_enc_valid(const struct enc_key_data *enc_state)
 /* ------------------------------------------------------------------ */
 /*  boot_enc_{encrypt,decrypt}                                        */
 /* ------------------------------------------------------------------ */
-void
+int
 boot_enc_encrypt(struct enc_key_data *enc, uint32_t off,
                  uint32_t sz, uint32_t blk_off, uint8_t *buf)
 {
     uint8_t nonce[16];
 
     if (sz == 0) {
-        return;
+        return 0;
     }
 
     memset(nonce, 0, 12);
@@ -461,17 +461,17 @@ boot_enc_encrypt(struct enc_key_data *enc, uint32_t off,
     nonce[15] = (uint8_t)off;
 
     assert(enc->valid == 1);
-    bootutil_aes_ctr_encrypt(&enc->aes_ctr, nonce, buf, sz, blk_off, buf);
+    return bootutil_aes_ctr_encrypt(&enc->aes_ctr, nonce, buf, sz, blk_off, buf);
 }
 
-void
+int
 boot_enc_decrypt(struct enc_key_data *enc, uint32_t off,
                  uint32_t sz, uint32_t blk_off, uint8_t *buf)
 {
     uint8_t nonce[16];
 
     if (sz == 0) {
-        return;
+        return 0;
     }
 
     memset(nonce, 0, 12);
@@ -482,7 +482,7 @@ boot_enc_decrypt(struct enc_key_data *enc, uint32_t off,
     nonce[15] = (uint8_t)off;
 
     assert(enc->valid == 1);
-    bootutil_aes_ctr_decrypt(&enc->aes_ctr, nonce, buf, sz, blk_off, buf);
+    return bootutil_aes_ctr_decrypt(&enc->aes_ctr, nonce, buf, sz, blk_off, buf);
 }
 
 /* ------------------------------------------------------------------ */
@@ -12,6 +12,9 @@
 #include <flash_map_backend/flash_map_backend.h>
 
 #include "../../../boot/bootutil/src/bootutil_priv.h"
+#ifdef MCUBOOT_HASH_WORKER
+#include "../../../boot/bootutil/src/bootutil_loader.h"
+#endif
 #include "bootsim.h"
 
 #ifdef MCUBOOT_ENCRYPT_RSA
@@ -28,6 +31,13 @@
 #include "mbedtls/nist_kw.h"
 #endif
 
+#if defined(MCUBOOT_HASH_HW_ENGINE) || defined(MCUBOOT_SIG_CACHE)
+#include "bootutil/crypto/sha.h"
+#endif
+#ifdef MCUBOOT_SIG_CACHE
+#include "bootutil/sig_cache.h"
+#endif
+
 #define BOOT_LOG_LEVEL BOOT_LOG_LEVEL_ERROR
 #include <bootutil/bootutil_log.h>
 
@@ -48,6 +58,7 @@ extern int sim_flash_read(uint8_t flash_id, uint32_t offset, uint8_t *dest,
         uint32_t size);
 extern int sim_flash_write(uint8_t flash_id, uint32_t offset, const uint8_t *src,
         uint32_t size);
+extern int sim_flash_is_erased(uint8_t flash_id, uint32_t offset, uint32_t size);
 extern uint32_t sim_flash_align(uint8_t flash_id);
 extern uint8_t sim_flash_erased_val(uint8_t flash_id);
 
@@ -249,6 +260,13 @@ struct area_desc {
     uint32_t num_slots;
 };
 
+#ifdef MCUBOOT_FLASH_AREA_ASYNC
+static void sim_async_reset(void);
+#endif
+#ifdef MCUBOOT_HASH_WORKER
+static void sim_worker_reset(void);
+#endif
+
 int invoke_boot_go(struct sim_context *ctx, struct area_desc *adesc,
                    struct boot_rsp *rsp, int image_id)
 {
@@ -267,6 +285,12 @@ int invoke_boot_go(struct sim_context *ctx, struct area_desc *adesc,
 
     sim_set_flash_areas(adesc);
     sim_set_context(ctx);
+#ifdef MCUBOOT_FLASH_AREA_ASYNC
+    sim_async_reset();
+#endif
+#ifdef MCUBOOT_HASH_WORKER
+    sim_worker_reset();
+#endif
 
     if (setjmp(ctx->boot_jmpbuf) == 0) {
         boot_state_init(state);
@@ -434,6 +458,269 @@ int flash_area_erase(const struct flash_area *area, uint32_t off, uint32_t len)
     return sim_flash_erase(area->fa_device_id, area->fa_off + off, len);
 }
 
+uint32_t flash_area_get_optimal_io_size(const struct flash_area *area)
+{
+    struct flash_sector sector;
+
+    if (flash_area_get_sector(area, 0, &sector) != 0) {
+        return 0;
+    }
+
+    return sector.fs_size;
+}
+
+#ifdef MCUBOOT_FLASH_AREA_IS_ERASED
+bool flash_area_is_erased(const struct flash_area *area, uint32_t off, uint32_t len)
+{
+    return sim_flash_is_erased(area->fa_device_id, area->fa_off + off, len) == 1;
+}
+#endif
+
+#ifdef MCUBOOT_FLASH_AREA_ERASE_RANGE
+uint32_t flash_area_get_max_erase_size(const struct flash_area *area)
+{
+    (void)area;
+
+    /* Smaller than the largest sectors of some simulated devices, so that
+     * both coalesced and oversized sector erases are exercised.
+     */
+    return 0x10000;
+}
+#endif
+
+#ifdef MCUBOOT_FLASH_AREA_ASYNC
+/*
+ * The simulated flash has no background engine, so asynchronous transfers
+ * are queued and only carried out when the caller waits for them. Any
+ * buffer reused by bootutil before the wait will then show up as corrupted
+ * data in the tests. The queue is per thread, like the simulator context,
+ * and transfers still queued on a simulated power failure are lost.
+ */
+#define SIM_ASYNC_MAX_OPS 4
+
+struct sim_async_op {
+    const struct flash_area *area;
+    uint32_t off;
+    void *dst;
+    const void *src;
+    uint32_t len;
+};
+
+static __thread struct sim_async_op sim_async_ops[SIM_ASYNC_MAX_OPS];
+static __thread int sim_async_count;
+
+static void sim_async_reset(void)
+{
+    sim_async_count = 0;
+}
+
+static int sim_async_queue(const struct flash_area *area, uint32_t off, void *dst,
+                           const void *src, uint32_t len)
+{
+    struct sim_async_op *op;
+
+    if (sim_async_count == SIM_ASYNC_MAX_OPS) {
+        return -1;
+    }
+
+    op = &sim_async_ops[sim_async_count++];
+    op->area = area;
+    op->off = off;
+    op->dst = dst;
+    op->src = src;
+    op->len = len;
+    return 0;
+}
+
+int flash_area_read_async(const struct flash_area *area, uint32_t off, void *dst,
+                          uint32_t len)
+{
+    return sim_async_queue(area, off, dst, NULL, len);
+}
+
+int flash_area_write_async(const struct flash_area *area, uint32_t off, const void *src,
+                           uint32_t len)
+{
+    return sim_async_queue(area, off, NULL, src, len);
+}
+
+int flash_area_async_wait(const struct flash_area *area)
+{
+    struct sim_async_op op;
+    int rc = 0;
+    int i = 0;
+
+    while (i < sim_async_count) {
+        if (sim_async_ops[i].area->fa_device_id != area->fa_device_id) {
+            i++;
+            continue;
+        }
+
+        op = sim_async_ops[i];
+        memmove(&sim_async_ops[i], &sim_async_ops[i + 1],
+                (sim_async_count - i - 1) * sizeof(sim_async_ops[0]));
+        sim_async_count--;
+
+        if (op.dst != NULL) {
+            rc = rc ? rc : flash_area_read(op.area, op.off, op.dst, op.len);
+        } else {
+            rc = rc ? rc : flash_area_write(op.area, op.off, op.src, op.len);
+        }
+    }
+
+    return rc;
+}
+#endif /* MCUBOOT_FLASH_AREA_ASYNC */
+
+#ifdef MCUBOOT_HASH_HW_ENGINE
+/*
+ * Simulated SHA engine, on top of the software backend. Like the async
+ * flash transfers, an update is only carried out when the caller waits for
+ * it, so that data modified before the wait corrupts the hash. The engine
+ * refuses every other hash, to also exercise the software fallback.
+ */
+static __thread bootutil_sha_context sim_hw_sha_ctx;
+static __thread const void *sim_hw_sha_data;
+static __thread uint32_t sim_hw_sha_len;
+static __thread bool sim_hw_sha_busy;
+static __thread unsigned int sim_hw_sha_count;
+
+int boot_hw_sha_init(void)
+{
+    if (sim_hw_sha_busy || (sim_hw_sha_count++ & 1) != 0) {
+        return -1;
+    }
+
+    sim_hw_sha_busy = true;
+    sim_hw_sha_data = NULL;
+    return bootutil_sha_init(&sim_hw_sha_ctx);
+}
+
+int boot_hw_sha_update_async(const void *data, uint32_t data_len)
+{
+    if (sim_hw_sha_data != NULL) {
+        return -1;
+    }
+
+    sim_hw_sha_data = data;
+    sim_hw_sha_len = data_len;
+    return 0;
+}
+
+int boot_hw_sha_wait(void)
+{
+    int rc = 0;
+
+    if (sim_hw_sha_data != NULL) {
+        rc = bootutil_sha_update(&sim_hw_sha_ctx, sim_hw_sha_data, sim_hw_sha_len);
+        sim_hw_sha_data = NULL;
+    }
+
+    return rc;
+}
+
+int boot_hw_sha_finish(uint8_t *output)
+{
+    return bootutil_sha_finish(&sim_hw_sha_ctx, output);
+}
+
+void boot_hw_sha_drop(void)
+{
+    bootutil_sha_drop(&sim_hw_sha_ctx);
+    sim_hw_sha_busy = false;
+}
+#endif /* MCUBOOT_HASH_HW_ENGINE */
+
+#ifdef MCUBOOT_HASH_WORKER
+/*
+ * Simulated worker. The simulated flash belongs to the thread running the
+ * test, so the function is only run when the caller joins it, which also
+ * shows any use of its results before the join.
+ */
+static __thread void (*sim_worker_fn)(void *arg);
+static __thread void *sim_worker_arg;
+
+static void sim_worker_reset(void)
+{
+    sim_worker_fn = NULL;
+}
+
+int boot_worker_start(void (*fn)(void *arg), void *arg)
+{
+    if (sim_worker_fn != NULL) {
+        return -1;
+    }
+
+    sim_worker_fn = fn;
+    sim_worker_arg = arg;
+    return 0;
+}
+
+void boot_worker_join(void)
+{
+    void (*fn)(void *arg) = sim_worker_fn;
+
+    if (fn != NULL) {
+        sim_worker_fn = NULL;
+        fn(sim_worker_arg);
+    }
+}
+#endif /* MCUBOOT_HASH_WORKER */
+
+#ifdef MCUBOOT_SIG_CACHE
+/*
+ * Signature cache kept in memory for the duration of the test, like
+ * retained RAM across resets. The MAC is a keyed hash with a fixed key,
+ * which is only good enough for the simulator.
+ */
+static __thread struct boot_sig_cache_entry sim_sig_cache[BOOT_IMAGE_NUMBER];
+static __thread bool sim_sig_cache_valid[BOOT_IMAGE_NUMBER];
+static __thread uint32_t sim_sig_cache_writes;
+
+uint32_t sim_sig_cache_write_count(void)
+{
+    return sim_sig_cache_writes;
+}
+
+int boot_sig_cache_read(uint32_t image_index, struct boot_sig_cache_entry *entry)
+{
+    if (image_index >= BOOT_IMAGE_NUMBER || !sim_sig_cache_valid[image_index]) {
+        return -1;
+    }
+
+    *entry = sim_sig_cache[image_index];
+    return 0;
+}
+
+int boot_sig_cache_write(uint32_t image_index, const struct boot_sig_cache_entry *entry)
+{
+    if (image_index >= BOOT_IMAGE_NUMBER) {
+        return -1;
+    }
+
+    sim_sig_cache[image_index] = *entry;
+    sim_sig_cache_valid[image_index] = true;
+    sim_sig_cache_writes++;
+    return 0;
+}
+
+int boot_sig_cache_mac(const void *data, uint32_t len, uint8_t *mac)
+{
+    static const uint8_t key[] = "mcuboot simulator signature cache key";
+    uint8_t digest[IMAGE_HASH_SIZE];
+    bootutil_sha_context sha_ctx;
+
+    bootutil_sha_init(&sha_ctx);
+    bootutil_sha_update(&sha_ctx, key, sizeof(key));
+    bootutil_sha_update(&sha_ctx, data, len);
+    bootutil_sha_finish(&sha_ctx, digest);
+    bootutil_sha_drop(&sha_ctx);
+
+    memcpy(mac, digest, BOOT_SIG_CACHE_MAC_SIZE);
+    return 0;
+}
+#endif /* MCUBOOT_SIG_CACHE */
+
 int flash_area_to_sectors(int idx, int *cnt, struct flash_area *ret)
 {
     int rc = 0;
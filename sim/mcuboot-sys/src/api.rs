@@ -306,6 +306,24 @@ pub extern "C" fn sim_flash_write(dev_id: u8, offset: u32, src: *const u8, size:
     rc
 }
 
+#[no_mangle]
+pub extern "C" fn sim_flash_is_erased(dev_id: u8, offset: u32, size: u32) -> libc::c_int {
+    let mut rc: libc::c_int = -19;
+    THREAD_CTX.with(|ctx| {
+        if let Some(flash) = ctx.borrow().flash_map.get(&dev_id) {
+            let dev = unsafe { &mut *(flash.ptr) };
+            rc = match dev.is_erased(offset as usize, size as usize) {
+                Ok(erased) => erased as libc::c_int,
+                Err(e) => {
+                    warn!("{}", e);
+                    -1
+                },
+            };
+        }
+    });
+    rc
+}
+
 #[no_mangle]
 pub extern "C" fn sim_flash_align(id: u8) -> u32 {
     THREAD_CTX.with(|ctx| {
@@ -79,6 +79,12 @@ pub const fn logical_sector_size() -> usize {
     0
 }
 
+/// The number of sectors swap-move moves and swaps at a time.  Must agree with
+/// the MCUBOOT_SWAP_UNIT_SECTORS that build.rs defines for the same features.
+pub const fn swap_unit_sectors() -> usize {
+    if cfg!(feature = "swap-unit") { 2 } else { 1 }
+}
+
 /// Invoke the bootloader on this flash device.
 pub fn boot_go(multiflash: &mut SimMultiFlash, areadesc: &AreaDesc,
                counter: Option<&mut i32>, image_index: Option<i32>,
@@ -204,6 +210,12 @@ pub fn reset_security_counters() {
     api::sim_reset_nv_counters();
 }
 
+/// Number of entries written to the signature cache by this thread.
+#[cfg(feature = "sig-cache")]
+pub fn sig_cache_writes() -> u32 {
+    unsafe { raw::sim_sig_cache_write_count() }
+}
+
 mod raw {
     use crate::area::CAreaDesc;
     use crate::api::{BootRsp, CSimContext};
@@ -231,6 +243,9 @@ mod raw {
         pub fn kw_encrypt_(kek: *const u8, seckey: *const u8,
                            encbuf: *mut u8) -> libc::c_int;
 
+        #[cfg(feature = "sig-cache")]
+        pub fn sim_sig_cache_write_count() -> u32;
+
         #[allow(unused)]
         pub fn psa_crypto_init() -> u32;
 
@@ -55,6 +55,7 @@ pub trait Flash {
     fn erase(&mut self, offset: usize, len: usize) -> Result<()>;
     fn write(&mut self, offset: usize, payload: &[u8]) -> Result<()>;
     fn read(&self, offset: usize, data: &mut [u8]) -> Result<()>;
+    fn is_erased(&self, offset: usize, len: usize) -> Result<bool>;
 
     fn add_bad_region(&mut self, offset: usize, len: usize, rate: f32) -> Result<()>;
     fn reset_bad_regions(&mut self);
@@ -227,6 +228,17 @@ impl Flash for SimFlash {
         Ok(())
     }
 
+    /// Blank check: a region is only reported as erased if it has not been
+    /// written to since it was last erased, as the write restrictions above
+    /// would otherwise fail for data which happens to match the erased value.
+    fn is_erased(&self, offset: usize, len: usize) -> Result<bool> {
+        if offset + len > self.data.len() {
+            bail!(ebounds("Blank check outside of device"));
+        }
+
+        Ok(self.write_safe[offset .. offset + len].iter().all(|&x| x))
+    }
+
     /// Adds a new flash bad region. Writes to this area fail with a chance
     /// given by `rate`.
     fn add_bad_region(&mut self, offset: usize, len: usize, rate: f32) -> Result<()> {
@@ -44,6 +44,12 @@ impl Caps {
         Caps::EcdsaP256.present() || Caps::EcdsaP384.present()
     }
 
+    /// Does this build check a signature of the images.
+    pub fn has_signature() -> bool {
+        Caps::RSA2048.present() || Caps::RSA3072.present() || Caps::has_ecdsa() ||
+            Caps::Ed25519.present()
+    }
+
     /// Query for the number of images that have been configured into this
     /// MCUboot build.
     pub fn get_num_images() -> usize {
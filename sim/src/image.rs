@@ -41,6 +41,7 @@ use crate::{
     DeviceName,
 };
 use crate::caps::Caps;
+use crate::lzma;
 use crate::depends::{
     BoringDep,
     Depender,
@@ -50,7 +51,7 @@ use crate::depends::{
     PairDep,
     UpgradeInfo,
 };
-use crate::tlv::{ManifestGen, SigningKey, TlvGen, TlvFlags};
+use crate::tlv::{ManifestGen, SigningKey, TlvGen, TlvFlags, TlvKinds};
 use crate::utils::align_up;
 use typenum::{U32, U16};
 
@@ -130,6 +131,8 @@ pub enum ImageManipulation {
     /// false to overlap by 1 byte
     OverlapImages(bool),
     CorruptHigherVersionImage,
+    /// A payload which compresses like code does.
+    Compressible,
 }
 
 
@@ -554,6 +557,98 @@ impl ImagesBuilder {
         }
     }
 
+    /// Construct an `Images` with a delta image in the secondary slot, which
+    /// rebuilds the upgrade from the image in the primary slot.
+    pub fn make_delta_image(self) -> Images {
+        let mut flash = self.flash;
+        let ram = self.ram.clone(); // TODO: Avoid this clone.
+        let images = self.slots.into_iter().enumerate().map(|(image_num, slots)| {
+            let dep = BoringDep::new(image_num, &NO_DEPS);
+            let primaries = install_image(&mut flash, &self.areadesc, &slots, 0,
+                maximal(32784), &ram, &dep, ImageManipulation::None, Some(0));
+            // The full image and the delta image both have to fit in the
+            // secondary slot.
+            let upgrades = install_image(&mut flash, &self.areadesc, &slots, 1,
+                ImageSize::Given(8192), &ram, &dep, ImageManipulation::None, Some(1));
+            install_delta_image(&mut flash, &slots, &primaries, &upgrades, Some(1));
+            OneImage {
+                slots,
+                primaries,
+                upgrades,
+            }}).collect();
+        let mut images = Images {
+            flash,
+            areadesc: self.areadesc,
+            images,
+            total_count: None,
+            ram: self.ram,
+        };
+
+        for image in &images.images {
+            mark_upgrade(&mut images.flash, &image.slots[1]);
+        }
+
+        // The count is meaningless if no flash operations are performed.
+        if !Caps::modifies_flash() {
+            return images;
+        }
+
+        let total_count = images.run_basic_upgrade(true)
+            .expect("Unable to perform basic upgrade from delta image");
+
+        c::reset_security_counters();
+
+        images.total_count = Some(total_count);
+        images
+    }
+
+    /// Construct an `Images` with a compressed image in the secondary slot,
+    /// compressed through the ARM thumb filter if thumb is set.  With
+    /// corrupt, the stream is damaged before the image is signed.
+    pub fn make_compressed_image(self, thumb: bool, corrupt: bool) -> Images {
+        let mut flash = self.flash;
+        let ram = self.ram.clone(); // TODO: Avoid this clone.
+        let images = self.slots.into_iter().enumerate().map(|(image_num, slots)| {
+            let dep = BoringDep::new(image_num, &NO_DEPS);
+            let primaries = install_image(&mut flash, &self.areadesc, &slots, 0,
+                maximal(32784), &ram, &dep, ImageManipulation::None, Some(0));
+            // Large enough for the decompression to look back further than
+            // it keeps in RAM.
+            let upgrades = install_image(&mut flash, &self.areadesc, &slots, 1,
+                ImageSize::Given(32784), &ram, &dep, ImageManipulation::Compressible, Some(1));
+            install_compressed_image(&mut flash, &slots, &upgrades, Some(1), thumb, corrupt);
+            OneImage {
+                slots,
+                primaries,
+                upgrades,
+            }}).collect();
+        let mut images = Images {
+            flash,
+            areadesc: self.areadesc,
+            images,
+            total_count: None,
+            ram: self.ram,
+        };
+
+        for image in &images.images {
+            mark_upgrade(&mut images.flash, &image.slots[1]);
+        }
+
+        // The count is meaningless if no flash operations are performed, or
+        // if the upgrade is not supposed to happen.
+        if !Caps::modifies_flash() || corrupt {
+            return images;
+        }
+
+        let total_count = images.run_basic_upgrade(true)
+            .expect("Unable to perform basic upgrade from compressed image");
+
+        c::reset_security_counters();
+
+        images.total_count = Some(total_count);
+        images
+    }
+
     /// If security_cnt is None then do not add a security counter TLV, otherwise add the specified value.
     pub fn make_image_with_security_counter(self, security_cnt: Option<u32>) -> Images {
         let mut flash = self.flash;
@@ -703,13 +798,16 @@ impl ImagesBuilder {
                 (flash, Rc::new(areadesc), &[])
             }
             DeviceName::Nrf52840UnequalSlots => {
+                // The primary slot is larger by the swap unit that swap-move
+                // needs to move the image up.
                 let dev = SimFlash::new(vec![4096; 128], align as usize, erased_val);
+                let primary_len = 0x03b000 + c::swap_unit_sectors() * 4096;
 
                 let dev_id = 0;
                 let mut areadesc = AreaDesc::new();
                 areadesc.add_flash_sectors(dev_id, &dev);
-                areadesc.add_image(0x008000, 0x03c000, FlashId::Image0, dev_id);
-                areadesc.add_image(0x044000, 0x03b000, FlashId::Image1, dev_id);
+                areadesc.add_image(0x008000, primary_len, FlashId::Image0, dev_id);
+                areadesc.add_image(0x008000 + primary_len, 0x03b000, FlashId::Image1, dev_id);
 
                 let mut flash = SimMultiFlash::new();
                 flash.insert(dev_id, dev);
@@ -1108,6 +1206,40 @@ impl Images {
         fails > 0
     }
 
+    /// An upgrade to a compressed image which does not decompress must fail
+    /// without leaving the upgrade in the primary slot.
+    pub fn run_bad_compressed_upgrade(&self) -> bool {
+        if !Caps::modifies_flash() {
+            return false;
+        }
+
+        let mut flash = self.flash.clone();
+        let mut fails = 0;
+
+        info!("Try upgrade with a corrupted compressed stream");
+
+        let result = c::boot_go(&mut flash, &self.areadesc, None, None, true);
+        if result.success() {
+            warn!("Boot succeeded with a corrupted compressed stream");
+            fails += 1;
+        }
+        if result.asserts() != 0 {
+            warn!("Assert while decompressing a corrupted stream");
+            fails += 1;
+        }
+
+        if self.verify_images(&flash, 0, 1) {
+            warn!("Corrupted compressed image was decompressed");
+            fails += 1;
+        }
+
+        if fails > 0 {
+            error!("Expected a failed upgrade from a corrupted compressed image");
+        }
+
+        fails > 0
+    }
+
     // Test expecting failed upgrade and primary slot left untouched
     pub fn run_fail_upgrade_primary_intact(&self) -> bool {
         let mut flash = self.flash.clone();
@@ -1312,6 +1444,26 @@ impl Images {
             fails += 1;
         }
 
+        if cfg!(feature = "overwrite-only-hash-on-copy") && !Caps::has_signature() {
+            // Without a signature, the corrupted hash can only be found once
+            // the image has been copied over the primary slot, which is then
+            // scrambled.
+            if c::boot_go(&mut flash, &self.areadesc, None, None, false).success() {
+                warn!("Booted an image with a bad hash");
+                fails += 1;
+            }
+            if self.verify_images(&flash, 0, 1) {
+                warn!("Image with a bad hash left in the primary slot");
+                fails += 1;
+            }
+
+            if fails > 0 {
+                error!("Expected an upgrade failure when image has bad hash");
+            }
+
+            return fails > 0;
+        }
+
         // Run the bootloader...
         if !c::boot_go(&mut flash, &self.areadesc, None, None, false).success() {
             warn!("Failed first boot");
@@ -1646,9 +1798,113 @@ impl Images {
             return true;
         }
 
+        // The security counter has to be checked before the image is copied.
+        if cfg!(feature = "overwrite-only-hash-on-copy") && !self.verify_images(&flash, 0, 0) {
+            warn!("Primary slot was overwritten by an image with a low security counter");
+            return true;
+        }
+
         false
     }
 
+    /// With the signature cache, a boot after one that verified the
+    /// signatures must find all of them in the cache.
+    #[cfg(feature = "sig-cache")]
+    pub fn run_sig_cache(&self) -> bool {
+        if !Caps::has_signature() ||
+            !(Caps::ValidatePrimarySlot.present() || Caps::DirectXip.present()) {
+            return false;
+        }
+
+        let mut flash = self.flash.clone();
+
+        if !c::boot_go(&mut flash, &self.areadesc, None, None, false).success() {
+            warn!("Failed first boot");
+            return true;
+        }
+
+        // A miss on an image with a single signature always rewrites its
+        // entry, so no write means that every signature hit the cache.
+        let writes = c::sig_cache_writes();
+        if !c::boot_go(&mut flash, &self.areadesc, None, None, false).success() {
+            warn!("Failed second boot");
+            return true;
+        }
+        if c::sig_cache_writes() != writes {
+            warn!("Second boot missed the signature cache");
+            return true;
+        }
+
+        false
+    }
+
+    /// With sector hashes, completing an interrupted swap checks the part of
+    /// the primary slot that it rewrote.  Resume swaps interrupted at a few
+    /// points, once as is, which must upgrade, and once after corrupting
+    /// every sector of the upgrade left in the secondary slot, which must not
+    /// boot whenever the corruption reached the image in the primary slot.
+    #[cfg(feature = "sector-hashes")]
+    pub fn run_sector_hashes_resume(&self) -> bool {
+        if !self.is_swap_upgrade() || Caps::OverwriteUpgrade.present() || self.images.len() != 1 {
+            return false;
+        }
+
+        let image = &self.images[0];
+        let upgrade = &image.upgrades.plain[..image.upgrades.size];
+        let hdr_size = u16::from_le_bytes([upgrade[8], upgrade[9]]) as usize;
+        let hashed_size = hdr_size +
+            u32::from_le_bytes([upgrade[12], upgrade[13], upgrade[14], upgrade[15]]) as usize;
+        let total_flash_ops = self.total_count.unwrap();
+        let mut refused = 0;
+        let mut fails = 0;
+
+        for i in 1 .. 8 {
+            let stop = total_flash_ops * i / 8;
+            let mut flash = self.flash.clone();
+            self.mark_permanent_upgrades(&mut flash, 1);
+
+            let mut counter = stop;
+            if !c::boot_go(&mut flash, &self.areadesc, Some(&mut counter), None,
+                           false).interrupted() {
+                warn!("Should have stopped at {}", stop);
+                fails += 1;
+                continue;
+            }
+
+            let mut clean = flash.clone();
+            if !c::boot_go(&mut clean, &self.areadesc, None, None, false).success() ||
+                !self.verify_images(&clean, 0, 1) {
+                warn!("Clean resume from {} failed", stop);
+                fails += 1;
+            }
+
+            corrupt_sectors(&mut flash, &image.slots[1], image.upgrades.size);
+            let booted = c::boot_go(&mut flash, &self.areadesc, None, None, false).success();
+
+            let slot = &image.slots[0];
+            let dev = flash.get(&slot.dev_id).unwrap();
+            let mut copy = vec![0u8; upgrade.len()];
+            dev.read(slot.base_off, &mut copy).unwrap();
+            if copy[..hashed_size] != upgrade[..hashed_size] {
+                if booted {
+                    warn!("Booted an image corrupted by the resume from {}", stop);
+                    fails += 1;
+                }
+                refused += 1;
+            } else if copy[..] == upgrade[..] && !booted {
+                warn!("Resume from {} untouched by the corruption failed", stop);
+                fails += 1;
+            }
+        }
+
+        if refused == 0 {
+            warn!("No resume rewrote a corrupted sector");
+            fails += 1;
+        }
+
+        fails > 0
+    }
+
     pub fn run_ram_load_boot_with_result(&self, expected_result: bool) -> bool {
         if !Caps::RamLoad.present() {
             return false;
@@ -2143,10 +2399,15 @@ fn image_largest_trailer(dev: &dyn Flash, areadesc: &AreaDesc, slot: &SlotInfo)
 
 // Computes the padding required in the primary or secondary slot to be able to perform an upgrade.
 // This is needed only for the swap-move and swap-offset upgrade strategies.
-fn required_slot_padding(dev: &dyn Flash) -> usize {
+fn required_slot_padding(dev: &dyn Flash, slot_len: usize, trailer: usize) -> usize {
     let mut required_padding = 0;
 
-    if Caps::SwapUsingMove.present() || Caps::SwapUsingOffset.present() {
+    if Caps::SwapUsingMove.present() {
+        // Assumes equally-sized sectors.  The image is moved up by one swap
+        // unit, and only whole units fit before the trailer.
+        let unit = boot_sector_size(dev) * c::swap_unit_sectors();
+        required_padding = unit + (slot_len - trailer) % unit;
+    } else if Caps::SwapUsingOffset.present() {
         // Assumes equally-sized sectors
         required_padding = boot_sector_size(dev);
     };
@@ -2164,7 +2425,7 @@ fn compute_largest_image_size(dev: &dyn Flash, areadesc: &AreaDesc, slots: &[Slo
     };
 
     let trailer = image_largest_trailer(dev, areadesc, &slots[slot_ind]);
-    let padding = required_slot_padding(dev);
+    let padding = required_slot_padding(dev, slot_len, trailer);
     let tlv_len = tlv.estimate_size();
     info!("slot: 0x{:x}, HDR: 0x{:x}, trailer: 0x{:x}, tlv_len: 0x{:x}, padding: 0x{:x}",
         slot_len, hdr_size, trailer, tlv_len, padding);
@@ -2253,6 +2514,13 @@ fn install_image_with_key(
         }
     };
 
+    // The sector hashes depend on the size of the image, so size them for
+    // the whole slot while looking for the largest image.
+    let sector_hashes = cfg!(feature = "sector-hashes");
+    if sector_hashes {
+        tlv.set_sector_hashes(boot_sector_size(dev) as u32, slot.len);
+    }
+
     let len = match len {
         ImageSize::Given(size) => size,
         ImageSize::Largest => compute_largest_image_size(dev, areadesc, slots, slot_ind,
@@ -2264,6 +2532,10 @@ fn install_image_with_key(
         }
     };
 
+    if sector_hashes {
+        tlv.set_sector_hashes(boot_sector_size(dev) as u32, HDR_SIZE + len);
+    }
+
     // Generate a boot header.  Note that the size doesn't include the header.
     let header = ImageHeader {
         magic: tlv.get_magic(),
@@ -2284,7 +2556,11 @@ fn install_image_with_key(
 
     // The core of the image itself is just pseudorandom data.
     let mut b_img = vec![0; len];
-    splat(&mut b_img, offset);
+    if img_manipulation == ImageManipulation::Compressible {
+        splat_code(&mut b_img, offset);
+    } else {
+        splat(&mut b_img, offset);
+    }
 
     // Add some information at the start of the payload to make it easier
     // to see what it is.  This will fail if the image itself is too small.
@@ -2415,6 +2691,179 @@ fn install_image_with_key(
     }
 }
 
+/// Replace the image installed in the secondary slot by a delta image, which
+/// rebuilds it from the base image in the primary slot.
+fn install_delta_image(flash: &mut SimMultiFlash, slots: &[SlotInfo], base: &ImageData,
+                       image: &ImageData, security_counter: Option<u32>) {
+    let slot = &slots[1];
+    let mut offset = slot.base_off;
+    let dev = flash.get_mut(&slot.dev_id).unwrap();
+
+    if Caps::SwapUsingOffset.present() {
+        offset += boot_sector_size(dev);
+    }
+
+    let full = &image.plain[..image.size];
+    let patch = make_delta_patch(full);
+
+    let mut tlv: Box<dyn ManifestGen> = Box::new(make_tlv(SigningKey::Primary));
+    tlv.set_security_counter(security_counter);
+    tlv.set_delta_base(full.len() as u32, &image_hash_tlv(&base.plain));
+
+    // The delta image keeps the load address and version of the full image.
+    let mut b_header = full[..32].to_vec();
+    {
+        let mut wr = Cursor::new(&mut b_header[10..20]);
+        wr.write_u16::<LittleEndian>(tlv.protect_size()).unwrap();
+        wr.write_u32::<LittleEndian>(patch.len() as u32).unwrap();
+        wr.write_u32::<LittleEndian>(tlv.get_flags()).unwrap();
+    }
+
+    tlv.add_bytes(&b_header);
+    tlv.add_bytes(&patch);
+
+    let mut buf = b_header;
+    buf.extend_from_slice(&patch);
+    buf.append(&mut tlv.make_tlv());
+
+    let align = dev.align();
+    while buf.len() % align != 0 {
+        buf.push(dev.erased_val());
+    }
+
+    dev.erase(slot.base_off, slot.len).unwrap();
+    dev.write(offset, &buf).unwrap();
+}
+
+/// Replace the image installed in the secondary slot by a compressed image,
+/// which decompresses to it.
+fn install_compressed_image(flash: &mut SimMultiFlash, slots: &[SlotInfo], image: &ImageData,
+                            security_counter: Option<u32>, thumb: bool, corrupt: bool) {
+    let slot = &slots[1];
+    let dev = flash.get_mut(&slot.dev_id).unwrap();
+
+    const HDR_SIZE: usize = 32;
+    let full = &image.plain[..image.size];
+    let img_size = u32::from_le_bytes([full[12], full[13], full[14], full[15]]);
+    let mut payload = lzma::compress(&full[HDR_SIZE..HDR_SIZE + img_size as usize], thumb);
+
+    // Damaged before signing, so that the image validates but does not
+    // decompress.
+    if corrupt {
+        let mid = payload.len() / 2;
+        payload[mid] ^= 0x10;
+    }
+
+    let mut tlv: Box<dyn ManifestGen> = Box::new(make_tlv(SigningKey::Primary));
+    tlv.set_security_counter(security_counter);
+    tlv.set_decompressed(img_size, &image_hash_tlv(full), image_sig_tlv(full).as_deref(), thumb);
+
+    // The compressed image keeps the load address and version of the full
+    // image.
+    let mut b_header = full[..HDR_SIZE].to_vec();
+    {
+        let mut wr = Cursor::new(&mut b_header[10..20]);
+        wr.write_u16::<LittleEndian>(tlv.protect_size()).unwrap();
+        wr.write_u32::<LittleEndian>(payload.len() as u32).unwrap();
+        wr.write_u32::<LittleEndian>(tlv.get_flags()).unwrap();
+    }
+
+    tlv.add_bytes(&b_header);
+    tlv.add_bytes(&payload);
+
+    let mut buf = b_header;
+    buf.extend_from_slice(&payload);
+    buf.append(&mut tlv.make_tlv());
+
+    let align = dev.align();
+    while buf.len() % align != 0 {
+        buf.push(dev.erased_val());
+    }
+
+    dev.erase(slot.base_off, slot.len).unwrap();
+    dev.write(slot.base_off, &buf).unwrap();
+}
+
+/// Make the patch of a delta image rebuilding the given image, as a sequence
+/// of inserts.
+fn make_delta_patch(image: &[u8]) -> Vec<u8> {
+    let mut patch = vec![];
+
+    for chunk in image.chunks(1000) {
+        // LEB128 encoded length, with the lowest bit set for an insert.
+        let mut val = ((chunk.len() as u32) << 1) | 1;
+        while val >= 0x80 {
+            patch.push((val as u8 & 0x7f) | 0x80);
+            val >>= 7;
+        }
+        patch.push(val as u8);
+        patch.extend_from_slice(chunk);
+    }
+
+    patch
+}
+
+/// Return the value of the hash TLV of the given image.
+fn image_hash_tlv(image: &[u8]) -> Vec<u8> {
+    image_unprot_tlv(image, &[TlvKinds::SHA256, TlvKinds::SHA384])
+        .expect("No hash TLV in image")
+}
+
+/// Return the value of the signature TLV of the given image, if it is signed.
+fn image_sig_tlv(image: &[u8]) -> Option<Vec<u8>> {
+    image_unprot_tlv(image, &[TlvKinds::RSA2048, TlvKinds::RSA3072,
+                              TlvKinds::ED25519, TlvKinds::ECDSASIG])
+}
+
+/// Return the value of the first unprotected TLV of the given image which is
+/// of one of the given kinds.
+fn image_unprot_tlv(image: &[u8], kinds: &[TlvKinds]) -> Option<Vec<u8>> {
+    let read_u16 = |off: usize| u16::from_le_bytes([image[off], image[off + 1]]) as usize;
+    let hdr_size = read_u16(8);
+    let protect_tlv_size = read_u16(10);
+    let img_size = u32::from_le_bytes([image[12], image[13], image[14], image[15]]) as usize;
+
+    // The hash and signature are in the unprotected TLV area.
+    let mut off = hdr_size + img_size + protect_tlv_size;
+    let end = off + read_u16(off + 2);
+    off += 4;
+    while off < end {
+        let kind = read_u16(off);
+        let len = read_u16(off + 2);
+        if kinds.iter().any(|&k| kind == k as usize) {
+            return Some(image[off + 4 .. off + 4 + len].to_vec());
+        }
+        off += 4 + len;
+    }
+
+    None
+}
+
+/// Flip a bit in every sector of the slot which holds data of the image of the
+/// given size, leaving the trailer and erased locations alone.
+#[cfg(feature = "sector-hashes")]
+fn corrupt_sectors(flash: &mut SimMultiFlash, slot: &SlotInfo, size: usize) {
+    let dev = flash.get_mut(&slot.dev_id).unwrap();
+    let sector_size = boot_sector_size(dev);
+    let align = dev.align();
+    let mut buf = vec![0u8; align];
+
+    // Past the header.  With swap-offset, the upgrade starts a sector into
+    // the slot.
+    let end = if Caps::SwapUsingOffset.present() { size + sector_size } else { size };
+    let mut off = slot.base_off + 0x40;
+    while off < slot.base_off + end {
+        if !dev.is_erased(off, align).unwrap() {
+            dev.read(off, &mut buf).unwrap();
+            buf[0] ^= 0x01;
+            dev.set_verify_writes(false);
+            dev.write(off, &buf).unwrap();
+            dev.set_verify_writes(true);
+        }
+        off += sector_size;
+    }
+}
+
 /// Install no image.  This is used when no upgrade happens.
 fn install_no_image() -> ImageData {
     ImageData {
@@ -2757,14 +3206,64 @@ fn mark_permanent_upgrade(flash: &mut SimMultiFlash, slot: &SlotInfo) {
 
 // Drop some pseudo-random gibberish onto the data.
 fn splat(data: &mut [u8], seed: usize) {
+    let mut rng = splat_rng(data, seed);
+    rng.fill_bytes(data);
+}
+
+// Drop pseudo-random data which compresses the way code does: runs copied
+// from earlier on, some of them far back, and thumb calls to a few functions.
+fn splat_code(data: &mut [u8], seed: usize) {
+    let mut rng = splat_rng(data, seed);
+    let funcs: Vec<usize> = (0..16).map(|_| rng.random_range(0..data.len()) & !1).collect();
+
+    let mut pos = 0;
+    while pos < data.len() {
+        let left = data.len() - pos;
+        match rng.random_range(0..4) {
+            0 => {
+                let len = rng.random_range(1..32).min(left);
+                rng.fill_bytes(&mut data[pos..pos + len]);
+                pos += len;
+            }
+            1 if pos >= 64 => {
+                let dist = if rng.random_bool(0.5) {
+                    rng.random_range(1..64)
+                } else {
+                    rng.random_range(1..=pos)
+                };
+                let len = rng.random_range(4..64).min(left);
+                for i in pos..pos + len {
+                    data[i] = data[i - dist];
+                }
+                pos += len;
+            }
+            2 if pos % 2 == 0 && left >= 4 => {
+                // BL, in halfwords from the next instruction.
+                let target = funcs[rng.random_range(0..funcs.len())];
+                let rel = (target.wrapping_sub(pos + 4) >> 1) as u32;
+                data[pos] = (rel >> 11) as u8;
+                data[pos + 1] = 0xf0 | ((rel >> 19) & 7) as u8;
+                data[pos + 2] = rel as u8;
+                data[pos + 3] = 0xf8 | ((rel >> 8) & 7) as u8;
+                pos += 4;
+            }
+            _ => {
+                let len = rng.random_range(1..16).min(left);
+                data[pos..pos + len].fill(0);
+                pos += len;
+            }
+        }
+    }
+}
+
+fn splat_rng(data: &[u8], seed: usize) -> SmallRng {
     let mut seed_block = [0u8; 32];
     let mut buf = Cursor::new(&mut seed_block[..]);
     buf.write_u32::<LittleEndian>(0x135782ea).unwrap();
     buf.write_u32::<LittleEndian>(0x92184728).unwrap();
     buf.write_u32::<LittleEndian>(data.len() as u32).unwrap();
     buf.write_u32::<LittleEndian>(seed as u32).unwrap();
-    let mut rng: SmallRng = SeedableRng::from_seed(seed_block);
-    rng.fill_bytes(data);
+    SeedableRng::from_seed(seed_block)
 }
 
 /// Return a read-only view into the raw bytes of this object
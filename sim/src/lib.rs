@@ -15,6 +15,7 @@ use serde_derive::Deserialize;
 mod caps;
 mod depends;
 mod image;
+mod lzma;
 pub mod tlv;
 mod utils;
 pub mod testlog;
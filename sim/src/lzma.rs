@@ -0,0 +1,418 @@
+// Copyright (c) 2026 Linaro LTD
+//
+// SPDX-License-Identifier: Apache-2.0
+
+//! LZMA2 compression of images.
+//!
+//! A small LZMA2 encoder, so that the simulator can build compressed images
+//! the way imgtool does with its `--compression` option, without an external
+//! compression library.  It only looks for matches greedily through hash
+//! chains, which compresses less than xz does, but uses the same stream
+//! format: the bootloader decodes both the same way.
+
+/// Literal context bits, literal position bits and position bits, as used
+/// by imgtool.
+const LC: u32 = 3;
+const LP: u32 = 1;
+const PB: u32 = 2;
+
+/// Dictionary size given in the header of the compressed payload.  Matches
+/// are never further back than this.
+const DICT_SIZE: usize = 128 * 1024;
+
+/// Most bytes of input encoded in one LZMA chunk.
+const CHUNK_SIZE: usize = 32 * 1024;
+
+/// Most bytes of input stored in one uncompressed chunk.
+const COPY_CHUNK_SIZE: usize = 64 * 1024;
+
+/// Largest LZMA chunk after compression.
+const PACKED_MAX: usize = 64 * 1024;
+
+const MATCH_LEN_MIN: usize = 2;
+const MATCH_LEN_MAX: usize = 273;
+
+/// Number of candidates looked at when looking for a match.
+const CHAIN_DEPTH: usize = 48;
+
+const HASH_BITS: u32 = 16;
+
+const PROB_BITS: u32 = 11;
+const PROB_INIT: u16 = 1 << (PROB_BITS - 1);
+const MOVE_BITS: u32 = 5;
+const RC_TOP: u32 = 1 << 24;
+
+const STATES: usize = 12;
+const LIT_STATES: usize = 7;
+const POS_STATES_MAX: usize = 1 << 4;
+const DIST_STATES: usize = 4;
+const DIST_MODEL_START: u32 = 4;
+const DIST_MODEL_END: u32 = 14;
+const FULL_DISTANCES: usize = 128;
+const ALIGN_BITS: u32 = 4;
+
+/// Compress the payload of an image: the two byte header of the dictionary
+/// size and properties, then a raw LZMA2 stream, with the ARM thumb filter
+/// applied first if `thumb` is set.
+pub fn compress(data: &[u8], thumb: bool) -> Vec<u8> {
+    let mut input = data.to_vec();
+    if thumb {
+        thumb_encode(&mut input);
+    }
+
+    let mut out = header();
+    let mut pos = 0;
+    while pos < input.len() {
+        let end = (pos + CHUNK_SIZE).min(input.len());
+        let packed = lzma_chunk(&input, pos, end);
+
+        if packed.len() <= PACKED_MAX && packed.len() < end - pos {
+            // State reset and new properties, plus a dictionary reset for
+            // the first chunk.
+            let unpacked = end - pos - 1;
+            let reset = if pos == 0 { 0xe0 } else { 0xc0 };
+            out.push(reset | (unpacked >> 16) as u8);
+            out.push((unpacked >> 8) as u8);
+            out.push(unpacked as u8);
+            out.push(((packed.len() - 1) >> 8) as u8);
+            out.push((packed.len() - 1) as u8);
+            out.push(((PB * 5 + LP) * 9 + LC) as u8);
+            out.extend_from_slice(&packed);
+        } else {
+            for (i, copy) in input[pos..end].chunks(COPY_CHUNK_SIZE).enumerate() {
+                out.push(if pos == 0 && i == 0 { 0x01 } else { 0x02 });
+                out.push(((copy.len() - 1) >> 8) as u8);
+                out.push((copy.len() - 1) as u8);
+                out.extend_from_slice(copy);
+            }
+        }
+        pos = end;
+    }
+    out.push(0x00);
+
+    out
+}
+
+/// The header of the payload, as imgtool writes it.
+fn header() -> Vec<u8> {
+    let dict_byte = (0..40).find(|&i: &u32| {
+        DICT_SIZE <= ((2 | (i & 1) as usize) << (i / 2 + 11))
+    }).unwrap();
+
+    vec![dict_byte as u8, ((PB * 5 + LP) * 9 + LC) as u8]
+}
+
+/// Apply the ARM thumb branch filter, which makes the targets of BL
+/// instructions absolute so that calls to the same function look alike.
+fn thumb_encode(buf: &mut [u8]) {
+    let mut i = 0;
+    while i + 4 <= buf.len() {
+        if (buf[i + 1] & 0xf8) == 0xf0 && (buf[i + 3] & 0xf8) == 0xf8 {
+            let src = ((buf[i + 1] as u32 & 7) << 19) | ((buf[i] as u32) << 11) |
+                      ((buf[i + 3] as u32 & 7) << 8) | buf[i + 2] as u32;
+            let dest = ((src << 1).wrapping_add(i as u32 + 4)) >> 1;
+            buf[i + 1] = 0xf0 | ((dest >> 19) & 7) as u8;
+            buf[i] = (dest >> 11) as u8;
+            buf[i + 3] = 0xf8 | ((dest >> 8) & 7) as u8;
+            buf[i + 2] = dest as u8;
+            i += 2;
+        }
+        i += 2;
+    }
+}
+
+struct RangeEncoder {
+    low: u64,
+    range: u32,
+    cache: u8,
+    cache_size: u64,
+    out: Vec<u8>,
+}
+
+impl RangeEncoder {
+    fn new() -> RangeEncoder {
+        RangeEncoder {
+            low: 0,
+            range: 0xffff_ffff,
+            cache: 0,
+            cache_size: 1,
+            out: vec![],
+        }
+    }
+
+    fn shift_low(&mut self) {
+        if (self.low as u32) < 0xff00_0000 || (self.low >> 32) != 0 {
+            let carry = (self.low >> 32) as u8;
+            let mut temp = self.cache;
+            loop {
+                self.out.push(temp.wrapping_add(carry));
+                temp = 0xff;
+                self.cache_size -= 1;
+                if self.cache_size == 0 {
+                    break;
+                }
+            }
+            self.cache = (self.low >> 24) as u8;
+        }
+        self.cache_size += 1;
+        self.low = (self.low & 0x00ff_ffff) << 8;
+    }
+
+    fn normalize(&mut self) {
+        while self.range < RC_TOP {
+            self.range <<= 8;
+            self.shift_low();
+        }
+    }
+
+    fn bit(&mut self, prob: &mut u16, bit: u32) {
+        let bound = (self.range >> PROB_BITS) * *prob as u32;
+        if bit == 0 {
+            self.range = bound;
+            *prob += ((1 << PROB_BITS) - *prob) >> MOVE_BITS;
+        } else {
+            self.low += bound as u64;
+            self.range -= bound;
+            *prob -= *prob >> MOVE_BITS;
+        }
+        self.normalize();
+    }
+
+    /// Encode the bits lowest bits of value, most significant first.
+    fn bittree(&mut self, probs: &mut [u16], bits: u32, value: u32) {
+        let mut symbol = 1;
+        for i in (0..bits).rev() {
+            let bit = (value >> i) & 1;
+            self.bit(&mut probs[symbol], bit);
+            symbol = (symbol << 1) | bit as usize;
+        }
+    }
+
+    /// Encode the bits lowest bits of value, least significant first.
+    fn bittree_reverse(&mut self, probs: &mut [u16], bits: u32, value: u32) {
+        let mut symbol = 1;
+        for i in 0..bits {
+            let bit = (value >> i) & 1;
+            self.bit(&mut probs[symbol - 1], bit);
+            symbol = (symbol << 1) | bit as usize;
+        }
+    }
+
+    /// Encode the bits lowest bits of value with equal probabilities.
+    fn direct(&mut self, bits: u32, value: u32) {
+        for i in (0..bits).rev() {
+            self.range >>= 1;
+            if (value >> i) & 1 != 0 {
+                self.low += self.range as u64;
+            }
+            self.normalize();
+        }
+    }
+
+    fn finish(mut self) -> Vec<u8> {
+        for _ in 0..5 {
+            self.shift_low();
+        }
+        self.out
+    }
+}
+
+struct LenCoder {
+    choice: u16,
+    choice2: u16,
+    low: [[u16; 8]; POS_STATES_MAX],
+    mid: [[u16; 8]; POS_STATES_MAX],
+    high: [u16; 256],
+}
+
+impl LenCoder {
+    fn new() -> LenCoder {
+        LenCoder {
+            choice: PROB_INIT,
+            choice2: PROB_INIT,
+            low: [[PROB_INIT; 8]; POS_STATES_MAX],
+            mid: [[PROB_INIT; 8]; POS_STATES_MAX],
+            high: [PROB_INIT; 256],
+        }
+    }
+
+    fn encode(&mut self, rc: &mut RangeEncoder, len: usize, pos_state: usize) {
+        let len = (len - MATCH_LEN_MIN) as u32;
+        if len < 8 {
+            rc.bit(&mut self.choice, 0);
+            rc.bittree(&mut self.low[pos_state], 3, len);
+        } else if len < 16 {
+            rc.bit(&mut self.choice, 1);
+            rc.bit(&mut self.choice2, 0);
+            rc.bittree(&mut self.mid[pos_state], 3, len - 8);
+        } else {
+            rc.bit(&mut self.choice, 1);
+            rc.bit(&mut self.choice2, 1);
+            rc.bittree(&mut self.high, 8, len - 16);
+        }
+    }
+}
+
+/// Encode input[start..end] as the data of one LZMA chunk, with a fresh
+/// state, the dictionary being all of the input before it.
+fn lzma_chunk(input: &[u8], start: usize, end: usize) -> Vec<u8> {
+    let mut rc = RangeEncoder::new();
+    let mut is_match = [[PROB_INIT; POS_STATES_MAX]; STATES];
+    let mut is_rep = [PROB_INIT; STATES];
+    let mut literal = vec![[PROB_INIT; 0x300]; 1 << (LC + LP)];
+    let mut dist_slot = [[PROB_INIT; 64]; DIST_STATES];
+    let mut dist_special = [PROB_INIT; FULL_DISTANCES - DIST_MODEL_END as usize];
+    let mut dist_align = [PROB_INIT; 1 << ALIGN_BITS];
+    let mut match_len = LenCoder::new();
+    let mut state = 0;
+    let mut rep0 = 0;
+
+    let mut finder = MatchFinder::new(input, start);
+    let mut pos = start;
+    while pos < end {
+        let pos_state = pos & ((1 << PB) - 1);
+        let (len, dist) = finder.find(pos, end);
+
+        if len < MATCH_LEN_MIN {
+            rc.bit(&mut is_match[state][pos_state], 0);
+
+            let prev = if pos > 0 { input[pos - 1] as usize } else { 0 };
+            let probs = &mut literal[((pos & ((1 << LP) - 1)) << LC) + (prev >> (8 - LC))];
+            let byte = input[pos] as u32;
+            if state < LIT_STATES {
+                rc.bittree(probs, 8, byte);
+            } else {
+                // Matched literal, coded along the byte after the last match
+                let mut match_byte = (input[pos - rep0 - 1] as u32) << 1;
+                let mut offset = 0x100;
+                let mut symbol = 1;
+                for i in (0..8).rev() {
+                    let bit = (byte >> i) & 1;
+                    let match_bit = match_byte & offset;
+                    match_byte <<= 1;
+                    rc.bit(&mut probs[(offset + match_bit + symbol) as usize], bit);
+                    symbol = (symbol << 1) | bit;
+                    offset = if bit != 0 { match_bit } else { offset & !match_bit };
+                }
+            }
+
+            state = if state < 4 { 0 } else if state < 10 { state - 3 } else { state - 6 };
+            finder.skip(pos, 1);
+            pos += 1;
+        } else {
+            rc.bit(&mut is_match[state][pos_state], 1);
+            rc.bit(&mut is_rep[state], 0);
+            match_len.encode(&mut rc, len, pos_state);
+
+            let dist = (dist - 1) as u32;
+            let slot = dist_slot_of(dist);
+            let len_state = (len - MATCH_LEN_MIN).min(DIST_STATES - 1);
+            rc.bittree(&mut dist_slot[len_state], 6, slot);
+            if slot >= DIST_MODEL_START {
+                let bits = (slot >> 1) - 1;
+                let base = (2 | (slot & 1)) << bits;
+                let reduced = dist - base;
+                if slot < DIST_MODEL_END {
+                    let off = (base - slot) as usize;
+                    rc.bittree_reverse(&mut dist_special[off..], bits, reduced);
+                } else {
+                    rc.direct(bits - ALIGN_BITS, reduced >> ALIGN_BITS);
+                    rc.bittree_reverse(&mut dist_align, ALIGN_BITS,
+                                       reduced & ((1 << ALIGN_BITS) - 1));
+                }
+            }
+
+            state = if state < LIT_STATES { 7 } else { 10 };
+            rep0 = dist as usize;
+            finder.skip(pos, len);
+            pos += len;
+        }
+    }
+
+    rc.finish()
+}
+
+fn dist_slot_of(dist: u32) -> u32 {
+    if dist < DIST_MODEL_START {
+        dist
+    } else {
+        let top = 31 - dist.leading_zeros();
+        (top << 1) | ((dist >> (top - 1)) & 1)
+    }
+}
+
+/// Finds the longest earlier match of the input at a position, through
+/// chains of the positions starting with the same three bytes.
+struct MatchFinder<'a> {
+    input: &'a [u8],
+    head: Vec<usize>,
+    prev: Vec<usize>,
+    /// Positions before this one have been added to the chains.
+    added: usize,
+}
+
+impl<'a> MatchFinder<'a> {
+    fn new(input: &'a [u8], start: usize) -> MatchFinder<'a> {
+        let mut finder = MatchFinder {
+            input,
+            head: vec![usize::MAX; 1 << HASH_BITS],
+            prev: vec![usize::MAX; input.len()],
+            added: start.saturating_sub(DICT_SIZE),
+        };
+        finder.add_until(start);
+        finder
+    }
+
+    fn hash(&self, pos: usize) -> usize {
+        let v = (self.input[pos] as u32) | ((self.input[pos + 1] as u32) << 8) |
+                ((self.input[pos + 2] as u32) << 16);
+        (v.wrapping_mul(0x9e37_79b1) >> (32 - HASH_BITS)) as usize
+    }
+
+    fn add_until(&mut self, end: usize) {
+        while self.added < end {
+            if self.added + 3 <= self.input.len() {
+                let h = self.hash(self.added);
+                self.prev[self.added] = self.head[h];
+                self.head[h] = self.added;
+            }
+            self.added += 1;
+        }
+    }
+
+    /// Return the length and distance of the longest match at pos, not
+    /// going past end.
+    fn find(&self, pos: usize, end: usize) -> (usize, usize) {
+        let limit = (end - pos).min(MATCH_LEN_MAX);
+        let mut best = (0, 0);
+        if limit < 3 {
+            return best;
+        }
+
+        let mut cand = self.head[self.hash(pos)];
+        let mut depth = 0;
+        while cand != usize::MAX && depth < CHAIN_DEPTH && pos - cand <= DICT_SIZE {
+            let len = self.input[cand..].iter().zip(&self.input[pos..pos + limit])
+                .take_while(|(a, b)| a == b).count();
+            if len > best.0 {
+                best = (len, pos - cand);
+                if len == limit {
+                    break;
+                }
+            }
+            cand = self.prev[cand];
+            depth += 1;
+        }
+
+        // Short matches far back cost more than the literals.
+        if best.0 == 3 && best.1 > 0x4000 {
+            (0, 0)
+        } else {
+            best
+        }
+    }
+
+    fn skip(&mut self, pos: usize, len: usize) {
+        self.add_until(pos + len);
+    }
+}
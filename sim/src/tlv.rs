@@ -62,6 +62,11 @@ pub enum TlvKinds {
     ENCX25519 = 0x33,
     DEPENDENCY = 0x40,
     SECCNT = 0x50,
+    DECOMPSIZE = 0x70,
+    DECOMPSHA = 0x71,
+    DECOMPSIGNATURE = 0x72,
+    SECTORHASHES = 0x76,
+    DELTABASE = 0x77,
 }
 
 #[allow(dead_code, non_camel_case_types)]
@@ -71,6 +76,9 @@ pub enum TlvFlags {
     ENCRYPTED_AES128 = 0x04,
     ENCRYPTED_AES256 = 0x08,
     RAM_LOAD = 0x20,
+    COMPRESSED_LZMA2 = 0x400,
+    COMPRESSED_ARM_THUMB = 0x800,
+    DELTA = 0x1000,
 }
 
 /// A generator for manifests.  The format of the manifest can be either a
@@ -118,6 +126,20 @@ pub trait ManifestGen {
     /// Sets the ignore_ram_load_flag so that can be validated when it is missing,
     /// it will not load successfully.
     fn set_ignore_ram_load_flag(&mut self);
+
+    /// Make this the manifest of a delta image, which rebuilds an image of
+    /// the given size from the image with the given hash.
+    fn set_delta_base(&mut self, size: u32, hash: &[u8]);
+
+    /// Make this the manifest of a compressed image, which decompresses to
+    /// an image of the given size, hash and signature.  With thumb, the ARM
+    /// thumb filter was applied before compressing.
+    fn set_decompressed(&mut self, size: u32, hash: &[u8], sig: Option<&[u8]>, thumb: bool);
+
+    /// Add the hashes of each sector of the given size of the header and
+    /// body, which are hashed_size bytes long.  Can be called again once the
+    /// size is known, as long as it does not grow.
+    fn set_sector_hashes(&mut self, sector_size: u32, hashed_size: usize);
 }
 
 /// Selects which signing key to use when generating the TLV signature.
@@ -151,6 +173,20 @@ pub struct TlvGen {
     ignore_ram_load_flag: bool,
     /// Which signing key to use.
     signing_key: SigningKey,
+    /// Size of the image rebuilt by a delta image, and hash of its base.
+    delta_base: Option<(u32, Vec<u8>)>,
+    /// What a compressed image decompresses to.
+    decompressed: Option<Decompressed>,
+    /// Sector size and length of the header and body, for the sector hashes.
+    sector_hashes: Option<(u32, usize)>,
+}
+
+#[derive(Debug)]
+struct Decompressed {
+    size: u32,
+    hash: Vec<u8>,
+    sig: Option<Vec<u8>>,
+    thumb: bool,
 }
 
 #[derive(Debug)]
@@ -350,6 +386,21 @@ impl TlvGen {
 
 }
 
+impl TlvGen {
+    /// Size of the image hash, which is also the size of each sector hash.
+    fn hash_size(&self) -> usize {
+        if self.kinds.contains(&TlvKinds::SHA384) { 48 } else { 32 }
+    }
+
+    /// Length of the sector hashes TLV, without its header.
+    fn sector_hashes_len(&self) -> Option<u16> {
+        self.sector_hashes.map(|(sector_size, hashed_size)| {
+            let count = (hashed_size + sector_size as usize - 1) / sector_size as usize;
+            (4 + count * self.hash_size()) as u16
+        })
+    }
+}
+
 impl ManifestGen for TlvGen {
     fn get_magic(&self) -> u32 {
         0x96f3b83d
@@ -357,11 +408,24 @@ impl ManifestGen for TlvGen {
 
     /// Retrieve the header flags for this configuration.  This can be called at any time.
     fn get_flags(&self) -> u32 {
+        let mut flags = if self.delta_base.is_some() {
+            self.flags | (TlvFlags::DELTA as u32)
+        } else {
+            self.flags
+        };
+
+        if let Some(decomp) = &self.decompressed {
+            flags |= TlvFlags::COMPRESSED_LZMA2 as u32;
+            if decomp.thumb {
+                flags |= TlvFlags::COMPRESSED_ARM_THUMB as u32;
+            }
+        }
+
         // For the RamLoad case, add in the flag for this feature.
         if Caps::RamLoad.present() && !self.ignore_ram_load_flag {
-            self.flags | (TlvFlags::RAM_LOAD as u32)
+            flags | (TlvFlags::RAM_LOAD as u32)
         } else {
-            self.flags
+            flags
         }
     }
 
@@ -372,7 +436,9 @@ impl ManifestGen for TlvGen {
 
     fn protect_size(&self) -> u16 {
         let mut size = 0;
-        if !self.dependencies.is_empty() || (Caps::HwRollbackProtection.present() && self.security_cnt.is_some()) {
+        if !self.dependencies.is_empty() || (Caps::HwRollbackProtection.present() && self.security_cnt.is_some()) ||
+            self.delta_base.is_some() || self.decompressed.is_some() ||
+            self.sector_hashes.is_some() {
             // include the TLV area header.
             size += 4;
             // add space for each dependency.
@@ -380,6 +446,18 @@ impl ManifestGen for TlvGen {
             if Caps::HwRollbackProtection.present() && self.security_cnt.is_some() {
                 size += 4 + 4;
             }
+            if let Some((_, hash)) = &self.delta_base {
+                size += 4 + 4 + hash.len() as u16;
+            }
+            if let Some(decomp) = &self.decompressed {
+                size += 4 + 4 + 4 + decomp.hash.len() as u16;
+                if let Some(sig) = &decomp.sig {
+                    size += 4 + sig.len() as u16;
+                }
+            }
+            if let Some(len) = self.sector_hashes_len() {
+                size += 4 + len;
+            }
         }
         size
     }
@@ -489,6 +567,38 @@ impl ManifestGen for TlvGen {
                 protected_tlv.write_u32::<LittleEndian>(self.security_cnt.unwrap() as u32).unwrap();
             }
 
+            if let Some((img_size, hash)) = &self.delta_base {
+                protected_tlv.write_u16::<LittleEndian>(TlvKinds::DELTABASE as u16).unwrap();
+                protected_tlv.write_u16::<LittleEndian>(4 + hash.len() as u16).unwrap();
+                protected_tlv.write_u32::<LittleEndian>(*img_size).unwrap();
+                protected_tlv.extend_from_slice(hash);
+            }
+
+            if let Some(decomp) = &self.decompressed {
+                protected_tlv.write_u16::<LittleEndian>(TlvKinds::DECOMPSIZE as u16).unwrap();
+                protected_tlv.write_u16::<LittleEndian>(4).unwrap();
+                protected_tlv.write_u32::<LittleEndian>(decomp.size).unwrap();
+                protected_tlv.write_u16::<LittleEndian>(TlvKinds::DECOMPSHA as u16).unwrap();
+                protected_tlv.write_u16::<LittleEndian>(decomp.hash.len() as u16).unwrap();
+                protected_tlv.extend_from_slice(&decomp.hash);
+                if let Some(sig) = &decomp.sig {
+                    protected_tlv.write_u16::<LittleEndian>(TlvKinds::DECOMPSIGNATURE as u16).unwrap();
+                    protected_tlv.write_u16::<LittleEndian>(sig.len() as u16).unwrap();
+                    protected_tlv.extend_from_slice(sig);
+                }
+            }
+
+            if let Some((sector_size, hashed_size)) = self.sector_hashes {
+                assert_eq!(hashed_size, self.payload.len(), "sector hashes size incorrect");
+                protected_tlv.write_u16::<LittleEndian>(TlvKinds::SECTORHASHES as u16).unwrap();
+                protected_tlv.write_u16::<LittleEndian>(self.sector_hashes_len().unwrap()).unwrap();
+                protected_tlv.write_u32::<LittleEndian>(sector_size).unwrap();
+                let algorithm = if self.hash_size() == 48 { &digest::SHA384 } else { &digest::SHA256 };
+                for sector in self.payload.chunks(sector_size as usize) {
+                    protected_tlv.extend_from_slice(digest::digest(algorithm, sector).as_ref());
+                }
+            }
+
             assert_eq!(size, protected_tlv.len() as u16, "protected TLV length incorrect");
         }
 
@@ -888,6 +998,23 @@ impl ManifestGen for TlvGen {
     fn set_ignore_ram_load_flag(&mut self) {
         self.ignore_ram_load_flag = true;
     }
+
+    fn set_delta_base(&mut self, size: u32, hash: &[u8]) {
+        self.delta_base = Some((size, hash.to_vec()));
+    }
+
+    fn set_decompressed(&mut self, size: u32, hash: &[u8], sig: Option<&[u8]>, thumb: bool) {
+        self.decompressed = Some(Decompressed {
+            size,
+            hash: hash.to_vec(),
+            sig: sig.map(|s| s.to_vec()),
+            thumb,
+        });
+    }
+
+    fn set_sector_hashes(&mut self, sector_size: u32, hashed_size: usize) {
+        self.sector_hashes = Some((sector_size, hashed_size));
+    }
 }
 
 include!("rsa_pub_key-rs.txt");
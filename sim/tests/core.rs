@@ -83,6 +83,26 @@ sim_test!(ram_load_failed_validation, make_no_upgrade_image(&NO_DEPS, ImageManip
 #[cfg(not(feature = "check-load-addr"))]
 sim_test!(ram_load_corrupt_higher_version_image, make_no_upgrade_image(&NO_DEPS, ImageManipulation::CorruptHigherVersionImage), run_ram_load_boot_with_result(true));
 
+#[cfg(feature = "delta")]
+sim_test!(delta_perm_with_fails, make_delta_image(), run_perm_with_fails());
+#[cfg(feature = "delta")]
+sim_test!(delta_perm_with_random_fails, make_delta_image(), run_perm_with_random_fails(5));
+
+#[cfg(feature = "decompression")]
+sim_test!(compressed_perm_with_fails, make_compressed_image(false, false), run_perm_with_fails());
+#[cfg(feature = "decompression")]
+sim_test!(compressed_thumb_perm_with_fails, make_compressed_image(true, false), run_perm_with_fails());
+#[cfg(feature = "decompression")]
+sim_test!(compressed_perm_with_random_fails, make_compressed_image(true, false), run_perm_with_random_fails(5));
+#[cfg(feature = "decompression")]
+sim_test!(compressed_corrupt_stream, make_compressed_image(false, true), run_bad_compressed_upgrade());
+
+#[cfg(feature = "sector-hashes")]
+sim_test!(sector_hashes_resume, make_image(&NO_DEPS, true), run_sector_hashes_resume());
+
+#[cfg(feature = "sig-cache")]
+sim_test!(sig_cache_second_boot, make_no_upgrade_image(&NO_DEPS, ImageManipulation::None), run_sig_cache());
+
 sim_test!(hw_prot_missing_security_cnt, make_image_with_security_counter(None), run_hw_rollback_prot());
 sim_test!(hw_prot_failed_security_cnt_check, make_image_with_security_counter(Some(0)), run_hw_rollback_prot());
 